@@ -0,0 +1,98 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+// Small helpers shared by the benchmark executables.
+namespace bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    template <typename F>
+    double time_seconds(F &&fn)
+    {
+        auto start = Clock::now();
+        fn();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // Keeps the compiler from optimizing away a computed value.
+    template <typename T>
+    void do_not_optimize(const T &value)
+    {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // Collects one result and prints it as a single JSON object per line,
+    // so runs can be appended to a file and compared commit over commit.
+    // MINIKAFKA_BENCH_COMMIT, when set, is recorded with every result.
+    class JsonLine
+    {
+    public:
+        explicit JsonLine(const std::string &benchmark)
+        {
+            out << "{\"benchmark\":\"" << benchmark << "\"";
+            if (const char *commit = std::getenv("MINIKAFKA_BENCH_COMMIT"))
+            {
+                out << ",\"commit\":\"" << commit << "\"";
+            }
+        }
+
+        ~JsonLine()
+        {
+            out << "}";
+            std::printf("%s\n", out.str().c_str());
+            std::fflush(stdout);
+        }
+
+        JsonLine &field(const std::string &name, const std::string &value)
+        {
+            out << ",\"" << name << "\":\"" << value << "\"";
+            return *this;
+        }
+
+        JsonLine &field(const std::string &name, const char *value)
+        {
+            return field(name, std::string(value));
+        }
+
+        template <typename T>
+        JsonLine &field(const std::string &name, T value)
+        {
+            out << ",\"" << name << "\":" << value;
+            return *this;
+        }
+
+    private:
+        std::ostringstream out;
+    };
+
+    // A scratch directory removed when the object goes out of scope.
+    class TempDir
+    {
+    public:
+        explicit TempDir(const std::string &prefix)
+        {
+            path = std::filesystem::temp_directory_path() / (prefix + "-" + std::to_string(getpid()));
+            std::filesystem::create_directories(path);
+        }
+
+        ~TempDir()
+        {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+
+        std::filesystem::path path;
+    };
+
+    inline long arg_or(int argc, char **argv, int index, long fallback)
+    {
+        return argc > index ? std::strtol(argv[index], nullptr, 10) : fallback;
+    }
+
+} // namespace bench
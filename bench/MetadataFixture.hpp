@@ -0,0 +1,42 @@
+#pragma once
+#include "storage/RecordBatchBuilder.hpp"
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+// Synthetic inputs shared by the metadata benchmarks.
+namespace bench
+{
+    // Writes a __cluster_metadata log with `topics` topics named topic-<n>, each with
+    // `partitions` partitions. Returns the log size in bytes.
+    inline std::size_t write_metadata_log(const std::filesystem::path &path, long topics, long partitions, CompressionType compression)
+    {
+        std::ofstream out(path, std::ios::binary);
+        std::mt19937_64 rng(42);
+        int64_t offset = 0;
+
+        for (long t = 0; t < topics; ++t)
+        {
+            std::vector<uint8_t> topic_id(16);
+            for (auto &b : topic_id)
+            {
+                b = static_cast<uint8_t>(rng());
+            }
+
+            // One batch per topic, as the controller writes a CreateTopics result.
+            RecordBatchBuilder batch(offset, 0, compression);
+            batch.append(std::nullopt, metadata_records::topic_record("topic-" + std::to_string(t), topic_id));
+            for (long p = 0; p < partitions; ++p)
+            {
+                int32_t leader = static_cast<int32_t>(p % 3) + 1;
+                batch.append(std::nullopt, metadata_records::partition_record(static_cast<int32_t>(p), topic_id, {1, 2, 3}, {1, 2, 3}, leader, 0));
+            }
+            offset += static_cast<int64_t>(batch.record_count());
+
+            auto bytes = batch.build();
+            out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+        return static_cast<std::size_t>(out.tellp());
+    }
+
+} // namespace bench
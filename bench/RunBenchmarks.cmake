@@ -0,0 +1,39 @@
+# Runs each benchmark and appends its JSON lines to OUTPUT. Invoked by the
+# run_benchmarks target with GIT_EXECUTABLE, SOURCE_DIR, BENCH_DIR and OUTPUT set.
+
+set(commit "unknown")
+if(GIT_EXECUTABLE)
+    execute_process(COMMAND ${GIT_EXECUTABLE} -C ${SOURCE_DIR} rev-parse --short HEAD
+        OUTPUT_VARIABLE commit OUTPUT_STRIP_TRAILING_WHITESPACE ERROR_QUIET)
+endif()
+
+# Each entry is a benchmark name followed by its arguments, separated by '|'.
+set(benchmarks
+    "bench_protocol|100000"
+    "bench_metadata_lookup|10000|8|500000|1"
+    "bench_metadata_load|20000|8"
+    "bench_offset_store|5000|16|4|200000"
+    "bench_crc32c"
+    "bench_codec|500|50"
+    "bench_async_handlers|2000|4|5"
+    "bench_priority|2|2000|100|200")
+
+set(failed "")
+foreach(entry IN LISTS benchmarks)
+    string(REPLACE "|" ";" command "${entry}")
+    list(POP_FRONT command name)
+    message(STATUS "Running ${name}")
+    execute_process(
+        COMMAND ${CMAKE_COMMAND} -E env MINIKAFKA_BENCH_COMMIT=${commit} ${BENCH_DIR}/${name} ${command}
+        OUTPUT_VARIABLE results
+        RESULT_VARIABLE status)
+    file(APPEND ${OUTPUT} "${results}")
+    if(NOT status EQUAL 0)
+        list(APPEND failed ${name})
+    endif()
+endforeach()
+
+message(STATUS "Results for ${commit} appended to ${OUTPUT}")
+if(failed)
+    message(FATAL_ERROR "Benchmarks failed: ${failed}")
+endif()
@@ -0,0 +1,275 @@
+// Keeps thousands of requests outstanding on a handful of threads.
+//
+// "blocking" runs handlers that wait on a simulated slow storage call inside the
+// worker, so concurrency is capped at the thread count. "coroutine" runs the same
+// handlers as tasks that co_await the wait on the event loop instead, so every
+// request is in flight at once. "fetch" pushes real Fetch requests through the
+// router and FetchHandler, reading partitions inline on the worker; "fetch_sharded"
+// does the same with each partition read on its home shard instead.
+//
+// Usage: bench_async_handlers [requests] [threads] [latency_ms]
+
+#include "BenchUtil.hpp"
+#include "api/ApiRouter.hpp"
+#include "api/FetchHandler.hpp"
+#include "core/EventLoop.hpp"
+#include "core/ShardSet.hpp"
+#include "core/Task.hpp"
+#include "core/ThreadPool.hpp"
+#include "storage/KRaftMetadataStore.hpp"
+#include "storage/RecordBatchBuilder.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <latch>
+#include <thread>
+
+namespace
+{
+    // Tracks how many requests are in flight at once.
+    struct Outstanding
+    {
+        std::atomic<long> current{0};
+        std::atomic<long> peak{0};
+
+        void enter()
+        {
+            long now = current.fetch_add(1) + 1;
+            long seen = peak.load();
+            while (seen < now && !peak.compare_exchange_weak(seen, now))
+            {
+            }
+        }
+
+        void leave() { current.fetch_sub(1); }
+    };
+
+    kafka::protocol::Response small_response(int32_t correlation_id)
+    {
+        kafka::protocol::Response response(correlation_id);
+        response.writeInt16(0);
+        return response;
+    }
+
+    void run_blocking(long requests, long threads, std::chrono::milliseconds latency)
+    {
+        // Every request holds a worker for the whole wait, so only run enough to measure the rate.
+        long measured = std::min(requests, threads * 25);
+        Outstanding outstanding;
+        std::latch done(measured);
+
+        double seconds = bench::time_seconds([&]
+                                             {
+                                                 ThreadPool pool(threads);
+                                                 for (long i = 0; i < measured; ++i)
+                                                 {
+                                                     pool.enqueue([&, i]
+                                                                  {
+                                                                      outstanding.enter();
+                                                                      std::this_thread::sleep_for(latency);
+                                                                      bench::do_not_optimize(small_response(static_cast<int32_t>(i)));
+                                                                      outstanding.leave();
+                                                                      done.count_down(); });
+                                                 }
+                                                 done.wait(); });
+
+        double rate = measured / seconds;
+        bench::JsonLine("async_handlers")
+            .field("mode", "blocking")
+            .field("requests", measured)
+            .field("threads", threads)
+            .field("latency_ms", latency.count())
+            .field("seconds", seconds)
+            .field("requests_per_s", rate)
+            .field("peak_outstanding", outstanding.peak.load())
+            .field("projected_seconds_for_all", requests / rate);
+    }
+
+    Task<kafka::protocol::Response> waiting_handler(EventLoop &loop, ThreadPool &pool, Outstanding &outstanding,
+                                                    std::chrono::milliseconds latency, int32_t correlation_id)
+    {
+        outstanding.enter();
+        co_await loop.sleep_for(latency);
+        co_await pool.schedule();
+        outstanding.leave();
+        co_return small_response(correlation_id);
+    }
+
+    void run_coroutine(long requests, long threads, std::chrono::milliseconds latency)
+    {
+        Outstanding outstanding;
+        std::latch done(requests);
+
+        ThreadPool pool(threads);
+        EventLoop loop;
+        std::jthread loop_thread([&]
+                                 { loop.run(); });
+
+        double seconds = bench::time_seconds([&]
+                                             {
+                                                 for (long i = 0; i < requests; ++i)
+                                                 {
+                                                     pool.enqueue([&, i]
+                                                                  { spawn(waiting_handler(loop, pool, outstanding, latency, static_cast<int32_t>(i)),
+                                                                          [&](std::expected<kafka::protocol::Response, std::exception_ptr> response)
+                                                                          {
+                                                                              bench::do_not_optimize(response.has_value());
+                                                                              done.count_down();
+                                                                          }); });
+                                                 }
+                                                 done.wait(); });
+        loop.stop();
+
+        bench::JsonLine("async_handlers")
+            .field("mode", "coroutine")
+            .field("requests", requests)
+            .field("threads", threads)
+            .field("latency_ms", latency.count())
+            .field("seconds", seconds)
+            .field("requests_per_s", requests / seconds)
+            .field("peak_outstanding", outstanding.peak.load());
+    }
+
+    constexpr int32_t kFixturePartitions = 8;
+
+    // A metadata log with one topic, plus a segment for each of its partitions.
+    std::vector<uint8_t> write_fetch_fixture(const std::filesystem::path &root)
+    {
+        std::vector<uint8_t> topic_id(16, 0x5a);
+        std::filesystem::create_directories(root / "__cluster_metadata-0");
+
+        RecordBatchBuilder metadata(0);
+        metadata.append(std::nullopt, metadata_records::topic_record("bench", topic_id));
+        for (int32_t p = 0; p < kFixturePartitions; ++p)
+        {
+            metadata.append(std::nullopt, metadata_records::partition_record(p, topic_id, {1}, {1}, 1, 0));
+        }
+        auto metadata_bytes = metadata.build();
+        std::ofstream(root / "__cluster_metadata-0" / "00000000000000000000.log", std::ios::binary)
+            .write(reinterpret_cast<const char *>(metadata_bytes.data()), static_cast<std::streamsize>(metadata_bytes.size()));
+
+        std::vector<uint8_t> value(1024, 'x');
+        for (int32_t p = 0; p < kFixturePartitions; ++p)
+        {
+            auto partition_dir = root / ("bench-" + std::to_string(p));
+            std::filesystem::create_directories(partition_dir);
+            std::ofstream segment(partition_dir / "00000000000000000000.log", std::ios::binary);
+            for (int64_t offset = 0; offset < 1000; offset += 10)
+            {
+                RecordBatchBuilder batch(offset);
+                for (int i = 0; i < 10; ++i)
+                {
+                    batch.append(std::nullopt, value);
+                }
+                auto bytes = batch.build();
+                segment.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            }
+        }
+        return topic_id;
+    }
+
+    kafka::protocol::Request fetch_request(const std::vector<uint8_t> &topic_id, int32_t correlation_id, int32_t partition, int64_t fetch_offset)
+    {
+        kafka::protocol::Response body(0);
+        body.writeInt32(500);     // max_wait_ms
+        body.writeInt32(1);       // min_bytes
+        body.writeInt32(1 << 20); // max_bytes
+        body.writeInt8(0);        // isolation_level
+        body.writeInt32(0);       // session_id
+        body.writeInt32(-1);      // session_epoch
+        body.writeInt8(1 + 1);    // topics
+        body.writeBytes(topic_id);
+        body.writeInt8(1 + 1); // partitions
+        body.writeInt32(partition);
+        body.writeInt32(0);
+        body.writeInt64(fetch_offset);
+        body.writeInt32(-1);
+        body.writeInt64(0);
+        body.writeInt32(64 << 10);
+        body.writeInt8(0);     // partition tagged fields
+        body.writeInt8(0);     // topic tagged fields
+        body.writeInt8(0 + 1); // forgotten_topics_data
+        body.writeInt8(0 + 1); // rack_id = ""
+        body.writeInt8(0);     // top-level tagged fields
+
+        kafka::protocol::Request request;
+        request.api_key = 1;
+        request.api_version = 16;
+        request.correlation_id = correlation_id;
+        request.client_id = "bench";
+        request.body = body.get_data();
+        return request;
+    }
+
+    void run_fetch(long requests, long threads, bool sharded)
+    {
+        bench::TempDir dir("bench-async-handlers");
+        auto topic_id = write_fetch_fixture(dir.path);
+
+        auto pool = std::make_shared<ThreadPool>(threads);
+        std::shared_ptr<ShardSet> shards;
+        if (sharded)
+        {
+            ShardSet::Options shard_options;
+            shard_options.shards = static_cast<unsigned>(threads);
+            shards = std::make_shared<ShardSet>(shard_options, pool);
+        }
+
+        KRaftMetadataStore::Options options;
+        options.batch_cache = std::make_shared<RecordBatchCache>(64 << 20);
+        options.shards = shards;
+        auto store = std::make_shared<KRaftMetadataStore>((dir.path / "__cluster_metadata-0" / "00000000000000000000.log").string(), options);
+
+        ApiRouter router;
+        router.registerHandler(1, 0, 16, std::make_unique<FetchHandler>(store, shards));
+
+        Outstanding outstanding;
+        std::atomic<long> failed{0};
+        std::latch done(requests);
+
+        double seconds = bench::time_seconds([&]
+                                             {
+                                                 for (long i = 0; i < requests; ++i)
+                                                 {
+                                                     auto request = fetch_request(topic_id, static_cast<int32_t>(i), static_cast<int32_t>(i % kFixturePartitions), (i * 10) % 1000);
+                                                     pool->enqueue([&, request = std::move(request)]() mutable
+                                                                   {
+                                                                       outstanding.enter();
+                                                                       spawn(router.routeRequestAsync(std::move(request)),
+                                                                             [&](std::expected<kafka::protocol::Response, std::exception_ptr> response)
+                                                                             {
+                                                                                 if (!response)
+                                                                                 {
+                                                                                     failed.fetch_add(1);
+                                                                                 }
+                                                                                 outstanding.leave();
+                                                                                 done.count_down();
+                                                                             }); });
+                                                 }
+                                                 done.wait(); });
+
+        bench::JsonLine("async_handlers")
+            .field("mode", sharded ? "fetch_sharded" : "fetch")
+            .field("requests", requests)
+            .field("threads", threads)
+            .field("shards", sharded ? threads : 0)
+            .field("seconds", seconds)
+            .field("requests_per_s", requests / seconds)
+            .field("peak_outstanding", outstanding.peak.load())
+            .field("failed", failed.load());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long requests = bench::arg_or(argc, argv, 1, 10000);
+    long threads = bench::arg_or(argc, argv, 2, 4);
+    std::chrono::milliseconds latency(bench::arg_or(argc, argv, 3, 20));
+
+    run_blocking(requests, threads, latency);
+    run_coroutine(requests, threads, latency);
+    run_fetch(requests, threads, false);
+    run_fetch(requests, threads, true);
+    return 0;
+}
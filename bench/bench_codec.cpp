@@ -0,0 +1,74 @@
+// Compression and decompression throughput of each codec compiled into this build,
+// on a batch of JSON-like records similar to typical producer payloads.
+//
+// Usage: bench_codec [records_per_batch] [iterations]
+
+#include "BenchUtil.hpp"
+#include "storage/Codec.hpp"
+#include "storage/RecordBatch.hpp"
+#include "storage/RecordBatchBuilder.hpp"
+#include <iostream>
+#include <random>
+#include <string>
+
+int main(int argc, char **argv)
+{
+    long records = bench::arg_or(argc, argv, 1, 500);
+    long iterations = bench::arg_or(argc, argv, 2, 200);
+
+    std::mt19937 rng(11);
+    const char *event_types[] = {"page_view", "click", "purchase", "signup", "logout"};
+
+    // Records are encoded once uncompressed; the raw records section is the codec input.
+    RecordBatchBuilder plain(0, 1700000000000);
+    for (long i = 0; i < records; ++i)
+    {
+        std::string json = "{\"user_id\":" + std::to_string(rng() % 100000) +
+                           ",\"event\":\"" + event_types[rng() % 5] +
+                           "\",\"ts\":" + std::to_string(1700000000000 + i) +
+                           ",\"session\":\"" + std::to_string(rng()) + "\",\"amount\":" + std::to_string(rng() % 10000) + "}";
+        std::string key = "user-" + std::to_string(rng() % 100000);
+        plain.append(std::vector<uint8_t>(key.begin(), key.end()), std::vector<uint8_t>(json.begin(), json.end()));
+    }
+    std::vector<uint8_t> batch = plain.build();
+    std::vector<uint8_t> input(batch.begin() + record_batch::kHeaderSize, batch.end());
+
+    for (CompressionType type : {CompressionType::Gzip, CompressionType::Lz4, CompressionType::Zstd})
+    {
+        if (!codec::is_supported(type))
+        {
+            bench::JsonLine("codec").field("codec", codec::name(type)).field("supported", "false");
+            continue;
+        }
+
+        std::vector<uint8_t> compressed;
+        double compress_s = bench::time_seconds([&]
+                                                {
+                                                    for (long i = 0; i < iterations; ++i)
+                                                    {
+                                                        compressed = codec::compress(type, input.data(), input.size());
+                                                    } });
+
+        std::vector<uint8_t> roundtrip;
+        double decompress_s = bench::time_seconds([&]
+                                                  {
+                                                      for (long i = 0; i < iterations; ++i)
+                                                      {
+                                                          roundtrip = codec::decompress(type, compressed.data(), compressed.size());
+                                                      } });
+        if (roundtrip != input)
+        {
+            std::cerr << codec::name(type) << " round trip mismatch\n";
+            return 1;
+        }
+
+        double bytes = static_cast<double>(input.size()) * iterations;
+        bench::JsonLine("codec")
+            .field("codec", codec::name(type))
+            .field("input_bytes", input.size())
+            .field("ratio", static_cast<double>(input.size()) / compressed.size())
+            .field("compress_mb_per_s", bytes / compress_s / 1e6)
+            .field("decompress_mb_per_s", bytes / decompress_s / 1e6);
+    }
+    return 0;
+}
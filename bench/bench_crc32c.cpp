@@ -0,0 +1,73 @@
+// CRC32C throughput of the hardware and portable implementations.
+//
+// Usage: bench_crc32c [total_megabytes_per_case]
+
+#include "BenchUtil.hpp"
+#include "storage/Crc32c.hpp"
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    long total_mb = bench::arg_or(argc, argv, 1, 1024);
+
+    // Known answer for "123456789"
+    if (crc32c::extend_software(0, "123456789", 9) != 0xe3069283 ||
+        (crc32c::hardware_available() && crc32c::extend_hardware(0, "123456789", 9) != 0xe3069283))
+    {
+        std::cerr << "crc32c check value mismatch\n";
+        return 1;
+    }
+
+    std::vector<uint8_t> data(16 << 20);
+    std::mt19937_64 rng(7);
+    for (auto &b : data)
+    {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    struct Impl
+    {
+        const char *name;
+        uint32_t (*fn)(uint32_t, const void *, std::size_t);
+    };
+    std::vector<Impl> impls = {{"software", crc32c::extend_software}};
+    if (crc32c::hardware_available())
+    {
+        impls.push_back({"sse42", crc32c::extend_hardware});
+    }
+
+    for (std::size_t size : {64ul, 1024ul, 16384ul, 1ul << 20, 16ul << 20})
+    {
+        // Cross-check, including an unaligned start
+        uint32_t expected = crc32c::extend_software(0, data.data() + 3, size - 3);
+        for (const auto &impl : impls)
+        {
+            if (impl.fn(0, data.data() + 3, size - 3) != expected)
+            {
+                std::cerr << impl.name << " disagrees at size " << size << "\n";
+                return 1;
+            }
+        }
+
+        std::size_t iterations = std::max<std::size_t>(1, (static_cast<std::size_t>(total_mb) << 20) / size);
+        for (const auto &impl : impls)
+        {
+            uint32_t crc = 0;
+            double seconds = bench::time_seconds([&]
+                                                 {
+                                                     for (std::size_t i = 0; i < iterations; ++i)
+                                                     {
+                                                         crc = impl.fn(crc, data.data(), size);
+                                                     } });
+            bench::do_not_optimize(crc);
+
+            bench::JsonLine("crc32c")
+                .field("impl", impl.name)
+                .field("buffer_bytes", size)
+                .field("gb_per_s", static_cast<double>(size) * iterations / seconds / 1e9);
+        }
+    }
+    return 0;
+}
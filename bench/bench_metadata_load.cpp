@@ -0,0 +1,72 @@
+// Compares sequential and parallel replay of a synthetic __cluster_metadata log.
+//
+// Usage: bench_metadata_load [topics] [partitions_per_topic] [parse_threads] [none|gzip|lz4|zstd]
+
+#include "BenchUtil.hpp"
+#include "MetadataFixture.hpp"
+#include "storage/KRaftMetadataStore.hpp"
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace
+{
+    MetadataSnapshot load(const std::string &path, unsigned threads, double &seconds)
+    {
+        KRaftMetadataStore::Options options;
+        options.parse_threads = threads;
+
+        std::unique_ptr<KRaftMetadataStore> store;
+        seconds = bench::time_seconds([&]
+                                      { store = std::make_unique<KRaftMetadataStore>(path, options); });
+        return *store->snapshot();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long topics = bench::arg_or(argc, argv, 1, 50000);
+    long partitions = bench::arg_or(argc, argv, 2, 8);
+    unsigned threads = static_cast<unsigned>(bench::arg_or(argc, argv, 3, std::max(1u, std::thread::hardware_concurrency())));
+
+    bench::TempDir dir("bench-metadata-load");
+    auto log_path = (dir.path / "00000000000000000000.log").string();
+    CompressionType compression = CompressionType::None;
+    if (argc > 4)
+    {
+        for (auto type : {CompressionType::Gzip, CompressionType::Lz4, CompressionType::Zstd})
+        {
+            if (std::string(argv[4]) == codec::name(type))
+            {
+                compression = type;
+            }
+        }
+    }
+    std::size_t log_bytes = bench::write_metadata_log(log_path, topics, partitions, compression);
+
+    double sequential_s = 0;
+    double parallel_s = 0;
+    MetadataSnapshot sequential = load(log_path, 1, sequential_s);
+    MetadataSnapshot parallel = load(log_path, threads, parallel_s);
+    bool identical = sequential == parallel;
+
+    bench::JsonLine("metadata_load")
+        .field("topics", topics)
+        .field("partitions_per_topic", partitions)
+        .field("compression", codec::name(compression))
+        .field("log_bytes", log_bytes)
+        .field("topics_loaded", sequential.nameToTopicId.size())
+        .field("threads", threads)
+        .field("sequential_s", sequential_s)
+        .field("parallel_s", parallel_s)
+        .field("speedup", sequential_s / parallel_s)
+        .field("identical", identical ? "true" : "false");
+
+    if (!identical)
+    {
+        std::cerr << "Parallel load does not match the sequential loader\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Cost of the metadata lookups request handlers make, against a store loaded from
+// a synthetic __cluster_metadata log. Lookups use a shuffled set of known and
+// unknown keys so they don't just hit the same cache lines; with more than one
+// thread, all threads look up concurrently and the rate is their total. The
+// Metadata API is measured answering from its per-snapshot encoding, for one topic
+// and for every topic, after the first request has encoded it.
+//
+// Usage: bench_metadata_lookup [topics] [partitions_per_topic] [lookups_per_thread] [threads]
+
+#include "BenchUtil.hpp"
+#include "MetadataFixture.hpp"
+#include "api/MetadataHandler.hpp"
+#include "storage/KRaftMetadataStore.hpp"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // Runs `lookup(i)` `count` times on each of `threads` threads and reports the combined rate.
+    template <typename F>
+    void measure(const std::string &name, long count, long threads, F &&lookup)
+    {
+        double seconds = bench::time_seconds([&]
+                                             {
+                                                 std::vector<std::jthread> workers;
+                                                 for (long t = 0; t < threads; ++t)
+                                                 {
+                                                     workers.emplace_back([&, t]
+                                                                          {
+                                                                              for (long i = 0; i < count; ++i)
+                                                                              {
+                                                                                  lookup(static_cast<std::size_t>(i + t * 7919));
+                                                                              } });
+                                                 } });
+        double total = static_cast<double>(count) * static_cast<double>(threads);
+        bench::JsonLine("metadata_lookup")
+            .field("op", name)
+            .field("threads", threads)
+            .field("lookups", static_cast<long>(total))
+            .field("ns_per_op", seconds * 1e9 * static_cast<double>(threads) / total)
+            .field("ops_per_s", total / seconds);
+    }
+
+    // A v12 Metadata request for `topics`, or for every topic when it is null.
+    kafka::protocol::Request metadata_request(const std::vector<std::string> *topics)
+    {
+        std::vector<char> body;
+        if (!topics)
+        {
+            body.push_back(0); // null topics
+        }
+        else
+        {
+            body.push_back(static_cast<char>(topics->size() + 1));
+            for (const auto &name : *topics)
+            {
+                body.insert(body.end(), 16, 0); // topic_id
+                body.push_back(static_cast<char>(name.size() + 1));
+                body.insert(body.end(), name.begin(), name.end());
+                body.push_back(0); // tagged fields
+            }
+        }
+        body.insert(body.end(), {0, 0, 0}); // allow_auto_topic_creation, include_topic_authorized_operations, tagged fields
+        return kafka::protocol::Request{3, 12, 1, "bench", std::move(body)};
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long topics = bench::arg_or(argc, argv, 1, 10000);
+    long partitions = bench::arg_or(argc, argv, 2, 8);
+    long lookups = bench::arg_or(argc, argv, 3, 1000000);
+    long threads = bench::arg_or(argc, argv, 4, 1);
+
+    bench::TempDir dir("bench-metadata-lookup");
+    auto log_path = (dir.path / "00000000000000000000.log").string();
+    bench::write_metadata_log(log_path, topics, partitions, CompressionType::None);
+
+    std::shared_ptr<KRaftMetadataStore> store;
+    double load_s = bench::time_seconds([&]
+                                        { store = std::make_shared<KRaftMetadataStore>(log_path); });
+    bench::JsonLine("metadata_lookup").field("op", "load").field("topics", topics).field("partitions_per_topic", partitions).field("seconds", load_s);
+
+    // Nine known names for every unknown one, in random order.
+    std::mt19937_64 rng(3);
+    std::vector<std::string> names;
+    for (long i = 0; i < std::min(topics, 4096L); ++i)
+    {
+        long t = static_cast<long>(rng() % static_cast<uint64_t>(topics));
+        names.push_back(i % 10 == 9 ? "missing-" + std::to_string(t) : "topic-" + std::to_string(t));
+    }
+    std::vector<std::vector<uint8_t>> ids;
+    for (const auto &name : names)
+    {
+        auto id = store->get_topic_uuid(name);
+        ids.push_back(id.empty() ? std::vector<uint8_t>(16, 0xee) : id);
+    }
+
+    measure("is_topic_known", lookups, threads, [&](std::size_t i)
+            { bench::do_not_optimize(store->is_topic_known(names[i % names.size()])); });
+    measure("get_topic_uuid", lookups, threads, [&](std::size_t i)
+            { bench::do_not_optimize(store->get_topic_uuid(names[i % names.size()]).size()); });
+    measure("is_uuid_known", lookups, threads, [&](std::size_t i)
+            { bench::do_not_optimize(store->is_uuid_known(ids[i % ids.size()])); });
+    measure("get_serialized_partitions", lookups / 4, threads, [&](std::size_t i)
+            { bench::do_not_optimize(store->get_serialized_partitions(ids[i % ids.size()]).size()); });
+    measure("snapshot_find_topic", lookups, threads, [&](std::size_t i)
+            {
+                auto snapshot = store->snapshot();
+                bench::do_not_optimize(snapshot->nameToTopicId.count(names[i % names.size()]));
+            });
+
+    MetadataHandler metadata(store, {{1, "localhost", 9092}}, 1);
+    std::vector<kafka::protocol::Request> one_topic;
+    for (const auto &name : names)
+    {
+        std::vector<std::string> topic{name};
+        one_topic.push_back(metadata_request(&topic));
+    }
+    auto all_topics = metadata_request(nullptr);
+    std::size_t response_bytes = 0;
+    double encode_s = bench::time_seconds([&]
+                                          { response_bytes = metadata.handle(all_topics).get_data().size(); });
+    bench::JsonLine("metadata_lookup").field("op", "metadata_api_encode").field("response_bytes", static_cast<long>(response_bytes)).field("seconds", encode_s);
+    measure("metadata_api_one_topic", lookups / 4, threads, [&](std::size_t i)
+            { bench::do_not_optimize(metadata.handle(one_topic[i % one_topic.size()]).get_data().size()); });
+    measure("metadata_api_all_topics", std::max(1L, lookups / 2000), threads, [&](std::size_t)
+            { bench::do_not_optimize(metadata.handle(all_topics).get_data().size()); });
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Consumer group offset commits and lookups. A rebalance is modelled as every one
+// of `groups` groups committing `partitions` offsets in a single call, from
+// `threads` threads at once; lookups then read them back from memory.
+//
+// Usage: bench_offset_store [partitions] [groups] [threads] [lookups]
+
+#include "BenchUtil.hpp"
+#include "storage/OffsetStore.hpp"
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    long partitions = bench::arg_or(argc, argv, 1, 5000);
+    long groups = bench::arg_or(argc, argv, 2, 64);
+    long threads = bench::arg_or(argc, argv, 3, 4);
+    long lookups = bench::arg_or(argc, argv, 4, 1000000);
+
+    bench::TempDir dir("bench-offset-store");
+    OffsetStore store((dir.path / "__minikafka_offsets").string());
+
+    std::vector<OffsetStore::Commit> commits;
+    for (long p = 0; p < partitions; ++p)
+    {
+        commits.push_back(OffsetStore::Commit{"topic-" + std::to_string(p % 100), static_cast<int32_t>(p / 100), {p * 10, 0, "", 0}});
+    }
+
+    // Per-call latency of the group commits, spread over the threads.
+    std::vector<std::vector<double>> latencies_ms(threads);
+    double seconds = bench::time_seconds([&]
+                                         {
+                                             std::vector<std::jthread> workers;
+                                             for (long t = 0; t < threads; ++t)
+                                             {
+                                                 workers.emplace_back([&, t]
+                                                                      {
+                                                                          for (long g = t; g < groups; g += threads)
+                                                                          {
+                                                                              auto start = bench::Clock::now();
+                                                                              store.commit("group-" + std::to_string(g), commits);
+                                                                              latencies_ms[t].push_back(std::chrono::duration<double, std::milli>(bench::Clock::now() - start).count());
+                                                                          } });
+                                             } });
+    std::vector<double> all;
+    for (const auto &thread_latencies : latencies_ms)
+    {
+        all.insert(all.end(), thread_latencies.begin(), thread_latencies.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto stats = store.stats();
+    bench::JsonLine("offset_store")
+        .field("op", "commit")
+        .field("partitions_per_commit", partitions)
+        .field("groups", groups)
+        .field("threads", threads)
+        .field("p50_ms", all[all.size() / 2])
+        .field("max_ms", all.back())
+        .field("offsets_per_s", static_cast<double>(partitions * groups) / seconds)
+        .field("log_writes", stats.writes);
+
+    double fetch_seconds = bench::time_seconds([&]
+                                               {
+                                                   for (long i = 0; i < lookups; ++i)
+                                                   {
+                                                       const auto &commit = commits[static_cast<std::size_t>(i * 7919 % partitions)];
+                                                       bench::do_not_optimize(store.fetch("group-" + std::to_string(i % groups), commit.topic, commit.partition));
+                                                   } });
+    bench::JsonLine("offset_store")
+        .field("op", "fetch")
+        .field("lookups", lookups)
+        .field("ns_per_op", fetch_seconds * 1e9 / static_cast<double>(lookups));
+    return 0;
+}
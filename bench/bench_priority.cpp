@@ -0,0 +1,82 @@
+// Queue time of control-plane tasks while the pool is flooded with data-plane work.
+//
+// Runs the same mix three ways: everything in one FIFO class, control tasks with
+// strict priority, and control tasks with a weighted share.
+//
+// Usage: bench_priority [threads] [data_tasks] [control_tasks] [data_task_us]
+
+#include "BenchUtil.hpp"
+#include "core/ThreadPool.hpp"
+#include <latch>
+#include <thread>
+
+namespace
+{
+    void busy_for(std::chrono::microseconds duration)
+    {
+        auto until = bench::Clock::now() + duration;
+        while (bench::Clock::now() < until)
+        {
+        }
+    }
+
+    void run(const char *policy, long threads, long data_tasks, long control_tasks, std::chrono::microseconds data_cost,
+             bool classify, unsigned control_weight)
+    {
+        ThreadPool pool(threads, control_weight);
+        std::latch done(data_tasks + control_tasks);
+
+        // Interleave a control task after every few data tasks, as bootstrap requests arrive mid-flood.
+        long every = std::max(1L, data_tasks / std::max(1L, control_tasks));
+        double seconds = bench::time_seconds([&]
+                                             {
+                                                 long control_sent = 0;
+                                                 for (long i = 0; i < data_tasks; ++i)
+                                                 {
+                                                     pool.enqueue([&]
+                                                                  { busy_for(data_cost); done.count_down(); }, TaskClass::Data);
+                                                     if (i % every == 0 && control_sent < control_tasks)
+                                                     {
+                                                         pool.enqueue([&]
+                                                                      { done.count_down(); }, classify ? TaskClass::Control : TaskClass::Data);
+                                                         ++control_sent;
+                                                     }
+                                                 }
+                                                 for (; control_sent < control_tasks; ++control_sent)
+                                                 {
+                                                     pool.enqueue([&]
+                                                                  { done.count_down(); }, classify ? TaskClass::Control : TaskClass::Data);
+                                                 }
+                                                 done.wait(); });
+
+        for (auto task_class : {TaskClass::Control, TaskClass::Data})
+        {
+            auto stats = pool.queue_stats(task_class);
+            if (stats.tasks == 0)
+            {
+                continue;
+            }
+            bench::JsonLine("priority")
+                .field("policy", policy)
+                .field("class", task_class == TaskClass::Control ? "control" : "data")
+                .field("threads", threads)
+                .field("tasks", stats.tasks)
+                .field("mean_wait_us", stats.total_wait_ns / 1000.0 / stats.tasks)
+                .field("max_wait_us", stats.max_wait_ns / 1000.0)
+                .field("seconds", seconds);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long threads = bench::arg_or(argc, argv, 1, 2);
+    long data_tasks = bench::arg_or(argc, argv, 2, 2000);
+    long control_tasks = bench::arg_or(argc, argv, 3, 100);
+    std::chrono::microseconds data_cost(bench::arg_or(argc, argv, 4, 200));
+
+    run("fifo", threads, data_tasks, control_tasks, data_cost, false, 0);
+    run("strict", threads, data_tasks, control_tasks, data_cost, true, 0);
+    run("weighted_8", threads, data_tasks, control_tasks, data_cost, true, 8);
+    return 0;
+}
@@ -0,0 +1,203 @@
+// Per-operation cost of the protocol hot paths: BufferReader field reads, varint
+// decoding, Response writes, serialize_response, parse_request and Fetch request
+// parsing, on inputs shaped like real client traffic.
+//
+// Usage: bench_protocol [iterations]
+
+#include "BenchUtil.hpp"
+#include "api/FetchRequest.hpp"
+#include "protocol/BufferReader.hpp"
+#include "protocol/Protocol.hpp"
+#include "protocol/Response.hpp"
+#include "protocol/Varint.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Runs `op` `iterations` times and reports the cost of one call.
+    template <typename F>
+    void measure(const std::string &name, const std::string &input, long iterations, std::size_t bytes_per_op, F &&op)
+    {
+        op(); // Warm caches and the allocator
+        double seconds = bench::time_seconds([&]
+                                             {
+                                                 for (long i = 0; i < iterations; ++i)
+                                                 {
+                                                     op();
+                                                 } });
+        bench::JsonLine line("protocol");
+        line.field("op", name)
+            .field("input", input)
+            .field("iterations", iterations)
+            .field("ns_per_op", seconds * 1e9 / static_cast<double>(iterations))
+            .field("ops_per_s", static_cast<double>(iterations) / seconds);
+        if (bytes_per_op != 0)
+        {
+            line.field("mb_per_s", static_cast<double>(bytes_per_op) * static_cast<double>(iterations) / seconds / 1e6);
+        }
+    }
+
+    // A Fetch v16 body as a consumer following `topics` topics of `partitions` partitions sends it.
+    std::vector<char> fetch_body(int topics, int partitions, std::mt19937_64 &rng)
+    {
+        kafka::protocol::Response body(0);
+        body.writeInt32(500);
+        body.writeInt32(1);
+        body.writeInt32(50 << 20);
+        body.writeInt8(0);
+        body.writeInt32(0);
+        body.writeInt32(-1);
+        body.writeInt8(static_cast<int8_t>(topics + 1));
+        for (int t = 0; t < topics; ++t)
+        {
+            std::vector<uint8_t> topic_id(16);
+            for (auto &b : topic_id)
+            {
+                b = static_cast<uint8_t>(rng());
+            }
+            body.writeBytes(topic_id);
+            body.writeInt8(static_cast<int8_t>(partitions + 1));
+            for (int p = 0; p < partitions; ++p)
+            {
+                body.writeInt32(p);
+                body.writeInt32(7);
+                body.writeInt64(static_cast<int64_t>(rng() % 100000000));
+                body.writeInt32(6);
+                body.writeInt64(0);
+                body.writeInt32(1 << 20);
+                body.writeInt8(0); // partition tagged fields
+            }
+            body.writeInt8(0); // topic tagged fields
+        }
+        body.writeInt8(1); // forgotten_topics_data (empty)
+        body.writeInt8(1); // rack_id ("")
+        body.writeInt8(0); // tagged fields
+        return body.get_data();
+    }
+
+    // A framed request (without the size prefix) with a v2 header.
+    std::vector<char> request_frame(int16_t api_key, int16_t api_version, const std::vector<char> &body)
+    {
+        kafka::protocol::Response frame(0);
+        frame.writeInt16(api_key);
+        frame.writeInt16(api_version);
+        frame.writeInt32(12345);
+        std::string client_id = "consumer-orders-service-1";
+        frame.writeInt16(static_cast<int16_t>(client_id.size()));
+        frame.writeRawBytes(client_id.data(), client_id.size());
+        frame.writeInt8(0);
+        frame.writeRawBytes(body.data(), body.size());
+        return frame.get_data();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = bench::arg_or(argc, argv, 1, 200000);
+    std::mt19937_64 rng(7);
+
+    // BufferReader: the fixed-width and string reads of a request header plus a partition entry.
+    auto header = request_frame(1, 16, fetch_body(1, 1, rng));
+    measure("buffer_reader_fields", "fetch_header", iterations * 10, header.size(), [&]
+            {
+                kafka::protocol::BufferReader reader(header);
+                bench::do_not_optimize(reader.readInt16());
+                bench::do_not_optimize(reader.readInt16());
+                bench::do_not_optimize(reader.readInt32());
+                bench::do_not_optimize(reader.readString());
+                reader.readInt8();
+                for (int i = 0; i < 3; ++i)
+                {
+                    bench::do_not_optimize(reader.readInt32());
+                }
+                bench::do_not_optimize(reader.readInt8());
+                bench::do_not_optimize(reader.readInt64());
+            });
+
+    // Varints: lengths and counts are mostly one or two bytes, with a tail of larger values.
+    std::vector<char> varints;
+    for (int i = 0; i < 4096; ++i)
+    {
+        uint64_t bound = (i % 10 < 7) ? 128 : (i % 10 < 9) ? 16384 : (1u << 28);
+        kafka::protocol::append_unsigned_varint(varints, rng() % bound);
+    }
+    measure("unsigned_varint_decode", "4096_mixed", iterations / 100, varints.size(), [&]
+            {
+                kafka::protocol::BufferReader reader(varints);
+                uint64_t sum = 0;
+                while (!reader.eof())
+                {
+                    sum += reader.readUnsignedVarint();
+                }
+                bench::do_not_optimize(sum);
+            });
+
+    // Response writes: a DescribeTopicPartitions-shaped response of 10 topics x 16 partitions.
+    measure("response_write", "describe_10x16", iterations / 10, 0, [&]
+            {
+                kafka::protocol::Response response(1);
+                response.writeInt8(0);
+                response.writeInt32(0);
+                response.writeUnsignedVarint(11);
+                for (int t = 0; t < 10; ++t)
+                {
+                    response.writeInt16(0);
+                    response.writeString("orders-events-" + std::to_string(t));
+                    response.writeBytes(std::vector<uint8_t>(16, static_cast<uint8_t>(t)));
+                    response.writeInt8(0);
+                    response.writeUnsignedVarint(17);
+                    for (int p = 0; p < 16; ++p)
+                    {
+                        response.writeInt16(0);
+                        response.writeInt32(p);
+                        response.writeInt32(p % 3);
+                        response.writeInt32(4);
+                        for (int a = 0; a < 2; ++a)
+                        {
+                            response.writeUnsignedVarint(4);
+                            response.writeInt32(1);
+                            response.writeInt32(2);
+                            response.writeInt32(3);
+                        }
+                        response.writeUnsignedVarint(1);
+                        response.writeUnsignedVarint(1);
+                        response.writeUnsignedVarint(1);
+                        response.writeInt8(0);
+                    }
+                    response.writeInt32(0x00000df8);
+                    response.writeInt8(0);
+                }
+                bench::do_not_optimize(response.get_data().size());
+            });
+
+    // serialize_response: small control-plane responses and large fetch responses.
+    for (std::size_t size : {std::size_t(64), std::size_t(64) << 10, std::size_t(1) << 20})
+    {
+        kafka::protocol::Response response(99);
+        std::vector<char> payload(size, 'r');
+        response.writeRawBytes(payload.data(), payload.size());
+        long n = size >= (1 << 20) ? std::max(1L, iterations / 1000) : size >= (64 << 10) ? iterations / 50 : iterations;
+        measure("serialize_response", std::to_string(size) + "_bytes", n, size, [&]
+                { bench::do_not_optimize(kafka::protocol::serialize_response(response).size()); });
+    }
+
+    // parse_request and FetchRequestData::parse for a single-partition poll and a wide consumer.
+    for (auto [topics, partitions] : {std::pair{1, 1}, std::pair{10, 16}, std::pair{50, 100}})
+    {
+        std::string input = std::to_string(topics) + "x" + std::to_string(partitions);
+        auto body = fetch_body(topics, partitions, rng);
+        auto frame = request_frame(1, 16, body);
+        long n = std::max(1L, iterations / (topics * partitions));
+
+        measure("parse_request", "fetch_" + input, n, frame.size(), [&]
+                { bench::do_not_optimize(kafka::protocol::parse_request(frame).body.size()); });
+        measure("fetch_request_parse", input, n, body.size(), [&]
+                {
+                    kafka::protocol::BufferReader reader(body);
+                    bench::do_not_optimize(FetchRequestData::parse(reader).topics.size());
+                });
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+// Replication between two brokers started as child processes: broker 1 leads one
+// partition that broker 2 follows. Reports how fast the follower copies a backlog
+// already on the leader, then the delay until each batch appended to the leader's
+// segment is on the follower's disk.
+//
+// Usage: bench_replication [backlog_mb] [lag_batches] [base_port]
+
+#include "BenchUtil.hpp"
+#include "storage/RecordBatchBuilder.hpp"
+#include <algorithm>
+#include <csignal>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    const std::string kTopic = "replicated";
+
+    void write_file(const std::filesystem::path &path, const std::vector<uint8_t> &bytes, bool append)
+    {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream out(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    // A metadata log with one topic whose partition 0 lives on brokers 1 and 2, led by 1.
+    void write_metadata(const std::filesystem::path &log_dir)
+    {
+        std::vector<uint8_t> topic_id(16);
+        for (std::size_t i = 0; i < topic_id.size(); ++i)
+        {
+            topic_id[i] = static_cast<uint8_t>(i + 1);
+        }
+        RecordBatchBuilder batch(0);
+        batch.append(std::nullopt, metadata_records::topic_record(kTopic, topic_id));
+        batch.append(std::nullopt, metadata_records::partition_record(0, topic_id, {1, 2}, {1, 2}, 1, 0));
+        write_file(log_dir / "__cluster_metadata-0" / "00000000000000000000.log", batch.build(), false);
+    }
+
+    std::vector<uint8_t> make_batch(int64_t base_offset, int records, std::size_t value_size)
+    {
+        RecordBatchBuilder batch(base_offset);
+        std::vector<uint8_t> value(value_size, 'x');
+        for (int i = 0; i < records; ++i)
+        {
+            batch.append(std::nullopt, value);
+        }
+        return batch.build();
+    }
+
+    std::uintmax_t size_of(const std::filesystem::path &path)
+    {
+        std::error_code ec;
+        std::uintmax_t size = std::filesystem::file_size(path, ec);
+        return ec ? 0 : size;
+    }
+
+    // Runs the broker binary with `args`, its output going to `log_path`.
+    pid_t spawn_broker(const std::vector<std::string> &args, const std::filesystem::path &log_path)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            throw std::runtime_error("fork failed");
+        }
+        if (pid == 0)
+        {
+            int fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            std::vector<char *> argv{const_cast<char *>(MINIKAFKA_BROKER_BINARY)};
+            for (const auto &arg : args)
+            {
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            }
+            argv.push_back(nullptr);
+            execv(MINIKAFKA_BROKER_BINARY, argv.data());
+            _exit(127);
+        }
+        return pid;
+    }
+
+    void stop_broker(pid_t pid)
+    {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+    }
+
+    // Polls until the follower segment holds `bytes`; false after `timeout`.
+    bool wait_for_size(const std::filesystem::path &path, std::uintmax_t bytes, std::chrono::seconds timeout)
+    {
+        auto deadline = bench::Clock::now() + timeout;
+        while (size_of(path) < bytes)
+        {
+            if (bench::Clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long backlog_mb = bench::arg_or(argc, argv, 1, 64);
+    long lag_batches = bench::arg_or(argc, argv, 2, 200);
+    long base_port = bench::arg_or(argc, argv, 3, 19092);
+
+    bench::TempDir dir("bench-replication");
+    const std::filesystem::path leader_dir = dir.path / "broker-1";
+    const std::filesystem::path follower_dir = dir.path / "broker-2";
+    write_metadata(leader_dir);
+    write_metadata(follower_dir);
+
+    // The backlog, in batches of 100 records of 640 bytes
+    const std::filesystem::path leader_segment = leader_dir / (kTopic + "-0") / "00000000000000000000.log";
+    const std::filesystem::path follower_segment = follower_dir / (kTopic + "-0") / "00000000000000000000.log";
+    int64_t next_offset = 0;
+    {
+        std::vector<uint8_t> backlog;
+        while (backlog.size() < static_cast<std::size_t>(backlog_mb) << 20)
+        {
+            auto batch = make_batch(next_offset, 100, 640);
+            backlog.insert(backlog.end(), batch.begin(), batch.end());
+            next_offset += 100;
+        }
+        write_file(leader_segment, backlog, false);
+    }
+    std::uintmax_t leader_bytes = size_of(leader_segment);
+
+    std::string leader_port = std::to_string(base_port);
+    std::string follower_port = std::to_string(base_port + 1);
+    pid_t leader = spawn_broker({"--broker-id=1", "--port=" + leader_port, "--log-dir=" + leader_dir.string(),
+                                 "--peers=2@127.0.0.1:" + follower_port, "--metrics=" + (dir.path / "metrics-1.txt").string()},
+                                dir.path / "broker-1.out");
+
+    // Catch-up starts when the follower comes up, against a leader that is already serving
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    auto start = bench::Clock::now();
+    pid_t follower = spawn_broker({"--broker-id=2", "--port=" + follower_port, "--log-dir=" + follower_dir.string(),
+                                   "--peers=1@127.0.0.1:" + leader_port, "--metrics=" + (dir.path / "metrics-2.txt").string()},
+                                  dir.path / "broker-2.out");
+
+    int status = 0;
+    if (!wait_for_size(follower_segment, leader_bytes, std::chrono::seconds(120)))
+    {
+        std::fprintf(stderr, "Follower did not catch up: %ju of %ju bytes\n", size_of(follower_segment), leader_bytes);
+        status = 1;
+    }
+    else
+    {
+        double seconds = std::chrono::duration<double>(bench::Clock::now() - start).count();
+        bench::JsonLine("replication")
+            .field("op", "catch_up")
+            .field("bytes", static_cast<long>(leader_bytes))
+            .field("seconds", seconds)
+            .field("mb_per_s", static_cast<double>(leader_bytes) / (1 << 20) / seconds);
+
+        // One small batch at a time, each timed from the leader's write to the follower's
+        std::vector<double> lags_us;
+        for (long i = 0; i < lag_batches; ++i)
+        {
+            auto batch = make_batch(next_offset, 10, 100);
+            next_offset += 10;
+            leader_bytes += batch.size();
+            auto written = bench::Clock::now();
+            write_file(leader_segment, batch, true);
+            if (!wait_for_size(follower_segment, leader_bytes, std::chrono::seconds(10)))
+            {
+                std::fprintf(stderr, "Batch %ld did not reach the follower\n", i);
+                status = 1;
+                break;
+            }
+            lags_us.push_back(std::chrono::duration<double, std::micro>(bench::Clock::now() - written).count());
+        }
+        if (!lags_us.empty())
+        {
+            std::sort(lags_us.begin(), lags_us.end());
+            bench::JsonLine("replication")
+                .field("op", "propagation")
+                .field("batches", static_cast<long>(lags_us.size()))
+                .field("p50_us", lags_us[lags_us.size() / 2])
+                .field("p99_us", lags_us[lags_us.size() * 99 / 100])
+                .field("max_us", lags_us.back());
+        }
+    }
+
+    stop_broker(follower);
+    stop_broker(leader);
+    return status;
+}
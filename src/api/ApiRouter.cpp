@@ -1,11 +1,13 @@
 #include "api/ApiRouter.hpp"
-#include <iostream>
+#include "core/Log.hpp"
 #include <stdexcept>
 #include <algorithm>
 
-void ApiRouter::registerHandler(int16_t api_key, int16_t min_version, int16_t max_version, std::unique_ptr<IApiHandler> handler)
+void ApiRouter::registerHandler(int16_t api_key, int16_t min_version, int16_t max_version, std::unique_ptr<IApiHandler> handler,
+                                TaskClass task_class)
 {
     handlers[api_key] = std::move(handler);
+    task_classes[api_key] = task_class;
     api_versions.push_back({api_key, min_version, max_version});
 
     // List sorted by API key for consistent responses
@@ -18,6 +20,13 @@ std::vector<ApiVersionInfo> ApiRouter::getSupportedApis() const
     return api_versions;
 }
 
+TaskClass ApiRouter::taskClassOf(int16_t api_key) const
+{
+    auto it = task_classes.find(api_key);
+    // Unknown keys only produce a small error response
+    return it != task_classes.end() ? it->second : TaskClass::Control;
+}
+
 kafka::protocol::Response ApiRouter::routeRequest(const kafka::protocol::Request &request)
 {
     auto it = handlers.find(request.api_key);
@@ -26,8 +35,22 @@ kafka::protocol::Response ApiRouter::routeRequest(const kafka::protocol::Request
         return it->second->handle(request);
     }
 
-    std::cerr << "No handler found for API key: " << request.api_key << std::endl;
+    LOG_WARN("No handler found for API key: {}", request.api_key);
     kafka::protocol::Response error_response(request.correlation_id);
     error_response.writeInt16(3); // UNSUPPORTED_VERSION error
     return error_response;
+}
+
+Task<kafka::protocol::Response> ApiRouter::routeRequestAsync(kafka::protocol::Request request)
+{
+    auto it = handlers.find(request.api_key);
+    if (it != handlers.end())
+    {
+        co_return co_await it->second->handle_async(std::move(request));
+    }
+
+    LOG_WARN("No handler found for API key: {}", request.api_key);
+    kafka::protocol::Response error_response(request.correlation_id);
+    error_response.writeInt16(3); // UNSUPPORTED_VERSION error
+    co_return error_response;
 }
\ No newline at end of file
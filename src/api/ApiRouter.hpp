@@ -3,6 +3,7 @@
 #include <memory>
 #include <vector>
 #include "IApiHandler.hpp"
+#include "core/ThreadPool.hpp"
 
 // A simple struct to hold the metadata for each API
 struct ApiVersionInfo
@@ -15,12 +16,18 @@ struct ApiVersionInfo
 class ApiRouter
 {
 public:
-    void registerHandler(int16_t api_key, int16_t min_version, int16_t max_version, std::unique_ptr<IApiHandler> handler);
+    void registerHandler(int16_t api_key, int16_t min_version, int16_t max_version, std::unique_ptr<IApiHandler> handler,
+                         TaskClass task_class = TaskClass::Data);
     kafka::protocol::Response routeRequest(const kafka::protocol::Request &request);
+    Task<kafka::protocol::Response> routeRequestAsync(kafka::protocol::Request request);
 
     std::vector<ApiVersionInfo> getSupportedApis() const;
 
+    // Scheduling class requests for this API key are dispatched with.
+    TaskClass taskClassOf(int16_t api_key) const;
+
 private:
     std::map<int16_t, std::unique_ptr<IApiHandler>> handlers;
+    std::map<int16_t, TaskClass> task_classes;
     std::vector<ApiVersionInfo> api_versions; // API Metadata store
 };
\ No newline at end of file
@@ -1,6 +1,63 @@
 #include "api/DescribeTopicPartitionsHandler.hpp"
 #include "storage/IMetadataStore.hpp"
 #include "protocol/BufferReader.hpp"
+#include <algorithm>
+#include <optional>
+
+namespace
+{
+    // Upper bound on partitions per response, whatever the client asks for.
+    constexpr int32_t kMaxPartitionLimit = 2000;
+
+    struct Cursor
+    {
+        std::string topic_name;
+        int32_t partition_index;
+    };
+
+    // One topic of the response: either a slice of a pre-encoded entry or an unknown topic.
+    struct TopicSlice
+    {
+        const std::string *name;
+        const DescribeTopicEntry *entry; // nullptr for unknown topics
+        std::size_t first;
+        std::size_t count;
+    };
+
+    void write_slice(kafka::protocol::Response &response, const TopicSlice &slice)
+    {
+        const DescribeTopicEntry *entry = slice.entry;
+        if (!entry)
+        {
+            response.writeInt16(3); // error_code: UNKNOWN_TOPIC_OR_PARTITION
+            response.writeString(*slice.name);
+            response.writeBytes(std::vector<uint8_t>(16, 0)); // topic_id
+            response.writeInt8(0);                           // is_internal
+            response.writeInt8(1);                           // empty partitions array
+            response.writeInt32(0x00000df8);                 // topic_authorized_operations
+            response.writeInt8(0);                           // topic tagged fields
+            return;
+        }
+
+        std::size_t total = entry->partition_ids.size();
+        if (slice.first == 0 && slice.count == total)
+        {
+            response.writeRawBytes(entry->bytes.data(), entry->bytes.size());
+            return;
+        }
+
+        // Header, then the selected partitions, then the trailing fields.
+        const char *bytes = entry->bytes.data();
+        std::size_t partitions_begin = entry->partition_offsets[slice.first];
+        std::size_t partitions_end = entry->partition_offsets[slice.first + slice.count];
+        std::size_t suffix = entry->partition_offsets.back();
+
+        response.writeRawBytes(bytes, entry->partitions_offset);
+        response.writeUnsignedVarint(slice.count + 1);
+        response.writeRawBytes(bytes + partitions_begin, partitions_end - partitions_begin);
+        response.writeRawBytes(bytes + suffix, entry->bytes.size() - suffix);
+    }
+}
 
 DescribeTopicPartitionsHandler::DescribeTopicPartitionsHandler(std::shared_ptr<IMetadataStore> store)
     : metadata_store(store) {}
@@ -11,54 +68,122 @@ kafka::protocol::Response DescribeTopicPartitionsHandler::handle(const kafka::pr
     kafka::protocol::BufferReader reader(request.body);
     std::vector<std::string> requested_topics;
 
-    int32_t topic_array_size = reader.readInt8() - 1;
+    int32_t topic_array_size = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
     for (int32_t i = 0; i < topic_array_size; ++i)
     {
-        int topic_id_size = reader.readInt8() - 1; // Read the size of the topic name
-        std::string topic_name = reader.readString(topic_id_size);
-        requested_topics.push_back(topic_name);
-        reader.readInt8(); // Tag buffer
+        requested_topics.push_back(reader.readCompactString());
+        reader.skipTaggedFields();
     }
 
-    kafka::protocol::Response response(request.correlation_id);
+    int32_t partition_limit = reader.readInt32();
+    if (partition_limit <= 0 || partition_limit > kMaxPartitionLimit)
+    {
+        partition_limit = kMaxPartitionLimit;
+    }
 
-    response.writeInt8(0);  // top-level tagged fields
-    response.writeInt32(0); // throttle_time_ms
+    std::optional<Cursor> cursor;
+    if (reader.readInt8() != -1)
+    {
+        std::string topic_name = reader.readCompactString();
+        int32_t partition_index = reader.readInt32();
+        reader.skipTaggedFields();
+        cursor = Cursor{std::move(topic_name), partition_index};
+    }
+
+    // Topics are described in name order, resuming at the cursor. An empty
+    // request describes every topic, read straight off the sorted snapshot index.
+    std::sort(requested_topics.begin(), requested_topics.end());
+    requested_topics.erase(std::unique(requested_topics.begin(), requested_topics.end()), requested_topics.end());
+
+    auto snapshot = metadata_store->snapshot();
+    const auto &entries = snapshot->describeTopicEntries;
+    const std::string start_name = cursor ? cursor->topic_name : std::string();
 
-    response.writeInt8(requested_topics.size() + 1); // topics array size
+    std::vector<TopicSlice> slices;
+    std::optional<Cursor> next_cursor;
+    std::size_t remaining = static_cast<std::size_t>(partition_limit);
 
-    for (const auto &topic_name : requested_topics)
+    // Returns false once the response is full.
+    auto add_topic = [&](const std::string &name, const DescribeTopicEntry *entry)
     {
-        bool is_known = metadata_store->is_topic_known(topic_name);
+        static const std::vector<int32_t> no_partitions;
+        const auto &ids = entry ? entry->partition_ids : no_partitions;
+        std::size_t first = 0;
+        if (cursor && name == cursor->topic_name)
+        {
+            first = std::lower_bound(ids.begin(), ids.end(), cursor->partition_index) - ids.begin();
+        }
 
-        response.writeInt16(is_known ? 0 : 3); // error_code
-        response.writeString(topic_name);
+        if (remaining == 0)
+        {
+            next_cursor = Cursor{name, first < ids.size() ? ids[first] : 0};
+            return false;
+        }
 
-        std::vector<uint8_t> topic_id = metadata_store->get_topic_uuid(topic_name);
-        response.writeBytes(topic_id);
+        if (!entry)
+        {
+            slices.push_back({&name, nullptr, 0, 0});
+            return true;
+        }
 
-        response.writeInt8(0); // is_internal
+        std::size_t count = std::min(remaining, ids.size() - first);
+        slices.push_back({&name, entry, first, count});
+        remaining -= count;
 
-        if (is_known)
+        if (first + count < ids.size())
         {
-            auto partitions_data = metadata_store->get_serialized_partitions(topic_id);
-            response.writeInt8(partitions_data.size() + 1); // partitions array size
-            for (const auto &part_data : partitions_data)
+            next_cursor = Cursor{name, ids[first + count]};
+            return false;
+        }
+        return true;
+    };
+
+    if (requested_topics.empty())
+    {
+        for (auto it = entries.lower_bound(start_name); it != entries.end(); ++it)
+        {
+            if (!add_topic(it->first, it->second.get()))
             {
-                response.writeBytes(part_data);
+                break;
             }
         }
-        else
+    }
+    else
+    {
+        auto first = std::lower_bound(requested_topics.begin(), requested_topics.end(), start_name);
+        for (auto name = first; name != requested_topics.end(); ++name)
         {
-            response.writeInt8(1); // empty partitions array
+            auto entry = entries.find(*name);
+            if (!add_topic(*name, entry != entries.end() ? entry->second.get() : nullptr))
+            {
+                break;
+            }
         }
+    }
+
+    kafka::protocol::Response response(request.correlation_id);
+
+    response.writeInt8(0);  // top-level tagged fields
+    response.writeInt32(0); // throttle_time_ms
 
-        response.writeInt32(0x00000df8); // topic_authorized_operations
-        response.writeInt8(0);           // topic tagged fields
+    response.writeUnsignedVarint(slices.size() + 1); // topics array size
+    for (const auto &slice : slices)
+    {
+        write_slice(response, slice);
     }
 
-    response.writeInt8(0xFF); // next_cursor (null)
-    response.writeInt8(0);    // final tagged fields
+    if (next_cursor)
+    {
+        response.writeInt8(1); // next_cursor present
+        response.writeString(next_cursor->topic_name);
+        response.writeInt32(next_cursor->partition_index);
+        response.writeInt8(0); // cursor tagged fields
+    }
+    else
+    {
+        response.writeInt8(0xFF); // next_cursor (null)
+    }
+    response.writeInt8(0); // final tagged fields
 
     return response;
-}
\ No newline at end of file
+}
@@ -1,173 +1,352 @@
 #include "api/FetchHandler.hpp"
+#include "api/FetchRequest.hpp"
 #include "storage/IMetadataStore.hpp"
 #include "protocol/BufferReader.hpp"
+#include "core/ShardSet.hpp"
+#include "replication/ReplicaManager.hpp"
+#include "storage/RecordBatch.hpp"
 
 #include <cstdint>
 #include <vector>
 #include <array>
 #include <memory>
 
-// Represents the data for a single partition to be fetched.
-struct PartitionFetchInfo
+FetchRequestData FetchRequestData::parse(kafka::protocol::BufferReader &reader)
 {
-    int32_t index;
-    int32_t current_leader_epoch;
-    int64_t fetch_offset;
-    int32_t last_fetched_epoch;
-    int64_t log_start_offset;
-    int32_t partition_max_bytes;
-};
-
-// Represents a topic to be fetched, containing its ID and a list of partitions.
-struct TopicFetchInfo
-{
-    std::array<uint8_t, 16> id;
-    std::vector<PartitionFetchInfo> partitions;
-};
+    FetchRequestData request_data;
 
-class FetchRequestData
-{
-public:
-    int32_t max_wait_ms;
-    int32_t min_bytes;
-    int32_t max_bytes;
-    int8_t isolation_level;
-    int32_t session_id;
-    int32_t session_epoch;
-    std::vector<TopicFetchInfo> topics;
-
-    // A static factory method to encapsulate the entire parsing logic.
-    static FetchRequestData parse(kafka::protocol::BufferReader &reader)
-    {
-        FetchRequestData request_data;
+    // Read header fields
+    request_data.max_wait_ms = reader.readInt32();
+    request_data.min_bytes = reader.readInt32();
+    request_data.max_bytes = reader.readInt32();
+    request_data.isolation_level = reader.readInt8();
+    request_data.session_id = reader.readInt32();
+    request_data.session_epoch = reader.readInt32();
 
-        // Read header fields
-        request_data.max_wait_ms = reader.readInt32();
-        request_data.min_bytes = reader.readInt32();
-        request_data.max_bytes = reader.readInt32();
-        request_data.isolation_level = reader.readInt8();
-        request_data.session_id = reader.readInt32();
-        request_data.session_epoch = reader.readInt32();
+    // Compact arrays carry their length plus one, as an unsigned varint.
+    int32_t topic_array_size = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
 
-        // The Kafka protocol often uses N-1 for array sizes.
-        int32_t topic_array_size = reader.readInt8() - 1;
+    if (topic_array_size > 0)
+    {
+        request_data.topics.reserve(topic_array_size); // Pre-allocate for efficiency
+    }
 
-        if (topic_array_size > 0)
+    for (int i = 0; i < topic_array_size; ++i)
+    {
+        TopicFetchInfo current_topic;
+
+        std::vector<uint8_t> topic_id_vec = reader.readBytes(16);
+        if (topic_id_vec.size() == 16)
         {
-            request_data.topics.reserve(topic_array_size); // Pre-allocate for efficiency
+            std::copy(topic_id_vec.begin(), topic_id_vec.end(), current_topic.id.begin());
         }
 
-        for (int i = 0; i < topic_array_size; ++i)
+        int32_t partition_array_size = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+        if (partition_array_size > 0)
         {
-            TopicFetchInfo current_topic;
-
-            std::vector<uint8_t> topic_id_vec = reader.readBytes(16);
-            if (topic_id_vec.size() == 16)
-            {
-                std::copy(topic_id_vec.begin(), topic_id_vec.end(), current_topic.id.begin());
-            }
-
-            int32_t partition_array_size = reader.readInt8() - 1;
-            if (partition_array_size > 0)
-            {
-                current_topic.partitions.reserve(partition_array_size);
-            }
+            current_topic.partitions.reserve(partition_array_size);
+        }
 
-            for (int j = 0; j < partition_array_size; ++j)
-            {
-                // Create a partition in-place using the data from the reader
-                current_topic.partitions.emplace_back(PartitionFetchInfo{
-                    .index = reader.readInt32(),
-                    .current_leader_epoch = reader.readInt32(),
-                    .fetch_offset = reader.readInt64(),
-                    .last_fetched_epoch = reader.readInt32(),
-                    .log_start_offset = reader.readInt64(),
-                    .partition_max_bytes = reader.readInt32()});
-            }
-            request_data.topics.push_back(std::move(current_topic));
+        for (int j = 0; j < partition_array_size; ++j)
+        {
+            // Create a partition in-place using the data from the reader
+            current_topic.partitions.emplace_back(PartitionFetchInfo{
+                .index = reader.readInt32(),
+                .current_leader_epoch = reader.readInt32(),
+                .fetch_offset = reader.readInt64(),
+                .last_fetched_epoch = reader.readInt32(),
+                .log_start_offset = reader.readInt64(),
+                .partition_max_bytes = reader.readInt32()});
+            reader.skipTaggedFields();
         }
+        reader.skipTaggedFields();
+        request_data.topics.push_back(std::move(current_topic));
+    }
 
+    // Forgotten topics and the rack are unused; the top-level tagged fields carry the
+    // ReplicaState of a follower's fetch.
+    if (reader.eof())
+    {
         return request_data;
     }
-};
+    uint32_t forgotten_topics = reader.readUnsignedVarint();
+    for (uint32_t i = 1; i < forgotten_topics; ++i)
+    {
+        reader.skip(16);
+        uint32_t partitions = reader.readUnsignedVarint();
+        reader.skip(partitions > 0 ? (partitions - 1) * sizeof(int32_t) : 0);
+        reader.skipTaggedFields();
+    }
+    reader.readCompactString();
 
-FetchHandler::FetchHandler(std::shared_ptr<IMetadataStore> store)
-    : metadata_store(store) {}
+    uint32_t tagged_fields = reader.readUnsignedVarint();
+    for (uint32_t i = 0; i < tagged_fields; ++i)
+    {
+        uint32_t tag = reader.readUnsignedVarint();
+        uint32_t size = reader.readUnsignedVarint();
+        if (tag == kReplicaStateTag && size >= sizeof(int32_t) + sizeof(int64_t))
+        {
+            request_data.replica_id = reader.readInt32();
+            request_data.replica_epoch = reader.readInt64();
+            reader.skip(size - sizeof(int32_t) - sizeof(int64_t));
+        }
+        else
+        {
+            reader.skip(size);
+        }
+    }
 
-kafka::protocol::Response FetchHandler::handle(const kafka::protocol::Request &request)
+    return request_data;
+}
+
+namespace
 {
-    kafka::protocol::BufferReader reader(request.body);
-    kafka::protocol::Response response(request.correlation_id);
+    constexpr int16_t kStorageError = 56; // KAFKA_STORAGE_ERROR
 
-    // Parse the request
-    FetchRequestData request_data = FetchRequestData::parse(reader);
+    // Known-ness of each requested topic and the read result and high watermark of
+    // each requested partition, flattened in request order.
+    struct FetchState
+    {
+        FetchRequestData request_data;
+        std::vector<bool> topic_known;
+        std::vector<PartitionLog::ReadResult> results;
+        std::vector<int64_t> high_watermarks;
+    };
 
-    response.writeInt8(0);  // top-level tagged fields
-    response.writeInt32(0); // throttle_time_ms
+    FetchState prepare(const kafka::protocol::Request &request, IMetadataStore &store)
+    {
+        kafka::protocol::BufferReader reader(request.body);
+        FetchState state{FetchRequestData::parse(reader), {}, {}, {}};
 
-    response.writeInt16(0); // error_code
-    response.writeInt32(0); // session_id
+        std::size_t partitions = 0;
+        for (const auto &topic : state.request_data.topics)
+        {
+            std::vector<uint8_t> topic_id_vec(topic.id.begin(), topic.id.end());
+            state.topic_known.push_back(store.is_uuid_known(topic_id_vec));
+            partitions += topic.partitions.size();
+        }
+        state.results.resize(partitions);
+        state.high_watermarks.assign(partitions, -1);
+        return state;
+    }
 
-    // Check if there are any topics to process
-    if (request_data.topics.empty())
+    // Calls `read(topic, partition, result slot)` for every partition of a known topic.
+    template <typename Read>
+    void for_each_read(FetchState &state, Read read)
     {
-        response.writeInt8(0 + 1); // num_responses = 0, encoded as 1
-        response.writeInt8(0);     // Final tag buffer
-        return response;
+        std::size_t slot = 0;
+        for (std::size_t t = 0; t < state.request_data.topics.size(); ++t)
+        {
+            for (const auto &partition : state.request_data.topics[t].partitions)
+            {
+                if (state.topic_known[t])
+                {
+                    read(state.request_data.topics[t], partition, slot);
+                }
+                ++slot;
+            }
+        }
+    }
+
+    // Drops the batches that end at or past the high watermark.
+    void trim_to(PartitionLog::Records &records, int64_t high_watermark)
+    {
+        std::size_t keep = 0;
+        uint8_t raw[record_batch::kHeaderSize];
+        while (records.copy(keep, raw, sizeof(raw)))
+        {
+            record_batch::Header header = record_batch::read_header(raw);
+            if (header.last_offset >= high_watermark)
+            {
+                break;
+            }
+            keep += header.size;
+        }
+        records.truncate(keep);
     }
 
-    response.writeInt8(request_data.topics.size() + 1); // num_responses
+    struct PartitionRead
+    {
+        PartitionLog::ReadResult result;
+        int64_t high_watermark;
+    };
+
+    // Reads a partition, reports a follower's fetch position and works out the high
+    // watermark. Consumers only get records below it; followers get everything. Runs on
+    // the partition's home shard, where its log and replica state live.
+    PartitionRead read_partition(IMetadataStore &store, ReplicaManager *replicas, int32_t replica_id, const std::vector<uint8_t> &topic_id, const PartitionFetchInfo &partition)
+    {
+        PartitionRead read{{}, -1};
+        try
+        {
+            read.result = store.read_records(topic_id, partition.index, partition.fetch_offset, partition.partition_max_bytes);
+        }
+        catch (const std::exception &)
+        {
+            read.result.error_code = kStorageError;
+        }
+        read.high_watermark = read.result.log_end_offset;
+        if (replicas)
+        {
+            if (replica_id >= 0 && read.result.error_code == 0)
+            {
+                replicas->on_follower_fetch(replica_id, topic_id, partition.index, partition.fetch_offset, read.result.log_end_offset);
+            }
+            read.high_watermark = replicas->high_watermark(topic_id, partition.index, read.result.log_end_offset);
+        }
+        if (replica_id < 0)
+        {
+            trim_to(read.result.records, read.high_watermark);
+        }
+        return read;
+    }
 
-    // Start Topic Response
-    for (const auto &topic : request_data.topics)
+    kafka::protocol::Response build_response(int32_t correlation_id, const FetchState &state)
     {
-        std::vector<uint8_t> topic_id_vec(topic.id.begin(), topic.id.end());
-        response.writeBytes(topic_id_vec);
+        kafka::protocol::Response response(correlation_id);
+
+        response.writeInt8(0);  // top-level tagged fields
+        response.writeInt32(0); // throttle_time_ms
 
-        response.writeInt8(topic.partitions.size() + 1); // 'partitions' array size
+        response.writeInt16(0); // error_code
+        response.writeInt32(0); // session_id
 
-        for (const auto &partition : topic.partitions)
+        // Check if there are any topics to process
+        if (state.request_data.topics.empty())
         {
-            response.writeInt32(partition.index); // partition index
+            response.writeInt8(0 + 1); // num_responses = 0, encoded as 1
+            response.writeInt8(0);     // Final tag buffer
+            return response;
+        }
 
-            bool is_known = metadata_store->is_uuid_known(topic_id_vec);
+        response.writeUnsignedVarint(state.request_data.topics.size() + 1); // num_responses
 
-            if (is_known)
-            {
-                response.writeInt16(0); // error_code: NO_ERROR
-            }
-            else
+        // Start Topic Response
+        std::size_t slot = 0;
+        for (std::size_t t = 0; t < state.request_data.topics.size(); ++t)
+        {
+            const auto &topic = state.request_data.topics[t];
+            std::vector<uint8_t> topic_id_vec(topic.id.begin(), topic.id.end());
+            response.writeBytes(topic_id_vec);
+
+            response.writeUnsignedVarint(topic.partitions.size() + 1); // 'partitions' array size
+
+            for (const auto &partition : topic.partitions)
             {
-                response.writeInt16(100); // error_code: UNKNOWN_TOPIC_ID
-            }
+                const PartitionLog::ReadResult &records = state.results[slot++];
 
-            response.writeInt64(-1); // high_watermark
-            response.writeInt64(-1); // last_stable_offset
-            response.writeInt64(-1); // log_start_offset
+                response.writeInt32(partition.index); // partition index
 
-            response.writeInt8(0 + 1); // aborted_transactions
-            response.writeInt8(0);     // tagged fields for partition data
+                if (state.topic_known[t])
+                {
+                    response.writeInt16(records.error_code);
+                }
+                else
+                {
+                    response.writeInt16(100); // error_code: UNKNOWN_TOPIC_ID
+                }
 
-            response.writeInt32(-1); // preferred_read_replica
+                // Without transactions the last stable offset is the high watermark.
+                response.writeInt64(state.high_watermarks[slot - 1]); // high_watermark
+                response.writeInt64(state.high_watermarks[slot - 1]); // last_stable_offset
+                response.writeInt64(state.topic_known[t] ? records.log_start_offset : -1);
 
-            if (is_known)
-            {
-                std::vector<uint8_t> recBatch = metadata_store->getEntireRecBatch(topic_id_vec, partition.index);
-                response.writeInt8(2); // TODO
-                response.writeBytes(recBatch);
-            }
-            else
-            {
-                response.writeInt8(0 + 1); // Empty record_set (size 0)
+                response.writeInt8(0 + 1); // aborted_transactions
+
+                response.writeInt32(-1); // preferred_read_replica
+
+                // records: compact length, then the batches as stored
+                response.writeUnsignedVarint(records.records.size() + 1);
+                for (const auto &slice : records.records.slices())
+                {
+                    response.writeRawBytes(reinterpret_cast<const char *>(slice.data->data() + slice.offset), slice.length);
+                }
+
+                response.writeInt8(0); // tagged fields for partition response
             }
 
-            response.writeInt8(0); // tagged fields for partition response
+            response.writeInt8(0); // tagged fields for topic response
         }
 
-        response.writeInt8(0); // tagged fields for topic response
+        response.writeInt8(0); // Final tag buffer
+
+        return response;
+    }
+}
+
+FetchHandler::FetchHandler(std::shared_ptr<IMetadataStore> store, std::shared_ptr<ShardSet> shards, std::shared_ptr<ReplicaManager> replicas)
+    : metadata_store(store), shards(shards), replicas(replicas) {}
+
+kafka::protocol::Response FetchHandler::handle(const kafka::protocol::Request &request)
+{
+    FetchState state = prepare(request, *metadata_store);
+
+    int32_t replica_id = state.request_data.replica_id;
+    for_each_read(state, [&](const TopicFetchInfo &topic, const PartitionFetchInfo &partition, std::size_t slot)
+                  {
+                      std::vector<uint8_t> topic_id(topic.id.begin(), topic.id.end());
+                      // Partition logs may only be touched by their home shard.
+                      auto read = ShardSet::call_home(shards.get(), topic_id, partition.index, [&]
+                                                      { return read_partition(*metadata_store, replicas.get(), replica_id, topic_id, partition); });
+                      state.results[slot] = std::move(read.result);
+                      state.high_watermarks[slot] = read.high_watermark; });
+
+    return build_response(request.correlation_id, state);
+}
+
+Task<kafka::protocol::Response> FetchHandler::handle_async(kafka::protocol::Request request)
+{
+    if (shards)
+    {
+        co_return co_await handle_sharded(std::move(request));
+    }
+    co_return handle(request);
+}
+
+Task<kafka::protocol::Response> FetchHandler::handle_sharded(kafka::protocol::Request request)
+{
+    FetchState state = prepare(request, *metadata_store);
+
+    // Split the request by home shard so each shard reads its partitions in one hop.
+    struct ShardRead
+    {
+        std::vector<uint8_t> topic_id;
+        PartitionFetchInfo partition;
+        std::size_t slot;
+    };
+    std::vector<std::vector<ShardRead>> by_shard(shards->size());
+    for_each_read(state, [&](const TopicFetchInfo &topic, const PartitionFetchInfo &partition, std::size_t slot)
+                  { by_shard[shards->shard_for(topic.id, partition.index)].push_back(ShardRead{std::vector<uint8_t>(topic.id.begin(), topic.id.end()), partition, slot}); });
+
+    std::vector<Task<std::vector<std::pair<std::size_t, PartitionRead>>>> reads;
+    for (unsigned shard = 0; shard < by_shard.size(); ++shard)
+    {
+        if (by_shard[shard].empty())
+        {
+            continue;
+        }
+        reads.push_back(shards->run(shard, [store = metadata_store, replicas = replicas, replica_id = state.request_data.replica_id, partitions = std::move(by_shard[shard])]
+                                    {
+                                        std::vector<std::pair<std::size_t, PartitionRead>> results;
+                                        for (const auto &read : partitions)
+                                        {
+                                            results.emplace_back(read.slot, read_partition(*store, replicas.get(), replica_id, read.topic_id, read.partition));
+                                        }
+                                        return results; }));
     }
 
-    response.writeInt8(0); // Final tag buffer
+    for (auto &shard_results : co_await when_all(std::move(reads)))
+    {
+        if (!shard_results)
+        {
+            continue; // Reads never throw out of the shard job
+        }
+        for (auto &[slot, read] : *shard_results)
+        {
+            state.results[slot] = std::move(read.result);
+            state.high_watermarks[slot] = read.high_watermark;
+        }
+    }
 
-    return response;
-}
\ No newline at end of file
+    co_return build_response(request.correlation_id, state);
+}
@@ -3,15 +3,26 @@
 #include <memory>
 
 class IMetadataStore;
+class ReplicaManager;
+class ShardSet;
 
 class FetchHandler : public IApiHandler
 {
 public:
     // We use dependency injection to provide the data store.
-    explicit FetchHandler(std::shared_ptr<IMetadataStore> metadata_store);
+    // Partition reads run on each partition's home shard when `shards` is given,
+    // otherwise inline. With `replicas`, follower fetches are reported to it and
+    // consumers only see records below the high watermark.
+    explicit FetchHandler(std::shared_ptr<IMetadataStore> metadata_store, std::shared_ptr<ShardSet> shards = nullptr,
+                          std::shared_ptr<ReplicaManager> replicas = nullptr);
 
     kafka::protocol::Response handle(const kafka::protocol::Request &request) override;
+    Task<kafka::protocol::Response> handle_async(kafka::protocol::Request request) override;
 
 private:
+    Task<kafka::protocol::Response> handle_sharded(kafka::protocol::Request request);
+
     std::shared_ptr<IMetadataStore> metadata_store;
+    std::shared_ptr<ShardSet> shards;
+    std::shared_ptr<ReplicaManager> replicas;
 };
\ No newline at end of file
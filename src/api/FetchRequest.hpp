@@ -0,0 +1,42 @@
+#pragma once
+#include "protocol/BufferReader.hpp"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Represents the data for a single partition to be fetched.
+struct PartitionFetchInfo
+{
+    int32_t index;
+    int32_t current_leader_epoch;
+    int64_t fetch_offset;
+    int32_t last_fetched_epoch;
+    int64_t log_start_offset;
+    int32_t partition_max_bytes;
+};
+
+// Represents a topic to be fetched, containing its ID and a list of partitions.
+struct TopicFetchInfo
+{
+    std::array<uint8_t, 16> id;
+    std::vector<PartitionFetchInfo> partitions;
+};
+
+class FetchRequestData
+{
+public:
+    int32_t max_wait_ms;
+    int32_t min_bytes;
+    int32_t max_bytes;
+    int8_t isolation_level;
+    int32_t session_id;
+    int32_t session_epoch;
+    std::vector<TopicFetchInfo> topics;
+    int32_t replica_id = -1; // A follower broker's id, from the ReplicaState tagged field; -1 for consumers
+    int64_t replica_epoch = -1;
+
+    static constexpr uint32_t kReplicaStateTag = 1;
+
+    // A static factory method to encapsulate the entire parsing logic.
+    static FetchRequestData parse(kafka::protocol::BufferReader &reader);
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include "protocol/Request.hpp"
 #include "protocol/Response.hpp"
+#include "core/Task.hpp"
 
 // Interface for all API handlers
 class IApiHandler
@@ -8,4 +9,11 @@ class IApiHandler
 public:
     virtual ~IApiHandler() = default;
     virtual kafka::protocol::Response handle(const kafka::protocol::Request &request) = 0;
-};
\ No newline at end of file
+
+    // Handlers that wait on storage override this to co_await it instead of
+    // blocking a worker. The request is taken by value since the task outlives the call.
+    virtual Task<kafka::protocol::Response> handle_async(kafka::protocol::Request request)
+    {
+        co_return handle(request);
+    }
+};
@@ -0,0 +1,231 @@
+#include "api/ListOffsetsHandler.hpp"
+#include "storage/IMetadataStore.hpp"
+#include "protocol/BufferReader.hpp"
+#include "core/ShardSet.hpp"
+#include "replication/ReplicaManager.hpp"
+#include <algorithm>
+
+namespace
+{
+    constexpr int16_t kUnknownTopicOrPartition = 3;
+    constexpr int16_t kStorageError = 56; // KAFKA_STORAGE_ERROR
+
+    struct PartitionLookup
+    {
+        int32_t index;
+        int64_t timestamp;
+        int32_t leader_epoch = -1;
+        int16_t error_code = 0;
+        PartitionLog::OffsetLookup result;
+    };
+
+    struct TopicLookup
+    {
+        std::string name;
+        std::vector<uint8_t> topic_id; // Empty for an unknown topic
+        std::vector<PartitionLookup> partitions;
+    };
+
+    struct ListOffsetsState
+    {
+        int32_t replica_id;
+        std::vector<TopicLookup> topics;
+    };
+
+    ListOffsetsState prepare(const kafka::protocol::Request &request, IMetadataStore &store)
+    {
+        // Parse the request body
+        kafka::protocol::BufferReader reader(request.body);
+        ListOffsetsState state;
+        state.replica_id = reader.readInt32();
+        reader.readInt8(); // isolation_level: without transactions both levels end at the high watermark
+
+        int32_t topic_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+        for (int32_t t = 0; t < topic_count; ++t)
+        {
+            TopicLookup &topic = state.topics.emplace_back();
+            topic.name = reader.readCompactString();
+            int32_t partition_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+            for (int32_t p = 0; p < partition_count; ++p)
+            {
+                PartitionLookup &partition = topic.partitions.emplace_back();
+                partition.index = reader.readInt32();
+                reader.readInt32(); // current_leader_epoch
+                partition.timestamp = reader.readInt64();
+                reader.skipTaggedFields();
+            }
+            reader.skipTaggedFields();
+        }
+
+        // Resolve names and partitions against one snapshot.
+        auto snapshot = store.snapshot();
+        for (auto &topic : state.topics)
+        {
+            const std::vector<PartitionState> *partitions = nullptr;
+            auto id = snapshot->nameToTopicId.find(topic.name);
+            if (id != snapshot->nameToTopicId.end())
+            {
+                auto it = snapshot->topicToPars.find(id->second);
+                partitions = it != snapshot->topicToPars.end() ? &it->second : nullptr;
+                topic.topic_id.assign(id->second.begin(), id->second.end());
+            }
+            for (auto &partition : topic.partitions)
+            {
+                auto it = partitions ? std::ranges::lower_bound(*partitions, partition.index, {}, &PartitionState::partition_id) : decltype(partitions->begin()){};
+                if (!partitions || it == partitions->end() || it->partition_id != partition.index)
+                {
+                    partition.error_code = kUnknownTopicOrPartition;
+                    continue;
+                }
+                partition.leader_epoch = it->leader_epoch;
+            }
+        }
+        return state;
+    }
+
+    // Calls `lookup(topic, partition)` for every partition of a known topic.
+    template <typename Lookup>
+    void for_each_lookup(ListOffsetsState &state, Lookup lookup)
+    {
+        for (auto &topic : state.topics)
+        {
+            for (auto &partition : topic.partitions)
+            {
+                if (partition.error_code == 0)
+                {
+                    lookup(topic, partition);
+                }
+            }
+        }
+    }
+
+    // Consumers only see offsets below the high watermark; followers see the whole log.
+    // The log start is returned as is, since consumers may always start from there.
+    void apply_high_watermark(ReplicaManager &replicas, const std::vector<uint8_t> &topic_id, PartitionLookup &partition)
+    {
+        if (partition.timestamp == PartitionLog::kEarliestTimestamp || partition.timestamp == PartitionLog::kEarliestLocalTimestamp)
+        {
+            return;
+        }
+        PartitionLog::OffsetLookup &result = partition.result;
+        int64_t high_watermark = replicas.high_watermark(topic_id, partition.index, result.log_end_offset);
+        if (partition.timestamp == PartitionLog::kLatestTimestamp)
+        {
+            result.offset = std::min(result.offset, high_watermark);
+        }
+        else if (result.offset >= high_watermark)
+        {
+            result.timestamp = -1;
+            result.offset = -1;
+        }
+    }
+
+    // Runs on the partition's home shard, where its log and replica state live.
+    void look_up(IMetadataStore &store, ReplicaManager *replicas, int32_t replica_id, const std::vector<uint8_t> &topic_id, PartitionLookup &partition)
+    {
+        try
+        {
+            auto result = store.list_offset(topic_id, partition.index, partition.timestamp);
+            if (!result)
+            {
+                partition.error_code = kUnknownTopicOrPartition;
+                return;
+            }
+            partition.result = *result;
+        }
+        catch (const std::exception &)
+        {
+            partition.error_code = kStorageError;
+            return;
+        }
+        if (replicas && replica_id < 0)
+        {
+            apply_high_watermark(*replicas, topic_id, partition);
+        }
+    }
+
+    kafka::protocol::Response build_response(int32_t correlation_id, const ListOffsetsState &state)
+    {
+        kafka::protocol::Response response(correlation_id);
+        response.writeInt8(0);  // Response header tagged fields
+        response.writeInt32(0); // throttle_time_ms
+
+        response.writeUnsignedVarint(state.topics.size() + 1);
+        for (const auto &topic : state.topics)
+        {
+            response.writeString(topic.name);
+            response.writeUnsignedVarint(topic.partitions.size() + 1);
+            for (const auto &partition : topic.partitions)
+            {
+                bool found = partition.error_code == 0;
+                response.writeInt32(partition.index);
+                response.writeInt16(partition.error_code);
+                response.writeInt64(found ? partition.result.timestamp : -1);
+                response.writeInt64(found ? partition.result.offset : -1);
+                response.writeInt32(partition.leader_epoch);
+                response.writeInt8(0); // partition tagged fields
+            }
+            response.writeInt8(0); // topic tagged fields
+        }
+        response.writeInt8(0); // Final tag buffer
+
+        return response;
+    }
+}
+
+ListOffsetsHandler::ListOffsetsHandler(std::shared_ptr<IMetadataStore> metadata_store, std::shared_ptr<ShardSet> shards,
+                                       std::shared_ptr<ReplicaManager> replicas)
+    : metadata_store(metadata_store), shards(shards), replicas(replicas) {}
+
+kafka::protocol::Response ListOffsetsHandler::handle(const kafka::protocol::Request &request)
+{
+    ListOffsetsState state = prepare(request, *metadata_store);
+
+    for_each_lookup(state, [&](const TopicLookup &topic, PartitionLookup &partition)
+                    {
+                        // Partition logs may only be touched by their home shard.
+                        ShardSet::call_home(shards.get(), topic.topic_id, partition.index, [&]
+                                            { look_up(*metadata_store, replicas.get(), state.replica_id, topic.topic_id, partition); }); });
+
+    return build_response(request.correlation_id, state);
+}
+
+Task<kafka::protocol::Response> ListOffsetsHandler::handle_async(kafka::protocol::Request request)
+{
+    if (!shards)
+    {
+        co_return handle(request);
+    }
+
+    ListOffsetsState state = prepare(request, *metadata_store);
+
+    // Split the request by home shard so each shard looks up its partitions in one hop.
+    // The state outlives every shard job, so they fill in its partitions in place.
+    struct ShardLookup
+    {
+        const std::vector<uint8_t> *topic_id;
+        PartitionLookup *partition;
+    };
+    std::vector<std::vector<ShardLookup>> by_shard(shards->size());
+    for_each_lookup(state, [&](TopicLookup &topic, PartitionLookup &partition)
+                    { by_shard[shards->shard_for(topic.topic_id, partition.index)].push_back(ShardLookup{&topic.topic_id, &partition}); });
+
+    std::vector<Task<std::size_t>> lookups; // Tasks need a result, so each returns its lookup count
+    for (unsigned shard = 0; shard < by_shard.size(); ++shard)
+    {
+        if (by_shard[shard].empty())
+        {
+            continue;
+        }
+        lookups.push_back(shards->run(shard, [store = metadata_store, replicas = replicas, replica_id = state.replica_id, partitions = std::move(by_shard[shard])]
+                                      {
+                                          for (const auto &lookup : partitions)
+                                          {
+                                              look_up(*store, replicas.get(), replica_id, *lookup.topic_id, *lookup.partition);
+                                          }
+                                          return partitions.size(); }));
+    }
+    co_await when_all(std::move(lookups)); // look_up never throws
+
+    co_return build_response(request.correlation_id, state);
+}
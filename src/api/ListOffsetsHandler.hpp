@@ -0,0 +1,25 @@
+#pragma once
+#include "api/IApiHandler.hpp"
+#include <memory>
+
+class IMetadataStore;
+class ReplicaManager;
+class ShardSet;
+
+// ListOffsets (v6+): the log start, log end, or first offset at or after a timestamp.
+// Lookups run on each partition's home shard when `shards` is given. With `replicas`,
+// consumers are not shown offsets at or past the high watermark.
+class ListOffsetsHandler : public IApiHandler
+{
+public:
+    explicit ListOffsetsHandler(std::shared_ptr<IMetadataStore> metadata_store, std::shared_ptr<ShardSet> shards = nullptr,
+                                std::shared_ptr<ReplicaManager> replicas = nullptr);
+
+    kafka::protocol::Response handle(const kafka::protocol::Request &request) override;
+    Task<kafka::protocol::Response> handle_async(kafka::protocol::Request request) override;
+
+private:
+    std::shared_ptr<IMetadataStore> metadata_store;
+    std::shared_ptr<ShardSet> shards;
+    std::shared_ptr<ReplicaManager> replicas;
+};
@@ -0,0 +1,219 @@
+#include "api/MetadataHandler.hpp"
+#include "storage/IMetadataStore.hpp"
+#include "protocol/BufferReader.hpp"
+#include <algorithm>
+#include <climits>
+#include <optional>
+
+namespace
+{
+    constexpr int16_t kUnknownTopicOrPartition = 3;
+    constexpr int16_t kLeaderNotAvailable = 5;
+    constexpr int16_t kUnknownTopicId = 100;
+
+    // Every topic operation, as DescribeTopicPartitions reports. INT32_MIN means not requested.
+    constexpr int32_t kTopicAuthorizedOperations = 0x00000df8;
+    constexpr int32_t kOperationsNotRequested = INT32_MIN;
+
+    // A requested topic; an empty name means the topic is requested by id (v12+).
+    struct TopicRequest
+    {
+        std::vector<uint8_t> topic_id;
+        std::string name;
+    };
+
+    void write_int32_array(kafka::protocol::Response &out, const std::vector<int32_t> &values)
+    {
+        out.writeUnsignedVarint(values.size() + 1);
+        for (int32_t value : values)
+        {
+            out.writeInt32(value);
+        }
+    }
+
+    void write_unknown_topic(kafka::protocol::Response &out, int16_t version, const TopicRequest &topic)
+    {
+        bool by_id = topic.name.empty();
+        out.writeInt16(by_id ? kUnknownTopicId : kUnknownTopicOrPartition);
+        if (by_id)
+        {
+            out.writeUnsignedVarint(0); // null name
+        }
+        else
+        {
+            out.writeString(topic.name);
+        }
+        if (version >= 10)
+        {
+            out.writeBytes(by_id ? topic.topic_id : std::vector<uint8_t>(16, 0));
+        }
+        out.writeInt8(0);                        // is_internal
+        out.writeUnsignedVarint(1);              // no partitions
+        out.writeInt32(kOperationsNotRequested); // topic_authorized_operations
+        out.writeInt8(0);                        // topic tagged fields
+    }
+}
+
+MetadataHandler::MetadataHandler(std::shared_ptr<IMetadataStore> metadata_store, std::vector<Broker> brokers, int32_t controller_id)
+    : metadata_store(metadata_store), brokers(std::move(brokers)), controller_id(controller_id)
+{
+    for (int16_t version = kMinVersion; version <= kMaxVersion; ++version)
+    {
+        for (int topic_operations = 0; topic_operations < 2; ++topic_operations)
+        {
+            cache.push_back(std::make_unique<rcu::Cell<Encoded>>(std::make_unique<const Encoded>()));
+        }
+    }
+}
+
+std::unique_ptr<const MetadataHandler::Encoded> MetadataHandler::encode(const MetadataSnapshot &snapshot, int16_t version, bool topic_operations) const
+{
+    auto encoded = std::make_unique<Encoded>();
+    encoded->snapshot_version = snapshot.version;
+
+    kafka::protocol::Response head(0);
+    head.writeInt32(0); // throttle_time_ms
+    head.writeUnsignedVarint(brokers.size() + 1);
+    for (const auto &broker : brokers)
+    {
+        head.writeInt32(broker.node_id);
+        head.writeString(broker.host);
+        head.writeInt32(broker.port);
+        head.writeUnsignedVarint(0); // rack: null
+        head.writeInt8(0);           // broker tagged fields
+    }
+    head.writeUnsignedVarint(0); // cluster_id: null
+    head.writeInt32(controller_id);
+    encoded->head = head.get_data();
+
+    // Topics in name order, each recorded so a request for some topics copies just those.
+    kafka::protocol::Response topics(0);
+    for (const auto &[name, topic_id] : snapshot.nameToTopicId)
+    {
+        auto begin = static_cast<uint32_t>(topics.get_data().size());
+        topics.writeInt16(0); // error_code
+        topics.writeString(name);
+        if (version >= 10)
+        {
+            topics.writeBytes(topic_id);
+        }
+        topics.writeInt8(name == "__consumer_offsets"); // is_internal
+
+        auto pars = snapshot.topicToPars.find(topic_id);
+        std::size_t partition_count = pars != snapshot.topicToPars.end() ? pars->second.size() : 0;
+        topics.writeUnsignedVarint(partition_count + 1);
+        for (std::size_t p = 0; p < partition_count; ++p)
+        {
+            const PartitionState &partition = pars->second[p];
+            topics.writeInt16(partition.leader < 0 ? kLeaderNotAvailable : 0);
+            topics.writeInt32(partition.partition_id);
+            topics.writeInt32(partition.leader);
+            topics.writeInt32(partition.leader_epoch);
+            write_int32_array(topics, partition.replicas);
+            write_int32_array(topics, partition.isr);
+            topics.writeUnsignedVarint(1); // offline_replicas
+            topics.writeInt8(0);           // partition tagged fields
+        }
+        topics.writeInt32(topic_operations ? kTopicAuthorizedOperations : kOperationsNotRequested);
+        topics.writeInt8(0); // topic tagged fields
+
+        encoded->spans.emplace(name, std::make_pair(begin, static_cast<uint32_t>(topics.get_data().size())));
+        ++encoded->topic_count;
+    }
+    encoded->topics = topics.get_data();
+
+    kafka::protocol::Response tail(0);
+    if (version <= 10)
+    {
+        tail.writeInt32(kOperationsNotRequested); // cluster_authorized_operations
+    }
+    if (version >= 13)
+    {
+        tail.writeInt16(0); // error_code
+    }
+    tail.writeInt8(0); // Final tag buffer
+    encoded->tail = tail.get_data();
+
+    return encoded;
+}
+
+kafka::protocol::Response MetadataHandler::handle(const kafka::protocol::Request &request)
+{
+    // Parse the request body
+    kafka::protocol::BufferReader reader(request.body);
+    std::optional<std::vector<TopicRequest>> requested; // Unset for every topic
+    int32_t topic_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+    if (topic_count >= 0)
+    {
+        requested.emplace();
+    }
+    for (int32_t t = 0; t < topic_count; ++t)
+    {
+        TopicRequest &topic = requested->emplace_back();
+        if (request.api_version >= 10)
+        {
+            topic.topic_id = reader.readBytes(16);
+        }
+        topic.name = reader.readCompactString();
+        reader.skipTaggedFields();
+    }
+    reader.readInt8(); // allow_auto_topic_creation: topics are only created through the metadata log
+    if (request.api_version <= 10)
+    {
+        reader.readInt8(); // include_cluster_authorized_operations
+    }
+    bool topic_operations = reader.readInt8() != 0;
+
+    int16_t version = std::clamp(request.api_version, kMinVersion, kMaxVersion);
+    rcu::Cell<Encoded> &cell = *cache[(version - kMinVersion) * 2 + topic_operations];
+    auto snapshot = metadata_store->snapshot();
+    if (cell.read()->snapshot_version != snapshot->version)
+    {
+        // Racing requests may each encode the new snapshot; the first to publish wins.
+        std::unique_ptr<const Encoded> fresh = encode(*snapshot, version, topic_operations);
+        {
+            std::lock_guard<std::mutex> lock(publish_mutex);
+            const Encoded *current = cell.writer_view();
+            if (current->snapshot_version == UINT64_MAX || current->snapshot_version < snapshot->version)
+            {
+                cell.publish(std::move(fresh));
+            }
+        }
+    }
+    auto encoded = cell.read();
+
+    // Building the response
+    kafka::protocol::Response response(request.correlation_id);
+    response.writeInt8(0); // Response header tagged fields
+    response.writeRawBytes(encoded->head.data(), encoded->head.size());
+
+    if (!requested)
+    {
+        response.writeUnsignedVarint(encoded->topic_count + 1);
+        response.writeRawBytes(encoded->topics.data(), encoded->topics.size());
+    }
+    else
+    {
+        response.writeUnsignedVarint(requested->size() + 1);
+        for (const auto &topic : *requested)
+        {
+            const std::string *name = &topic.name;
+            if (name->empty())
+            {
+                auto by_id = snapshot->topicIdToName.find(topic.topic_id);
+                name = by_id != snapshot->topicIdToName.end() ? &by_id->second : name;
+            }
+            auto span = encoded->spans.find(*name);
+            if (span == encoded->spans.end())
+            {
+                write_unknown_topic(response, version, topic);
+                continue;
+            }
+            auto [begin, end] = span->second;
+            response.writeRawBytes(encoded->topics.data() + begin, end - begin);
+        }
+    }
+    response.writeRawBytes(encoded->tail.data(), encoded->tail.size());
+
+    return response;
+}
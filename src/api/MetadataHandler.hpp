@@ -0,0 +1,55 @@
+#pragma once
+#include "api/IApiHandler.hpp"
+#include "core/Rcu.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class IMetadataStore;
+struct MetadataSnapshot;
+
+// Metadata (v9+): brokers, topics, partition leaders, replicas and ISRs. Responses are
+// encoded once per metadata snapshot and request version, then copied out.
+class MetadataHandler : public IApiHandler
+{
+public:
+    struct Broker
+    {
+        int32_t node_id;
+        std::string host;
+        int32_t port;
+    };
+
+    // The metadata log holds no broker registrations, so the brokers and the
+    // controller id reported are the ones the broker was started with.
+    MetadataHandler(std::shared_ptr<IMetadataStore> metadata_store, std::vector<Broker> brokers, int32_t controller_id);
+
+    kafka::protocol::Response handle(const kafka::protocol::Request &request) override;
+
+private:
+    static constexpr int16_t kMinVersion = 9;
+    static constexpr int16_t kMaxVersion = 13;
+
+    // One snapshot encoded for one request version and include_topic_authorized_operations.
+    struct Encoded
+    {
+        uint64_t snapshot_version = UINT64_MAX; // UINT64_MAX until first built
+        std::vector<char> head;                 // throttle_time_ms up to the topics array
+        std::vector<char> topics;               // Every topic entry, without the array length
+        std::size_t topic_count = 0;
+        std::map<std::string, std::pair<uint32_t, uint32_t>> spans; // Each topic's entry within `topics`
+        std::vector<char> tail;                                     // After the topics array
+    };
+
+    std::unique_ptr<const Encoded> encode(const MetadataSnapshot &snapshot, int16_t version, bool topic_operations) const;
+
+    std::shared_ptr<IMetadataStore> metadata_store;
+    std::vector<Broker> brokers;
+    int32_t controller_id;
+
+    std::vector<std::unique_ptr<rcu::Cell<Encoded>>> cache; // By version, then topic_operations
+    std::mutex publish_mutex;
+};
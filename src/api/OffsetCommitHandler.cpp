@@ -0,0 +1,136 @@
+#include "api/OffsetCommitHandler.hpp"
+#include "storage/IMetadataStore.hpp"
+#include "storage/OffsetStore.hpp"
+#include "protocol/BufferReader.hpp"
+#include "core/Log.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+    constexpr int16_t kUnknownServerError = -1;
+    constexpr int16_t kUnknownTopicOrPartition = 3;
+    constexpr int16_t kOffsetMetadataTooLarge = 12;
+    constexpr int16_t kInvalidGroupId = 24;
+
+    // Kafka's offset.metadata.max.bytes default.
+    constexpr std::size_t kMaxMetadataBytes = 4096;
+
+    struct PartitionCommit
+    {
+        int32_t index;
+        int64_t offset;
+        int32_t leader_epoch;
+        std::string metadata;
+        int16_t error_code = 0;
+    };
+
+    struct TopicCommit
+    {
+        std::string name;
+        std::vector<PartitionCommit> partitions;
+    };
+}
+
+OffsetCommitHandler::OffsetCommitHandler(std::shared_ptr<OffsetStore> offset_store, std::shared_ptr<IMetadataStore> metadata_store)
+    : offset_store(offset_store), metadata_store(metadata_store) {}
+
+kafka::protocol::Response OffsetCommitHandler::handle(const kafka::protocol::Request &request)
+{
+    // Parse the request body
+    kafka::protocol::BufferReader reader(request.body);
+    std::string group_id = reader.readCompactString();
+    reader.readInt32();         // generation_id_or_member_epoch
+    reader.readCompactString(); // member_id
+    reader.readCompactString(); // group_instance_id
+
+    std::vector<TopicCommit> topics;
+    int32_t topic_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+    for (int32_t t = 0; t < topic_count; ++t)
+    {
+        TopicCommit &topic = topics.emplace_back();
+        topic.name = reader.readCompactString();
+        int32_t partition_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+        for (int32_t p = 0; p < partition_count; ++p)
+        {
+            PartitionCommit &partition = topic.partitions.emplace_back();
+            partition.index = reader.readInt32();
+            partition.offset = reader.readInt64();
+            partition.leader_epoch = reader.readInt32();
+            partition.metadata = reader.readCompactString();
+            reader.skipTaggedFields();
+        }
+        reader.skipTaggedFields();
+    }
+
+    // There is no group coordinator yet, so generations and members aren't checked;
+    // every commit for a known partition is accepted.
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::vector<OffsetStore::Commit> commits;
+    {
+        auto snapshot = metadata_store->snapshot();
+        for (auto &topic : topics)
+        {
+            const std::vector<PartitionState> *partitions = nullptr;
+            auto id = snapshot->nameToTopicId.find(topic.name);
+            if (id != snapshot->nameToTopicId.end())
+            {
+                auto it = snapshot->topicToPars.find(id->second);
+                partitions = it != snapshot->topicToPars.end() ? &it->second : nullptr;
+            }
+
+            for (auto &partition : topic.partitions)
+            {
+                if (group_id.empty())
+                {
+                    partition.error_code = kInvalidGroupId;
+                }
+                else if (!partitions || !std::ranges::binary_search(*partitions, partition.index, {}, &PartitionState::partition_id))
+                {
+                    partition.error_code = kUnknownTopicOrPartition;
+                }
+                else if (partition.metadata.size() > kMaxMetadataBytes)
+                {
+                    partition.error_code = kOffsetMetadataTooLarge;
+                }
+                else
+                {
+                    commits.push_back(OffsetStore::Commit{topic.name, partition.index, {partition.offset, partition.leader_epoch, partition.metadata, now}});
+                }
+            }
+        }
+    }
+
+    int16_t commit_error = 0;
+    try
+    {
+        offset_store->commit(group_id, commits);
+    }
+    catch (const std::exception &e)
+    {
+        LOG_ERROR("Failed to commit {} offsets of group {}: {}", commits.size(), group_id, e.what());
+        commit_error = kUnknownServerError;
+    }
+
+    // Building the response
+    kafka::protocol::Response response(request.correlation_id);
+    response.writeInt8(0);  // Response header tagged fields
+    response.writeInt32(0); // throttle_time_ms
+
+    response.writeUnsignedVarint(topics.size() + 1);
+    for (const auto &topic : topics)
+    {
+        response.writeString(topic.name);
+        response.writeUnsignedVarint(topic.partitions.size() + 1);
+        for (const auto &partition : topic.partitions)
+        {
+            response.writeInt32(partition.index);
+            response.writeInt16(partition.error_code != 0 ? partition.error_code : commit_error);
+            response.writeInt8(0); // partition tagged fields
+        }
+        response.writeInt8(0); // topic tagged fields
+    }
+    response.writeInt8(0); // Final tag buffer
+
+    return response;
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include "api/IApiHandler.hpp"
+#include <memory>
+
+class IMetadataStore;
+class OffsetStore;
+
+// OffsetCommit (v8+): stores consumer group offsets, all partitions of a request in one log append.
+class OffsetCommitHandler : public IApiHandler
+{
+public:
+    OffsetCommitHandler(std::shared_ptr<OffsetStore> offset_store, std::shared_ptr<IMetadataStore> metadata_store);
+
+    kafka::protocol::Response handle(const kafka::protocol::Request &request) override;
+
+private:
+    std::shared_ptr<OffsetStore> offset_store;
+    std::shared_ptr<IMetadataStore> metadata_store;
+};
@@ -0,0 +1,137 @@
+#include "api/OffsetFetchHandler.hpp"
+#include "storage/OffsetStore.hpp"
+#include "protocol/BufferReader.hpp"
+#include <optional>
+
+namespace
+{
+    constexpr int16_t kInvalidGroupId = 24;
+
+    struct TopicRequest
+    {
+        std::string name;
+        std::vector<int32_t> partitions;
+    };
+
+    struct GroupRequest
+    {
+        std::string group_id;
+        std::optional<std::vector<TopicRequest>> topics; // Unset for every committed offset
+    };
+
+    void write_partition(kafka::protocol::Response &response, int32_t partition, const OffsetStore::CommittedOffset &offset)
+    {
+        response.writeInt32(partition);
+        response.writeInt64(offset.offset);
+        response.writeInt32(offset.leader_epoch);
+        response.writeString(offset.metadata);
+        response.writeInt16(0); // error_code
+        response.writeInt8(0);  // partition tagged fields
+    }
+}
+
+OffsetFetchHandler::OffsetFetchHandler(std::shared_ptr<OffsetStore> offset_store)
+    : offset_store(offset_store) {}
+
+kafka::protocol::Response OffsetFetchHandler::handle(const kafka::protocol::Request &request)
+{
+    // Parse the request body
+    kafka::protocol::BufferReader reader(request.body);
+    std::vector<GroupRequest> groups;
+    int32_t group_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+    for (int32_t g = 0; g < group_count; ++g)
+    {
+        GroupRequest &group = groups.emplace_back();
+        group.group_id = reader.readCompactString();
+        if (request.api_version >= 9)
+        {
+            reader.readCompactString(); // member_id
+            reader.readInt32();         // member_epoch
+        }
+
+        int32_t topic_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+        if (topic_count >= 0)
+        {
+            group.topics.emplace();
+        }
+        for (int32_t t = 0; t < topic_count; ++t)
+        {
+            TopicRequest &topic = group.topics->emplace_back();
+            topic.name = reader.readCompactString();
+            int32_t partition_count = static_cast<int32_t>(reader.readUnsignedVarint()) - 1;
+            for (int32_t p = 0; p < partition_count; ++p)
+            {
+                topic.partitions.push_back(reader.readInt32());
+            }
+            reader.skipTaggedFields();
+        }
+        reader.skipTaggedFields();
+    }
+    reader.readInt8(); // require_stable: there are no transactions, so every offset is stable
+
+    // Building the response
+    kafka::protocol::Response response(request.correlation_id);
+    response.writeInt8(0);  // Response header tagged fields
+    response.writeInt32(0); // throttle_time_ms
+
+    response.writeUnsignedVarint(groups.size() + 1);
+    for (const auto &group : groups)
+    {
+        response.writeString(group.group_id);
+        if (group.group_id.empty())
+        {
+            response.writeUnsignedVarint(1); // no topics
+            response.writeInt16(kInvalidGroupId);
+            response.writeInt8(0); // group tagged fields
+            continue;
+        }
+
+        if (group.topics)
+        {
+            // Partitions without a committed offset get -1, which is not an error.
+            response.writeUnsignedVarint(group.topics->size() + 1);
+            for (const auto &topic : *group.topics)
+            {
+                response.writeString(topic.name);
+                response.writeUnsignedVarint(topic.partitions.size() + 1);
+                for (int32_t partition : topic.partitions)
+                {
+                    write_partition(response, partition, offset_store->fetch(group.group_id, topic.name, partition).value_or(OffsetStore::CommittedOffset{}));
+                }
+                response.writeInt8(0); // topic tagged fields
+            }
+        }
+        else
+        {
+            // Every committed offset of the group, which fetch_all orders by topic.
+            auto commits = offset_store->fetch_all(group.group_id);
+            std::size_t topic_count = 0;
+            for (std::size_t i = 0; i < commits.size(); ++i)
+            {
+                topic_count += i == 0 || commits[i].topic != commits[i - 1].topic;
+            }
+            response.writeUnsignedVarint(topic_count + 1);
+            for (std::size_t begin = 0; begin < commits.size();)
+            {
+                std::size_t end = begin;
+                while (end < commits.size() && commits[end].topic == commits[begin].topic)
+                {
+                    ++end;
+                }
+                response.writeString(commits[begin].topic);
+                response.writeUnsignedVarint(end - begin + 1);
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    write_partition(response, commits[i].partition, commits[i].offset);
+                }
+                response.writeInt8(0); // topic tagged fields
+                begin = end;
+            }
+        }
+        response.writeInt16(0); // group error_code
+        response.writeInt8(0);  // group tagged fields
+    }
+    response.writeInt8(0); // Final tag buffer
+
+    return response;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "api/IApiHandler.hpp"
+#include <memory>
+
+class OffsetStore;
+
+// OffsetFetch (v8+): answers from the in-memory offsets, without touching the disk.
+class OffsetFetchHandler : public IApiHandler
+{
+public:
+    explicit OffsetFetchHandler(std::shared_ptr<OffsetStore> offset_store);
+
+    kafka::protocol::Response handle(const kafka::protocol::Request &request) override;
+
+private:
+    std::shared_ptr<OffsetStore> offset_store;
+};
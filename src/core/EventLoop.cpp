@@ -0,0 +1,166 @@
+#include "core/EventLoop.hpp"
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+EventLoop::EventLoop()
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+    {
+        throw std::runtime_error("Failed to create epoll instance");
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0)
+    {
+        close(epoll_fd);
+        throw std::runtime_error("Failed to create eventfd");
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+}
+
+EventLoop::~EventLoop()
+{
+    close(wake_fd);
+    close(epoll_fd);
+}
+
+void EventLoop::add(int fd, uint32_t events, FdCallback callback)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        throw std::runtime_error("epoll_ctl ADD failed");
+    }
+    callbacks[fd] = std::make_shared<FdCallback>(std::move(callback));
+}
+
+void EventLoop::modify(int fd, uint32_t events)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) != 0)
+    {
+        throw std::runtime_error("epoll_ctl MOD failed");
+    }
+}
+
+void EventLoop::remove(int fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    callbacks.erase(fd);
+}
+
+void EventLoop::post(std::function<void()> fn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        posted.push_back(std::move(fn));
+    }
+    wake();
+}
+
+void EventLoop::run_after(std::chrono::milliseconds delay, std::function<void()> fn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.push(Timer{Clock::now() + delay, timer_sequence++, std::move(fn)});
+    }
+    wake();
+}
+
+void EventLoop::stop()
+{
+    stopping.store(true, std::memory_order_release);
+    wake();
+}
+
+void EventLoop::wake()
+{
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t n = write(wake_fd, &one, sizeof(one));
+}
+
+int EventLoop::next_timeout_ms()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!posted.empty())
+    {
+        return 0;
+    }
+    if (timers.empty())
+    {
+        return -1;
+    }
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(timers.top().deadline - Clock::now());
+    return remaining.count() > 0 ? static_cast<int>(remaining.count()) : 0;
+}
+
+void EventLoop::run_posted()
+{
+    std::vector<std::function<void()>> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(posted);
+    }
+    for (auto &fn : batch)
+    {
+        fn();
+    }
+}
+
+void EventLoop::run_due_timers()
+{
+    auto now = Clock::now();
+    while (true)
+    {
+        std::function<void()> fn;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (timers.empty() || timers.top().deadline > now)
+            {
+                return;
+            }
+            fn = std::move(const_cast<Timer &>(timers.top()).fn);
+            timers.pop();
+        }
+        fn();
+    }
+}
+
+void EventLoop::run()
+{
+    constexpr int kMaxEvents = 256;
+    epoll_event events[kMaxEvents];
+
+    while (!stopping.load(std::memory_order_acquire))
+    {
+        int n = epoll_wait(epoll_fd, events, kMaxEvents, next_timeout_ms());
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == wake_fd)
+            {
+                uint64_t count;
+                [[maybe_unused]] ssize_t r = read(wake_fd, &count, sizeof(count));
+                continue;
+            }
+            auto it = callbacks.find(fd);
+            if (it != callbacks.end())
+            {
+                auto callback = it->second;
+                (*callback)(events[i].events);
+            }
+        }
+        run_posted();
+        run_due_timers();
+    }
+}
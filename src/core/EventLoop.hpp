@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A single-threaded epoll loop for sockets, timers and cross-thread work.
+ *
+ * File descriptors are registered with a callback that receives the ready epoll
+ * events. Registration must happen on the loop thread; other threads hand work to
+ * the loop with post(), which wakes it through an eventfd. Timers fire on the loop
+ * thread in deadline order.
+ */
+class EventLoop
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using FdCallback = std::function<void(uint32_t events)>;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // Loop thread only.
+    void add(int fd, uint32_t events, FdCallback callback);
+    void modify(int fd, uint32_t events);
+    void remove(int fd);
+
+    // Any thread.
+    void post(std::function<void()> fn);
+    void run_after(std::chrono::milliseconds delay, std::function<void()> fn);
+
+    // `co_await loop.sleep_for(d)` resumes the coroutine on the loop thread after `d`.
+    auto sleep_for(std::chrono::milliseconds delay)
+    {
+        struct Awaiter
+        {
+            EventLoop &loop;
+            std::chrono::milliseconds delay;
+
+            bool await_ready() const noexcept { return delay.count() <= 0; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                loop.run_after(delay, [handle]
+                               { handle.resume(); });
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, delay};
+    }
+
+    // Runs until stop() is called.
+    void run();
+    void stop();
+
+private:
+    struct Timer
+    {
+        Clock::time_point deadline;
+        uint64_t sequence; // Keeps timers with equal deadlines in FIFO order
+        std::function<void()> fn;
+
+        bool operator>(const Timer &other) const
+        {
+            return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+        }
+    };
+
+    void wake();
+    int next_timeout_ms();
+    void run_posted();
+    void run_due_timers();
+
+    int epoll_fd;
+    int wake_fd;
+    std::atomic<bool> stopping{false};
+
+    // Shared so a callback that removes its own fd stays alive while it runs.
+    std::unordered_map<int, std::shared_ptr<FdCallback>> callbacks;
+
+    std::mutex mutex; // Guards posted and timers
+    std::vector<std::function<void()>> posted;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    uint64_t timer_sequence = 0;
+};
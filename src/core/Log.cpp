@@ -0,0 +1,326 @@
+#include "core/Log.hpp"
+#include "core/SpscQueue.hpp"
+#include <cerrno>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using logging::Level;
+    using logging::Record;
+
+    struct ThreadRing
+    {
+        ThreadRing(std::size_t capacity, uint32_t id) : queue(capacity), id(id) {}
+
+        SpscQueue<Record> queue;
+        std::atomic<uint64_t> dropped{0}; // Records lost to a full ring
+        std::atomic<bool> abandoned{false}; // Owner exited; removed once drained
+        uint32_t id;
+    };
+
+    std::atomic<Level> min_level{Level::Info};
+    std::atomic<int> sink_fd{STDOUT_FILENO};
+    std::atomic<bool> running{false};
+
+    std::mutex registry_mutex; // Guards rings, options and next_ring_id
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    logging::Options options;
+    uint32_t next_ring_id = 0;
+
+    std::mutex drainer_mutex; // Serializes start() and stop()
+    std::jthread drainer;
+
+    // The calling thread's ring, claimed on its first record while the logger runs.
+    struct ThreadLocalRing
+    {
+        std::shared_ptr<ThreadRing> ring;
+
+        ~ThreadLocalRing()
+        {
+            if (ring)
+            {
+                ring->abandoned.store(true, std::memory_order_release);
+            }
+        }
+
+        ThreadRing &get()
+        {
+            if (!ring)
+            {
+                std::lock_guard<std::mutex> lock(registry_mutex);
+                ring = std::make_shared<ThreadRing>(options.ring_capacity, next_ring_id++);
+                rings.push_back(ring);
+            }
+            return *ring;
+        }
+    };
+
+    thread_local ThreadLocalRing this_ring;
+    thread_local uint32_t this_thread_sync_id = 0; // For lines written synchronously
+
+    const char *level_name(Level level)
+    {
+        switch (level)
+        {
+        case Level::Debug:
+            return "DEBUG";
+        case Level::Info:
+            return "INFO ";
+        case Level::Warn:
+            return "WARN ";
+        case Level::Error:
+            return "ERROR";
+        }
+        return "?    ";
+    }
+
+    // Appends "2026-01-31T12:34:56.123456Z".
+    void append_timestamp(std::string &out, int64_t timestamp_ns)
+    {
+        std::time_t seconds = static_cast<std::time_t>(timestamp_ns / 1000000000);
+        std::tm utc{};
+        gmtime_r(&seconds, &utc);
+        char buffer[40];
+        std::size_t n = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+        n += static_cast<std::size_t>(std::snprintf(buffer + n, sizeof(buffer) - n, ".%06lldZ", static_cast<long long>(timestamp_ns % 1000000000 / 1000)));
+        out.append(buffer, n);
+    }
+
+    void render_line(std::string &out, const Record &record, uint32_t thread_id)
+    {
+        append_timestamp(out, record.timestamp_ns);
+        out.push_back(' ');
+        out.append(level_name(record.level));
+        out.append(" [t");
+        logging::append(out, thread_id);
+        out.append("] ");
+        record.render(out, record);
+        if (record.suppressed != 0)
+        {
+            out.append(" (");
+            logging::append(out, record.suppressed);
+            out.append(" similar lines suppressed)");
+        }
+        out.push_back('\n');
+    }
+
+    void write_all(const std::string &text)
+    {
+        int fd = sink_fd.load(std::memory_order_relaxed);
+        std::size_t written = 0;
+        while (written < text.size())
+        {
+            ssize_t n = ::write(fd, text.data() + written, text.size() - written);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return;
+            }
+            written += static_cast<std::size_t>(n);
+        }
+    }
+
+    // Empties every ring, writes the records in timestamp order and drops rings whose threads exited.
+    void drain_once(std::vector<std::pair<Record, uint32_t>> &batch, std::string &text)
+    {
+        std::vector<std::shared_ptr<ThreadRing>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            snapshot = rings;
+        }
+
+        batch.clear();
+        text.clear();
+        std::vector<std::shared_ptr<ThreadRing>> finished;
+        for (const auto &ring : snapshot)
+        {
+            // Read before draining, so a record pushed just before exit isn't left behind.
+            bool abandoned = ring->abandoned.load(std::memory_order_acquire);
+            Record record;
+            while (ring->queue.try_pop(record))
+            {
+                batch.emplace_back(record, ring->id);
+            }
+            if (uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed))
+            {
+                Record notice{};
+                notice.level = Level::Warn;
+                notice.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+                notice.format = "Log ring full, dropped {} records";
+                new (notice.args) std::tuple<uint64_t>(dropped);
+                notice.render = [](std::string &out, const Record &r)
+                {
+                    logging::render_args(out, r.format, *std::launder(reinterpret_cast<const std::tuple<uint64_t> *>(r.args)), std::index_sequence<0>{});
+                };
+                batch.emplace_back(notice, ring->id);
+            }
+            if (abandoned)
+            {
+                finished.push_back(ring);
+            }
+        }
+
+        std::stable_sort(batch.begin(), batch.end(), [](const auto &a, const auto &b)
+                         { return a.first.timestamp_ns < b.first.timestamp_ns; });
+        for (const auto &[record, id] : batch)
+        {
+            render_line(text, record, id);
+        }
+        write_all(text);
+
+        if (!finished.empty())
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            std::erase_if(rings, [&](const auto &ring)
+                          { return std::find(finished.begin(), finished.end(), ring) != finished.end(); });
+        }
+    }
+
+    void drain_loop(std::stop_token stop, std::chrono::milliseconds interval)
+    {
+        std::vector<std::pair<Record, uint32_t>> batch;
+        std::string text;
+        std::mutex sleep_mutex;
+        std::condition_variable_any sleep_cv;
+        while (!stop.stop_requested())
+        {
+            drain_once(batch, text);
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait_for(lock, stop, interval, []
+                              { return false; });
+        }
+        drain_once(batch, text);
+    }
+}
+
+namespace logging
+{
+    void start(Options new_options)
+    {
+        std::lock_guard<std::mutex> guard(drainer_mutex);
+        if (running.load())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            options = new_options;
+        }
+        min_level.store(new_options.level, std::memory_order_relaxed);
+        sink_fd.store(new_options.fd, std::memory_order_relaxed);
+        drainer = std::jthread([interval = new_options.drain_interval](std::stop_token stop)
+                               { drain_loop(stop, interval); });
+        running.store(true, std::memory_order_release);
+    }
+
+    void stop()
+    {
+        std::lock_guard<std::mutex> guard(drainer_mutex);
+        if (!running.exchange(false))
+        {
+            return;
+        }
+        drainer.request_stop();
+        drainer.join();
+    }
+
+    void set_level(Level level)
+    {
+        min_level.store(level, std::memory_order_relaxed);
+    }
+
+    bool enabled(Level level)
+    {
+        return level >= min_level.load(std::memory_order_relaxed);
+    }
+
+    void append(std::string &out, const StringArg &value)
+    {
+        out.append(value.data, value.size);
+    }
+
+    void append(std::string &out, bool value)
+    {
+        out.append(value ? "true" : "false");
+    }
+
+    void append(std::string &out, char value)
+    {
+        out.push_back(value);
+    }
+
+    void append(std::string &out, double value)
+    {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    const char *append_until_placeholder(std::string &out, const char *format)
+    {
+        const char *placeholder = std::strstr(format, "{}");
+        if (!placeholder)
+        {
+            out.append(format);
+            return format + std::strlen(format);
+        }
+        out.append(format, placeholder);
+        return placeholder + 2;
+    }
+
+    bool CallSite::admit(uint32_t &suppressed)
+    {
+        constexpr int64_t kInterval = 100'000'000; // 10 lines per second
+        constexpr int64_t kBurst = 20;
+
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t due = this->allowed_at.load(std::memory_order_relaxed);
+        while (true)
+        {
+            int64_t base = std::max(due, now);
+            if (base - now > kBurst * kInterval)
+            {
+                this->dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (this->allowed_at.compare_exchange_weak(due, base + kInterval, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        suppressed = this->dropped.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    void submit(const Record &record)
+    {
+        if (running.load(std::memory_order_acquire))
+        {
+            ThreadRing &ring = this_ring.get();
+            Record copy = record;
+            if (!ring.queue.try_push(std::move(copy)))
+            {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            return;
+        }
+
+        if (this_thread_sync_id == 0)
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            this_thread_sync_id = ++next_ring_id;
+        }
+        std::string line;
+        render_line(line, record, this_thread_sync_id);
+        write_all(line);
+    }
+
+} // namespace logging
@@ -0,0 +1,183 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unistd.h>
+
+/**
+ * @brief An asynchronous, levelled logger that keeps formatting and I/O off the
+ * calling thread.
+ *
+ * Each thread appends fixed-size records to its own lock-free ring. A record holds
+ * the format string, a copy of the arguments and a pointer to the function that
+ * renders them, so the caller only pays for copying its arguments. A background
+ * thread drains every ring, renders the records in timestamp order and writes each
+ * pass with a single write(). When a ring is full the record is dropped and counted
+ * rather than blocking the caller.
+ *
+ * Formats use "{}" placeholders, filled in order. Strings are copied and truncated
+ * at kMaxStringArg bytes. Each LOG_* call site is rate limited on its own; lines it
+ * suppresses are counted on the next line it emits.
+ *
+ * Until start() is called, and after stop(), records are rendered and written on the
+ * calling thread, so code that logs works in tools and benchmarks too.
+ */
+namespace logging
+{
+    enum class Level : uint8_t
+    {
+        Debug,
+        Info,
+        Warn,
+        Error,
+    };
+
+    struct Options
+    {
+        Level level = Level::Info;
+        int fd = STDOUT_FILENO;
+        std::chrono::milliseconds drain_interval{20};
+        std::size_t ring_capacity = 256; // Records buffered per thread
+    };
+
+    void start(Options options);
+    // Drains everything still buffered and returns to writing synchronously.
+    void stop();
+
+    void set_level(Level level);
+    bool enabled(Level level);
+
+    constexpr std::size_t kMaxStringArg = 120;
+    constexpr std::size_t kArgBytes = 256;
+
+    // A string argument, copied so the caller's buffer may go away before the drain.
+    struct StringArg
+    {
+        uint8_t size;
+        char data[kMaxStringArg];
+
+        explicit StringArg(std::string_view s) : size(static_cast<uint8_t>(std::min(s.size(), kMaxStringArg)))
+        {
+            std::memcpy(data, s.data(), size);
+        }
+    };
+
+    // How each argument type is stored in a record.
+    template <typename T>
+    auto stored(const T &value)
+    {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool> || std::is_same_v<U, char> || std::is_arithmetic_v<U>)
+        {
+            return value;
+        }
+        else if constexpr (std::is_enum_v<U>)
+        {
+            return static_cast<std::underlying_type_t<U>>(value);
+        }
+        else
+        {
+            return StringArg(std::string_view(value));
+        }
+    }
+
+    void append(std::string &out, const StringArg &value);
+    void append(std::string &out, bool value);
+    void append(std::string &out, char value);
+    void append(std::string &out, double value);
+
+    template <typename T>
+        requires std::is_integral_v<T>
+    void append(std::string &out, T value)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    inline void append(std::string &out, float value) { append(out, static_cast<double>(value)); }
+
+    // Copies `format` up to the next "{}" and returns what follows it.
+    const char *append_until_placeholder(std::string &out, const char *format);
+
+    template <typename Tuple, std::size_t... I>
+    void render_args(std::string &out, const char *format, const Tuple &args, std::index_sequence<I...>)
+    {
+        ((format = append_until_placeholder(out, format), append(out, std::get<I>(args))), ...);
+        out.append(format);
+    }
+
+    struct Record
+    {
+        Level level;
+        int64_t timestamp_ns; // Since the Unix epoch
+        uint32_t suppressed;  // Lines this call site dropped since its last one
+        const char *format;
+        void (*render)(std::string &out, const Record &record);
+        alignas(std::max_align_t) unsigned char args[kArgBytes];
+    };
+
+    // Rate limit of one call site: a burst of 20 lines, then 10 per second.
+    class CallSite
+    {
+    public:
+        // Returns false if the line should be dropped; otherwise how many were dropped before it.
+        bool admit(uint32_t &suppressed);
+
+    private:
+        std::atomic<int64_t> allowed_at{0}; // Theoretical arrival time of the next line, ns
+        std::atomic<uint32_t> dropped{0};
+    };
+
+    void submit(const Record &record);
+
+    template <typename... Args>
+    void write(CallSite &site, Level level, const char *format, const Args &...args)
+    {
+        if (!enabled(level))
+        {
+            return;
+        }
+        Record record;
+        if (!site.admit(record.suppressed))
+        {
+            return;
+        }
+
+        using Stored = std::tuple<decltype(stored(args))...>;
+        static_assert(sizeof(Stored) <= kArgBytes, "Too many or too large log arguments");
+        static_assert((std::is_trivially_copyable_v<decltype(stored(args))> && ...), "Log arguments must be copyable into a record");
+
+        record.level = level;
+        record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        record.format = format;
+        new (record.args) Stored(stored(args)...);
+        record.render = [](std::string &out, const Record &r)
+        {
+            render_args(out, r.format, *std::launder(reinterpret_cast<const Stored *>(r.args)), std::index_sequence_for<Args...>{});
+        };
+        submit(record);
+    }
+
+} // namespace logging
+
+#define MINIKAFKA_LOG(level, ...)                                   \
+    do                                                              \
+    {                                                               \
+        static ::logging::CallSite minikafka_log_site;              \
+        ::logging::write(minikafka_log_site, level, __VA_ARGS__);   \
+    } while (0)
+
+#define LOG_DEBUG(...) MINIKAFKA_LOG(::logging::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) MINIKAFKA_LOG(::logging::Level::Info, __VA_ARGS__)
+#define LOG_WARN(...) MINIKAFKA_LOG(::logging::Level::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) MINIKAFKA_LOG(::logging::Level::Error, __VA_ARGS__)
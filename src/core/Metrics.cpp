@@ -0,0 +1,352 @@
+#include "core/Metrics.hpp"
+#include <bit>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    using metrics::LatencyHistogram;
+
+    // Single writer: the owning thread. A plain load and store avoids a locked instruction.
+    void bump(std::atomic<uint64_t> &counter, uint64_t by = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    struct ApiCounters
+    {
+        std::array<std::atomic<uint64_t>, metrics::kMaxApiVersion> requests{};
+        std::array<std::atomic<uint64_t>, metrics::kMaxApiVersion> failed{};
+        LatencyHistogram latency;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::atomic<bool> in_use{false};
+        std::array<LatencyHistogram, metrics::kPhases> phases;
+        // Allocated by the owner on first use of each key, read by render().
+        std::array<std::atomic<ApiCounters *>, metrics::kMaxApiKey> apis{};
+
+        ~Shard()
+        {
+            for (auto &api : apis)
+            {
+                delete api.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<std::pair<std::string, std::function<void(std::ostream &)>>> sources;
+
+    // Claims a shard for the lifetime of the calling thread.
+    struct ThreadShard
+    {
+        Shard *shard = nullptr;
+
+        ~ThreadShard()
+        {
+            if (shard)
+            {
+                shard->in_use.store(false, std::memory_order_release);
+            }
+        }
+
+        Shard &get()
+        {
+            if (shard)
+            {
+                return *shard;
+            }
+
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            for (auto &candidate : shards)
+            {
+                bool expected = false;
+                if (candidate->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                {
+                    shard = candidate.get();
+                    return *shard;
+                }
+            }
+            shards.push_back(std::make_unique<Shard>());
+            shard = shards.back().get();
+            shard->in_use.store(true, std::memory_order_relaxed);
+            return *shard;
+        }
+    };
+
+    thread_local ThreadShard this_shard;
+
+    constexpr const char *kPhaseNames[metrics::kPhases] = {"read", "parse", "route", "handle", "serialize", "send"};
+    constexpr double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    uint64_t to_ns(std::chrono::steady_clock::duration elapsed)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        return ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    }
+
+    void write_summary(std::ostream &out, const std::string &name, const std::string &labels, const metrics::HistogramSummary &summary)
+    {
+        out << name << "_count{" << labels << "} " << summary.total << '\n';
+        out << name << "_sum_ns{" << labels << "} " << summary.sum_ns << '\n';
+        for (double q : kQuantiles)
+        {
+            out << name << "_ns{" << labels << ",quantile=\"" << q << "\"} " << summary.quantile(q) << '\n';
+        }
+        out << name << "_ns{" << labels << ",quantile=\"max\"} " << summary.max_ns << '\n';
+    }
+
+    int dump_pipe[2] = {-1, -1};
+
+    void on_dump_signal(int)
+    {
+        int saved_errno = errno;
+        char byte = 1;
+        ssize_t written = write(dump_pipe[1], &byte, 1); // Non-blocking; a full pipe already has a dump pending
+        (void)written;
+        errno = saved_errno;
+    }
+}
+
+namespace metrics
+{
+    std::size_t LatencyHistogram::bucket_of(uint64_t ns)
+    {
+        if (ns < kSubBuckets)
+        {
+            return static_cast<std::size_t>(ns);
+        }
+        std::size_t shift = static_cast<std::size_t>(63 - std::countl_zero(ns)) - 4;
+        if (shift > kMaxShift)
+        {
+            return kBuckets - 1;
+        }
+        std::size_t top = static_cast<std::size_t>(ns >> shift); // In [16, 32)
+        return kSubBuckets + shift * kSubBuckets + (top - kSubBuckets);
+    }
+
+    uint64_t LatencyHistogram::bucket_upper(std::size_t bucket)
+    {
+        if (bucket < kSubBuckets)
+        {
+            return bucket;
+        }
+        std::size_t shift = (bucket - kSubBuckets) / kSubBuckets;
+        uint64_t top = kSubBuckets + (bucket - kSubBuckets) % kSubBuckets;
+        return ((top + 1) << shift) - 1;
+    }
+
+    void LatencyHistogram::record(uint64_t ns)
+    {
+        bump(this->counts[bucket_of(ns)]);
+        bump(this->total);
+        bump(this->sum_ns, ns);
+        if (ns > this->max_ns.load(std::memory_order_relaxed))
+        {
+            this->max_ns.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    void HistogramSummary::add(const LatencyHistogram &histogram)
+    {
+        for (std::size_t i = 0; i < LatencyHistogram::kBuckets; ++i)
+        {
+            this->counts[i] += histogram.counts[i].load(std::memory_order_relaxed);
+        }
+        this->total += histogram.total.load(std::memory_order_relaxed);
+        this->sum_ns += histogram.sum_ns.load(std::memory_order_relaxed);
+        this->max_ns = std::max(this->max_ns, histogram.max_ns.load(std::memory_order_relaxed));
+    }
+
+    uint64_t HistogramSummary::quantile(double q) const
+    {
+        uint64_t counted = 0;
+        for (uint64_t count : this->counts)
+        {
+            counted += count;
+        }
+        if (counted == 0)
+        {
+            return 0;
+        }
+
+        // Rank of the quantile among the recorded values, 1-based.
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(counted) + 0.5));
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < LatencyHistogram::kBuckets; ++i)
+        {
+            seen += this->counts[i];
+            if (seen >= rank)
+            {
+                return std::min(LatencyHistogram::bucket_upper(i), this->max_ns);
+            }
+        }
+        return this->max_ns;
+    }
+
+    void record_phase(Phase phase, std::chrono::steady_clock::duration elapsed)
+    {
+        this_shard.get().phases[static_cast<std::size_t>(phase)].record(to_ns(elapsed));
+    }
+
+    void record_request(int16_t api_key, int16_t api_version, bool failed, std::chrono::steady_clock::duration elapsed)
+    {
+        if (api_key < 0 || api_key >= kMaxApiKey)
+        {
+            return;
+        }
+
+        Shard &shard = this_shard.get();
+        ApiCounters *api = shard.apis[api_key].load(std::memory_order_relaxed);
+        if (!api)
+        {
+            api = new ApiCounters();
+            shard.apis[api_key].store(api, std::memory_order_release);
+        }
+
+        if (api_version >= 0 && api_version < kMaxApiVersion)
+        {
+            bump(api->requests[api_version]);
+            if (failed)
+            {
+                bump(api->failed[api_version]);
+            }
+        }
+        api->latency.record(to_ns(elapsed));
+    }
+
+    void add_source(std::string name, std::function<void(std::ostream &)> write)
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        sources.emplace_back(std::move(name), std::move(write));
+    }
+
+    void render(std::ostream &out)
+    {
+        std::array<HistogramSummary, kPhases> phases;
+        std::array<std::unique_ptr<HistogramSummary>, kMaxApiKey> api_latency;
+        std::array<std::array<uint64_t, kMaxApiVersion>, kMaxApiKey> requests{};
+        std::array<std::array<uint64_t, kMaxApiVersion>, kMaxApiKey> failed{};
+        std::vector<std::pair<std::string, std::function<void(std::ostream &)>>> extra;
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            for (const auto &shard : shards)
+            {
+                for (std::size_t p = 0; p < kPhases; ++p)
+                {
+                    phases[p].add(shard->phases[p]);
+                }
+                for (int16_t key = 0; key < kMaxApiKey; ++key)
+                {
+                    const ApiCounters *api = shard->apis[key].load(std::memory_order_acquire);
+                    if (!api)
+                    {
+                        continue;
+                    }
+                    if (!api_latency[key])
+                    {
+                        api_latency[key] = std::make_unique<HistogramSummary>();
+                    }
+                    api_latency[key]->add(api->latency);
+                    for (int16_t version = 0; version < kMaxApiVersion; ++version)
+                    {
+                        requests[key][version] += api->requests[version].load(std::memory_order_relaxed);
+                        failed[key][version] += api->failed[version].load(std::memory_order_relaxed);
+                    }
+                }
+            }
+            extra = sources;
+        }
+
+        out << "# Request phase latency\n";
+        for (std::size_t p = 0; p < kPhases; ++p)
+        {
+            write_summary(out, "phase", std::string("phase=\"") + kPhaseNames[p] + "\"", phases[p]);
+        }
+
+        out << "# Requests by API\n";
+        for (int16_t key = 0; key < kMaxApiKey; ++key)
+        {
+            if (!api_latency[key])
+            {
+                continue;
+            }
+            for (int16_t version = 0; version < kMaxApiVersion; ++version)
+            {
+                if (requests[key][version] == 0)
+                {
+                    continue;
+                }
+                std::string labels = "api_key=\"" + std::to_string(key) + "\",api_version=\"" + std::to_string(version) + "\"";
+                out << "requests_total{" << labels << "} " << requests[key][version] << '\n';
+                out << "request_failures_total{" << labels << "} " << failed[key][version] << '\n';
+            }
+            write_summary(out, "request_latency", "api_key=\"" + std::to_string(key) + "\"", *api_latency[key]);
+        }
+
+        for (const auto &[name, write] : extra)
+        {
+            out << "# " << name << '\n';
+            write(out);
+        }
+    }
+
+    void dump_on_signal(std::string path)
+    {
+        static std::once_flag installed;
+        std::call_once(installed, [&]
+                       {
+                           if (pipe2(dump_pipe, O_CLOEXEC) != 0)
+                           {
+                               throw std::runtime_error("metrics: failed to create dump pipe");
+                           }
+                           fcntl(dump_pipe[1], F_SETFL, O_NONBLOCK);
+
+                           // Lives for the rest of the process; the dump itself runs on this thread, not in the handler.
+                           std::thread([path = std::move(path)]
+                                       {
+                                           char byte;
+                                           while (true)
+                                           {
+                                               ssize_t n = read(dump_pipe[0], &byte, 1);
+                                               if (n < 0 && errno == EINTR)
+                                               {
+                                                   continue;
+                                               }
+                                               if (n <= 0)
+                                               {
+                                                   return;
+                                               }
+
+                                               std::string temp = path + ".tmp";
+                                               {
+                                                   std::ofstream out(temp, std::ios::trunc);
+                                                   render(out);
+                                               }
+                                               std::error_code ec;
+                                               std::filesystem::rename(temp, path, ec);
+                                           } })
+                               .detach();
+
+                           struct sigaction action{};
+                           action.sa_handler = on_dump_signal;
+                           sigemptyset(&action.sa_mask);
+                           action.sa_flags = SA_RESTART;
+                           sigaction(SIGUSR1, &action, nullptr);
+                       });
+    }
+
+} // namespace metrics
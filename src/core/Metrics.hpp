@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+/**
+ * @brief Request counters and latency histograms with no shared writes.
+ *
+ * Every thread records into its own shard, so recording is a few relaxed loads and
+ * stores to cache lines only that thread writes. Shards are claimed on a thread's
+ * first record and handed to the next new thread once it exits, keeping their
+ * counts. render() sums all shards on demand; it may observe a record half applied,
+ * which only skews a dump by that one record.
+ */
+namespace metrics
+{
+    // Stages of a request's trip through the server.
+    enum class Phase : uint8_t
+    {
+        Read,      // recv() calls for one readiness event
+        Parse,     // Decoding one request frame
+        Route,     // Dispatch until the handler starts, including pool queueing
+        Handle,    // Handler start until its response is ready, including awaits
+        Serialize, // Encoding one response
+        Send,      // send() calls for one flush
+    };
+    constexpr std::size_t kPhases = 6;
+
+    constexpr int16_t kMaxApiKey = 128;
+    constexpr int16_t kMaxApiVersion = 32;
+
+    // Log-linear buckets over nanoseconds: 16 per power of two, so any recorded
+    // value is within about 6% of its bucket's bounds. Values past ~18 minutes
+    // land in the last bucket.
+    class LatencyHistogram
+    {
+    public:
+        static constexpr std::size_t kSubBuckets = 16;
+        static constexpr std::size_t kMaxShift = 36;
+        static constexpr std::size_t kBuckets = kSubBuckets + (kMaxShift + 1) * kSubBuckets;
+
+        static std::size_t bucket_of(uint64_t ns);
+        // Largest value that falls into `bucket`.
+        static uint64_t bucket_upper(std::size_t bucket);
+
+        // Single writer only: the owning thread.
+        void record(uint64_t ns);
+
+        std::array<std::atomic<uint64_t>, kBuckets> counts{};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sum_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+    };
+
+    // Sum of any number of histograms, for reporting.
+    struct HistogramSummary
+    {
+        std::array<uint64_t, LatencyHistogram::kBuckets> counts{};
+        uint64_t total = 0;
+        uint64_t sum_ns = 0;
+        uint64_t max_ns = 0;
+
+        void add(const LatencyHistogram &histogram);
+        // Upper bound of the bucket holding the `q` quantile, 0 when empty.
+        uint64_t quantile(double q) const;
+    };
+
+    void record_phase(Phase phase, std::chrono::steady_clock::duration elapsed);
+
+    // Counts one completed request and its dispatch-to-response latency.
+    void record_request(int16_t api_key, int16_t api_version, bool failed, std::chrono::steady_clock::duration elapsed);
+
+    // Adds a section to every dump, for stats owned by other components.
+    void add_source(std::string name, std::function<void(std::ostream &)> write);
+
+    // Writes all counters, histograms and sources as plain `name{labels} value` lines.
+    void render(std::ostream &out);
+
+    // Rewrites `path` with render() each time the process receives SIGUSR1.
+    void dump_on_signal(std::string path);
+
+    // Times a scope into one phase.
+    class PhaseTimer
+    {
+    public:
+        explicit PhaseTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+        ~PhaseTimer() { record_phase(phase, std::chrono::steady_clock::now() - start); }
+
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    private:
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+    };
+
+} // namespace metrics
@@ -0,0 +1,98 @@
+#include "core/Rcu.hpp"
+#include <stdexcept>
+
+namespace
+{
+    constexpr std::size_t kMaxReaders = 512;
+
+    struct alignas(64) ReaderSlot
+    {
+        std::atomic<uint64_t> epoch{0}; // 0 means the owner is outside a read-side section
+        std::atomic<bool> in_use{false};
+    };
+
+    ReaderSlot slots[kMaxReaders];
+    std::atomic<std::size_t> slots_high_water{0};
+    std::atomic<uint64_t> global_epoch{1};
+
+    // Claims a reader slot for the lifetime of the calling thread.
+    struct ThreadReader
+    {
+        ReaderSlot *slot = nullptr;
+        int depth = 0;
+
+        ~ThreadReader()
+        {
+            if (slot)
+            {
+                slot->epoch.store(0, std::memory_order_release);
+                slot->in_use.store(false, std::memory_order_release);
+            }
+        }
+
+        ReaderSlot *acquire()
+        {
+            if (slot)
+            {
+                return slot;
+            }
+
+            for (std::size_t i = 0; i < kMaxReaders; ++i)
+            {
+                bool expected = false;
+                if (slots[i].in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                {
+                    std::size_t high = slots_high_water.load(std::memory_order_relaxed);
+                    while (high < i + 1 && !slots_high_water.compare_exchange_weak(high, i + 1))
+                    {
+                    }
+                    slot = &slots[i];
+                    return slot;
+                }
+            }
+            throw std::runtime_error("rcu: too many reader threads");
+        }
+    };
+
+    thread_local ThreadReader this_reader;
+}
+
+namespace rcu
+{
+    void read_lock()
+    {
+        if (this_reader.depth++ == 0)
+        {
+            ReaderSlot *slot = this_reader.acquire();
+            slot->epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+    }
+
+    void read_unlock()
+    {
+        if (--this_reader.depth == 0)
+        {
+            this_reader.slot->epoch.store(0, std::memory_order_release);
+        }
+    }
+
+    uint64_t advance_epoch()
+    {
+        return global_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    }
+
+    bool is_quiescent(uint64_t epoch)
+    {
+        std::size_t high = slots_high_water.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < high; ++i)
+        {
+            uint64_t reader_epoch = slots[i].epoch.load(std::memory_order_seq_cst);
+            if (reader_epoch != 0 && reader_epoch < epoch)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+} // namespace rcu
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A minimal epoch-based RCU for read-mostly shared state.
+ *
+ * Readers enter a read-side section by publishing the current global epoch in a
+ * per-thread slot. That is a single store to a cache line owned by the thread, so
+ * readers never take a lock or contend on a shared counter. Writers swap in a new
+ * object and retire the old one; it is only freed once no reader that could still
+ * be holding it remains inside a read-side section.
+ *
+ * Read-side sections may nest on the same thread, but must not span a coroutine
+ * suspension point since they are bound to the current thread.
+ */
+namespace rcu
+{
+    void read_lock();
+    void read_unlock();
+
+    // Advances the global epoch and returns the new value.
+    uint64_t advance_epoch();
+
+    // True once no reader that entered before `epoch` is still inside a read-side section.
+    bool is_quiescent(uint64_t epoch);
+
+    template <typename T>
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const std::atomic<const T *> &source)
+        {
+            read_lock();
+            ptr = source.load(std::memory_order_seq_cst);
+        }
+
+        ReadGuard(ReadGuard &&other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+        ReadGuard &operator=(ReadGuard &&) = delete;
+
+        ~ReadGuard()
+        {
+            if (ptr)
+            {
+                read_unlock();
+            }
+        }
+
+        const T *get() const { return ptr; }
+        const T *operator->() const { return ptr; }
+        const T &operator*() const { return *ptr; }
+
+    private:
+        const T *ptr;
+    };
+
+    template <typename T>
+    class Cell
+    {
+    public:
+        explicit Cell(std::unique_ptr<const T> initial) : current(initial.release()) {}
+
+        ~Cell()
+        {
+            delete current.load();
+        }
+
+        Cell(const Cell &) = delete;
+        Cell &operator=(const Cell &) = delete;
+
+        ReadGuard<T> read() const
+        {
+            return ReadGuard<T>(current);
+        }
+
+        // Writers must be serialized by the caller.
+        const T *writer_view() const
+        {
+            return current.load(std::memory_order_acquire);
+        }
+
+        // Writers must be serialized by the caller.
+        void publish(std::unique_ptr<const T> next)
+        {
+            const T *old = current.exchange(next.release(), std::memory_order_seq_cst);
+            retired.emplace_back(advance_epoch(), std::unique_ptr<const T>(old));
+            reclaim();
+        }
+
+        // Frees retired objects that no reader can still observe.
+        void reclaim()
+        {
+            std::erase_if(retired, [](const auto &entry)
+                          { return is_quiescent(entry.first); });
+        }
+
+    private:
+        std::atomic<const T *> current;
+        std::vector<std::pair<uint64_t, std::unique_ptr<const T>>> retired;
+    };
+
+} // namespace rcu
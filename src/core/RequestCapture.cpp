@@ -0,0 +1,176 @@
+#include "core/RequestCapture.hpp"
+#include "core/Log.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::size_t kEntryHeader = 8 + 4 + 4;
+    constexpr auto kFlushInterval = std::chrono::seconds(1); // Partial buffers are written at least this often
+
+    void write_all(int fd, const std::vector<char> &bytes)
+    {
+        std::size_t written = 0;
+        while (written < bytes.size())
+        {
+            ssize_t n = ::write(fd, bytes.data() + written, bytes.size() - written);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                LOG_ERROR("Failed to write request capture: {}", std::strerror(errno));
+                return;
+            }
+            written += static_cast<std::size_t>(n);
+        }
+    }
+}
+
+RequestCapture::RequestCapture(Options options) : options(std::move(options))
+{
+    this->fd = ::open(this->options.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (this->fd < 0)
+    {
+        throw std::runtime_error("Failed to open request capture " + this->options.path + ": " + std::strerror(errno));
+    }
+    this->buffer.reserve(this->options.buffer_bytes);
+    this->buffer.insert(this->buffer.end(), std::begin(kMagic), std::end(kMagic));
+    this->writer = std::jthread([this](std::stop_token stop)
+                                { writer_loop(stop); });
+}
+
+RequestCapture::~RequestCapture()
+{
+    this->writer.request_stop();
+    this->writer.join();
+    close(this->fd);
+}
+
+void RequestCapture::record_frame(uint32_t connection_id, const char *frame, std::size_t size)
+{
+    append(connection_id, static_cast<int32_t>(size), frame);
+}
+
+void RequestCapture::record_close(uint32_t connection_id)
+{
+    append(connection_id, -1, nullptr);
+}
+
+void RequestCapture::append(uint32_t connection_id, int32_t size, const char *frame)
+{
+    std::size_t payload = size > 0 ? static_cast<std::size_t>(size) : 0;
+    int64_t offset_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->started).count();
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->full)
+    {
+        return;
+    }
+    if (this->captured_bytes + kEntryHeader + payload > this->options.max_bytes)
+    {
+        this->full = true;
+        LOG_WARN("Request capture {} reached {} bytes, recording stopped", this->options.path, this->captured_bytes);
+        return;
+    }
+    this->captured_bytes += kEntryHeader + payload;
+
+    char header[kEntryHeader];
+    uint64_t offset_be = htobe64(static_cast<uint64_t>(offset_ns));
+    uint32_t connection_be = htonl(connection_id);
+    uint32_t size_be = htonl(static_cast<uint32_t>(size));
+    std::memcpy(header, &offset_be, 8);
+    std::memcpy(header + 8, &connection_be, 4);
+    std::memcpy(header + 12, &size_be, 4);
+    this->buffer.insert(this->buffer.end(), header, header + kEntryHeader);
+    this->buffer.insert(this->buffer.end(), frame, frame + payload);
+
+    if (this->buffer.size() >= this->options.buffer_bytes)
+    {
+        this->ready.push_back(std::move(this->buffer));
+        this->buffer = std::vector<char>();
+        this->buffer.reserve(this->options.buffer_bytes);
+        this->ready_cv.notify_one();
+    }
+}
+
+void RequestCapture::writer_loop(std::stop_token stop)
+{
+    while (true)
+    {
+        std::vector<std::vector<char>> pending;
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->ready_cv.wait_for(lock, stop, kFlushInterval, [this]
+                                    { return !this->ready.empty(); });
+            stopping = stop.stop_requested();
+            pending.swap(this->ready);
+            if (pending.empty() || stopping)
+            {
+                pending.push_back(std::move(this->buffer));
+                this->buffer = std::vector<char>();
+            }
+        }
+        for (const auto &bytes : pending)
+        {
+            write_all(this->fd, bytes);
+        }
+        if (stopping)
+        {
+            return;
+        }
+    }
+}
+
+std::vector<RequestCapture::Entry> RequestCapture::read(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open request capture " + path);
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(kMagic) || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0)
+    {
+        throw std::runtime_error(path + " is not a request capture");
+    }
+
+    std::vector<Entry> entries;
+    std::size_t pos = sizeof(kMagic);
+    while (pos + kEntryHeader <= bytes.size())
+    {
+        uint64_t offset_be;
+        uint32_t connection_be;
+        uint32_t size_be;
+        std::memcpy(&offset_be, bytes.data() + pos, 8);
+        std::memcpy(&connection_be, bytes.data() + pos + 8, 4);
+        std::memcpy(&size_be, bytes.data() + pos + 12, 4);
+        pos += kEntryHeader;
+
+        Entry entry;
+        entry.offset_ns = static_cast<int64_t>(be64toh(offset_be));
+        entry.connection_id = ntohl(connection_be);
+        int32_t size = static_cast<int32_t>(ntohl(size_be));
+        entry.closed = size < 0;
+        if (size > 0)
+        {
+            if (bytes.size() - pos < static_cast<std::size_t>(size))
+            {
+                break; // Truncated by a crash mid-write
+            }
+            entry.frame.assign(bytes.begin() + pos, bytes.begin() + pos + size);
+            pos += static_cast<std::size_t>(size);
+        }
+        entries.push_back(std::move(entry));
+    }
+    return entries;
+}
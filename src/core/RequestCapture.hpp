@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Records the request frames clients send, for replaying the traffic later.
+ *
+ * A capture file starts with an 8-byte magic, followed by one entry per event:
+ * the nanoseconds since the capture started (int64), the connection id (uint32)
+ * and the frame size (int32), all big-endian, then the frame without its size
+ * prefix. A size of -1 marks the connection closing.
+ *
+ * Entries are appended to a buffer on the recording thread and written by a
+ * background thread, so recording doesn't add disk writes to the event loop.
+ * Recording stops once `max_bytes` have been captured.
+ */
+class RequestCapture
+{
+public:
+    struct Options
+    {
+        std::string path;
+        uint64_t max_bytes = 1ull << 30;
+        std::size_t buffer_bytes = 1 << 20; // Handed to the writer when full
+    };
+
+    struct Entry
+    {
+        int64_t offset_ns;
+        uint32_t connection_id;
+        bool closed; // The connection closed; `frame` is empty
+        std::vector<char> frame;
+    };
+
+    static constexpr char kMagic[8] = {'M', 'K', 'C', 'A', 'P', '0', '0', '1'};
+
+    explicit RequestCapture(Options options);
+    ~RequestCapture();
+
+    RequestCapture(const RequestCapture &) = delete;
+    RequestCapture &operator=(const RequestCapture &) = delete;
+
+    void record_frame(uint32_t connection_id, const char *frame, std::size_t size);
+    void record_close(uint32_t connection_id);
+
+    // Reads a whole capture file, in recording order.
+    static std::vector<Entry> read(const std::string &path);
+
+private:
+    void append(uint32_t connection_id, int32_t size, const char *frame);
+    void writer_loop(std::stop_token stop);
+
+    Options options;
+    int fd;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    uint64_t captured_bytes = 0;
+    bool full = false;
+
+    std::mutex mutex; // Guards buffer, ready and the cv wait
+    std::condition_variable_any ready_cv;
+    std::vector<char> buffer;
+    std::vector<std::vector<char>> ready; // Full buffers waiting for the writer
+    std::jthread writer;
+};
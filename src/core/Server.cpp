@@ -1,17 +1,337 @@
 #include "core/Server.hpp"
+#include "core/Log.hpp"
+#include "core/Metrics.hpp"
 #include "protocol/Protocol.hpp"
-#include <iostream>
 #include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <vector>
 
-// Forward declaration for the connection handler
-void handle_connection(int client_fd, std::shared_ptr<ApiRouter> router);
+// One client socket, driven by the server's event loop. Requests are parsed on the
+// loop thread and run as tasks on the thread pool; their responses are posted back
+// and written in request order, since Kafka clients match responses by position.
+// Reading pauses while too many requests or response bytes are outstanding, so one
+// client can't queue unbounded work or memory.
+class ClientConnection : public std::enable_shared_from_this<ClientConnection>
+{
+public:
+    ClientConnection(int fd, uint32_t id, EventLoop &loop, std::shared_ptr<ThreadPool> pool, std::shared_ptr<ApiRouter> router,
+                     std::shared_ptr<RequestCapture> capture, std::function<void(int)> on_close)
+        : fd(fd), id(id), loop(loop), pool(std::move(pool)), router(std::move(router)), capture(std::move(capture)),
+          on_close(std::move(on_close)) {}
+
+    ~ClientConnection()
+    {
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+
+    void on_events(uint32_t events)
+    {
+        auto self = shared_from_this(); // Closing drops the server's reference
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            // Requests that arrived before the peer went away still run, though their
+            // responses can't be delivered. The loop keeps reporting these events, so the
+            // connection can't stay open to wait for them.
+            read_available();
+            shutdown_connection();
+            return;
+        }
+        if (events & EPOLLOUT)
+        {
+            flush();
+            close_if_finished();
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP))
+        {
+            read_available();
+        }
+    }
+
+private:
+    // Per-connection limits on dispatched requests awaiting their response, and on bytes
+    // buffered either way. The byte limit leaves room for a whole request of the largest size.
+    static constexpr uint64_t kMaxInFlightRequests = 128;
+    static constexpr std::size_t kMaxBufferedBytes = 64 << 20;
+
+    bool over_limit() const
+    {
+        return issued - next_to_send >= kMaxInFlightRequests ||
+               in.size() + (out.size() - out_offset) + ready_bytes >= kMaxBufferedBytes;
+    }
+
+    void read_available()
+    {
+        {
+            metrics::PhaseTimer timer(metrics::Phase::Read);
+            char chunk[64 * 1024];
+            while (fd != -1 && !over_limit())
+            {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n > 0)
+                {
+                    in.insert(in.end(), chunk, chunk + n);
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+
+                // Client disconnected; finish sending what it already asked for. The socket
+                // stays readable at EOF, so stop polling for reads or the loop would spin.
+                peer_closed = true;
+                update_interest();
+                break;
+            }
+        }
+
+        dispatch_buffered();
+        close_if_finished();
+    }
+
+    // Dispatches the complete requests read so far, then pauses or resumes reading.
+    void dispatch_buffered()
+    {
+        try
+        {
+            dispatch_frames();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Error handling connection {}: {}", fd, e.what());
+            shutdown_connection();
+            return;
+        }
+
+        if (fd != -1 && over_limit() != reads_paused)
+        {
+            reads_paused = !reads_paused;
+            update_interest();
+        }
+    }
+
+    void dispatch_frames()
+    {
+        std::size_t consumed = 0;
+        while (fd != -1 && in.size() - consumed >= sizeof(int32_t) && issued - next_to_send < kMaxInFlightRequests)
+        {
+            int32_t size_be;
+            std::memcpy(&size_be, in.data() + consumed, sizeof(size_be));
+            int32_t message_size = ntohl(size_be);
+            if (message_size < 0 || message_size > kafka::protocol::kMaxMessageSize)
+            {
+                throw std::runtime_error("Message size too large: " + std::to_string(message_size));
+            }
+            if (in.size() - consumed - sizeof(int32_t) < static_cast<std::size_t>(message_size))
+            {
+                break;
+            }
+
+            const char *begin = in.data() + consumed + sizeof(int32_t);
+            if (capture)
+            {
+                capture->record_frame(id, begin, message_size);
+            }
+            std::vector<char> request_bytes(begin, begin + message_size);
+            consumed += sizeof(int32_t) + message_size;
+
+            kafka::protocol::Request request;
+            {
+                metrics::PhaseTimer timer(metrics::Phase::Parse);
+                request = kafka::protocol::parse_request(request_bytes);
+            }
+            dispatch(std::move(request));
+        }
+        in.erase(in.begin(), in.begin() + consumed);
+    }
+
+    void dispatch(kafka::protocol::Request request)
+    {
+        uint64_t sequence = issued++;
+        auto self = shared_from_this();
+        TaskClass task_class = router->taskClassOf(request.api_key);
+        auto dispatched = std::chrono::steady_clock::now();
+        pool->enqueue([self, sequence, dispatched, request = std::move(request)]() mutable
+                      {
+                          auto started = std::chrono::steady_clock::now();
+                          metrics::record_phase(metrics::Phase::Route, started - dispatched);
+                          int16_t api_key = request.api_key;
+                          int16_t api_version = request.api_version;
+                          spawn(self->router->routeRequestAsync(std::move(request)),
+                                [self, sequence, dispatched, started, api_key, api_version](std::expected<kafka::protocol::Response, std::exception_ptr> result)
+                                {
+                                    metrics::record_phase(metrics::Phase::Handle, std::chrono::steady_clock::now() - started);
+                                    std::vector<char> response_bytes;
+                                    bool ok = static_cast<bool>(result);
+                                    if (ok)
+                                    {
+                                        metrics::PhaseTimer timer(metrics::Phase::Serialize);
+                                        response_bytes = kafka::protocol::serialize_response(*result);
+                                    }
+                                    else
+                                    {
+                                        try
+                                        {
+                                            std::rethrow_exception(result.error());
+                                        }
+                                        catch (const std::exception &e)
+                                        {
+                                            LOG_ERROR("Error handling request: {}", e.what());
+                                        }
+                                    }
+                                    metrics::record_request(api_key, api_version, !ok, std::chrono::steady_clock::now() - dispatched);
+                                    self->loop.post([self, sequence, ok, response_bytes = std::move(response_bytes)]() mutable
+                                                    { self->complete(sequence, ok, std::move(response_bytes)); });
+                                });
+                      },
+                      task_class);
+    }
+
+    void complete(uint64_t sequence, bool ok, std::vector<char> response_bytes)
+    {
+        if (fd == -1)
+        {
+            return;
+        }
+        if (!ok)
+        {
+            shutdown_connection();
+            return;
+        }
+
+        ready_bytes += response_bytes.size();
+        ready.emplace(sequence, std::move(response_bytes));
+        while (!ready.empty() && ready.begin()->first == next_to_send)
+        {
+            auto &bytes = ready.begin()->second;
+            out.insert(out.end(), bytes.begin(), bytes.end());
+            ready_bytes -= bytes.size();
+            ready.erase(ready.begin());
+            ++next_to_send;
+        }
+        flush();
+        if (reads_paused)
+        {
+            dispatch_buffered();
+        }
+        close_if_finished();
+    }
+
+    // After the client disconnected, closes once every response it asked for is sent.
+    void close_if_finished()
+    {
+        if (fd != -1 && peer_closed && !reads_paused && next_to_send == issued && out_offset == out.size())
+        {
+            shutdown_connection();
+        }
+    }
 
-Server::Server(int port, std::shared_ptr<ThreadPool> pool, std::shared_ptr<ApiRouter> router)
-    : port(port), server_fd(-1), thread_pool(pool), api_router(router) {}
+    void flush()
+    {
+        if (out_offset == out.size())
+        {
+            set_write_interest(false);
+            return;
+        }
+
+        metrics::PhaseTimer timer(metrics::Phase::Send);
+        while (fd != -1 && out_offset < out.size())
+        {
+            ssize_t n = send(fd, out.data() + out_offset, out.size() - out_offset, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                out_offset += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                set_write_interest(true);
+                return;
+            }
+            LOG_WARN("Error sending response on connection {}: {}", fd, std::strerror(errno));
+            shutdown_connection();
+            return;
+        }
+        out.clear();
+        out_offset = 0;
+        set_write_interest(false);
+    }
+
+    void set_write_interest(bool enabled)
+    {
+        if (fd != -1 && enabled != waiting_for_write)
+        {
+            waiting_for_write = enabled;
+            update_interest();
+        }
+    }
+
+    void update_interest()
+    {
+        loop.modify(fd, (peer_closed || reads_paused ? 0 : EPOLLIN | EPOLLRDHUP) | (waiting_for_write ? EPOLLOUT : 0));
+    }
+
+    void shutdown_connection()
+    {
+        if (fd == -1)
+        {
+            return;
+        }
+        int closing = fd;
+        loop.remove(closing);
+        close(closing);
+        fd = -1;
+        if (capture)
+        {
+            capture->record_close(id);
+        }
+        LOG_INFO("Client disconnected, connection {}", closing);
+        on_close(closing); // May drop the last reference held by the server
+    }
+
+    int fd;
+    uint32_t id; // Unlike the fd, never reused while the server runs
+    EventLoop &loop;
+    std::shared_ptr<ThreadPool> pool;
+    std::shared_ptr<ApiRouter> router;
+    std::shared_ptr<RequestCapture> capture; // Null unless capturing
+    std::function<void(int)> on_close;
+
+    std::vector<char> in;
+    std::vector<char> out;
+    std::size_t out_offset = 0;
+    bool waiting_for_write = false;
+    bool peer_closed = false;
+    bool reads_paused = false; // Over a limit, so EPOLLIN is off
+
+    uint64_t issued = 0;
+    uint64_t next_to_send = 0;
+    std::map<uint64_t, std::vector<char>> ready; // Completed out of order
+    std::size_t ready_bytes = 0;
+};
+
+Server::Server(int port, std::shared_ptr<ThreadPool> pool, std::shared_ptr<ApiRouter> router, std::shared_ptr<RequestCapture> capture)
+    : port(port), server_fd(-1), thread_pool(pool), api_router(router), capture(std::move(capture)) {}
 
 Server::~Server()
 {
@@ -24,12 +344,15 @@ Server::~Server()
 void Server::start()
 {
     setup_socket();
-    accept_loop();
+    loop.add(server_fd, EPOLLIN, [this](uint32_t)
+             { accept_connections(); });
+    LOG_INFO("Waiting for connections on port {}", port);
+    loop.run();
 }
 
 void Server::setup_socket()
 {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_fd < 0)
     {
         throw std::runtime_error("Failed to create server socket");
@@ -53,62 +376,39 @@ void Server::setup_socket()
         throw std::runtime_error("Failed to bind to port " + std::to_string(port));
     }
 
-    if (listen(server_fd, 10) != 0)
+    if (listen(server_fd, SOMAXCONN) != 0)
     {
         close(server_fd);
         throw std::runtime_error("listen failed");
     }
 }
 
-void Server::accept_loop()
+void Server::accept_connections()
 {
-    std::cout << "Waiting for connections...\n";
     while (true)
     {
-        int client_fd = accept(server_fd, nullptr, nullptr);
+        int client_fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_fd < 0)
         {
-            std::cerr << "accept failed\n";
-            continue;
-        }
-        std::cout << "Client connected\n";
-
-        // Pass the router to the handler task
-        thread_pool->enqueue([client_fd, router = this->api_router]
-                             { handle_connection(client_fd, router); });
-    }
-}
-
-// This function now replaces the old `kafkaConnection` logic.
-void handle_connection(int client_fd, std::shared_ptr<ApiRouter> router)
-{
-    try
-    {
-        while (true)
-        {
-            // Read the full request from the socket
-            std::vector<char> request_bytes = kafka::protocol::read_message(client_fd);
-            if (request_bytes.empty())
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
             {
-                break; // Client disconnected
+                LOG_ERROR("accept failed: {}", std::strerror(errno));
             }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        LOG_INFO("Client connected, connection {}", client_fd);
 
-            // Parse the request bytes
-            kafka::protocol::Request request = kafka::protocol::parse_request(request_bytes);
-
-            // Route to the correct API handler to get a response
-            kafka::protocol::Response response = router->routeRequest(request);
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
-            // Serialize the response and send it back
-            std::vector<char> response_bytes = kafka::protocol::serialize_response(response);
-            kafka::protocol::send_message(client_fd, response_bytes);
-        }
+        auto connection = std::make_shared<ClientConnection>(client_fd, next_connection_id++, loop, thread_pool, api_router, capture, [this](int fd)
+                                                             { connections.erase(fd); });
+        connections[client_fd] = connection;
+        loop.add(client_fd, EPOLLIN | EPOLLRDHUP, [connection = connection.get()](uint32_t events)
+                 { connection->on_events(events); });
     }
-    catch (const std::exception &e)
-    {
-        std::cerr << "Error handling connection: " << e.what() << std::endl;
-    }
-
-    std::cout << "Client disconnected\n";
-    close(client_fd);
-}
\ No newline at end of file
+}
@@ -1,22 +1,37 @@
 #pragma once
 #include <memory>
+#include <unordered_map>
+#include "core/EventLoop.hpp"
+#include "core/RequestCapture.hpp"
 #include "core/ThreadPool.hpp"
 #include "api/ApiRouter.hpp"
 
+class ClientConnection;
+
+// Accepts clients and does all socket I/O on one event loop thread. Each request
+// is handed to the thread pool as a handler task; handlers that await storage
+// release their worker until the data is ready. With a capture, every request frame
+// is also recorded for replay.
 class Server
 {
 public:
-    Server(int port, std::shared_ptr<ThreadPool> pool, std::shared_ptr<ApiRouter> router);
+    Server(int port, std::shared_ptr<ThreadPool> pool, std::shared_ptr<ApiRouter> router,
+           std::shared_ptr<RequestCapture> capture = nullptr);
     ~Server();
 
     void start();
 
 private:
     void setup_socket();
-    void accept_loop();
+    void accept_connections();
 
     int port;
     int server_fd;
     std::shared_ptr<ThreadPool> thread_pool;
     std::shared_ptr<ApiRouter> api_router;
-};
\ No newline at end of file
+    std::shared_ptr<RequestCapture> capture;
+
+    EventLoop loop;
+    std::unordered_map<int, std::shared_ptr<ClientConnection>> connections; // Loop thread only
+    uint32_t next_connection_id = 0;
+};
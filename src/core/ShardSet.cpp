@@ -0,0 +1,293 @@
+#include "core/ShardSet.hpp"
+#include "core/Log.hpp"
+#include <pthread.h>
+#include <sched.h>
+#ifdef MINIKAFKA_WITH_NUMA
+#include <numa.h>
+#endif
+
+namespace
+{
+    constexpr std::size_t kProducerSlots = ShardSet::kMaxProducers;
+    constexpr int kSpinsBeforeSleep = 64;
+    constexpr std::size_t kDrainBatch = 64; // Jobs taken from one ring before moving to the next
+
+    // Producer slots are process-wide and claimed per thread, so a thread pool
+    // that replaces its workers keeps reusing the same rings.
+    std::atomic<bool> slot_in_use[kProducerSlots];
+    std::atomic<std::size_t> slots_high_water{0};
+
+    struct ThreadProducer
+    {
+        int slot = -2; // -2 = not claimed yet, -1 = no slot left
+
+        ~ThreadProducer()
+        {
+            if (slot >= 0)
+            {
+                slot_in_use[slot].store(false, std::memory_order_release);
+            }
+        }
+
+        int acquire()
+        {
+            if (slot != -2)
+            {
+                return slot;
+            }
+            slot = -1;
+            for (std::size_t i = 0; i < kProducerSlots; ++i)
+            {
+                bool expected = false;
+                if (slot_in_use[i].compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+                {
+                    std::size_t high = slots_high_water.load(std::memory_order_relaxed);
+                    while (high < i + 1 && !slots_high_water.compare_exchange_weak(high, i + 1))
+                    {
+                    }
+                    slot = static_cast<int>(i);
+                    break;
+                }
+            }
+            return slot;
+        }
+    };
+
+    thread_local ThreadProducer this_producer;
+    thread_local int this_shard = -1;
+
+    std::vector<int> allowed_cpus()
+    {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+}
+
+ShardSet::ShardSet() : ShardSet(Options{}) {}
+
+ShardSet::ShardSet(Options options, std::shared_ptr<ThreadPool> resume_on)
+    : options(options), resume_on(std::move(resume_on))
+{
+    std::vector<int> cpus = allowed_cpus();
+    unsigned count = options.shards;
+    if (count == 0)
+    {
+        count = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : static_cast<unsigned>(cpus.size());
+    }
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        auto shard = std::make_unique<Shard>();
+        if (options.pin_threads && !cpus.empty())
+        {
+            shard->cpu = cpus[i % cpus.size()];
+        }
+        shards.push_back(std::move(shard));
+    }
+
+    // Start threads once every shard exists, since producers may submit immediately.
+    for (unsigned i = 0; i < count; ++i)
+    {
+        Shard &shard = *shards[i];
+        shard.thread = std::jthread([this, i](std::stop_token stop)
+                                    { shard_loop(i, stop); });
+        if (shard.cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(shard.cpu, &set);
+            if (pthread_setaffinity_np(shard.thread.native_handle(), sizeof(set), &set) != 0)
+            {
+                LOG_WARN("Failed to pin shard {} to CPU {}", i, shard.cpu);
+            }
+        }
+    }
+}
+
+ShardSet::~ShardSet()
+{
+    for (auto &shard : shards)
+    {
+        shard->thread.request_stop();
+        shard->signal.fetch_add(1, std::memory_order_release);
+        shard->signal.notify_one();
+    }
+    for (auto &shard : shards)
+    {
+        if (shard->thread.joinable())
+        {
+            shard->thread.join();
+        }
+    }
+}
+
+unsigned ShardSet::shard_for(std::span<const uint8_t> topic_id, int32_t partition) const
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint8_t b : topic_id)
+    {
+        hash = (hash ^ b) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ static_cast<uint32_t>(partition)) * 0x100000001b3ULL;
+    hash ^= hash >> 32;
+    return static_cast<unsigned>(hash % shards.size());
+}
+
+int ShardSet::current()
+{
+    return this_shard;
+}
+
+SpscQueue<ShardSet::Job> &ShardSet::queue_for(Shard &shard, std::size_t producer)
+{
+    SpscQueue<Job> *queue = shard.inbox[producer].load(std::memory_order_acquire);
+    if (!queue)
+    {
+        auto created = std::make_unique<SpscQueue<Job>>(options.queue_capacity);
+        queue = created.get();
+        {
+            std::lock_guard<std::mutex> lock(shard.owned_mutex);
+            shard.owned.push_back(std::move(created));
+        }
+        shard.inbox[producer].store(queue, std::memory_order_release);
+    }
+    return *queue;
+}
+
+void ShardSet::submit(unsigned index, Job job)
+{
+    Shard &shard = *shards[index];
+
+    int producer = this_producer.acquire();
+    if (producer >= 0)
+    {
+        SpscQueue<Job> &queue = queue_for(shard, static_cast<std::size_t>(producer));
+        while (!queue.try_push(std::move(job)))
+        {
+            // The shard is behind; sleep until it takes jobs off rather than queueing without bound.
+            uint32_t seen = shard.space.load(std::memory_order_acquire);
+            shard.full_waiters.fetch_add(1, std::memory_order_seq_cst);
+            shard.signal.fetch_add(1, std::memory_order_release);
+            shard.signal.notify_one();
+            // Pairs with the fence in drain: either the shard sees this waiter, or the retry sees its pops.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            bool pushed = queue.try_push(std::move(job));
+            if (!pushed)
+            {
+                shard.space.wait(seen, std::memory_order_acquire);
+            }
+            shard.full_waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (pushed)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(shard.overflow_mutex);
+        shard.overflow.push_back(std::move(job));
+        shard.has_overflow.store(true, std::memory_order_release);
+    }
+
+    // Pairs with the shard publishing `sleeping` before re-reading the signal.
+    shard.signal.fetch_add(1, std::memory_order_seq_cst);
+    if (shard.sleeping.load(std::memory_order_seq_cst))
+    {
+        shard.signal.notify_one();
+    }
+}
+
+bool ShardSet::drain(Shard &shard)
+{
+    bool ran = false;
+    std::size_t producers = slots_high_water.load(std::memory_order_acquire);
+    Job job;
+    for (std::size_t p = 0; p < producers; ++p)
+    {
+        SpscQueue<Job> *queue = shard.inbox[p].load(std::memory_order_acquire);
+        if (!queue)
+        {
+            continue;
+        }
+        for (std::size_t n = 0; n < kDrainBatch && queue->try_pop(job); ++n)
+        {
+            job();
+            ran = true;
+        }
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ran && shard.full_waiters.load(std::memory_order_relaxed) > 0)
+    {
+        shard.space.fetch_add(1, std::memory_order_release);
+        shard.space.notify_all();
+    }
+
+    if (shard.has_overflow.load(std::memory_order_acquire))
+    {
+        std::deque<Job> overflow;
+        {
+            std::lock_guard<std::mutex> lock(shard.overflow_mutex);
+            overflow.swap(shard.overflow);
+            shard.has_overflow.store(false, std::memory_order_relaxed);
+        }
+        for (auto &pending : overflow)
+        {
+            pending();
+            ran = true;
+        }
+    }
+    return ran;
+}
+
+void ShardSet::shard_loop(unsigned index, std::stop_token stop)
+{
+    Shard &shard = *shards[index];
+    this_shard = static_cast<int>(index);
+
+#ifdef MINIKAFKA_WITH_NUMA
+    if (shard.cpu >= 0 && numa_available() >= 0)
+    {
+        numa_set_preferred(numa_node_of_cpu(shard.cpu));
+    }
+#endif
+
+    int idle_spins = 0;
+    while (!stop.stop_requested())
+    {
+        uint32_t seen = shard.signal.load(std::memory_order_acquire);
+        if (drain(shard))
+        {
+            idle_spins = 0;
+            continue;
+        }
+        if (++idle_spins < kSpinsBeforeSleep)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Sleep until a producer bumps the eventcount past what was seen before draining.
+        shard.sleeping.store(true, std::memory_order_seq_cst);
+        if (shard.signal.load(std::memory_order_seq_cst) == seen && !stop.stop_requested())
+        {
+            shard.signal.wait(seen, std::memory_order_acquire);
+        }
+        shard.sleeping.store(false, std::memory_order_relaxed);
+        idle_spins = 0;
+    }
+    drain(shard);
+}
@@ -0,0 +1,193 @@
+#pragma once
+#include "core/SpscQueue.hpp"
+#include "core/Task.hpp"
+#include "core/ThreadPool.hpp"
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <expected>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed set of shard threads, each the only owner of the partitions hashed to it.
+ *
+ * Work for a partition is forwarded to its home shard instead of being done by
+ * whichever thread received the request, so partition state is only ever touched
+ * by one thread and needs no locks. Every producing thread gets its own lock-free
+ * SPSC ring into each shard; a shard drains its rings in turn and sleeps on an
+ * eventcount when all of them are empty. A producer that finds its ring full
+ * sleeps on a second eventcount until the shard has taken jobs off.
+ *
+ * Shard threads are pinned to the CPUs the process may run on, one shard per CPU
+ * by default. When built with libnuma, each shard also prefers memory from its
+ * CPU's NUMA node, so the partition state it allocates stays local.
+ */
+class ShardSet
+{
+public:
+    using Job = std::function<void()>;
+
+    struct Options
+    {
+        unsigned shards = 0;               // 0 = one per available CPU
+        bool pin_threads = true;
+        std::size_t queue_capacity = 1024; // Per producer thread and shard
+    };
+
+    ShardSet();
+    explicit ShardSet(Options options, std::shared_ptr<ThreadPool> resume_on = nullptr);
+    ~ShardSet();
+
+    ShardSet(const ShardSet &) = delete;
+    ShardSet &operator=(const ShardSet &) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(shards.size()); }
+
+    // The home shard of a partition.
+    unsigned shard_for(std::span<const uint8_t> topic_id, int32_t partition) const;
+
+    // The shard the calling thread runs, or -1 off the shard threads.
+    static int current();
+
+    // Runs `job` on `shard`. Blocks briefly if that shard is saturated.
+    void submit(unsigned shard, Job job);
+
+    // Runs `op` on `shard`; the awaiting coroutine resumes on the `resume_on` pool if one is given.
+    template <typename Op>
+    Task<std::invoke_result_t<Op &>> run(unsigned shard, Op op)
+    {
+        using Result = std::invoke_result_t<Op &>;
+
+        struct Awaiter
+        {
+            ShardSet &set;
+            unsigned shard;
+            Op &op;
+            std::expected<Result, std::exception_ptr> result = std::unexpected(std::exception_ptr());
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                set.submit(shard, [this, handle]
+                           {
+                               try
+                               {
+                                   result = op();
+                               }
+                               catch (...)
+                               {
+                                   result = std::unexpected(std::current_exception());
+                               }
+                               if (set.resume_on)
+                               {
+                                   set.resume_on->enqueue([handle]
+                                                          { handle.resume(); });
+                               }
+                               else
+                               {
+                                   handle.resume();
+                               } });
+            }
+
+            Result await_resume()
+            {
+                if (!result)
+                {
+                    std::rethrow_exception(result.error());
+                }
+                return std::move(*result);
+            }
+        };
+
+        co_return co_await Awaiter{*this, shard, op};
+    }
+
+    // Runs `op` on `shard` and waits for it, for callers that are not coroutines. Runs it
+    // inline when called on that shard, which would otherwise wait on itself.
+    template <typename Op>
+    std::invoke_result_t<Op &> call(unsigned shard, Op op)
+    {
+        using Result = std::invoke_result_t<Op &>;
+        if (current() == static_cast<int>(shard))
+        {
+            return op();
+        }
+
+        // Shared with the job, which may still be returning from set_value when the caller wakes.
+        auto promise = std::make_shared<std::promise<Result>>();
+        auto future = promise->get_future();
+        submit(shard, [&op, promise]
+               {
+                   try
+                   {
+                       if constexpr (std::is_void_v<Result>)
+                       {
+                           op();
+                           promise->set_value();
+                       }
+                       else
+                       {
+                           promise->set_value(op());
+                       }
+                   }
+                   catch (...)
+                   {
+                       promise->set_exception(std::current_exception());
+                   } });
+        return future.get();
+    }
+
+    // call() on the home shard of a partition, or inline when `shards` is null because sharding is off.
+    template <typename Op>
+    static std::invoke_result_t<Op &> call_home(ShardSet *shards, std::span<const uint8_t> topic_id, int32_t partition, Op op)
+    {
+        if (!shards)
+        {
+            return op();
+        }
+        return shards->call(shards->shard_for(topic_id, partition), std::move(op));
+    }
+
+    // Threads that can submit over lock-free rings at once; more fall back to a locked queue.
+    static constexpr std::size_t kMaxProducers = 256;
+
+private:
+    struct Shard
+    {
+        // One ring per producer slot, created by the producer on first use.
+        std::array<std::atomic<SpscQueue<Job> *>, kMaxProducers> inbox{};
+        std::vector<std::unique_ptr<SpscQueue<Job>>> owned; // Guarded by owned_mutex
+        std::mutex owned_mutex;
+
+        // Producers beyond kMaxProducers threads fall back to a locked queue.
+        std::mutex overflow_mutex;
+        std::deque<Job> overflow;
+        std::atomic<bool> has_overflow{false};
+
+        std::atomic<uint32_t> signal{0}; // Eventcount the idle shard waits on
+        std::atomic<bool> sleeping{false};
+        std::atomic<uint32_t> space{0};        // Eventcount producers with a full ring wait on
+        std::atomic<uint32_t> full_waiters{0}; // Producers waiting on `space`
+        int cpu = -1;
+        std::jthread thread;
+    };
+
+    SpscQueue<Job> &queue_for(Shard &shard, std::size_t producer);
+    bool drain(Shard &shard);
+    void shard_loop(unsigned index, std::stop_token stop);
+
+    Options options;
+    std::shared_ptr<ThreadPool> resume_on;
+    std::vector<std::unique_ptr<Shard>> shards;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/**
+ * @brief A bounded, lock-free single-producer single-consumer ring buffer.
+ *
+ * Exactly one thread may push and exactly one thread may pop at a time. Head and
+ * tail live on separate cache lines, and each side keeps a cached copy of the
+ * other's index so it only reads the shared one when the ring looks full or empty.
+ */
+template <typename T>
+class SpscQueue
+{
+public:
+    // `capacity` is rounded up to a power of two.
+    explicit SpscQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        mask = size - 1;
+        slots = std::make_unique<std::optional<T>[]>(size);
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Producer only. Returns false if the ring is full.
+    bool try_push(T &&value)
+    {
+        std::size_t tail = producer.tail.load(std::memory_order_relaxed);
+        if (tail - producer.cached_head > mask)
+        {
+            producer.cached_head = consumer.head.load(std::memory_order_acquire);
+            if (tail - producer.cached_head > mask)
+            {
+                return false;
+            }
+        }
+        slots[tail & mask].emplace(std::move(value));
+        producer.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the ring is empty.
+    bool try_pop(T &out)
+    {
+        std::size_t head = consumer.head.load(std::memory_order_relaxed);
+        if (head == consumer.cached_tail)
+        {
+            consumer.cached_tail = producer.tail.load(std::memory_order_acquire);
+            if (head == consumer.cached_tail)
+            {
+                return false;
+            }
+        }
+        auto &slot = slots[head & mask];
+        out = std::move(*slot);
+        slot.reset();
+        consumer.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct alignas(64) ProducerSide
+    {
+        std::atomic<std::size_t> tail{0};
+        std::size_t cached_head = 0;
+    };
+
+    struct alignas(64) ConsumerSide
+    {
+        std::atomic<std::size_t> head{0};
+        std::size_t cached_tail = 0;
+    };
+
+    ProducerSide producer;
+    ConsumerSide consumer;
+    std::size_t mask;
+    std::unique_ptr<std::optional<T>[]> slots;
+};
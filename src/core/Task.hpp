@@ -0,0 +1,175 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <expected>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * @brief A lazily started coroutine producing a value of type T.
+ *
+ * A Task does nothing until it is awaited; the awaiting coroutine is then resumed
+ * by symmetric transfer once the task finishes, on whichever thread finished it.
+ * Exceptions thrown inside the task are rethrown at the co_await.
+ *
+ * Tasks are started from ordinary code with spawn(), which reports the outcome to
+ * a callback. Coroutine parameters outlive the caller's stack frame, so Task
+ * functions take anything they need after their first suspension by value.
+ */
+template <typename T>
+class Task
+{
+public:
+    struct promise_type
+    {
+        std::variant<std::monostate, T, std::exception_ptr> result;
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+            {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_value(T value) { result.template emplace<1>(std::move(value)); }
+        void unhandled_exception() { result.template emplace<2>(std::current_exception()); }
+    };
+
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task()
+    {
+        if (handle)
+        {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume()
+    {
+        auto &result = handle.promise().result;
+        if (result.index() == 2)
+        {
+            std::rethrow_exception(std::get<2>(result));
+        }
+        return std::move(std::get<1>(result));
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace task_detail
+{
+    // A coroutine that starts immediately and frees itself when it finishes.
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+}
+
+// Starts `task` on the calling thread and passes its result, or the exception it
+// threw, to `done` once it finishes.
+template <typename T, typename Done>
+task_detail::Detached spawn(Task<T> task, Done done)
+{
+    std::expected<T, std::exception_ptr> result = std::unexpected(std::exception_ptr());
+    try
+    {
+        result = co_await std::move(task);
+    }
+    catch (...)
+    {
+        result = std::unexpected(std::current_exception());
+    }
+    done(std::move(result));
+}
+
+// Runs all tasks concurrently and resumes once every one of them has finished.
+// Results are in the order of `tasks`.
+template <typename T>
+Task<std::vector<std::expected<T, std::exception_ptr>>> when_all(std::vector<Task<T>> tasks)
+{
+    struct State
+    {
+        std::vector<std::expected<T, std::exception_ptr>> results;
+        std::atomic<std::size_t> remaining;
+        std::coroutine_handle<> parent;
+    };
+
+    struct Awaiter
+    {
+        State &state;
+        std::vector<Task<T>> &tasks;
+
+        bool await_ready() const noexcept { return tasks.empty(); }
+
+        bool await_suspend(std::coroutine_handle<> parent)
+        {
+            state.parent = parent;
+            // One extra count for this function, so no child can resume the parent
+            // before every child has been started.
+            state.remaining.store(tasks.size() + 1, std::memory_order_relaxed);
+            for (std::size_t i = 0; i < tasks.size(); ++i)
+            {
+                spawn(std::move(tasks[i]), [&state = state, i](std::expected<T, std::exception_ptr> result)
+                      {
+                          state.results[i] = std::move(result);
+                          if (state.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                          {
+                              state.parent.resume();
+                          } });
+            }
+            return state.remaining.fetch_sub(1, std::memory_order_acq_rel) != 1;
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    State state{std::vector<std::expected<T, std::exception_ptr>>(tasks.size(), std::unexpected(std::exception_ptr())), {}, {}};
+    co_await Awaiter{state, tasks};
+    co_return std::move(state.results);
+}
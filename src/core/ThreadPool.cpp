@@ -1,48 +1,273 @@
 #include "core/ThreadPool.hpp"
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
 
-ThreadPool::ThreadPool(size_t num_threads) : stop(false)
+ThreadPool::Sizing ThreadPool::Sizing::fixed(size_t num_threads)
 {
-    for (size_t i = 0; i < num_threads; ++i)
+    Sizing sizing;
+    sizing.min_threads = num_threads;
+    sizing.max_threads = num_threads;
+    return sizing;
+}
+
+ThreadPool::Sizing ThreadPool::Sizing::for_hardware()
+{
+    size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+    Sizing sizing;
+    sizing.min_threads = std::max<size_t>(2, hardware);
+    sizing.max_threads = 2 * sizing.min_threads;
+    return sizing;
+}
+
+ThreadPool::ThreadPool(size_t num_threads, unsigned control_weight) : ThreadPool(Sizing::fixed(num_threads), control_weight)
+{
+}
+
+ThreadPool::ThreadPool(Sizing sizing, unsigned control_weight) : sizing(std::move(sizing)), control_weight(control_weight), stop(false)
+{
+    if (this->sizing.min_threads == 0 || this->sizing.max_threads < this->sizing.min_threads)
+    {
+        throw std::runtime_error("ThreadPool: invalid sizing");
+    }
+
+    std::unique_lock<std::mutex> lock(this->queue_mutex);
+    for (size_t i = 0; i < this->sizing.min_threads; ++i)
     {
-        workers.emplace_back([this]
-                             { this->worker_thread(); });
+        add_worker();
+    }
+    if (this->sizing.max_threads > this->sizing.min_threads)
+    {
+        this->monitor = std::thread([this]
+                                    { this->monitor_thread(); });
     }
 }
 
-void ThreadPool::worker_thread()
+void ThreadPool::add_worker()
 {
-    while (true)
+    size_t id = this->next_worker_id++;
+    this->workers.emplace(id, std::thread([this, id]
+                                          { this->worker_thread(id); }));
+}
+
+size_t ThreadPool::maybe_grow(Clock::time_point now)
+{
+    if (this->stop || this->idle > 0 || this->workers.size() >= this->sizing.max_threads)
+    {
+        return 0;
+    }
+    // One worker per target interval, so a burst doesn't spawn a thread per queued task.
+    if (now - this->last_grow < this->sizing.target_queue_time)
+    {
+        return 0;
+    }
+
+    bool backed_up = false;
+    for (const auto &queue : this->tasks)
+    {
+        if (!queue.empty() && now - queue.front().enqueued >= this->sizing.target_queue_time)
+        {
+            backed_up = true;
+        }
+    }
+    if (!backed_up)
     {
-        std::function<void()> task;
+        return 0;
+    }
+
+    add_worker();
+    this->last_grow = now;
+    ++this->grown;
+    return this->workers.size();
+}
+
+void ThreadPool::monitor_thread()
+{
+    std::unique_lock<std::mutex> lock(this->queue_mutex);
+    while (!this->stop)
+    {
+        auto now = Clock::now();
+        size_t grown_to = maybe_grow(now);
+        if (grown_to != 0 && this->sizing.on_resize)
         {
-            std::unique_lock<std::mutex> lock(this->queue_mutex);
-            // Wait until there's a task or the pool is stopped
-            this->condition.wait(lock, [this]
-                                 { return this->stop || !this->tasks.empty(); });
+            lock.unlock();
+            this->sizing.on_resize(grown_to - 1, grown_to);
+            lock.lock();
+            continue;
+        }
 
-            if (this->stop && this->tasks.empty())
+        std::optional<Clock::time_point> oldest;
+        for (const auto &queue : this->tasks)
+        {
+            if (!queue.empty() && (!oldest || queue.front().enqueued < *oldest))
             {
-                return;
+                oldest = queue.front().enqueued;
             }
+        }
+        if (!oldest || this->idle > 0)
+        {
+            // Nothing is stuck behind busy workers; enqueue or a task pickup wakes us when that changes.
+            this->monitor_sleeping = true;
+            this->monitor_condition.wait(lock, [this]
+                                         { return this->stop || !this->monitor_sleeping; });
+            continue;
+        }
 
-            task = std::move(this->tasks.front());
-            this->tasks.pop();
+        // Check again when the oldest task comes due, or an interval on if it already has.
+        auto due = *oldest + this->sizing.target_queue_time;
+        this->monitor_condition.wait_until(lock, due > now ? due : now + this->sizing.target_queue_time);
+    }
+}
+
+void ThreadPool::wake_monitor()
+{
+    if (this->monitor_sleeping && this->idle == 0 && (!this->tasks[0].empty() || !this->tasks[1].empty()))
+    {
+        this->monitor_sleeping = false;
+        this->monitor_condition.notify_one();
+    }
+}
+
+void ThreadPool::join_retired()
+{
+    std::vector<std::thread> finished;
+    {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        finished.swap(this->retired);
+    }
+    for (std::thread &worker : finished)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::next_class()
+{
+    auto &control = this->tasks[static_cast<size_t>(TaskClass::Control)];
+    auto &data = this->tasks[static_cast<size_t>(TaskClass::Data)];
+
+    bool take_control = !control.empty() &&
+                        (data.empty() || this->control_weight == 0 || this->control_streak < this->control_weight);
+    if (take_control)
+    {
+        ++this->control_streak;
+        return static_cast<size_t>(TaskClass::Control);
+    }
+    this->control_streak = 0;
+    return static_cast<size_t>(TaskClass::Data);
+}
+
+void ThreadPool::worker_thread(size_t id)
+{
+    std::unique_lock<std::mutex> lock(this->queue_mutex);
+    while (true)
+    {
+        // Wait until there's a task or the pool is stopped
+        ++this->idle;
+        bool woken = this->condition.wait_for(lock, this->sizing.idle_timeout, [this]
+                                              { return this->stop || !this->tasks[0].empty() || !this->tasks[1].empty(); });
+        --this->idle;
+
+        if (!woken)
+        {
+            if (this->workers.size() <= this->sizing.min_threads)
+            {
+                continue;
+            }
+            // Idle for a whole timeout with more workers than needed: retire this one.
+            size_t from = this->workers.size();
+            this->retired.push_back(std::move(this->workers.extract(id).mapped()));
+            ++this->retired_count;
+            lock.unlock();
+            if (this->sizing.on_resize)
+            {
+                this->sizing.on_resize(from, from - 1);
+            }
+            return;
         }
-        task();
+
+        if (this->stop && this->tasks[0].empty() && this->tasks[1].empty())
+        {
+            return;
+        }
+
+        size_t task_class = next_class();
+        QueuedTask task = std::move(this->tasks[task_class].front());
+        this->tasks[task_class].pop();
+
+        auto now = Clock::now();
+        size_t grown_to = maybe_grow(now);
+        wake_monitor();
+        lock.unlock();
+
+        if (grown_to != 0 && this->sizing.on_resize)
+        {
+            this->sizing.on_resize(grown_to - 1, grown_to);
+        }
+
+        uint64_t wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - task.enqueued).count();
+        auto &class_counters = this->counters[task_class];
+        class_counters.tasks.fetch_add(1, std::memory_order_relaxed);
+        class_counters.total_wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+        uint64_t max = class_counters.max_wait_ns.load(std::memory_order_relaxed);
+        while (wait_ns > max && !class_counters.max_wait_ns.compare_exchange_weak(max, wait_ns, std::memory_order_relaxed))
+        {
+        }
+
+        task.fn();
+        lock.lock();
     }
 }
 
-void ThreadPool::enqueue(std::function<void()> task)
+void ThreadPool::enqueue(std::function<void()> task, TaskClass task_class)
 {
+    size_t grown_to;
+    bool reap;
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
         if (stop)
         {
             throw std::runtime_error("enqueue on stopped ThreadPool");
         }
-        tasks.emplace(std::move(task));
+        auto now = Clock::now();
+        tasks[static_cast<size_t>(task_class)].push(QueuedTask{std::move(task), now});
+        grown_to = maybe_grow(now);
+        wake_monitor();
+        reap = !retired.empty();
     }
     condition.notify_one();
+
+    if (grown_to != 0 && sizing.on_resize)
+    {
+        sizing.on_resize(grown_to - 1, grown_to);
+    }
+    if (reap)
+    {
+        join_retired();
+    }
+}
+
+ThreadPool::QueueStats ThreadPool::queue_stats(TaskClass task_class) const
+{
+    const auto &class_counters = counters[static_cast<size_t>(task_class)];
+    return QueueStats{
+        .tasks = class_counters.tasks.load(std::memory_order_relaxed),
+        .total_wait_ns = class_counters.total_wait_ns.load(std::memory_order_relaxed),
+        .max_wait_ns = class_counters.max_wait_ns.load(std::memory_order_relaxed),
+    };
+}
+
+ThreadPool::SizeStats ThreadPool::size_stats() const
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    return SizeStats{
+        .threads = workers.size(),
+        .busy = workers.size() - idle,
+        .min_threads = sizing.min_threads,
+        .max_threads = sizing.max_threads,
+        .grown = grown,
+        .retired = retired_count,
+    };
 }
 
 ThreadPool::~ThreadPool()
@@ -52,8 +277,19 @@ ThreadPool::~ThreadPool()
         stop = true;
     }
     condition.notify_all();
-    for (std::thread &worker : workers)
+    monitor_condition.notify_one();
+    if (monitor.joinable())
+    {
+        monitor.join();
+    }
+
+    // Workers neither retire nor get added once stopped, so both sets are final.
+    for (auto &[id, worker] : workers)
+    {
+        worker.join();
+    }
+    for (std::thread &worker : retired)
     {
         worker.join();
     }
-}
\ No newline at end of file
+}
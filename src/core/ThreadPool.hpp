@@ -1,26 +1,151 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
 #include <vector>
 #include <queue>
 #include <functional>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <coroutine>
 
+// Scheduling class of a task. Control-plane tasks (bootstrap and metadata
+// requests) are served ahead of data-plane tasks such as large fetches.
+enum class TaskClass : uint8_t
+{
+    Control = 0,
+    Data = 1,
+};
+
+/**
+ * @brief A worker pool with two priority classes that resizes itself between a
+ * minimum and a maximum number of threads.
+ *
+ * Whenever a task is queued or picked up, the pool checks how long the oldest
+ * queued task has waited; if every worker is busy and that exceeds the target
+ * queue time, one worker is added. While every worker is busy and tasks are
+ * queued, a monitor thread also checks when the oldest task comes due, so the
+ * pool grows even if all workers are blocked and nothing else is queued. Workers
+ * that stay idle for the idle timeout retire until the pool is back at its
+ * minimum size.
+ */
 class ThreadPool
 {
 public:
-    ThreadPool(size_t num_threads);
+    struct Sizing
+    {
+        size_t min_threads = 1;
+        size_t max_threads = 1;
+        std::chrono::microseconds target_queue_time{2000}; // Grow when a task has waited longer than this
+        std::chrono::milliseconds idle_timeout{30000};     // Retire workers idle this long, down to min_threads
+        std::function<void(size_t from, size_t to)> on_resize; // Called after each added or retired worker
+
+        // A pool that never resizes.
+        static Sizing fixed(size_t num_threads);
+        // One worker per hardware thread, growing to twice that under queueing delay.
+        static Sizing for_hardware();
+    };
+
+    // Time tasks of one class spent queued before a worker picked them up.
+    struct QueueStats
+    {
+        uint64_t tasks;
+        uint64_t total_wait_ns;
+        uint64_t max_wait_ns;
+    };
+
+    struct SizeStats
+    {
+        size_t threads;
+        size_t busy;
+        size_t min_threads;
+        size_t max_threads;
+        uint64_t grown;   // Workers added since construction
+        uint64_t retired; // Workers retired since construction
+    };
+
+    // `control_weight` control tasks are run for every data task while both are
+    // queued; 0 gives control tasks strict priority.
+    explicit ThreadPool(size_t num_threads, unsigned control_weight = 0);
+    explicit ThreadPool(Sizing sizing, unsigned control_weight = 0);
     ~ThreadPool();
 
-    void enqueue(std::function<void()> task);
+    void enqueue(std::function<void()> task, TaskClass task_class = TaskClass::Data);
+
+    QueueStats queue_stats(TaskClass task_class) const;
+    SizeStats size_stats() const;
+
+    // `co_await pool.schedule()` continues the awaiting coroutine on a pool worker.
+    auto schedule(TaskClass task_class = TaskClass::Data)
+    {
+        struct Awaiter
+        {
+            ThreadPool &pool;
+            TaskClass task_class;
+
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                pool.enqueue([handle]
+                             { handle.resume(); }, task_class);
+            }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, task_class};
+    }
 
 private:
-    void worker_thread();
+    using Clock = std::chrono::steady_clock;
+
+    struct QueuedTask
+    {
+        std::function<void()> fn;
+        Clock::time_point enqueued;
+    };
+
+    struct ClassCounters
+    {
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> total_wait_ns{0};
+        std::atomic<uint64_t> max_wait_ns{0};
+    };
+
+    static constexpr size_t kClasses = 2;
 
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    void worker_thread(size_t id);
+    // Grows the pool on time while every worker is busy; runs only if the pool can grow.
+    void monitor_thread();
+    // Wakes the monitor if tasks are queued with no idle worker; requires queue_mutex.
+    void wake_monitor();
+    // Picks the next task's class; requires queue_mutex and at least one queued task.
+    size_t next_class();
+    // Adds a worker if the queue is backing up; requires queue_mutex. Returns the new size, or 0.
+    size_t maybe_grow(Clock::time_point now);
+    void add_worker();
+    // Joins workers that have retired; must not hold queue_mutex.
+    void join_retired();
 
-    std::mutex queue_mutex;
+    Sizing sizing;
+    std::map<size_t, std::thread> workers; // Keyed by worker id
+    std::vector<std::thread> retired;      // Exited workers waiting to be joined
+    std::thread monitor;
+    size_t next_worker_id = 0;
+    size_t idle = 0; // Workers waiting for a task
+    Clock::time_point last_grow;
+
+    std::array<std::queue<QueuedTask>, kClasses> tasks;
+    unsigned control_weight;
+    unsigned control_streak = 0; // Control tasks run since the last data task
+
+    mutable std::mutex queue_mutex;
     std::condition_variable condition;
+    std::condition_variable monitor_condition;
+    bool monitor_sleeping = false; // Waiting for wake_monitor rather than a deadline
     bool stop;
-};
\ No newline at end of file
+
+    std::array<ClassCounters, kClasses> counters;
+    uint64_t grown = 0;
+    uint64_t retired_count = 0;
+};
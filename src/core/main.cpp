@@ -1,34 +1,144 @@
 #include "core/Server.hpp"
 #include "core/ThreadPool.hpp"
+#include "core/ShardSet.hpp"
+#include "core/Metrics.hpp"
+#include "core/Log.hpp"
 #include "api/ApiRouter.hpp"
 #include "storage/KRaftMetadataStore.hpp"
 #include "api/ApiVersionsHandler.hpp"
 #include "api/DescribeTopicPartitionsHandler.hpp"
 #include "api/FetchHandler.hpp"
-#include <iostream>
+#include "api/ListOffsetsHandler.hpp"
+#include "api/MetadataHandler.hpp"
+#include "api/OffsetCommitHandler.hpp"
+#include "api/OffsetFetchHandler.hpp"
+#include "storage/LogCompactor.hpp"
+#include "storage/OffsetStore.hpp"
+#include "replication/ReplicaManager.hpp"
 #include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <sstream>
+#include <string>
 
-int main(int argc, char *argv[])
+namespace
 {
-    // Unbuffer output for immediate logging
-    std::cout << std::unitbuf;
-    std::cerr << std::unitbuf;
+    // Command line options; the defaults run a single broker as before.
+    struct BrokerOptions
+    {
+        int32_t broker_id = 1;
+        int port = 9092;
+        std::string advertised_host = "localhost"; // Host clients are told to connect to
+        std::string log_dir = "/tmp/kraft-combined-logs";
+        std::string peers; // "2@host:port,..." for replication
+        std::string compact_topics; // "name,..." of topics to keep only the latest record per key of
+        std::string metrics_path = "/tmp/mini-kafka-metrics.txt"; // Rewritten on SIGUSR1
+    };
+
+    BrokerOptions parse_options(int argc, char *argv[])
+    {
+        BrokerOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            std::size_t eq = arg.find('=');
+            if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+            {
+                throw std::runtime_error("Expected --name=value, got " + arg);
+            }
+            std::string name = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
 
-    // if (argc != 2)
-    // {
-    //     std::cerr << "Usage: " << argv[0] << " <path_to_kraft_log_file>\n";
-    //     return 1;
-    // }
+            if (name == "broker-id")
+                options.broker_id = std::stoi(value);
+            else if (name == "port")
+                options.port = std::stoi(value);
+            else if (name == "advertised-host")
+                options.advertised_host = value;
+            else if (name == "log-dir")
+                options.log_dir = value;
+            else if (name == "peers")
+                options.peers = value;
+            else if (name == "compact-topics")
+                options.compact_topics = value;
+            else if (name == "metrics")
+                options.metrics_path = value;
+            else
+                throw std::runtime_error("Unknown option --" + name);
+        }
+        return options;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // Log lines are buffered per thread and written by a background thread
+    logging::start({});
 
-    const std::string metadata_log_path = "/tmp/kraft-combined-logs/__cluster_metadata-0/00000000000000000000.log";
-    const int port = 9092;
-    const int num_threads = 4;
+    const unsigned control_weight = 8; // Control-plane tasks run per data-plane task under load
+    const unsigned num_shards = 0; // One per available CPU
+    const std::size_t batch_cache_bytes = 256 << 20;
 
     try
     {
+        const BrokerOptions options = parse_options(argc, argv);
+        const std::string metadata_log_dir = options.log_dir + "/__cluster_metadata-0";
+        const int port = options.port;
+        const std::string &metrics_path = options.metrics_path;
+
+        // Setup the thread pool that runs request handlers, sized from the hardware and
+        // grown while requests queue up behind busy workers
+        ThreadPool::Sizing pool_sizing = ThreadPool::Sizing::for_hardware();
+        pool_sizing.on_resize = [](size_t from, size_t to)
+        {
+            LOG_INFO("Thread pool resized from {} to {} workers", from, to);
+        };
+        auto threadPool = std::make_shared<ThreadPool>(pool_sizing, control_weight);
+
+        // Every partition is owned by one pinned shard thread, which does all of its disk work;
+        // handlers awaiting a shard resume on the handler pool
+        ShardSet::Options shard_options;
+        shard_options.shards = num_shards;
+        auto shards = std::make_shared<ShardSet>(shard_options, threadPool);
+        LOG_INFO("Thread pool with {}-{} workers and {} partition shards created", pool_sizing.min_threads, pool_sizing.max_threads, shards->size());
+
         // Setup the data source
-        auto metadataStore = std::make_shared<KRaftMetadataStore>(metadata_log_path);
-        std::cout << "Successfully parsed metadata log file.\n";
+        KRaftMetadataStore::Options metadata_options;
+        // Checkpoints are this broker's own files, so they stay out of Kafka's partition directories
+        metadata_options.checkpoint_dir = options.log_dir + "/__minikafka_metadata_checkpoints";
+        auto batchCache = std::make_shared<RecordBatchCache>(batch_cache_bytes);
+        auto readAhead = std::make_shared<ReadAhead>();
+        metadata_options.batch_cache = batchCache;
+        metadata_options.read_ahead = readAhead;
+        metadata_options.shards = shards;
+        auto metadataStore = std::make_shared<KRaftMetadataStore>(metadata_log_dir, metadata_options);
+        LOG_INFO("Successfully parsed metadata log");
+
+        // Pick up topics and partitions created while the broker is running
+        metadataStore->start_tailing(std::chrono::milliseconds(500));
+
+        // Replicate partitions led by or followed from the brokers named in --peers
+        ReplicaManager::Options replica_options;
+        replica_options.broker_id = options.broker_id;
+        replica_options.peers = ReplicaManager::parse_peers(options.peers);
+        auto replicaManager = std::make_shared<ReplicaManager>(replica_options, metadataStore, shards);
+        replicaManager->start();
+        LOG_INFO("Broker {} replicating with {} peers", options.broker_id, replica_options.peers.size());
+
+        // Compact the closed segments of keyed topics in the background, within an I/O budget
+        LogCompactor::Options compactor_options;
+        std::stringstream compact_topics(options.compact_topics);
+        for (std::string topic; std::getline(compact_topics, topic, ',');)
+        {
+            compactor_options.topics.insert(topic);
+        }
+        auto logCompactor = std::make_shared<LogCompactor>(compactor_options, metadataStore, shards);
+        logCompactor->start();
+
+        // Consumer group offsets, served from memory and persisted to a compacted log. The log is
+        // rewritten in place, so it lives in a directory of its own rather than Kafka's __consumer_offsets-0
+        auto offsetStore = std::make_shared<OffsetStore>(options.log_dir + "/__minikafka_offsets");
 
         // Setup the API routing logic
         auto apiRouter = std::make_shared<ApiRouter>();
@@ -37,26 +147,98 @@ int main(int argc, char *argv[])
         auto apiVersionsHandler = std::make_unique<ApiVersionsHandler>(apiRouter);
 
         // apiRouter->registerHandler(0, 0, 11, std::make_unique<ProduceHandler>());
-        apiRouter->registerHandler(1, 0, 16, std::make_unique<FetchHandler>(metadataStore));
-        apiRouter->registerHandler(18, 0, 4, std::move(apiVersionsHandler));
-        apiRouter->registerHandler(75, 0, 0, std::make_unique<DescribeTopicPartitionsHandler>(metadataStore));
+        apiRouter->registerHandler(1, 0, 16, std::make_unique<FetchHandler>(metadataStore, shards, replicaManager));
+        apiRouter->registerHandler(2, 6, 9, std::make_unique<ListOffsetsHandler>(metadataStore, shards, replicaManager));
+        // Clients learn every broker from Metadata, so it lists this one and its peers
+        std::vector<MetadataHandler::Broker> brokers{{options.broker_id, options.advertised_host, port}};
+        for (const auto &[id, address] : replica_options.peers)
+        {
+            if (id != options.broker_id)
+            {
+                brokers.push_back({id, address.host, address.port});
+            }
+        }
+        apiRouter->registerHandler(3, 9, 13, std::make_unique<MetadataHandler>(metadataStore, brokers, options.broker_id), TaskClass::Control);
+        apiRouter->registerHandler(8, 8, 9, std::make_unique<OffsetCommitHandler>(offsetStore, metadataStore));
+        // Bootstrap and metadata requests are control plane, so busy consumers don't delay them
+        apiRouter->registerHandler(9, 8, 9, std::make_unique<OffsetFetchHandler>(offsetStore), TaskClass::Control);
+        apiRouter->registerHandler(18, 0, 4, std::move(apiVersionsHandler), TaskClass::Control);
+        apiRouter->registerHandler(75, 0, 0, std::make_unique<DescribeTopicPartitionsHandler>(metadataStore), TaskClass::Control);
+
+        LOG_INFO("API handlers registered");
 
-        std::cout << "API handlers registered.\n";
+        // Expose request metrics, plus the stats of the pool, cache and prefetcher, on SIGUSR1
+        metrics::add_source("thread pool", [threadPool](std::ostream &out)
+                            {
+                                auto size = threadPool->size_stats();
+                                out << "pool_threads " << size.threads << '\n'
+                                    << "pool_busy_threads " << size.busy << '\n'
+                                    << "pool_grown_total " << size.grown << '\n'
+                                    << "pool_retired_total " << size.retired << '\n';
+                                for (auto [task_class, name] : {std::pair{TaskClass::Control, "control"}, std::pair{TaskClass::Data, "data"}})
+                                {
+                                    auto queue = threadPool->queue_stats(task_class);
+                                    out << "pool_tasks_total{class=\"" << name << "\"} " << queue.tasks << '\n'
+                                        << "pool_queue_wait_sum_ns{class=\"" << name << "\"} " << queue.total_wait_ns << '\n'
+                                        << "pool_queue_wait_max_ns{class=\"" << name << "\"} " << queue.max_wait_ns << '\n';
+                                } });
+        metrics::add_source("record batch cache", [batchCache](std::ostream &out)
+                            {
+                                auto stats = batchCache->stats();
+                                out << "cache_hits_total " << stats.hits << '\n'
+                                    << "cache_misses_total " << stats.misses << '\n'
+                                    << "cache_coalesced_total " << stats.coalesced << '\n'
+                                    << "cache_evictions_total " << stats.evictions << '\n'
+                                    << "cache_resident_bytes " << stats.resident_bytes << '\n'
+                                    << "cache_capacity_bytes " << stats.capacity_bytes << '\n'; });
+        metrics::add_source("read ahead", [readAhead](std::ostream &out)
+                            {
+                                auto stats = readAhead->stats();
+                                out << "readahead_prefetched_bytes_total " << stats.prefetched_bytes << '\n'
+                                    << "readahead_dropped_segments_total " << stats.dropped_segments << '\n'
+                                    << "readahead_skipped_hints_total " << stats.skipped_hints << '\n'; });
+        metrics::add_source("offsets", [offsetStore](std::ostream &out)
+                            {
+                                auto stats = offsetStore->stats();
+                                out << "offsets_commits_total " << stats.commits << '\n'
+                                    << "offsets_log_writes_total " << stats.writes << '\n'
+                                    << "offsets_compactions_total " << stats.compactions << '\n'
+                                    << "offsets_log_bytes " << stats.log_bytes << '\n'
+                                    << "offsets_live " << stats.live_offsets << '\n'; });
+        metrics::add_source("replication", [replicaManager](std::ostream &out)
+                            { replicaManager->write_metrics(out); });
+        metrics::add_source("compaction", [logCompactor](std::ostream &out)
+                            {
+                                auto stats = logCompactor->stats();
+                                out << "compaction_passes_total " << stats.passes << '\n'
+                                    << "compaction_segments_rewritten_total " << stats.segments_rewritten << '\n'
+                                    << "compaction_read_bytes_total " << stats.bytes_read << '\n'
+                                    << "compaction_written_bytes_total " << stats.bytes_written << '\n'
+                                    << "compaction_records_removed_total " << stats.records_removed << '\n'
+                                    << "compaction_throttled_ms_total " << stats.throttled_ms << '\n'; });
+        metrics::dump_on_signal(metrics_path);
+        LOG_INFO("Metrics are written to {} on SIGUSR1", metrics_path);
 
-        // Setup the thread pool
-        auto threadPool = std::make_shared<ThreadPool>(num_threads);
-        std::cout << "Thread pool with " << num_threads << " workers created.\n";
+        // Record client traffic for tools/replay when MINIKAFKA_CAPTURE names a file
+        std::shared_ptr<RequestCapture> capture;
+        if (const char *capture_path = std::getenv("MINIKAFKA_CAPTURE"))
+        {
+            capture = std::make_shared<RequestCapture>(RequestCapture::Options{capture_path});
+            LOG_INFO("Capturing requests to {}", capture_path);
+        }
 
         // Start the server
-        Server server(port, threadPool, apiRouter);
-        std::cout << "Server starting on port " << port << "...\n";
+        Server server(port, threadPool, apiRouter, capture);
+        LOG_INFO("Server starting on port {}", port);
         server.start();
     }
     catch (const std::exception &e)
     {
-        std::cerr << "Fatal error: " << e.what() << std::endl;
+        LOG_ERROR("Fatal error: {}", e.what());
+        logging::stop();
         return 1;
     }
 
+    logging::stop();
     return 0;
 }
\ No newline at end of file
@@ -84,6 +84,41 @@ namespace kafka::protocol
         return bytes;
     }
 
+    uint32_t BufferReader::readUnsignedVarint()
+    {
+        uint32_t result = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(readInt8());
+            result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return result;
+            }
+        }
+        throw std::runtime_error("Varint too long");
+    }
+
+    std::string BufferReader::readCompactString()
+    {
+        uint32_t len = readUnsignedVarint();
+        if (len == 0)
+        { // Null string
+            return "";
+        }
+        return readString(len - 1);
+    }
+
+    void BufferReader::skipTaggedFields()
+    {
+        uint32_t num_fields = readUnsignedVarint();
+        for (uint32_t i = 0; i < num_fields; ++i)
+        {
+            readUnsignedVarint(); // tag
+            skip(readUnsignedVarint());
+        }
+    }
+
     void BufferReader::skip(size_t bytes)
     {
         ensure_can_read(bytes);
@@ -22,6 +22,9 @@ namespace kafka::protocol
         std::string readString();
         std::string readString(size_t len);
         std::vector<uint8_t> readBytes(size_t len);
+        uint32_t readUnsignedVarint();
+        std::string readCompactString();
+        void skipTaggedFields();
 
         void skip(size_t bytes);
         bool eof() const; // End of file/buffer
@@ -3,6 +3,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
 #include <stdexcept>
 #include <cstring>
 #include <iostream>
@@ -61,7 +62,7 @@ namespace kafka::protocol
         }
         int32_t message_size = ntohl(*reinterpret_cast<int32_t *>(size_buf));
 
-        if (message_size > 10 * 1024 * 1024)
+        if (message_size > kMaxMessageSize)
         { // 10MB sanity limit
             throw std::runtime_error("Message size too large: " + std::to_string(message_size));
         }
@@ -108,22 +109,19 @@ namespace kafka::protocol
         int32_t payload_size = response.get_data().size() + 4; // Add 4 for correlation ID
         int32_t total_size = payload_size + 4;
 
-        std::vector<char> buffer;
-        buffer.reserve(total_size);
+        std::vector<char> buffer(total_size);
 
         // 1. Message Size
         int32_t msg_size_be = htonl(payload_size);
-        const char *p = reinterpret_cast<const char *>(&msg_size_be);
-        buffer.insert(buffer.end(), p, p + sizeof(msg_size_be));
+        std::memcpy(buffer.data(), &msg_size_be, sizeof(msg_size_be));
 
         // 2. Correlation ID
         int32_t correlation_id_be = htonl(response.get_correlation_id());
-        p = reinterpret_cast<const char *>(&correlation_id_be);
-        buffer.insert(buffer.end(), p, p + sizeof(correlation_id_be));
+        std::memcpy(buffer.data() + 4, &correlation_id_be, sizeof(correlation_id_be));
 
         // 3. Payload
         const auto &payload = response.get_data();
-        buffer.insert(buffer.end(), payload.begin(), payload.end());
+        std::copy(payload.begin(), payload.end(), buffer.begin() + 8);
 
         return buffer;
     }
@@ -6,6 +6,9 @@
 
 namespace kafka::protocol
 {
+    // Largest request accepted from a client.
+    constexpr int32_t kMaxMessageSize = 10 * 1024 * 1024;
+
     // Reads a complete Kafka message (size-prefixed) from a socket.
     std::vector<char> read_message(int socket_fd);
 
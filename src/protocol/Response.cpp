@@ -1,4 +1,5 @@
 #include "protocol/Response.hpp"
+#include "protocol/Varint.hpp"
 #include <cstring>
 #include <cstdint>
 #include <endian.h>
@@ -34,9 +35,14 @@ namespace kafka::protocol
         data.insert(data.end(), p, p + sizeof(be_val));
     }
 
+    void Response::writeUnsignedVarint(uint64_t val)
+    {
+        append_unsigned_varint(data, val);
+    }
+
     void Response::writeString(const std::string &s)
     {
-        writeInt8(s.length() + 1);
+        writeUnsignedVarint(s.length() + 1);
         data.insert(data.end(), s.begin(), s.end());
     }
 
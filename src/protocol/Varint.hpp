@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace kafka::protocol
+{
+    // Appends an unsigned LEB128 varint, as used for compact lengths and arrays.
+    template <typename Buffer>
+    void append_unsigned_varint(Buffer &out, uint64_t val)
+    {
+        while (val >= 0x80)
+        {
+            out.push_back(static_cast<typename Buffer::value_type>(val | 0x80));
+            val >>= 7;
+        }
+        out.push_back(static_cast<typename Buffer::value_type>(val));
+    }
+
+    // Appends a zig-zag encoded signed varint, as used inside records.
+    template <typename Buffer>
+    void append_zigzag_varint(Buffer &out, int64_t val)
+    {
+        append_unsigned_varint(out, (static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63));
+    }
+
+    // Number of bytes an unsigned varint takes.
+    inline std::size_t unsigned_varint_size(uint64_t val)
+    {
+        std::size_t size = 1;
+        while (val >= 0x80)
+        {
+            val >>= 7;
+            ++size;
+        }
+        return size;
+    }
+
+} // namespace kafka::protocol
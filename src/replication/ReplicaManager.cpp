@@ -0,0 +1,746 @@
+#include "replication/ReplicaManager.hpp"
+#include "api/FetchRequest.hpp"
+#include "core/Log.hpp"
+#include "protocol/BufferReader.hpp"
+#include "protocol/Response.hpp"
+#include "storage/RecordBatch.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr int16_t kFetchApiKey = 1;
+    constexpr int16_t kFetchVersion = 16;
+    constexpr int16_t kOffsetOutOfRange = 1;
+    constexpr auto kSocketTimeout = std::chrono::seconds(10);
+
+    // One past the last offset in a run of whole record batches, or -1 if there are none.
+    int64_t next_offset_after(const std::vector<uint8_t> &records)
+    {
+        int64_t next = -1;
+        std::size_t position = 0;
+        while (records.size() - position >= record_batch::kHeaderSize)
+        {
+            record_batch::Header header = record_batch::read_header(records.data() + position);
+            next = header.last_offset + 1;
+            position += header.size;
+        }
+        return next;
+    }
+
+    std::string partition_name(const MetadataSnapshot &snapshot, const std::vector<uint8_t> &topic_id, int32_t partition)
+    {
+        auto it = snapshot.topicIdToName.find(topic_id);
+        return (it != snapshot.topicIdToName.end() ? it->second : std::string("?")) + "-" + std::to_string(partition);
+    }
+}
+
+// Follows every partition one leader leads and this broker replicates, on its own thread.
+class ReplicaManager::Fetcher
+{
+public:
+    Fetcher(ReplicaManager &manager, int32_t leader, BrokerAddress address)
+        : manager(manager), leader(leader), address(std::move(address))
+    {
+        this->thread = std::jthread([this](std::stop_token stop)
+                                    { run(stop); });
+    }
+
+private:
+    struct Followed
+    {
+        int64_t fetch_offset;   // Where the next request continues
+        int64_t requested = -1; // What the request in flight asked for
+        Clock::time_point paused_until{}; // Left out of requests until then
+    };
+
+    struct PartitionData
+    {
+        int16_t error_code;
+        int64_t high_watermark;
+        int64_t log_start_offset;
+        std::vector<uint8_t> records;
+    };
+
+    void run(std::stop_token stop)
+    {
+        std::stop_callback on_stop(stop, [this]
+                                   {
+                                       // Unblock a send or receive in progress.
+                                       int fd = this->socket_fd.load();
+                                       if (fd != -1)
+                                       {
+                                           ::shutdown(fd, SHUT_RDWR);
+                                       } });
+
+        bool in_flight = false;
+        while (!stop.stop_requested())
+        {
+            if (Clock::now() >= this->next_refresh)
+            {
+                refresh_partitions();
+            }
+            if (this->followed.empty())
+            {
+                sleep(stop, this->manager.options.metadata_refresh);
+                continue;
+            }
+
+            try
+            {
+                if (this->socket_fd.load() == -1)
+                {
+                    connect_to_leader();
+                    in_flight = false;
+                }
+                if (!in_flight)
+                {
+                    send_fetch();
+                }
+                auto response = parse(receive());
+                in_flight = false;
+
+                // Work out where every partition continues, then ask for more before
+                // appending what arrived, so the append overlaps the next round trip.
+                bool has_data = false;
+                for (auto &[key, data] : response)
+                {
+                    auto followed = this->followed.find(key);
+                    if (followed == this->followed.end())
+                    {
+                        continue;
+                    }
+                    if (followed->second.requested != followed->second.fetch_offset)
+                    {
+                        // Asked for before a failed append moved the offset back.
+                        data.error_code = 0;
+                        data.records.clear();
+                        continue;
+                    }
+                    int64_t next = next_offset_after(data.records);
+                    if (data.error_code == 0 && next > followed->second.fetch_offset)
+                    {
+                        followed->second.fetch_offset = next;
+                        has_data = true;
+                    }
+                    else if (data.error_code == kOffsetOutOfRange)
+                    {
+                        restart_out_of_range(key, followed->second, data);
+                    }
+                }
+                if (has_data)
+                {
+                    send_fetch();
+                    in_flight = true;
+                }
+
+                for (auto &[key, data] : response)
+                {
+                    if (data.error_code == 0)
+                    {
+                        append(key, data);
+                    }
+                }
+                if (!has_data)
+                {
+                    sleep(stop, this->manager.options.idle_backoff);
+                }
+            }
+            catch (const std::exception &e)
+            {
+                if (!stop.stop_requested())
+                {
+                    LOG_WARN("Replica fetcher for broker {} failed: {}", this->leader, e.what());
+                }
+                disconnect();
+                in_flight = false;
+                sleep(stop, this->manager.options.error_backoff);
+            }
+        }
+        disconnect();
+    }
+
+    // Follows the partitions the metadata now says this leader leads and this broker replicates.
+    void refresh_partitions()
+    {
+        std::vector<PartitionKey> wanted;
+        {
+            auto snapshot = this->manager.store->snapshot();
+            for (const auto &[topic_id, partitions] : snapshot->topicToPars)
+            {
+                for (const auto &state : partitions)
+                {
+                    if (state.leader == this->leader && this->manager.role_of(state) == Role::Follower)
+                    {
+                        wanted.emplace_back(topic_id, state.partition_id);
+                    }
+                }
+            }
+        }
+
+        std::map<PartitionKey, Followed, TopicIdLess> refreshed;
+        for (auto &key : wanted)
+        {
+            auto it = this->followed.find(key);
+            if (it != this->followed.end())
+            {
+                refreshed.emplace(key, it->second);
+                continue;
+            }
+            int64_t end = ShardSet::call_home(this->manager.shards.get(), key.first, key.second, [&]
+                                              { return this->manager.store->log_end_offset(key.first, key.second); });
+            refreshed.emplace(std::move(key), Followed{end, end});
+        }
+        if (refreshed.size() != this->followed.size())
+        {
+            LOG_INFO("Following {} partitions led by broker {}", refreshed.size(), this->leader);
+        }
+        this->followed = std::move(refreshed);
+        this->next_refresh = Clock::now() + this->manager.options.metadata_refresh;
+    }
+
+    // The leader's log no longer holds our offset. An empty local log starts over at the
+    // leader's log start; a diverged one needs truncation, which isn't supported.
+    void restart_out_of_range(const PartitionKey &key, Followed &followed, const PartitionData &data)
+    {
+        int64_t end = ShardSet::call_home(this->manager.shards.get(), key.first, key.second, [&]
+                                          { return this->manager.store->log_end_offset(key.first, key.second); });
+        if (end == 0 && data.log_start_offset > 0)
+        {
+            followed.fetch_offset = data.log_start_offset;
+            return;
+        }
+        LOG_ERROR("Offset {} of partition {} is out of range on broker {}", followed.fetch_offset, key.second, this->leader);
+        followed.fetch_offset = end;
+        followed.paused_until = Clock::now() + this->manager.options.error_backoff;
+    }
+
+    void append(const PartitionKey &key, const PartitionData &data)
+    {
+        auto followed = this->followed.find(key);
+        if (followed == this->followed.end())
+        {
+            return;
+        }
+        if (data.records.empty())
+        {
+            // Caught up: the local log ends where the request asked to continue.
+            this->manager.on_leader_response(key, data.high_watermark, followed->second.fetch_offset);
+            return;
+        }
+
+        int64_t end = -1;
+        try
+        {
+            end = ShardSet::call_home(this->manager.shards.get(), key.first, key.second, [&]
+                                      {
+                                          int64_t appended = this->manager.store->append_records(key.first, key.second, data.records);
+                                          this->manager.on_leader_response(key, data.high_watermark, appended);
+                                          return appended; });
+            this->manager.fetched_bytes.fetch_add(data.records.size(), std::memory_order_relaxed);
+        }
+        catch (const std::exception &e)
+        {
+            this->manager.append_errors.fetch_add(1, std::memory_order_relaxed);
+            LOG_ERROR("Failed to append replicated records of partition {}: {}", key.second, e.what());
+            // Resume from what the log really holds; the request in flight is re-checked on append.
+            end = ShardSet::call_home(this->manager.shards.get(), key.first, key.second, [&]
+                                      {
+                                          int64_t local_end = this->manager.store->log_end_offset(key.first, key.second);
+                                          this->manager.on_leader_response(key, data.high_watermark, local_end);
+                                          return local_end; });
+            followed->second.fetch_offset = end;
+        }
+    }
+
+    void connect_to_leader()
+    {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to create socket");
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(this->address.port);
+        if (inet_pton(AF_INET, this->address.host.c_str(), &addr.sin_addr) != 1)
+        {
+            ::close(fd);
+            throw std::runtime_error("Invalid broker address " + this->address.host);
+        }
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to connect to " + this->address.host + ":" + std::to_string(this->address.port) + ": " + std::strerror(error));
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        timeval timeout{std::chrono::duration_cast<std::chrono::seconds>(kSocketTimeout).count(), 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        this->socket_fd.store(fd);
+        LOG_INFO("Connected to leader broker {} at {}:{}", this->leader, this->address.host, this->address.port);
+    }
+
+    void disconnect()
+    {
+        int fd = this->socket_fd.exchange(-1);
+        if (fd != -1)
+        {
+            ::close(fd);
+        }
+    }
+
+    // A Fetch v16 request for every followed partition, with this broker's ReplicaState.
+    void send_fetch()
+    {
+        kafka::protocol::Response body(0);
+        body.writeInt32(0); // max_wait_ms
+        body.writeInt32(1); // min_bytes
+        body.writeInt32(std::numeric_limits<int32_t>::max());
+        body.writeInt8(0);  // isolation_level
+        body.writeInt32(0); // session_id
+        body.writeInt32(-1); // session_epoch
+
+        std::map<std::vector<uint8_t>, std::vector<std::pair<int32_t, int64_t>>, TopicIdLess> by_topic;
+        auto now = Clock::now();
+        for (auto &[key, followed] : this->followed)
+        {
+            if (followed.paused_until > now)
+            {
+                continue;
+            }
+            by_topic[key.first].emplace_back(key.second, followed.fetch_offset);
+            followed.requested = followed.fetch_offset;
+        }
+        body.writeUnsignedVarint(by_topic.size() + 1);
+        for (const auto &[topic_id, partitions] : by_topic)
+        {
+            body.writeBytes(topic_id);
+            body.writeUnsignedVarint(partitions.size() + 1);
+            for (auto [partition, fetch_offset] : partitions)
+            {
+                body.writeInt32(partition);
+                body.writeInt32(-1); // current_leader_epoch
+                body.writeInt64(fetch_offset);
+                body.writeInt32(-1); // last_fetched_epoch
+                body.writeInt64(-1); // log_start_offset
+                body.writeInt32(this->manager.options.partition_max_bytes);
+                body.writeInt8(0); // partition tagged fields
+            }
+            body.writeInt8(0); // topic tagged fields
+        }
+        body.writeUnsignedVarint(1); // forgotten_topics_data (empty)
+        body.writeUnsignedVarint(1); // rack_id ("")
+
+        body.writeUnsignedVarint(1); // tagged fields: ReplicaState
+        body.writeUnsignedVarint(FetchRequestData::kReplicaStateTag);
+        body.writeUnsignedVarint(sizeof(int32_t) + sizeof(int64_t) + 1);
+        body.writeInt32(this->manager.options.broker_id);
+        body.writeInt64(-1); // replica_epoch
+        body.writeInt8(0);   // ReplicaState tagged fields
+
+        const std::string client_id = "replica-fetcher-" + std::to_string(this->manager.options.broker_id);
+        kafka::protocol::Response frame(0);
+        frame.writeInt32(static_cast<int32_t>(2 + 2 + 4 + 2 + client_id.size() + 1 + body.get_data().size()));
+        frame.writeInt16(kFetchApiKey);
+        frame.writeInt16(kFetchVersion);
+        frame.writeInt32(++this->correlation_id);
+        frame.writeInt16(static_cast<int16_t>(client_id.size()));
+        frame.writeRawBytes(client_id.data(), client_id.size());
+        frame.writeInt8(0); // header tagged fields
+        frame.writeRawBytes(body.get_data().data(), body.get_data().size());
+
+        const auto &bytes = frame.get_data();
+        std::size_t sent = 0;
+        while (sent < bytes.size())
+        {
+            ssize_t n = ::send(this->socket_fd.load(), bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                throw std::runtime_error(std::string("Failed to send fetch: ") + std::strerror(errno));
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        this->manager.fetch_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void read_exactly(char *out, std::size_t size)
+    {
+        std::size_t received = 0;
+        while (received < size)
+        {
+            ssize_t n = ::recv(this->socket_fd.load(), out + received, size - received, 0);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                throw std::runtime_error(n == 0 ? "Leader closed the connection" : std::string("Failed to receive fetch response: ") + std::strerror(errno));
+            }
+            received += static_cast<std::size_t>(n);
+        }
+    }
+
+    // The next response frame, without its size prefix.
+    std::vector<char> receive()
+    {
+        uint32_t size_be;
+        read_exactly(reinterpret_cast<char *>(&size_be), sizeof(size_be));
+        int32_t size = static_cast<int32_t>(ntohl(size_be));
+        if (size < 4)
+        {
+            throw std::runtime_error("Malformed fetch response");
+        }
+        std::vector<char> frame(static_cast<std::size_t>(size));
+        read_exactly(frame.data(), frame.size());
+        return frame;
+    }
+
+    std::map<PartitionKey, PartitionData, TopicIdLess> parse(const std::vector<char> &frame) const
+    {
+        kafka::protocol::BufferReader reader(frame);
+        // At most one request is in flight, so the response must answer the last one sent.
+        if (reader.readInt32() != this->correlation_id)
+        {
+            throw std::runtime_error("Fetch response out of order");
+        }
+        reader.skipTaggedFields(); // Response header
+        reader.readInt32();        // throttle_time_ms
+        int16_t error_code = reader.readInt16();
+        if (error_code != 0)
+        {
+            throw std::runtime_error("Fetch failed with error " + std::to_string(error_code));
+        }
+        reader.readInt32(); // session_id
+
+        std::map<PartitionKey, PartitionData, TopicIdLess> partitions;
+        uint32_t topics = reader.readUnsignedVarint();
+        for (uint32_t t = 1; t < topics; ++t)
+        {
+            std::vector<uint8_t> topic_id = reader.readBytes(16);
+            uint32_t count = reader.readUnsignedVarint();
+            for (uint32_t p = 1; p < count; ++p)
+            {
+                int32_t partition = reader.readInt32();
+                PartitionData data;
+                data.error_code = reader.readInt16();
+                data.high_watermark = reader.readInt64();
+                reader.readInt64(); // last_stable_offset
+                data.log_start_offset = reader.readInt64();
+                uint32_t aborted = reader.readUnsignedVarint();
+                for (uint32_t a = 1; a < aborted; ++a)
+                {
+                    reader.skip(2 * sizeof(int64_t));
+                    reader.skipTaggedFields();
+                }
+                reader.readInt32(); // preferred_read_replica
+                uint32_t records = reader.readUnsignedVarint();
+                if (records > 1)
+                {
+                    data.records = reader.readBytes(records - 1);
+                }
+                reader.skipTaggedFields();
+                partitions.emplace(PartitionKey{topic_id, partition}, std::move(data));
+            }
+            reader.skipTaggedFields();
+        }
+        return partitions;
+    }
+
+    void sleep(std::stop_token stop, std::chrono::milliseconds duration)
+    {
+        std::unique_lock<std::mutex> lock(this->sleep_mutex);
+        this->sleep_cv.wait_for(lock, stop, duration, []
+                                { return false; });
+    }
+
+    ReplicaManager &manager;
+    int32_t leader;
+    BrokerAddress address;
+
+    std::map<PartitionKey, Followed, TopicIdLess> followed; // Fetcher thread only
+    Clock::time_point next_refresh{};
+    std::atomic<int> socket_fd{-1};
+    int32_t correlation_id = 0;
+
+    std::mutex sleep_mutex;
+    std::condition_variable_any sleep_cv;
+    std::jthread thread; // Last, so it stops before the members it uses go away
+};
+
+ReplicaManager::ReplicaManager(Options options, std::shared_ptr<IMetadataStore> store, std::shared_ptr<ShardSet> shards)
+    : options(std::move(options)), store(std::move(store)), shards(std::move(shards))
+{
+    if (this->shards)
+    {
+        shard_partitions.resize(this->shards->size());
+    }
+}
+
+ReplicaManager::~ReplicaManager() = default;
+
+std::map<int32_t, ReplicaManager::BrokerAddress> ReplicaManager::parse_peers(const std::string &text)
+{
+    std::map<int32_t, BrokerAddress> peers;
+    std::stringstream list(text);
+    std::string entry;
+    while (std::getline(list, entry, ','))
+    {
+        std::size_t at = entry.find('@');
+        std::size_t colon = entry.rfind(':');
+        if (at == std::string::npos || colon == std::string::npos || colon < at)
+        {
+            throw std::runtime_error("Expected <broker id>@<host>:<port>, got " + entry);
+        }
+        peers[std::stoi(entry.substr(0, at))] = BrokerAddress{entry.substr(at + 1, colon - at - 1), std::stoi(entry.substr(colon + 1))};
+    }
+    return peers;
+}
+
+void ReplicaManager::start()
+{
+    for (const auto &[id, address] : options.peers)
+    {
+        if (id != options.broker_id)
+        {
+            fetchers.push_back(std::make_unique<Fetcher>(*this, id, address));
+        }
+    }
+}
+
+ReplicaManager::Role ReplicaManager::role_of(const PartitionState &state) const
+{
+    auto is_peer = [&](int32_t id)
+    { return id != options.broker_id && options.peers.count(id) != 0; };
+
+    if (state.leader == options.broker_id)
+    {
+        return std::any_of(state.replicas.begin(), state.replicas.end(), is_peer) ? Role::Leader : Role::None;
+    }
+    bool replica = std::find(state.replicas.begin(), state.replicas.end(), options.broker_id) != state.replicas.end();
+    return replica && is_peer(state.leader) ? Role::Follower : Role::None;
+}
+
+template <typename Op>
+auto ReplicaManager::with_partitions(const PartitionKey &key, Op op)
+{
+    if (!shards)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return op(partitions);
+    }
+    return ShardSet::call_home(shards.get(), key.first, key.second, [&]
+                               { return op(shard_partitions[ShardSet::current()].partitions); });
+}
+
+ReplicaManager::PartitionReplicas *ReplicaManager::replicas_for(Partitions &partitions, const PartitionKey &key, Clock::time_point now)
+{
+    PartitionState state;
+    {
+        auto snapshot = store->snapshot();
+        auto topic = snapshot->topicToPars.find(key.first);
+        if (topic == snapshot->topicToPars.end())
+        {
+            return nullptr;
+        }
+        auto it = std::lower_bound(topic->second.begin(), topic->second.end(), key.second, [](const PartitionState &p, int32_t id)
+                                   { return p.partition_id < id; });
+        if (it == topic->second.end() || it->partition_id != key.second)
+        {
+            return nullptr;
+        }
+        state = *it;
+    }
+
+    Role role = role_of(state);
+    if (role == Role::None)
+    {
+        partitions.erase(key);
+        return nullptr;
+    }
+    PartitionReplicas &replicas = partitions[key];
+    if (replicas.role != role || replicas.leader != state.leader)
+    {
+        // New, or leadership moved: start over, giving followers a full lag window to catch up.
+        replicas = PartitionReplicas{};
+        replicas.role = role;
+        replicas.leader = state.leader;
+        if (role == Role::Leader)
+        {
+            for (int32_t id : state.replicas)
+            {
+                if (id != options.broker_id && options.peers.count(id) != 0)
+                {
+                    replicas.followers[id].caught_up_at = now;
+                }
+            }
+        }
+    }
+    return &replicas;
+}
+
+void ReplicaManager::update_isr(const PartitionKey &key, PartitionReplicas &replicas, Clock::time_point now)
+{
+    for (auto &[id, follower] : replicas.followers)
+    {
+        bool in_sync = follower.log_end_offset >= replicas.log_end_offset || now - follower.caught_up_at <= options.replica_lag_time_max;
+        if (in_sync == follower.in_sync)
+        {
+            continue;
+        }
+        follower.in_sync = in_sync;
+        (in_sync ? isr_expands : isr_shrinks).fetch_add(1, std::memory_order_relaxed);
+        LOG_INFO("Broker {} {} the in-sync replicas of partition {} at offset {}", id, in_sync ? "joined" : "left", key.second, follower.log_end_offset);
+    }
+}
+
+void ReplicaManager::on_follower_fetch(int32_t replica_id, const std::vector<uint8_t> &topic_id, int32_t partition, int64_t fetch_offset, int64_t log_end_offset)
+{
+    if (options.peers.empty())
+    {
+        return;
+    }
+    PartitionKey key{topic_id, partition};
+    with_partitions(key, [&](Partitions &partitions)
+                    {
+                        auto now = Clock::now();
+                        PartitionReplicas *replicas = replicas_for(partitions, key, now);
+                        if (!replicas || replicas->role != Role::Leader)
+                        {
+                            return;
+                        }
+                        auto follower = replicas->followers.find(replica_id);
+                        if (follower == replicas->followers.end())
+                        {
+                            return; // Not a replica of this partition
+                        }
+                        replicas->log_end_offset = log_end_offset;
+                        follower->second.log_end_offset = fetch_offset;
+                        if (fetch_offset >= log_end_offset)
+                        {
+                            follower->second.caught_up_at = now;
+                        }
+                        update_isr(key, *replicas, now); });
+}
+
+int64_t ReplicaManager::high_watermark(const std::vector<uint8_t> &topic_id, int32_t partition, int64_t log_end_offset)
+{
+    if (options.peers.empty())
+    {
+        return log_end_offset;
+    }
+    PartitionKey key{topic_id, partition};
+    return with_partitions(key, [&](Partitions &partitions)
+                           {
+                               auto now = Clock::now();
+                               PartitionReplicas *replicas = replicas_for(partitions, key, now);
+                               if (!replicas)
+                               {
+                                   return log_end_offset;
+                               }
+                               replicas->log_end_offset = log_end_offset;
+                               if (replicas->role == Role::Follower)
+                               {
+                                   return std::min(replicas->high_watermark, log_end_offset);
+                               }
+
+                               update_isr(key, *replicas, now);
+                               int64_t committed = log_end_offset;
+                               for (const auto &[id, follower] : replicas->followers)
+                               {
+                                   // A follower that has not fetched yet says nothing about what it holds.
+                                   if (follower.in_sync && follower.log_end_offset >= 0)
+                                   {
+                                       committed = std::min(committed, follower.log_end_offset);
+                                   }
+                               }
+                               // Never moves back, even when a lagging follower rejoins the in-sync set.
+                               replicas->high_watermark = std::max(replicas->high_watermark, committed);
+                               return std::min(replicas->high_watermark, log_end_offset); });
+}
+
+void ReplicaManager::on_leader_response(const PartitionKey &key, int64_t high_watermark, int64_t log_end_offset)
+{
+    with_partitions(key, [&](Partitions &partitions)
+                    {
+                        PartitionReplicas *replicas = replicas_for(partitions, key, Clock::now());
+                        if (replicas && replicas->role == Role::Follower)
+                        {
+                            replicas->log_end_offset = log_end_offset;
+                            replicas->high_watermark = std::max(replicas->high_watermark, std::min(high_watermark, log_end_offset));
+                        } });
+}
+
+ReplicaManager::Stats ReplicaManager::stats() const
+{
+    return Stats{fetch_requests.load(std::memory_order_relaxed), fetched_bytes.load(std::memory_order_relaxed),
+                 append_errors.load(std::memory_order_relaxed), isr_shrinks.load(std::memory_order_relaxed),
+                 isr_expands.load(std::memory_order_relaxed)};
+}
+
+void ReplicaManager::write_metrics(std::ostream &out) const
+{
+    auto snapshot = store->snapshot();
+    auto write = [&](const Partitions &partitions)
+    {
+        for (const auto &[key, replicas] : partitions)
+        {
+            std::string labels = "partition=\"" + partition_name(*snapshot, key.first, key.second) + "\"";
+            out << "replica_role{" << labels << ",role=\"" << (replicas.role == Role::Leader ? "leader" : "follower") << "\"} 1\n"
+                << "replica_log_end_offset{" << labels << "} " << replicas.log_end_offset << '\n'
+                << "replica_high_watermark{" << labels << "} " << replicas.high_watermark << '\n';
+            if (replicas.role != Role::Leader)
+            {
+                continue;
+            }
+            std::size_t in_sync = 1;
+            for (const auto &[id, follower] : replicas.followers)
+            {
+                in_sync += follower.in_sync ? 1 : 0;
+                if (follower.log_end_offset >= 0)
+                {
+                    out << "replica_follower_lag{" << labels << ",broker=\"" << id << "\"} " << replicas.log_end_offset - follower.log_end_offset << '\n';
+                }
+            }
+            out << "replica_isr_size{" << labels << "} " << in_sync << '\n';
+        }
+    };
+    if (shards)
+    {
+        for (unsigned shard = 0; shard < shards->size(); ++shard)
+        {
+            shards->call(shard, [&]
+                         { write(shard_partitions[shard].partitions); });
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        write(partitions);
+    }
+    auto totals = stats();
+    out << "replica_fetch_requests_total " << totals.fetch_requests << '\n'
+        << "replica_fetched_bytes_total " << totals.fetched_bytes << '\n'
+        << "replica_append_errors_total " << totals.append_errors << '\n'
+        << "replica_isr_shrinks_total " << totals.isr_shrinks << '\n'
+        << "replica_isr_expands_total " << totals.isr_expands << '\n';
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "storage/IMetadataStore.hpp"
+#include "core/ShardSet.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Leader/follower replication of partition data between brokers.
+ *
+ * Roles come from the metadata: a broker leads the partitions whose leader is its
+ * id and follows those that list it as a replica under another leader. Only brokers
+ * named in `peers` take part, so a broker started without peers serves every
+ * partition on its own, as before.
+ *
+ * As a follower, one fetcher thread per leader sends Fetch requests carrying this
+ * broker's id for all partitions it follows there. When a response brings data,
+ * the next request goes out before the data is appended locally, so the disk write
+ * overlaps the round trip to the leader.
+ *
+ * As the leader, the offset a follower fetches from is its log end offset. The
+ * high watermark, the end of what consumers may read, is the lowest log end offset
+ * among the leader and its in-sync followers. A follower stays in sync while it has
+ * reached the leader's log end within `replica_lag_time_max`. The in-sync set is
+ * tracked by the leader only; the ISR in the metadata log is written by the
+ * controller and is not updated. A follower's log end offset is unknown until its
+ * first fetch, and until then it does not hold back the high watermark.
+ *
+ * With sharding on, a partition's replica state lives on its home shard and is only
+ * touched from there, like its log. Callers already on that shard run inline.
+ */
+class ReplicaManager
+{
+public:
+    struct BrokerAddress
+    {
+        std::string host;
+        int port;
+    };
+
+    struct Options
+    {
+        int32_t broker_id = 1;
+        std::map<int32_t, BrokerAddress> peers; // The other brokers, by id
+        std::chrono::milliseconds replica_lag_time_max{10000};
+        std::chrono::milliseconds idle_backoff{10};       // Between fetches that returned nothing
+        std::chrono::milliseconds error_backoff{1000};    // Before reconnecting to a leader
+        std::chrono::milliseconds metadata_refresh{1000}; // How often fetchers re-read their partitions
+        int32_t partition_max_bytes = 1 << 20;
+    };
+
+    struct Stats
+    {
+        uint64_t fetch_requests;
+        uint64_t fetched_bytes;
+        uint64_t append_errors;
+        uint64_t isr_shrinks;
+        uint64_t isr_expands;
+    };
+
+    ReplicaManager(Options options, std::shared_ptr<IMetadataStore> store, std::shared_ptr<ShardSet> shards = nullptr);
+    ~ReplicaManager();
+
+    ReplicaManager(const ReplicaManager &) = delete;
+    ReplicaManager &operator=(const ReplicaManager &) = delete;
+
+    // Parses "2@127.0.0.1:9093,3@127.0.0.1:9094".
+    static std::map<int32_t, BrokerAddress> parse_peers(const std::string &text);
+
+    // Starts one fetcher per peer that leads partitions this broker follows.
+    void start();
+
+    // Leader side: a follower fetched `partition` from `fetch_offset`, which is its log end offset.
+    void on_follower_fetch(int32_t replica_id, const std::vector<uint8_t> &topic_id, int32_t partition, int64_t fetch_offset, int64_t log_end_offset);
+
+    // End of the records consumers may read, given the local log end offset.
+    int64_t high_watermark(const std::vector<uint8_t> &topic_id, int32_t partition, int64_t log_end_offset);
+
+    Stats stats() const;
+
+    // Per-partition high watermark, in-sync set and follower lag, in the metrics text format.
+    void write_metrics(std::ostream &out) const;
+
+private:
+    class Fetcher;
+    using Clock = std::chrono::steady_clock;
+    using PartitionKey = std::pair<std::vector<uint8_t>, int32_t>;
+
+    enum class Role
+    {
+        None,
+        Leader,
+        Follower,
+    };
+
+    struct FollowerState
+    {
+        int64_t log_end_offset = -1; // Unknown until its first fetch
+        Clock::time_point caught_up_at; // Last time it had reached the leader's log end
+        bool in_sync = true;
+    };
+
+    struct PartitionReplicas
+    {
+        Role role = Role::None;
+        int32_t leader = -1;
+        std::map<int32_t, FollowerState> followers; // Leader only
+        int64_t high_watermark = 0;
+        int64_t log_end_offset = 0;
+    };
+
+    using Partitions = std::map<PartitionKey, PartitionReplicas, TopicIdLess>;
+
+    Role role_of(const PartitionState &state) const;
+    // Runs `op` on the replica state of the partition's home shard, or under `mutex` when sharding is off.
+    template <typename Op>
+    auto with_partitions(const PartitionKey &key, Op op);
+    // The replica state of a partition, reset when its role or leader changed.
+    PartitionReplicas *replicas_for(Partitions &partitions, const PartitionKey &key, Clock::time_point now);
+    void update_isr(const PartitionKey &key, PartitionReplicas &replicas, Clock::time_point now);
+    // Follower side: the leader reported `high_watermark` and the local log now ends at `log_end_offset`.
+    void on_leader_response(const PartitionKey &key, int64_t high_watermark, int64_t log_end_offset);
+
+    Options options;
+    std::shared_ptr<IMetadataStore> store;
+    std::shared_ptr<ShardSet> shards;
+
+    mutable std::mutex mutex; // Guards partitions
+    Partitions partitions;    // When sharding is off
+
+    // The replica state of the partitions each shard is home to, only touched from that shard.
+    struct alignas(64) ShardPartitions
+    {
+        Partitions partitions;
+    };
+    std::vector<ShardPartitions> shard_partitions;
+
+    std::vector<std::unique_ptr<Fetcher>> fetchers;
+
+    std::atomic<uint64_t> fetch_requests{0};
+    std::atomic<uint64_t> fetched_bytes{0};
+    std::atomic<uint64_t> append_errors{0};
+    std::atomic<uint64_t> isr_shrinks{0};
+    std::atomic<uint64_t> isr_expands{0};
+};
@@ -0,0 +1,274 @@
+#include "storage/Codec.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#ifdef MINIKAFKA_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MINIKAFKA_WITH_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef MINIKAFKA_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+    [[noreturn]] void unsupported(CompressionType type)
+    {
+        throw std::runtime_error(std::string("Compression codec not available in this build: ") + codec::name(type));
+    }
+
+    std::size_t initial_capacity(std::size_t size, std::size_t size_hint)
+    {
+        return size_hint != 0 ? size_hint : std::max<std::size_t>(size * 4, 1024);
+    }
+
+#ifdef MINIKAFKA_WITH_ZLIB
+    std::vector<uint8_t> gzip_compress(const uint8_t *data, std::size_t size)
+    {
+        z_stream zs{};
+        if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("gzip: deflateInit2 failed");
+        }
+        std::vector<uint8_t> out(deflateBound(&zs, size) + 32);
+        zs.next_in = const_cast<Bytef *>(data);
+        zs.avail_in = static_cast<uInt>(size);
+        zs.next_out = out.data();
+        zs.avail_out = static_cast<uInt>(out.size());
+        int ret = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        if (ret != Z_STREAM_END)
+        {
+            throw std::runtime_error("gzip: compression failed");
+        }
+        return out;
+    }
+
+    std::vector<uint8_t> gzip_decompress(const uint8_t *data, std::size_t size, std::size_t size_hint)
+    {
+        z_stream zs{};
+        if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+        {
+            throw std::runtime_error("gzip: inflateInit2 failed");
+        }
+        std::vector<uint8_t> out(initial_capacity(size, size_hint));
+        zs.next_in = const_cast<Bytef *>(data);
+        zs.avail_in = static_cast<uInt>(size);
+
+        int ret = Z_OK;
+        while (ret != Z_STREAM_END)
+        {
+            if (zs.total_out == out.size())
+            {
+                out.resize(out.size() * 2);
+            }
+            zs.next_out = out.data() + zs.total_out;
+            zs.avail_out = static_cast<uInt>(out.size() - zs.total_out);
+            ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END)
+            {
+                inflateEnd(&zs);
+                throw std::runtime_error("gzip: corrupt or truncated input");
+            }
+            if (ret == Z_OK && zs.avail_in == 0 && zs.avail_out != 0)
+            {
+                inflateEnd(&zs);
+                throw std::runtime_error("gzip: truncated input");
+            }
+        }
+        out.resize(zs.total_out);
+        inflateEnd(&zs);
+        return out;
+    }
+#endif
+
+#ifdef MINIKAFKA_WITH_LZ4
+    std::vector<uint8_t> lz4_compress(const uint8_t *data, std::size_t size)
+    {
+        std::vector<uint8_t> out(LZ4F_compressFrameBound(size, nullptr));
+        std::size_t n = LZ4F_compressFrame(out.data(), out.size(), data, size, nullptr);
+        if (LZ4F_isError(n))
+        {
+            throw std::runtime_error(std::string("lz4: ") + LZ4F_getErrorName(n));
+        }
+        out.resize(n);
+        return out;
+    }
+
+    std::vector<uint8_t> lz4_decompress(const uint8_t *data, std::size_t size, std::size_t size_hint)
+    {
+        LZ4F_dctx *dctx = nullptr;
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)))
+        {
+            throw std::runtime_error("lz4: cannot create decompression context");
+        }
+
+        std::vector<uint8_t> out(initial_capacity(size, size_hint));
+        std::size_t in_pos = 0;
+        std::size_t out_pos = 0;
+        std::size_t ret = 1;
+        while (ret != 0)
+        {
+            if (out_pos == out.size())
+            {
+                out.resize(out.size() * 2);
+            }
+            std::size_t dst = out.size() - out_pos;
+            std::size_t src = size - in_pos;
+            ret = LZ4F_decompress(dctx, out.data() + out_pos, &dst, data + in_pos, &src, nullptr);
+            if (LZ4F_isError(ret) || (ret != 0 && in_pos + src == size && dst == 0))
+            {
+                LZ4F_freeDecompressionContext(dctx);
+                throw std::runtime_error("lz4: corrupt or truncated frame");
+            }
+            in_pos += src;
+            out_pos += dst;
+        }
+        LZ4F_freeDecompressionContext(dctx);
+        out.resize(out_pos);
+        return out;
+    }
+#endif
+
+#ifdef MINIKAFKA_WITH_ZSTD
+    std::vector<uint8_t> zstd_compress(const uint8_t *data, std::size_t size)
+    {
+        std::vector<uint8_t> out(ZSTD_compressBound(size));
+        std::size_t n = ZSTD_compress(out.data(), out.size(), data, size, 3);
+        if (ZSTD_isError(n))
+        {
+            throw std::runtime_error(std::string("zstd: ") + ZSTD_getErrorName(n));
+        }
+        out.resize(n);
+        return out;
+    }
+
+    std::vector<uint8_t> zstd_decompress(const uint8_t *data, std::size_t size, std::size_t size_hint)
+    {
+        // Producers stream-compress, so the frame may not record its content size.
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        if (!dctx)
+        {
+            throw std::runtime_error("zstd: cannot create decompression context");
+        }
+
+        std::vector<uint8_t> out(initial_capacity(size, size_hint));
+        ZSTD_inBuffer in{data, size, 0};
+        std::size_t out_pos = 0;
+        std::size_t ret = 1;
+        while (ret != 0)
+        {
+            if (out_pos == out.size())
+            {
+                out.resize(out.size() * 2);
+            }
+            ZSTD_outBuffer dst{out.data(), out.size(), out_pos};
+            ret = ZSTD_decompressStream(dctx, &dst, &in);
+            out_pos = dst.pos;
+            if (ZSTD_isError(ret) || (ret != 0 && in.pos == in.size && dst.pos < dst.size))
+            {
+                ZSTD_freeDCtx(dctx);
+                throw std::runtime_error("zstd: corrupt or truncated frame");
+            }
+        }
+        ZSTD_freeDCtx(dctx);
+        out.resize(out_pos);
+        return out;
+    }
+#endif
+}
+
+namespace codec
+{
+    bool is_supported(CompressionType type)
+    {
+        switch (type)
+        {
+        case CompressionType::None:
+            return true;
+#ifdef MINIKAFKA_WITH_ZLIB
+        case CompressionType::Gzip:
+            return true;
+#endif
+#ifdef MINIKAFKA_WITH_LZ4
+        case CompressionType::Lz4:
+            return true;
+#endif
+#ifdef MINIKAFKA_WITH_ZSTD
+        case CompressionType::Zstd:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    const char *name(CompressionType type)
+    {
+        switch (type)
+        {
+        case CompressionType::None:
+            return "none";
+        case CompressionType::Gzip:
+            return "gzip";
+        case CompressionType::Snappy:
+            return "snappy";
+        case CompressionType::Lz4:
+            return "lz4";
+        case CompressionType::Zstd:
+            return "zstd";
+        }
+        return "unknown";
+    }
+
+    std::vector<uint8_t> compress(CompressionType type, const uint8_t *data, std::size_t size)
+    {
+        switch (type)
+        {
+        case CompressionType::None:
+            return std::vector<uint8_t>(data, data + size);
+#ifdef MINIKAFKA_WITH_ZLIB
+        case CompressionType::Gzip:
+            return gzip_compress(data, size);
+#endif
+#ifdef MINIKAFKA_WITH_LZ4
+        case CompressionType::Lz4:
+            return lz4_compress(data, size);
+#endif
+#ifdef MINIKAFKA_WITH_ZSTD
+        case CompressionType::Zstd:
+            return zstd_compress(data, size);
+#endif
+        default:
+            unsupported(type);
+        }
+    }
+
+    std::vector<uint8_t> decompress(CompressionType type, const uint8_t *data, std::size_t size, std::size_t size_hint)
+    {
+        switch (type)
+        {
+        case CompressionType::None:
+            return std::vector<uint8_t>(data, data + size);
+#ifdef MINIKAFKA_WITH_ZLIB
+        case CompressionType::Gzip:
+            return gzip_decompress(data, size, size_hint);
+#endif
+#ifdef MINIKAFKA_WITH_LZ4
+        case CompressionType::Lz4:
+            return lz4_decompress(data, size, size_hint);
+#endif
+#ifdef MINIKAFKA_WITH_ZSTD
+        case CompressionType::Zstd:
+            return zstd_decompress(data, size, size_hint);
+#endif
+        default:
+            unsupported(type);
+        }
+    }
+
+} // namespace codec
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compression codecs, numbered as in the low three bits of a record batch's attributes.
+enum class CompressionType : uint8_t
+{
+    None = 0,
+    Gzip = 1,
+    Snappy = 2,
+    Lz4 = 3,
+    Zstd = 4,
+};
+
+/**
+ * @brief Compression for record batch payloads.
+ *
+ * Batches are stored and served compressed exactly as the producer sent them; the
+ * broker only decompresses when it has to look at individual records (metadata
+ * parsing, validation, compaction). Each codec is compiled in when its library is
+ * found at configure time; is_supported() reports what this build can handle.
+ */
+namespace codec
+{
+    bool is_supported(CompressionType type);
+    const char *name(CompressionType type);
+
+    // Compresses into the framing Kafka clients use (gzip stream, LZ4 frame, zstd frame).
+    std::vector<uint8_t> compress(CompressionType type, const uint8_t *data, std::size_t size);
+
+    // `size_hint` is the expected decompressed size if known, 0 otherwise.
+    std::vector<uint8_t> decompress(CompressionType type, const uint8_t *data, std::size_t size, std::size_t size_hint = 0);
+
+} // namespace codec
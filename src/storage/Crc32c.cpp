@@ -0,0 +1,271 @@
+#include "storage/Crc32c.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t kPoly = 0x82f63b78; // Reflected Castagnoli polynomial
+
+    // Tables for the portable slicing-by-8 implementation.
+    struct SliceTables
+    {
+        uint32_t table[8][256];
+
+        SliceTables()
+        {
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t crc = n;
+                for (int k = 0; k < 8; ++k)
+                {
+                    crc = crc & 1 ? (crc >> 1) ^ kPoly : crc >> 1;
+                }
+                table[0][n] = crc;
+            }
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t crc = table[0][n];
+                for (int k = 1; k < 8; ++k)
+                {
+                    crc = table[0][crc & 0xff] ^ (crc >> 8);
+                    table[k][n] = crc;
+                }
+            }
+        }
+    };
+
+    const SliceTables &slice_tables()
+    {
+        static const SliceTables tables;
+        return tables;
+    }
+
+#if defined(__x86_64__)
+    // The hardware path runs three independent crc32 streams over adjacent blocks to
+    // hide the instruction's latency, then folds them together. Folding a stream
+    // forward over `len` zero bytes is a linear operator, precomputed here as tables.
+    constexpr std::size_t kLongBlock = 8192;
+    constexpr std::size_t kShortBlock = 256;
+
+    uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+    {
+        uint32_t sum = 0;
+        while (vec)
+        {
+            if (vec & 1)
+            {
+                sum ^= *mat;
+            }
+            vec >>= 1;
+            mat++;
+        }
+        return sum;
+    }
+
+    void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+    {
+        for (int n = 0; n < 32; n++)
+        {
+            square[n] = gf2_matrix_times(mat, mat[n]);
+        }
+    }
+
+    // Operator that advances a CRC over `len` zero bytes (len a power of two).
+    void zeros_operator(uint32_t *even, std::size_t len)
+    {
+        uint32_t odd[32];
+        odd[0] = kPoly;
+        uint32_t row = 1;
+        for (int n = 1; n < 32; n++)
+        {
+            odd[n] = row;
+            row <<= 1;
+        }
+
+        gf2_matrix_square(even, odd); // 2 zero bits
+        gf2_matrix_square(odd, even); // 4 zero bits
+
+        // Each square doubles the shift; the first square here reaches one zero byte.
+        do
+        {
+            gf2_matrix_square(even, odd);
+            len >>= 1;
+            if (len == 0)
+            {
+                return;
+            }
+            gf2_matrix_square(odd, even);
+            len >>= 1;
+        } while (len);
+
+        std::memcpy(even, odd, sizeof(odd));
+    }
+
+    struct ShiftTables
+    {
+        uint32_t long_shift[4][256];
+        uint32_t short_shift[4][256];
+
+        static void build(uint32_t zeros[][256], std::size_t len)
+        {
+            uint32_t op[32];
+            zeros_operator(op, len);
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                zeros[0][n] = gf2_matrix_times(op, n);
+                zeros[1][n] = gf2_matrix_times(op, n << 8);
+                zeros[2][n] = gf2_matrix_times(op, n << 16);
+                zeros[3][n] = gf2_matrix_times(op, n << 24);
+            }
+        }
+
+        ShiftTables()
+        {
+            build(long_shift, kLongBlock);
+            build(short_shift, kShortBlock);
+        }
+    };
+
+    const ShiftTables &shift_tables()
+    {
+        static const ShiftTables tables;
+        return tables;
+    }
+
+    inline uint32_t shift(const uint32_t zeros[][256], uint32_t crc)
+    {
+        return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+    }
+
+    inline uint64_t load64(const unsigned char *p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    template <std::size_t Block>
+    __attribute__((target("sse4.2"))) inline void crc_3way(uint64_t &crc0, const unsigned char *&next, std::size_t &len, const uint32_t zeros[][256])
+    {
+        while (len >= Block * 3)
+        {
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+            const unsigned char *end = next + Block;
+            do
+            {
+                crc0 = _mm_crc32_u64(crc0, load64(next));
+                crc1 = _mm_crc32_u64(crc1, load64(next + Block));
+                crc2 = _mm_crc32_u64(crc2, load64(next + 2 * Block));
+                next += 8;
+            } while (next < end);
+            crc0 = shift(zeros, static_cast<uint32_t>(crc0)) ^ crc1;
+            crc0 = shift(zeros, static_cast<uint32_t>(crc0)) ^ crc2;
+            next += Block * 2;
+            len -= Block * 3;
+        }
+    }
+
+    __attribute__((target("sse4.2"))) uint32_t extend_sse42(uint32_t crc, const void *data, std::size_t len)
+    {
+        const ShiftTables &tables = shift_tables();
+        const unsigned char *next = static_cast<const unsigned char *>(data);
+        uint64_t crc0 = crc ^ 0xffffffff;
+
+        while (len && (reinterpret_cast<uintptr_t>(next) & 7) != 0)
+        {
+            crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *next++);
+            len--;
+        }
+
+        crc_3way<kLongBlock>(crc0, next, len, tables.long_shift);
+        crc_3way<kShortBlock>(crc0, next, len, tables.short_shift);
+
+        while (len >= 8)
+        {
+            crc0 = _mm_crc32_u64(crc0, load64(next));
+            next += 8;
+            len -= 8;
+        }
+        while (len)
+        {
+            crc0 = _mm_crc32_u8(static_cast<uint32_t>(crc0), *next++);
+            len--;
+        }
+        return static_cast<uint32_t>(crc0) ^ 0xffffffff;
+    }
+#endif
+
+    using ExtendFn = uint32_t (*)(uint32_t, const void *, std::size_t);
+
+    ExtendFn select_implementation()
+    {
+        return crc32c::hardware_available() ? crc32c::extend_hardware : crc32c::extend_software;
+    }
+}
+
+namespace crc32c
+{
+    uint32_t extend(uint32_t crc, const void *data, std::size_t len)
+    {
+        static const ExtendFn impl = select_implementation();
+        return impl(crc, data, len);
+    }
+
+    uint32_t extend_software(uint32_t crc, const void *data, std::size_t len)
+    {
+        const auto &t = slice_tables().table;
+        const unsigned char *next = static_cast<const unsigned char *>(data);
+        uint32_t c = crc ^ 0xffffffff;
+
+        while (len && (reinterpret_cast<uintptr_t>(next) & 7) != 0)
+        {
+            c = t[0][(c ^ *next++) & 0xff] ^ (c >> 8);
+            len--;
+        }
+        while (len >= 8)
+        {
+            uint32_t lo;
+            uint32_t hi;
+            std::memcpy(&lo, next, 4);
+            std::memcpy(&hi, next + 4, 4);
+            lo ^= c; // Little-endian byte order assumed, as on every platform we build for
+            c = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            next += 8;
+            len -= 8;
+        }
+        while (len)
+        {
+            c = t[0][(c ^ *next++) & 0xff] ^ (c >> 8);
+            len--;
+        }
+        return c ^ 0xffffffff;
+    }
+
+    uint32_t extend_hardware(uint32_t crc, const void *data, std::size_t len)
+    {
+#if defined(__x86_64__)
+        if (hardware_available())
+        {
+            return extend_sse42(crc, data, len);
+        }
+#endif
+        throw std::runtime_error("crc32c: no hardware support on this CPU");
+    }
+
+    bool hardware_available()
+    {
+#if defined(__x86_64__)
+        static const bool available = __builtin_cpu_supports("sse4.2");
+        return available;
+#else
+        return false;
+#endif
+    }
+
+} // namespace crc32c
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief CRC32C (Castagnoli), the checksum Kafka uses for record batches.
+ *
+ * crc32c() picks an implementation once at runtime: the SSE4.2 crc32 instruction
+ * with three interleaved streams where the CPU has it, otherwise a portable
+ * slicing-by-8 table implementation. Both produce identical results.
+ */
+namespace crc32c
+{
+    // Extends `crc` (0 for a fresh checksum) over `len` bytes of `data`.
+    uint32_t extend(uint32_t crc, const void *data, std::size_t len);
+
+    inline uint32_t compute(const void *data, std::size_t len)
+    {
+        return extend(0, data, len);
+    }
+
+    // Individual implementations, exposed for benchmarking and cross-checking.
+    uint32_t extend_software(uint32_t crc, const void *data, std::size_t len);
+    uint32_t extend_hardware(uint32_t crc, const void *data, std::size_t len);
+    bool hardware_available();
+
+} // namespace crc32c
@@ -3,6 +3,10 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <optional>
+#include "core/Rcu.hpp"
+#include "storage/MetadataSnapshot.hpp"
+#include "storage/PartitionLog.hpp"
 
 /**
  * @brief An interface for a data store that provides Kafka topic and partition metadata.
@@ -23,5 +27,24 @@ public:
 
     virtual std::vector<std::vector<uint8_t>> get_serialized_partitions(const std::vector<uint8_t> &topic_id) const = 0;
 
-    virtual std::vector<uint8_t> getEntireRecBatch(const std::vector<uint8_t> &uuid, const int32_t &parIndex) const = 0;
+    // The current metadata snapshot. Must not be held across a blocking call.
+    virtual rcu::ReadGuard<MetadataSnapshot> snapshot() const = 0;
+
+    // Record batches of a partition starting at `fetch_offset`, up to about `max_bytes`.
+    virtual PartitionLog::ReadResult read_records(const std::vector<uint8_t> &uuid, int32_t parIndex, int64_t fetch_offset, int32_t max_bytes) const = 0;
+
+    // Appends record batches copied from the partition leader; returns the new log end offset.
+    // Like read_records, runs on the partition's home shard when sharding is on.
+    virtual int64_t append_records(const std::vector<uint8_t> &uuid, int32_t parIndex, const std::vector<uint8_t> &batches) = 0;
+
+    virtual int64_t log_end_offset(const std::vector<uint8_t> &uuid, int32_t parIndex) const = 0;
+
+    // The offset for a ListOffsets timestamp, or nullopt for an unknown topic.
+    virtual std::optional<PartitionLog::OffsetLookup> list_offset(const std::vector<uint8_t> &uuid, int32_t parIndex, int64_t timestamp) const = 0;
+
+    // Segments of a partition that are no longer appended to, for the log compactor.
+    virtual std::vector<PartitionLog::SegmentInfo> closed_segments(const std::vector<uint8_t> &uuid, int32_t parIndex) const = 0;
+
+    // Swaps a compacted copy in for one of those segments.
+    virtual void replace_segment(const std::vector<uint8_t> &uuid, int32_t parIndex, int64_t base_offset, const std::string &rewritten) = 0;
 };
\ No newline at end of file
@@ -1,60 +1,112 @@
 #include "storage/KRaftMetadataStore.hpp"
+#include "protocol/Varint.hpp"
+#include "storage/RecordBatch.hpp"
+#include "core/Log.hpp"
 #include <fstream>
 #include <stdexcept>
 #include <cstring>
-#include <cassert>
-#include <iostream>
+#include <cstdio>
+#include <algorithm>
+#include <filesystem>
 #include <arpa/inet.h>
+#include <endian.h>
+
+using kafka::protocol::append_unsigned_varint;
+
+namespace
+{
+    void ensure_in_bounds(const std::vector<uint8_t> &buf, std::size_t offset, std::size_t len)
+    {
+        if (offset + len > buf.size())
+        {
+            throw std::runtime_error("KRaft metadata record truncated");
+        }
+    }
+
+    int32_t read_be_int32(const std::vector<uint8_t> &buf, std::size_t offset)
+    {
+        ensure_in_bounds(buf, offset, sizeof(int32_t));
+        int32_t val;
+        std::memcpy(&val, buf.data() + offset, sizeof(val));
+        return ntohl(val);
+    }
+
+    void append_be_int32(std::vector<uint8_t> &out, int32_t val)
+    {
+        int32_t be_val = htonl(val);
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(&be_val);
+        out.insert(out.end(), p, p + sizeof(be_val));
+    }
+}
 
 // Constructor and Main Parser
 
 KRaftMetadataStore::KRaftMetadataStore(const std::string &log_path)
+    : KRaftMetadataStore(log_path, Options{}) {}
+
+KRaftMetadataStore::KRaftMetadataStore(const std::string &log_path, Options options)
+    : log_path(log_path), options(std::move(options)), state(std::make_unique<MetadataSnapshot>())
 {
-    std::ifstream file(log_path, std::ios::binary);
-    if (!file)
+    if (this->options.shards)
     {
-        throw std::runtime_error("Failed to open KRaft log file: " + log_path);
+        shard_logs.resize(this->options.shards->size());
     }
-    this->cluster_metadata.assign((std::istreambuf_iterator<char>(file)), {});
+    std::error_code ec;
+    this->log_is_dir = std::filesystem::is_directory(log_path, ec);
+    std::filesystem::path metadata_dir = this->log_is_dir ? std::filesystem::path(log_path) : std::filesystem::path(log_path).parent_path();
+    this->log_dir = this->options.log_dir.empty() ? metadata_dir.parent_path().string() : this->options.log_dir;
 
-    if (this->cluster_metadata.empty())
+    if (this->log_is_dir ? metadata_segments().empty() : std::filesystem::file_size(log_path, ec) == 0 || ec)
     {
-        throw std::runtime_error("KRaft log file is empty or could not be read: " + log_path);
+        throw std::runtime_error("KRaft log is missing or empty: " + log_path);
     }
 
-    // Parse the loaded data
-    getBatch_info();  // for std::map<int64_t, int32_t> batch_info(batch_index,batch_size)
-    toRecords();      // for offsetToRec
-    getRecords_num(); // how many records in each RecordBatch. for std::vector<int32_t> records_num
+    if (!this->options.checkpoint_dir.empty())
+    {
+        auto segment_path = [this](int64_t base_offset)
+        { return this->segment_path(base_offset); };
+        if (auto checkpoint = MetadataCheckpoint(this->options.checkpoint_dir).load_latest(segment_path))
+        {
+            LOG_INFO("Loaded metadata checkpoint up to offset {}", checkpoint->next_offset);
+            for (const auto &[topic_id, name] : checkpoint->topicIdToName)
+            {
+                encodeDescribeEntry(*checkpoint, topic_id);
+            }
+            state.publish(std::move(checkpoint));
+        }
+    }
 
-    parseTopic();
-    parsePars();
+    catch_up();
+}
+
+KRaftMetadataStore::~KRaftMetadataStore()
+{
+    if (tailer.joinable())
+    {
+        tailer.request_stop();
+        tailer.join();
+    }
 }
 
 // IMetadataStore Interface Implementation
 
 bool KRaftMetadataStore::is_topic_known(const std::string &name) const
 {
-    return topic_name.find(name) != topic_name.end();
+    auto snapshot = state.read();
+    return snapshot->nameToTopicId.contains(name);
 }
 
 bool KRaftMetadataStore::is_uuid_known(const std::vector<uint8_t> &uuid) const
 {
-    for (const auto &[n, id] : nameToTopicId)
-    {
-        if (uuid == id)
-        {
-            return true;
-        }
-    }
-
-    return false;
+    auto snapshot = state.read();
+    return snapshot->topicIdToName.contains(uuid);
 }
 
 std::vector<uint8_t> KRaftMetadataStore::get_topic_uuid(const std::string &topicN) const
 {
-    auto it = nameToTopicId.find(topicN);
-    if (it != nameToTopicId.end())
+    auto snapshot = state.read();
+    auto it = snapshot->nameToTopicId.find(topicN);
+    if (it != snapshot->nameToTopicId.end())
     {
         return it->second;
     }
@@ -64,70 +116,424 @@ std::vector<uint8_t> KRaftMetadataStore::get_topic_uuid(const std::string &topic
 
 std::vector<std::vector<uint8_t>> KRaftMetadataStore::get_serialized_partitions(const std::vector<uint8_t> &topic_id) const
 {
-    auto it = topicToPars.find(topic_id);
-    if (it != topicToPars.end())
+    auto snapshot = state.read();
+    std::vector<std::vector<uint8_t>> serialized;
+
+    auto it = snapshot->topicToPars.find(topic_id);
+    if (it != snapshot->topicToPars.end())
     {
-        return it->second;
+        serialized.reserve(it->second.size());
+        for (const auto &partition : it->second)
+        {
+            serialized.push_back(partition.serialized);
+        }
     }
-    return {};
+    return serialized;
 }
 
-std::vector<uint8_t> KRaftMetadataStore::getEntireRecBatch(const std::vector<uint8_t> &topic_id, const int32_t &partition) const
+std::unique_ptr<PartitionLog> KRaftMetadataStore::open_partition_log(const std::vector<uint8_t> &topic_id, int32_t partition) const
 {
     std::string topic_name;
+    {
+        auto snapshot = state.read();
+        auto name = snapshot->topicIdToName.find(topic_id);
+        if (name == snapshot->topicIdToName.end())
+        {
+            return nullptr;
+        }
+        topic_name = name->second;
+    }
+
+    std::array<uint8_t, 16> id{};
+    std::copy_n(topic_id.begin(), std::min(topic_id.size(), id.size()), id.begin());
+    return std::make_unique<PartitionLog>(log_dir + "/" + topic_name + "-" + std::to_string(partition), id, partition,
+                                          options.batch_cache, options.read_ahead);
+}
 
-    for (const auto &[n, id] : nameToTopicId)
+template <typename Op>
+auto KRaftMetadataStore::with_partition_log(const std::vector<uint8_t> &topic_id, int32_t partition, Op op) const
+    -> std::optional<std::invoke_result_t<Op &, PartitionLog &>>
+{
+    if (options.shards)
     {
-        if (topic_id == id)
+        // Only the home shard touches a partition's log, so no lock is needed.
+        int shard = ShardSet::current();
+        if (shard < 0 || static_cast<unsigned>(shard) != options.shards->shard_for(topic_id, partition))
+        {
+            throw std::runtime_error("Partition access outside its home shard");
+        }
+        auto &logs = shard_logs[shard].logs;
+        auto it = logs.find({topic_id, partition});
+        if (it == logs.end())
+        {
+            auto created = open_partition_log(topic_id, partition);
+            if (!created)
+            {
+                return std::nullopt;
+            }
+            it = logs.emplace(std::make_pair(topic_id, partition), std::move(created)).first;
+        }
+        return op(*it->second);
+    }
+
+    std::shared_ptr<LockedPartitionLog> log;
+    {
+        std::lock_guard<std::mutex> lock(partition_logs_mutex);
+        auto it = partition_logs.find({topic_id, partition});
+        if (it == partition_logs.end())
+        {
+            auto created = open_partition_log(topic_id, partition);
+            if (!created)
+            {
+                return std::nullopt;
+            }
+            auto locked = std::make_shared<LockedPartitionLog>();
+            locked->log = std::move(created);
+            it = partition_logs.emplace(std::make_pair(topic_id, partition), std::move(locked)).first;
+        }
+        log = it->second;
+    }
+    std::lock_guard<std::mutex> lock(log->mutex);
+    return op(*log->log);
+}
+
+PartitionLog::ReadResult KRaftMetadataStore::read_records(const std::vector<uint8_t> &topic_id, int32_t partition, int64_t fetch_offset, int32_t max_bytes) const
+{
+    auto result = with_partition_log(topic_id, partition, [&](PartitionLog &log)
+                                     { return log.read(fetch_offset, max_bytes); });
+    return result ? std::move(*result) : PartitionLog::ReadResult{};
+}
+
+int64_t KRaftMetadataStore::append_records(const std::vector<uint8_t> &topic_id, int32_t partition, const std::vector<uint8_t> &batches)
+{
+    auto end = with_partition_log(topic_id, partition, [&](PartitionLog &log)
+                                  { return log.append(batches); });
+    if (!end)
+    {
+        throw std::runtime_error("Append to a partition of an unknown topic");
+    }
+    return *end;
+}
+
+int64_t KRaftMetadataStore::log_end_offset(const std::vector<uint8_t> &topic_id, int32_t partition) const
+{
+    return with_partition_log(topic_id, partition, [](PartitionLog &log)
+                              { return log.log_end_offset(); })
+        .value_or(0);
+}
+
+std::optional<PartitionLog::OffsetLookup> KRaftMetadataStore::list_offset(const std::vector<uint8_t> &topic_id, int32_t partition, int64_t timestamp) const
+{
+    return with_partition_log(topic_id, partition, [&](PartitionLog &log)
+                              { return log.list_offset(timestamp); });
+}
+
+std::vector<PartitionLog::SegmentInfo> KRaftMetadataStore::closed_segments(const std::vector<uint8_t> &topic_id, int32_t partition) const
+{
+    return with_partition_log(topic_id, partition, [](PartitionLog &log)
+                              { return log.closed_segments(); })
+        .value_or(std::vector<PartitionLog::SegmentInfo>());
+}
+
+void KRaftMetadataStore::replace_segment(const std::vector<uint8_t> &topic_id, int32_t partition, int64_t base_offset, const std::string &rewritten)
+{
+    auto replaced = with_partition_log(topic_id, partition, [&](PartitionLog &log)
+                                       {
+                                           log.replace_segment(base_offset, rewritten);
+                                           return true; });
+    if (!replaced)
+    {
+        throw std::runtime_error("Segment replaced in a partition of an unknown topic");
+    }
+}
+
+// Log Tailing
+
+void KRaftMetadataStore::start_tailing(std::chrono::milliseconds poll_interval)
+{
+    if (tailer.joinable())
+    {
+        return;
+    }
+    tailer = std::jthread([this, poll_interval](std::stop_token stop)
+                          { tail_loop(stop, poll_interval); });
+}
+
+void KRaftMetadataStore::tail_loop(std::stop_token stop, std::chrono::milliseconds poll_interval)
+{
+    while (!stop.stop_requested())
+    {
+        {
+            std::unique_lock<std::mutex> lock(tail_mutex);
+            tail_cv.wait_for(lock, stop, poll_interval, []
+                             { return false; });
+        }
+        if (stop.stop_requested())
         {
-            topic_name = n;
             break;
         }
+
+        try
+        {
+            if (catch_up())
+            {
+                LOG_INFO("Applied metadata log update, snapshot version {}", state.writer_view()->version);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Error tailing metadata log: {}", e.what());
+        }
+    }
+}
+
+bool KRaftMetadataStore::catch_up()
+{
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    const MetadataSnapshot *current = state.writer_view();
+
+    // Resume in the segment the last update stopped in, or the next one if it was deleted.
+    std::vector<int64_t> segments = metadata_segments();
+    auto segment = std::lower_bound(segments.begin(), segments.end(), current->log_segment);
+    if (segment == segments.end())
+    {
+        // The log was truncated underneath us, which we don't follow.
+        state.reclaim();
+        return false;
+    }
+    std::size_t position = *segment == current->log_segment ? current->log_position : 0;
+
+    std::unique_ptr<MetadataSnapshot> next;
+    std::set<std::vector<uint8_t>, TopicIdLess> touched;
+    std::size_t applied_bytes = 0;
+
+    // Records between the last one applied and the start of the log are gone: KRaft deleted
+    // their segments after taking a snapshot. Rebuild the state from that snapshot.
+    if (*segment > current->next_offset)
+    {
+        next = std::make_unique<MetadataSnapshot>();
+        if (!load_kraft_snapshot(*next, touched) || next->next_offset < *segment)
+        {
+            throw std::runtime_error("Metadata log starts at offset " + std::to_string(*segment) + " but only " +
+                                     std::to_string(current->next_offset) + " records were applied, and no snapshot covers the gap");
+        }
+        next->log_segment = *segment;
+        LOG_INFO("Loaded KRaft metadata snapshot up to offset {}", next->next_offset);
+    }
+
+    while (true)
+    {
+        // Only complete batches are applied; a partially written tail is picked up on the next call.
+        std::size_t file_size = 0;
+        std::vector<BatchInfo> batches = read_batches(segment_path(*segment), position, file_size);
+        if (!batches.empty())
+        {
+            if (!next)
+            {
+                next = std::make_unique<MetadataSnapshot>(*current);
+            }
+
+            // Batches a loaded snapshot already covers are skipped, but still count as read.
+            std::vector<BatchInfo> fresh;
+            for (const BatchInfo &batch : batches)
+            {
+                if (batch.base_offset + batch.last_offset_delta >= next->next_offset)
+                {
+                    fresh.push_back(batch);
+                }
+            }
+            apply_batches(*next, fresh, touched);
+
+            const BatchInfo &last = batches.back();
+            std::size_t end = last.position + record_batch::kLogOverhead + last.batch_len;
+            next->log_segment = *segment;
+            next->log_position = position + end;
+            next->next_offset = std::max(next->next_offset, last.base_offset + last.last_offset_delta + 1);
+            next->last_batch_position = position + last.position;
+            next->last_batch_crc = last.crc;
+            applied_bytes += end;
+            position += end;
+        }
+
+        // A newer segment means KRaft rolled this one, so it is complete once read to the end.
+        if (position < file_size || std::next(segment) == segments.end())
+        {
+            break;
+        }
+        ++segment;
+        position = 0;
+    }
+    this->cluster_metadata.clear();
+
+    if (!next)
+    {
+        state.reclaim();
+        return false;
+    }
+
+    // Only topics changed by this update are re-encoded; the rest are shared with the previous snapshot.
+    for (const auto &topic_id : touched)
+    {
+        encodeDescribeEntry(*next, topic_id);
+    }
+    next->version = current->version + 1;
+
+    state.publish(std::move(next));
+    uncheckpointed_bytes += applied_bytes;
+    maybe_checkpoint(*state.writer_view());
+    return true;
+}
+
+void KRaftMetadataStore::apply_batches(MetadataSnapshot &snapshot, const std::vector<BatchInfo> &batches,
+                                       std::set<std::vector<uint8_t>, TopicIdLess> &touched)
+{
+    for (auto &chunk : decodeBatches(this->cluster_metadata, batches))
+    {
+        for (auto &record : chunk)
+        {
+            if (auto *topic = std::get_if<TopicRecord>(&record))
+            {
+                touched.insert(topic->uuid);
+            }
+            else
+            {
+                touched.insert(std::get<PartitionRecord>(record).topic_uuid);
+            }
+            applyRecord(snapshot, std::move(record));
+        }
+    }
+}
+
+std::vector<int64_t> KRaftMetadataStore::metadata_segments() const
+{
+    if (!log_is_dir)
+    {
+        return {0};
+    }
+    std::vector<int64_t> segments;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(log_path, ec))
+    {
+        const auto &path = entry.path();
+        if (path.extension() != ".log")
+        {
+            continue;
+        }
+        try
+        {
+            segments.push_back(std::stoll(path.stem().string()));
+        }
+        catch (const std::exception &)
+        {
+            // Not a segment file
+        }
     }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
 
-    std::string log_file = "/tmp/kraft-combined-logs/" + topic_name + "-" + std::to_string(partition) + "/00000000000000000000.log";
+std::string KRaftMetadataStore::segment_path(int64_t base_offset) const
+{
+    if (!log_is_dir)
+    {
+        return log_path;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%020lld.log", static_cast<long long>(base_offset));
+    return log_path + "/" + name;
+}
 
-    std::ifstream file(log_file, std::ios::binary);
+std::vector<KRaftMetadataStore::BatchInfo> KRaftMetadataStore::read_batches(const std::string &path, std::size_t position, std::size_t &file_size)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
     if (!file)
-        throw std::runtime_error("Cannot open log file: " + log_file);
+    {
+        throw std::runtime_error("Failed to open KRaft log file: " + path);
+    }
+    file_size = static_cast<std::size_t>(file.tellg());
+    if (file_size <= position)
+    {
+        return {};
+    }
 
-    return std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), {});
+    this->cluster_metadata.resize(file_size - position);
+    file.seekg(static_cast<std::streamoff>(position));
+    file.read(reinterpret_cast<char *>(this->cluster_metadata.data()), static_cast<std::streamsize>(this->cluster_metadata.size()));
+    this->cluster_metadata.resize(static_cast<std::size_t>(file.gcount()));
+    return getBatch_info(this->cluster_metadata);
 }
 
-int64_t KRaftMetadataStore::toBigEndian(int64_t littleEndianVal)
+bool KRaftMetadataStore::load_kraft_snapshot(MetadataSnapshot &snapshot, std::set<std::vector<uint8_t>, TopicIdLess> &touched)
 {
-    uint64_t v = static_cast<uint64_t>(littleEndianVal);
-    uint64_t result = ((v & 0x00000000000000FFULL) << 56) |
-                      ((v & 0x000000000000FF00ULL) << 40) |
-                      ((v & 0x0000000000FF0000ULL) << 24) |
-                      ((v & 0x00000000FF000000ULL) << 8) |
-                      ((v & 0x000000FF00000000ULL) >> 8) |
-                      ((v & 0x0000FF0000000000ULL) >> 24) |
-                      ((v & 0x00FF000000000000ULL) >> 40) |
-                      ((v & 0xFF00000000000000ULL) >> 56);
-    return static_cast<int64_t>(result);
+    if (!log_is_dir)
+    {
+        return false;
+    }
+
+    // Snapshots are "<end offset>-<epoch>.checkpoint" files holding the state before that offset.
+    std::string newest;
+    int64_t newest_offset = -1;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(log_path, ec))
+    {
+        const auto &path = entry.path();
+        if (path.extension() != ".checkpoint")
+        {
+            continue;
+        }
+        try
+        {
+            int64_t offset = std::stoll(path.stem().string().substr(0, path.stem().string().find('-')));
+            if (offset > newest_offset)
+            {
+                newest_offset = offset;
+                newest = path.string();
+            }
+        }
+        catch (const std::exception &)
+        {
+            // Not a snapshot file
+        }
+    }
+    if (newest_offset < 0)
+    {
+        return false;
+    }
+
+    std::size_t file_size = 0;
+    apply_batches(snapshot, read_batches(newest, 0, file_size), touched);
+    snapshot.next_offset = newest_offset;
+    return true;
 }
 
-int64_t KRaftMetadataStore::toLittleEndian(int64_t bigEndianVal)
+void KRaftMetadataStore::maybe_checkpoint(const MetadataSnapshot &snapshot)
 {
-    uint64_t v = static_cast<uint64_t>(bigEndianVal);
-    uint64_t result = ((v & 0x00000000000000FFULL) << 56) |
-                      ((v & 0x000000000000FF00ULL) << 40) |
-                      ((v & 0x0000000000FF0000ULL) << 24) |
-                      ((v & 0x00000000FF000000ULL) << 8) |
-                      ((v & 0x000000FF00000000ULL) >> 8) |
-                      ((v & 0x0000FF0000000000ULL) >> 24) |
-                      ((v & 0x00FF000000000000ULL) >> 40) |
-                      ((v & 0xFF00000000000000ULL) >> 56);
-    return static_cast<int64_t>(result);
+    // A snapshot that stopped before any batch of its segment has nothing to match a checkpoint against.
+    if (options.checkpoint_dir.empty() || uncheckpointed_bytes < options.checkpoint_interval_bytes || snapshot.log_position == 0)
+    {
+        return;
+    }
+
+    try
+    {
+        MetadataCheckpoint(options.checkpoint_dir).write(snapshot);
+        uncheckpointed_bytes = 0;
+    }
+    catch (const std::exception &e)
+    {
+        // A missed checkpoint only costs a longer replay on the next start.
+        LOG_ERROR("Failed to write metadata checkpoint: {}", e.what());
+    }
 }
 
-std::pair<int32_t, std::size_t> KRaftMetadataStore::readZigZagVarint(std::size_t offset)
+// Record Decoding
+
+std::pair<int32_t, std::size_t> KRaftMetadataStore::readZigZagVarint(const std::vector<uint8_t> &buf, std::size_t offset)
 {
     uint32_t raw = 0;
     int shift = 0;
     std::size_t bytesRead = 0;
-    std::size_t bound = this->cluster_metadata.size();
+    std::size_t bound = buf.size();
 
     while (true)
     {
@@ -136,7 +542,7 @@ std::pair<int32_t, std::size_t> KRaftMetadataStore::readZigZagVarint(std::size_t
             throw std::runtime_error("readZigZagVarint: Out of bounds");
         }
 
-        uint8_t byte = this->cluster_metadata[offset + bytesRead];
+        uint8_t byte = buf[offset + bytesRead];
         raw |= (byte & 0x7f) << shift;
         bytesRead++;
 
@@ -156,12 +562,12 @@ std::pair<int32_t, std::size_t> KRaftMetadataStore::readZigZagVarint(std::size_t
     return {value, bytesRead};
 }
 
-std::pair<uint32_t, std::size_t> KRaftMetadataStore::readUnsignedVarint(std::size_t offset)
+std::pair<uint32_t, std::size_t> KRaftMetadataStore::readUnsignedVarint(const std::vector<uint8_t> &buf, std::size_t offset)
 {
     uint32_t result = 0;
     int shift = 0;
     std::size_t bytesRead = 0;
-    std::size_t bound = this->cluster_metadata.size();
+    std::size_t bound = buf.size();
 
     while (true)
     {
@@ -170,7 +576,7 @@ std::pair<uint32_t, std::size_t> KRaftMetadataStore::readUnsignedVarint(std::siz
             throw std::runtime_error("readUnsignedVarint: Out of bounds");
         }
 
-        uint8_t byte = this->cluster_metadata[offset + bytesRead];
+        uint8_t byte = buf[offset + bytesRead];
         result |= (byte & 0x7f) << shift;
         bytesRead++;
 
@@ -189,240 +595,253 @@ std::pair<uint32_t, std::size_t> KRaftMetadataStore::readUnsignedVarint(std::siz
     return {result, bytesRead};
 }
 
-void KRaftMetadataStore::getBatch_info()
+std::vector<KRaftMetadataStore::BatchInfo> KRaftMetadataStore::getBatch_info(const std::vector<uint8_t> &buf)
 {
-    std::size_t size = this->cluster_metadata.size() * sizeof(uint8_t);
+    std::vector<BatchInfo> batches;
+    std::size_t size = buf.size();
     std::size_t offset = 0;
-    int loop_cnt = 0;
+    constexpr std::size_t log_overhead = sizeof(int64_t) + sizeof(int32_t);
 
-    while (size > offset)
+    while (offset + log_overhead <= size)
     {
         int64_t base_offset = 0;
         int32_t batch_len = 0;
-        std::memcpy(&base_offset, this->cluster_metadata.data() + offset, sizeof(base_offset));
-        offset += sizeof(base_offset);
-        std::memcpy(&batch_len, this->cluster_metadata.data() + offset, sizeof(batch_len));
-        offset += sizeof(batch_len);
+        std::memcpy(&base_offset, buf.data() + offset, sizeof(base_offset));
+        std::memcpy(&batch_len, buf.data() + offset + sizeof(base_offset), sizeof(batch_len));
 
-        base_offset = toLittleEndian(base_offset);
+        base_offset = static_cast<int64_t>(be64toh(static_cast<uint64_t>(base_offset)));
         batch_len = ntohl(batch_len);
 
-        this->batch_info[base_offset] = batch_len;
-        offset += batch_len;
-        loop_cnt++;
-    }
-}
-
-void KRaftMetadataStore::toRecords()
-{
-    int64_t base_offset;
-    int32_t batch_len;
-    int32_t leader_epoch;
-    uint8_t batch_format;
-
-    int32_t crc;
-    int16_t attributes;
-    int32_t last_offset;
-    int64_t base_timestamp;
-
-    int64_t max_timestamp;
-    int64_t producer_id;
-    int16_t producer_epoch;
-    int32_t base_sequence;
-
-    int32_t records_len;
-
-    offsetToRec = offsetToRec + sizeof(base_offset) + sizeof(batch_len) + sizeof(leader_epoch) + sizeof(batch_format);
-    offsetToRec = offsetToRec + sizeof(crc) + sizeof(attributes) + sizeof(last_offset) + sizeof(base_timestamp);
-    offsetToRec = offsetToRec + sizeof(max_timestamp) + sizeof(producer_id) + sizeof(producer_epoch) + sizeof(base_sequence);
-    offsetToRec += sizeof(records_len);
-}
-
-void KRaftMetadataStore::getRecords_num()
-{
-    int32_t record_num = 0;
-    std::size_t toRec_num = this->offsetToRec - sizeof(record_num);
-    std::size_t offset = 0;
-
-    for (const auto &[base_offset, batch_len] : batch_info)
-    {
-        record_num = 0;
-
-        offset += toRec_num;
-        std::memcpy(&record_num, this->cluster_metadata.data() + offset, sizeof(record_num));
-        record_num = ntohl(record_num);
-        this->records_num.push_back(record_num);
+        if (batch_len < static_cast<int32_t>(offsetToRec - log_overhead))
+        {
+            throw std::runtime_error("Corrupt record batch at position " + std::to_string(offset));
+        }
+        if (offset + log_overhead + batch_len > size)
+        {
+            break; // Incomplete trailing batch
+        }
 
-        offset -= toRec_num;
-        offset += sizeof(base_offset);
-        offset += sizeof(batch_len);
-        offset += batch_len;
+        int32_t record_num = read_be_int32(buf, offset + offsetToRec - sizeof(int32_t));
+        int32_t last_offset_delta = read_be_int32(buf, offset + record_batch::kLastOffsetDeltaOffset);
+        uint32_t crc = static_cast<uint32_t>(read_be_int32(buf, offset + record_batch::kCrcOffset));
+        batches.push_back({offset, base_offset, last_offset_delta, batch_len, record_num, crc});
+        offset += log_overhead + batch_len;
     }
+
+    return batches;
 }
 
-std::size_t KRaftMetadataStore::getRecToValue(std::size_t offset)
+std::size_t KRaftMetadataStore::getRecToValue(const std::vector<uint8_t> &buf, std::size_t offset)
 {
-    std::size_t recToValue = 0;
     std::size_t ptr = offset;
 
-    auto [len, len_size] = readZigZagVarint(ptr);
-    recToValue += len_size;
+    auto [len, len_size] = readZigZagVarint(buf, ptr);
     ptr += len_size;
 
     uint8_t attributes_;
-    recToValue += sizeof(attributes_);
     ptr += sizeof(attributes_);
 
-    auto [timestamp_delta, size] = readZigZagVarint(ptr);
-    recToValue += size;
+    auto [timestamp_delta, size] = readZigZagVarint(buf, ptr);
     ptr += size;
 
-    auto [offset_delta, od_size] = readZigZagVarint(ptr);
-    recToValue += od_size;
+    auto [offset_delta, od_size] = readZigZagVarint(buf, ptr);
     ptr += od_size;
 
-    auto [key_len, kl_size] = readZigZagVarint(ptr);
-    recToValue += kl_size;
+    auto [key_len, kl_size] = readZigZagVarint(buf, ptr);
     ptr += kl_size;
+    if (key_len > 0)
+    {
+        ptr += key_len;
+    }
 
-    auto [value_len, vl_size] = readZigZagVarint(ptr);
-    recToValue += vl_size;
+    auto [value_len, vl_size] = readZigZagVarint(buf, ptr);
     ptr += vl_size;
 
-    return recToValue;
+    return ptr - offset;
 }
 
-std::size_t KRaftMetadataStore::toNextBatch(std::size_t offset)
+std::vector<KRaftMetadataStore::MetadataRecord> KRaftMetadataStore::decodeBatch(const std::vector<uint8_t> &buf, const BatchInfo &batch)
 {
-    std::size_t beginOff = sizeof(int64_t) + sizeof(int32_t);
-    std::size_t toNext = 0;
+    std::vector<MetadataRecord> records;
+    std::size_t batch_end = batch.position + sizeof(int64_t) + sizeof(int32_t) + batch.batch_len;
+    const uint8_t *batch_start = buf.data() + batch.position;
 
-    for (auto &[base_offset, batch_len] : batch_info)
+    // Recovery never trusts a batch whose checksum doesn't match.
+    if (!record_batch::crc_matches(batch_start, batch_end - batch.position))
     {
-        if (offset > toNext)
-        {
-            toNext = toNext + beginOff + batch_len;
-        }
+        throw std::runtime_error("CRC mismatch in metadata record batch at offset " + std::to_string(batch.base_offset));
     }
 
-    return toNext;
+    if (record_batch::compression_of(batch_start) != CompressionType::None)
+    {
+        std::vector<uint8_t> decompressed = record_batch::decompressed_records(batch_start, batch_end - batch.position);
+        decodeRecords(decompressed, 0, decompressed.size(), batch.records_num, records);
+    }
+    else
+    {
+        decodeRecords(buf, batch.position + offsetToRec, batch_end, batch.records_num, records);
+    }
+
+    return records;
 }
 
-void KRaftMetadataStore::parseTopicHelper(std::size_t offset)
+void KRaftMetadataStore::decodeRecords(const std::vector<uint8_t> &buf, std::size_t begin, std::size_t end, int32_t count, std::vector<MetadataRecord> &records)
 {
-    uint8_t ver;
-    offset = offset + sizeof(ver);
+    std::size_t i_offset = begin;
 
-    auto [nLen, nLen_size] = readUnsignedVarint(offset);
-    offset += nLen_size;
+    for (int32_t i = 0; i < count; i++)
+    {
+        auto [rec_len, varint_bytes] = readZigZagVarint(buf, i_offset);
+        std::size_t value_offset = i_offset + getRecToValue(buf, i_offset);
 
-    std::size_t len = nLen - 1;
-    std::string name;
-    name.assign(reinterpret_cast<const char *>(this->cluster_metadata.data() + offset), len);
-    this->topic_name.insert(name);
-    offset += len;
+        uint8_t frame_version;
+        uint8_t type;
+        ensure_in_bounds(buf, value_offset, sizeof(frame_version) + sizeof(type));
+        type = buf[value_offset + sizeof(frame_version)];
+        value_offset += sizeof(frame_version) + sizeof(type);
+
+        if (type == 2)
+        {
+            records.emplace_back(parseTopicHelper(buf, value_offset));
+        }
+        else if (type == 3)
+        {
+            records.emplace_back(parseParsHelper(buf, value_offset));
+        }
 
-    std::vector<uint8_t> uuid(cluster_metadata.begin() + offset, cluster_metadata.begin() + offset + 16);
-    nameToTopicId[name] = uuid;
-    offset = offset + sizeof(uint8_t) * 16;
+        i_offset = i_offset + rec_len + varint_bytes;
+        if (i_offset > end)
+        {
+            throw std::runtime_error("Record overruns its batch");
+        }
+    }
 }
 
-void KRaftMetadataStore::parseTopic()
+std::vector<std::vector<KRaftMetadataStore::MetadataRecord>> KRaftMetadataStore::decodeBatches(const std::vector<uint8_t> &buf, const std::vector<BatchInfo> &batches) const
 {
-    std::size_t main_offset = 0;
-    std::size_t size = this->cluster_metadata.size() * sizeof(uint8_t);
-    int loop = 0;
-    std::size_t i_offset = 0;
-    std::size_t index = 0;
-    int32_t rec_num = 0;
+    // Below this many batches per worker, thread start-up costs more than it saves.
+    constexpr std::size_t kMinBatchesPerWorker = 256;
 
-    while (size > main_offset)
-    {
-        main_offset += this->offsetToRec;
-        rec_num = records_num[loop];
-        i_offset = main_offset;
+    std::size_t workers = options.parse_threads != 0 ? options.parse_threads : std::max(1u, std::thread::hardware_concurrency());
+    workers = std::max<std::size_t>(1, std::min(workers, batches.size() / kMinBatchesPerWorker));
 
-        for (int i = 0; i < rec_num; i++)
+    // Contiguous chunks, one per worker, so concatenating the results keeps log order.
+    std::vector<std::vector<MetadataRecord>> chunks(workers);
+    auto decode_chunk = [&](std::size_t chunk)
+    {
+        std::size_t begin = batches.size() * chunk / workers;
+        std::size_t end = batches.size() * (chunk + 1) / workers;
+        for (std::size_t b = begin; b < end; ++b)
         {
-            auto [rec_len, varint_bytes] = readZigZagVarint(i_offset);
-
-            index = getRecToValue(i_offset);
-            i_offset += index;
-
-            uint8_t frame_version;
-            i_offset += sizeof(frame_version);
-            index += sizeof(frame_version);
+            auto records = decodeBatch(buf, batches[b]);
+            std::move(records.begin(), records.end(), std::back_inserter(chunks[chunk]));
+        }
+    };
 
-            uint8_t type = cluster_metadata[i_offset];
-            i_offset += sizeof(type);
-            index += sizeof(type);
-            if (type == 2)
-            {
-                parseTopicHelper(i_offset);
-            }
+    if (workers == 1)
+    {
+        decode_chunk(0);
+        return chunks;
+    }
 
-            i_offset -= index;
-            i_offset = i_offset + rec_len + varint_bytes;
+    std::vector<std::exception_ptr> errors(workers);
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(workers - 1);
+        for (std::size_t chunk = 1; chunk < workers; ++chunk)
+        {
+            threads.emplace_back([&, chunk]
+                                 {
+                                     try
+                                     {
+                                         decode_chunk(chunk);
+                                     }
+                                     catch (...)
+                                     {
+                                         errors[chunk] = std::current_exception();
+                                     } });
         }
+        try
+        {
+            decode_chunk(0);
+        }
+        catch (...)
+        {
+            errors[0] = std::current_exception();
+        }
+    }
 
-        main_offset = toNextBatch(main_offset);
-        loop++;
+    // Report the first failure in log order, as the sequential loader would.
+    for (const auto &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
     }
+    return chunks;
 }
 
-void KRaftMetadataStore::topicMatchPars(std::vector<uint8_t> uuid, std::vector<uint8_t> par)
+KRaftMetadataStore::TopicRecord KRaftMetadataStore::parseTopicHelper(const std::vector<uint8_t> &buf, std::size_t offset)
 {
-    this->topicToPars[uuid].push_back(par);
+    uint8_t ver;
+    offset = offset + sizeof(ver);
+
+    auto [nLen, nLen_size] = readUnsignedVarint(buf, offset);
+    offset += nLen_size;
+
+    std::size_t len = nLen - 1;
+    ensure_in_bounds(buf, offset, len + 16);
+
+    TopicRecord record;
+    record.name.assign(reinterpret_cast<const char *>(buf.data() + offset), len);
+    offset += len;
+
+    record.uuid.assign(buf.begin() + offset, buf.begin() + offset + 16);
+    return record;
 }
 
-std::vector<uint8_t> KRaftMetadataStore::parseParsHelper(std::size_t offset)
+KRaftMetadataStore::PartitionRecord KRaftMetadataStore::parseParsHelper(const std::vector<uint8_t> &buf, std::size_t offset)
 {
+    PartitionRecord record;
+    PartitionState &par = record.state;
+
     uint8_t ver;
     offset += sizeof(ver);
 
-    int32_t partition_id;
-    std::memcpy(&partition_id, cluster_metadata.data() + offset, sizeof(partition_id));
-    offset += sizeof(partition_id);
-
-    std::vector<uint8_t> topic_uuid;
-    topic_uuid.assign(cluster_metadata.begin() + offset, cluster_metadata.begin() + offset + 16);
-    std::size_t id_size = topic_uuid.size() * sizeof(uint8_t);
-    offset += id_size;
+    par.partition_id = read_be_int32(buf, offset);
+    offset += sizeof(par.partition_id);
 
-    auto [replicaArray_len, size] = readUnsignedVarint(offset);
-    offset += size;
+    ensure_in_bounds(buf, offset, 16);
+    record.topic_uuid.assign(buf.begin() + offset, buf.begin() + offset + 16);
+    offset += 16;
 
-    std::vector<int32_t> replica_array;
-    int r_len = replicaArray_len - 1;
-    replica_array.resize(r_len);
-    std::memcpy(replica_array.data(), cluster_metadata.data() + offset, sizeof(int32_t) * r_len);
-    std::size_t t = sizeof(int32_t) * r_len;
-    offset += t;
-
-    auto [isrArray_len, isr_size] = readUnsignedVarint(offset);
-    offset += isr_size;
-
-    std::vector<int32_t> isr_array;
-    int isr_len = isrArray_len - 1;
-    isr_array.resize(isr_len);
-    std::memcpy(isr_array.data(), cluster_metadata.data() + offset, sizeof(int32_t) * isr_len);
-    std::size_t i = sizeof(int32_t) * isr_len;
-    offset += i;
+    auto read_int32_array = [&](std::vector<int32_t> &out)
+    {
+        auto [array_len, len_size] = readUnsignedVarint(buf, offset);
+        offset += len_size;
+        for (uint32_t i = 1; i < array_len; ++i)
+        {
+            out.push_back(read_be_int32(buf, offset));
+            offset += sizeof(int32_t);
+        }
+    };
 
-    auto [rrArray_len, rr_size] = readUnsignedVarint(offset);
-    offset += rr_size;
+    read_int32_array(par.replicas);
+    read_int32_array(par.isr);
 
-    auto [arArray_len, ar_size] = readUnsignedVarint(offset);
-    offset += ar_size;
+    std::vector<int32_t> removing_replicas;
+    std::vector<int32_t> adding_replicas;
+    read_int32_array(removing_replicas);
+    read_int32_array(adding_replicas);
 
-    int32_t leader;
-    std::memcpy(&leader, cluster_metadata.data() + offset, sizeof(leader));
-    offset += sizeof(leader);
+    par.leader = read_be_int32(buf, offset);
+    offset += sizeof(par.leader);
 
-    int32_t leader_epoch;
-    std::memcpy(&leader_epoch, cluster_metadata.data() + offset, sizeof(leader_epoch));
+    par.leader_epoch = read_be_int32(buf, offset);
 
-    std::vector<uint8_t> sp;
+    // DescribeTopicPartitions partition entry
+    std::vector<uint8_t> &sp = par.serialized;
 
     int16_t error_code = 0;
     uint8_t elr_len = 1;
@@ -431,71 +850,101 @@ std::vector<uint8_t> KRaftMetadataStore::parseParsHelper(std::size_t offset)
     uint8_t tag_buf = 0;
 
     sp.insert(sp.end(), reinterpret_cast<uint8_t *>(&error_code), reinterpret_cast<uint8_t *>(&error_code) + sizeof(error_code));
-    sp.insert(sp.end(), reinterpret_cast<uint8_t *>(&partition_id), reinterpret_cast<uint8_t *>(&partition_id) + sizeof(partition_id));
-    sp.insert(sp.end(), reinterpret_cast<uint8_t *>(&leader), reinterpret_cast<uint8_t *>(&leader) + sizeof(leader));
-    sp.insert(sp.end(), reinterpret_cast<uint8_t *>(&leader_epoch), reinterpret_cast<uint8_t *>(&leader_epoch) + sizeof(leader_epoch));
-    sp.push_back(replicaArray_len);
+    append_be_int32(sp, par.partition_id);
+    append_be_int32(sp, par.leader);
+    append_be_int32(sp, par.leader_epoch);
 
-    std::size_t ra_size = replica_array.size() * sizeof(int32_t);
-    sp.insert(sp.end(), reinterpret_cast<uint8_t *>(replica_array.data()), reinterpret_cast<uint8_t *>(replica_array.data()) + ra_size);
-    sp.push_back(isrArray_len);
+    append_unsigned_varint(sp, par.replicas.size() + 1);
+    for (int32_t replica : par.replicas)
+    {
+        append_be_int32(sp, replica);
+    }
 
-    std::size_t ia_size = isr_array.size() * sizeof(int32_t);
-    sp.insert(sp.end(), reinterpret_cast<uint8_t *>(isr_array.data()), reinterpret_cast<uint8_t *>(isr_array.data()) + ia_size);
+    append_unsigned_varint(sp, par.isr.size() + 1);
+    for (int32_t replica : par.isr)
+    {
+        append_be_int32(sp, replica);
+    }
 
     sp.push_back(elr_len);
     sp.push_back(lk_elr_len);
     sp.push_back(or_nodes_len);
     sp.push_back(tag_buf);
 
-    topicMatchPars(topic_uuid, sp);
-
-    return sp;
+    return record;
 }
 
-void KRaftMetadataStore::parsePars()
+void KRaftMetadataStore::applyRecord(MetadataSnapshot &snapshot, MetadataRecord &&record)
 {
-    std::size_t main_offset = 0;
-    std::size_t size = this->cluster_metadata.size() * sizeof(uint8_t);
-    int loop = 0;
-    std::size_t i_offset = 0;
-    std::size_t index = 0;
-    int32_t rec_num = 0;
-
-    while (size > main_offset)
+    if (auto *topic = std::get_if<TopicRecord>(&record))
     {
-        main_offset += this->offsetToRec;
-        rec_num = records_num[loop];
-        i_offset = main_offset;
-
-        int t = 0;
-
-        for (int i = 0; i < rec_num; i++)
+        // A re-created topic gets a new id; drop the mapping for the old one.
+        auto existing = snapshot.nameToTopicId.find(topic->name);
+        if (existing != snapshot.nameToTopicId.end() && existing->second != topic->uuid)
         {
-            auto [rec_len, varint_bytes] = readZigZagVarint(i_offset);
+            snapshot.describeTopicEntries.erase(topic->name);
+            snapshot.topicIdToName.erase(existing->second);
+            snapshot.topicToPars.erase(existing->second);
+        }
 
-            index = getRecToValue(i_offset);
-            i_offset += index;
+        snapshot.topicIdToName[topic->uuid] = topic->name;
+        snapshot.nameToTopicId[topic->name] = std::move(topic->uuid);
+        return;
+    }
 
-            uint8_t frame_version;
-            i_offset += sizeof(frame_version);
-            index += sizeof(frame_version);
+    auto &partition = std::get<PartitionRecord>(record);
+    auto &pars = snapshot.topicToPars[partition.topic_uuid];
 
-            uint8_t type = cluster_metadata[i_offset];
+    // Keep partitions sorted by id; a later record for the same partition replaces the earlier one.
+    auto it = std::lower_bound(pars.begin(), pars.end(), partition.state.partition_id, [](const PartitionState &p, int32_t id)
+                               { return p.partition_id < id; });
+    if (it != pars.end() && it->partition_id == partition.state.partition_id)
+    {
+        *it = std::move(partition.state);
+    }
+    else
+    {
+        pars.insert(it, std::move(partition.state));
+    }
+}
 
-            i_offset += sizeof(type);
-            index += sizeof(type);
-            if (type == 3)
-            {
-                t++;
-                partitions.push_back(parseParsHelper(i_offset));
-            }
+void KRaftMetadataStore::encodeDescribeEntry(MetadataSnapshot &snapshot, const std::vector<uint8_t> &topic_id)
+{
+    auto name = snapshot.topicIdToName.find(topic_id);
+    if (name == snapshot.topicIdToName.end())
+    {
+        return; // Partitions seen before their TopicRecord
+    }
 
-            i_offset -= index;
-            i_offset = i_offset + rec_len + varint_bytes;
+    auto entry = std::make_shared<DescribeTopicEntry>();
+    std::vector<char> &out = entry->bytes;
+
+    out.push_back(0); // error_code: NONE
+    out.push_back(0);
+    append_unsigned_varint(out, name->second.size() + 1);
+    out.insert(out.end(), name->second.begin(), name->second.end());
+    out.insert(out.end(), topic_id.begin(), topic_id.end());
+    out.push_back(0); // is_internal
+
+    auto pars = snapshot.topicToPars.find(topic_id);
+    std::size_t partition_count = pars != snapshot.topicToPars.end() ? pars->second.size() : 0;
+    entry->partitions_offset = out.size();
+    append_unsigned_varint(out, partition_count + 1);
+    if (partition_count > 0)
+    {
+        for (const auto &par : pars->second)
+        {
+            entry->partition_offsets.push_back(static_cast<uint32_t>(out.size()));
+            entry->partition_ids.push_back(par.partition_id);
+            out.insert(out.end(), par.serialized.begin(), par.serialized.end());
         }
-
-        main_offset = toNextBatch(main_offset);
-        loop++;
     }
-}
\ No newline at end of file
+    entry->partition_offsets.push_back(static_cast<uint32_t>(out.size()));
+
+    int32_t authorized_operations = htonl(0x00000df8);
+    const char *ops = reinterpret_cast<const char *>(&authorized_operations);
+    out.insert(out.end(), ops, ops + sizeof(authorized_operations));
+    out.push_back(0); // topic tagged fields
+
+    snapshot.describeTopicEntries[name->second] = std::move(entry);
+}
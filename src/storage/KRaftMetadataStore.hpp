@@ -1,56 +1,185 @@
 #pragma once
 
 #include "storage/IMetadataStore.hpp"
+#include "storage/MetadataSnapshot.hpp"
+#include "storage/MetadataCheckpoint.hpp"
+#include "storage/PartitionLog.hpp"
+#include "storage/ReadAhead.hpp"
+#include "storage/RecordBatchCache.hpp"
+#include "core/Rcu.hpp"
+#include "core/ShardSet.hpp"
 #include <vector>
 #include <cstdint>
-#include <set>
 #include <map>
+#include <set>
 #include <string>
+#include <optional>
+#include <type_traits>
+#include <variant>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
 
 /**
  * @brief An implementation of IMetadataStore that loads and parses state from a
- * Kafka KRaft __cluster_metadata log file.
+ * Kafka KRaft __cluster_metadata log.
+ *
+ * The log is either the __cluster_metadata-0 directory, whose segments are read in
+ * order, or a single log file. It is replayed once on construction. When tailing is
+ * enabled a background thread follows the log as it grows and across segment rolls,
+ * applies new records to a copy of the current state and publishes it as a new
+ * immutable MetadataSnapshot. Lookups read the current snapshot through RCU and
+ * never block on the tailer. If KRaft has deleted segments that were never applied,
+ * the state is rebuilt from its newest snapshot file first.
+ *
+ * If a checkpoint directory is configured, startup resumes from the newest valid
+ * checkpoint and only replays the log past it; a new checkpoint is written whenever
+ * enough of the log has been applied since the last one.
+ *
+ * Large replays decode record batches on several threads; the decoded records are
+ * then applied strictly in log order, so the result is identical to a sequential load.
+ *
+ * Partition data is read, and on followers appended, through a PartitionLog per
+ * partition, created on first use. Reads go through the broker-wide RecordBatchCache when one is configured,
+ * so consumers fetching the same data share one in-memory copy. With a ShardSet,
+ * each shard keeps its own partition logs and reads must run on the home shard.
  */
 class KRaftMetadataStore : public IMetadataStore
 {
 public:
+    struct Options
+    {
+        std::string checkpoint_dir;                      // Empty disables checkpoints
+        std::size_t checkpoint_interval_bytes = 4 << 20; // Log bytes applied between checkpoints
+        unsigned parse_threads = 0;                      // Record decoding workers, 0 = hardware concurrency
+        std::string log_dir;                             // Partition log root, empty = parent of the metadata partition
+        std::shared_ptr<RecordBatchCache> batch_cache;   // Shared segment read cache, null reads straight from disk
+        std::shared_ptr<ReadAhead> read_ahead;           // Sequential read prefetcher, null disables it
+        std::shared_ptr<ShardSet> shards;                // Partition home shards, null = any thread under a lock
+    };
+
+    // `log_path` is the metadata partition directory or a single log file.
     explicit KRaftMetadataStore(const std::string &log_path);
+    KRaftMetadataStore(const std::string &log_path, Options options);
+    ~KRaftMetadataStore() override;
 
     // IMetadataStore Interface Implementation
     bool is_topic_known(const std::string &name) const override;
     bool is_uuid_known(const std::vector<uint8_t> &uuid) const override;
     std::vector<uint8_t> get_topic_uuid(const std::string &topicN) const override;
     std::vector<std::vector<uint8_t>> get_serialized_partitions(const std::vector<uint8_t> &topic_id) const override;
-    std::vector<uint8_t> getEntireRecBatch(const std::vector<uint8_t> &uuid, const int32_t &parIndex) const override;
+    PartitionLog::ReadResult read_records(const std::vector<uint8_t> &uuid, int32_t parIndex, int64_t fetch_offset, int32_t max_bytes) const override;
+    int64_t append_records(const std::vector<uint8_t> &uuid, int32_t parIndex, const std::vector<uint8_t> &batches) override;
+    int64_t log_end_offset(const std::vector<uint8_t> &uuid, int32_t parIndex) const override;
+    std::optional<PartitionLog::OffsetLookup> list_offset(const std::vector<uint8_t> &uuid, int32_t parIndex, int64_t timestamp) const override;
+    std::vector<PartitionLog::SegmentInfo> closed_segments(const std::vector<uint8_t> &uuid, int32_t parIndex) const override;
+    void replace_segment(const std::vector<uint8_t> &uuid, int32_t parIndex, int64_t base_offset, const std::string &rewritten) override;
+    rcu::ReadGuard<MetadataSnapshot> snapshot() const override { return state.read(); }
+
+    // Starts following the metadata log for new records, polling at the given interval.
+    void start_tailing(std::chrono::milliseconds poll_interval);
+
+    // Applies any complete record batches appended since the last call.
+    // Returns true if a new snapshot was published.
+    bool catch_up();
 
 private:
+    // Location and header fields of one record batch in a buffer.
+    struct BatchInfo
+    {
+        std::size_t position;
+        int64_t base_offset;
+        int32_t last_offset_delta;
+        int32_t batch_len;
+        int32_t records_num;
+        uint32_t crc;
+    };
+
+    struct TopicRecord
+    {
+        std::string name;
+        std::vector<uint8_t> uuid;
+    };
+
+    struct PartitionRecord
+    {
+        std::vector<uint8_t> topic_uuid;
+        PartitionState state;
+    };
+
+    using MetadataRecord = std::variant<TopicRecord, PartitionRecord>;
+
     // State Variables
-    std::vector<uint8_t> cluster_metadata;
-    std::map<int64_t, int32_t> batch_info;
-    std::vector<int32_t> records_num;
-    std::set<std::string> topic_name;
-    std::map<std::string, std::vector<uint8_t>> nameToTopicId;
-    std::map<std::vector<uint8_t>, std::vector<std::vector<uint8_t>>> topicToPars;
-    std::vector<std::vector<uint8_t>> partitions;
-    std::size_t offsetToRec = 0;
+    std::string log_path;
+    bool log_is_dir = false; // log_path holds segments rather than being the log itself
+    std::string log_dir;
+    Options options;
+    rcu::Cell<MetadataSnapshot> state;
+
+    // Writer side: guarded by writer_mutex
+    std::mutex writer_mutex;
+    std::vector<uint8_t> cluster_metadata; // Unparsed bytes read from the log
+    std::size_t uncheckpointed_bytes = 0;  // Log bytes applied since the last checkpoint
+
+    using PartitionKey = std::pair<std::vector<uint8_t>, int32_t>;
+
+    // Partition logs when sharding is off, each behind its own lock.
+    struct LockedPartitionLog
+    {
+        std::mutex mutex;
+        std::unique_ptr<PartitionLog> log;
+    };
+    mutable std::mutex partition_logs_mutex;
+    mutable std::map<PartitionKey, std::shared_ptr<LockedPartitionLog>, TopicIdLess> partition_logs;
+
+    // Partition logs owned by each shard, only touched from that shard's thread.
+    struct alignas(64) ShardPartitionLogs
+    {
+        std::map<PartitionKey, std::unique_ptr<PartitionLog>, TopicIdLess> logs;
+    };
+    mutable std::vector<ShardPartitionLogs> shard_logs;
+
+    std::mutex tail_mutex;
+    std::condition_variable_any tail_cv;
+    std::jthread tailer;
+
+    // Size of the record batch header up to the first record.
+    static constexpr std::size_t offsetToRec = sizeof(int64_t) + sizeof(int32_t) + sizeof(int32_t) + sizeof(uint8_t) +
+                                               sizeof(int32_t) + sizeof(int16_t) + sizeof(int32_t) + sizeof(int64_t) +
+                                               sizeof(int64_t) + sizeof(int64_t) + sizeof(int16_t) + sizeof(int32_t) +
+                                               sizeof(int32_t);
 
     // Private Helper Methods
-    int64_t toBigEndian(int64_t littleEndianVal);
-    int64_t toLittleEndian(int64_t bigEndianVal);
-    std::pair<int32_t, std::size_t> readZigZagVarint(std::size_t offset);
-    std::pair<uint32_t, std::size_t> readUnsignedVarint(std::size_t offset);
+    static std::pair<int32_t, std::size_t> readZigZagVarint(const std::vector<uint8_t> &buf, std::size_t offset);
+    static std::pair<uint32_t, std::size_t> readUnsignedVarint(const std::vector<uint8_t> &buf, std::size_t offset);
+
+    static std::vector<BatchInfo> getBatch_info(const std::vector<uint8_t> &buf);
 
-    void getBatch_info();
-    void toRecords();
-    void getRecords_num();
-    std::size_t getRecToValue(std::size_t offset);
-    std::size_t toNextBatch(std::size_t offset);
+    // Base offsets of the metadata log segments, oldest first; a single log file is one segment at 0.
+    std::vector<int64_t> metadata_segments() const;
+    std::string segment_path(int64_t base_offset) const;
+    // Reads `path` from `position` into cluster_metadata and returns its complete batches.
+    std::vector<BatchInfo> read_batches(const std::string &path, std::size_t position, std::size_t &file_size);
+    // Applies the newest KRaft snapshot file to an empty `snapshot`; false if there is none.
+    bool load_kraft_snapshot(MetadataSnapshot &snapshot, std::set<std::vector<uint8_t>, TopicIdLess> &touched);
+    void apply_batches(MetadataSnapshot &snapshot, const std::vector<BatchInfo> &batches, std::set<std::vector<uint8_t>, TopicIdLess> &touched);
+    static std::size_t getRecToValue(const std::vector<uint8_t> &buf, std::size_t offset);
+    static std::vector<MetadataRecord> decodeBatch(const std::vector<uint8_t> &buf, const BatchInfo &batch);
+    static void decodeRecords(const std::vector<uint8_t> &buf, std::size_t begin, std::size_t end, int32_t count, std::vector<MetadataRecord> &records);
+    std::vector<std::vector<MetadataRecord>> decodeBatches(const std::vector<uint8_t> &buf, const std::vector<BatchInfo> &batches) const;
 
-    void parseTopicHelper(std::size_t offset);
-    void parseTopic();
+    static TopicRecord parseTopicHelper(const std::vector<uint8_t> &buf, std::size_t offset);
+    static PartitionRecord parseParsHelper(const std::vector<uint8_t> &buf, std::size_t offset);
 
-    void topicMatchPars(std::vector<uint8_t> uuid, std::vector<uint8_t> par);
+    static void applyRecord(MetadataSnapshot &snapshot, MetadataRecord &&record);
+    static void encodeDescribeEntry(MetadataSnapshot &snapshot, const std::vector<uint8_t> &topic_id);
 
-    std::vector<uint8_t> parseParsHelper(std::size_t offset);
-    void parsePars();
-};
\ No newline at end of file
+    std::unique_ptr<PartitionLog> open_partition_log(const std::vector<uint8_t> &topic_id, int32_t partition) const;
+    // Runs `op` on the partition's log, on its home shard or under its lock; nullopt if the topic is unknown.
+    template <typename Op>
+    auto with_partition_log(const std::vector<uint8_t> &topic_id, int32_t partition, Op op) const
+        -> std::optional<std::invoke_result_t<Op &, PartitionLog &>>;
+    void maybe_checkpoint(const MetadataSnapshot &snapshot);
+    void tail_loop(std::stop_token stop, std::chrono::milliseconds poll_interval);
+};
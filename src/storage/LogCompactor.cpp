@@ -0,0 +1,385 @@
+#include "storage/LogCompactor.hpp"
+#include "storage/RecordBatch.hpp"
+#include "core/Log.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr std::size_t kReadChunk = 1 << 20;
+
+    // Paces I/O to a byte rate: after each read or write, sleeps until the bytes
+    // spent so far are within budget. Unused budget doesn't build up between passes.
+    class Throttle
+    {
+    public:
+        Throttle(uint64_t bytes_per_second, std::stop_token stop)
+            : bytes_per_second(bytes_per_second), stop(std::move(stop)), start(std::chrono::steady_clock::now()) {}
+
+        void spend(uint64_t bytes)
+        {
+            spent += bytes;
+            if (bytes_per_second == 0)
+            {
+                return;
+            }
+            auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>(static_cast<double>(spent) / static_cast<double>(bytes_per_second)));
+            auto now = std::chrono::steady_clock::now();
+            if (due > now)
+            {
+                std::mutex mutex;
+                std::condition_variable_any never;
+                std::unique_lock lock(mutex);
+                never.wait_until(lock, stop, due, []
+                                 { return false; });
+                waited += std::chrono::steady_clock::now() - now;
+            }
+        }
+
+        uint64_t waited_ms() const { return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(waited).count()); }
+
+    private:
+        uint64_t bytes_per_second;
+        std::stop_token stop;
+        std::chrono::steady_clock::time_point start;
+        uint64_t spent = 0;
+        std::chrono::steady_clock::duration waited{};
+    };
+
+    // Calls `on_batch(batch, size)` for every complete batch of a closed segment, reading it in chunks.
+    template <typename OnBatch>
+    void for_each_batch(const PartitionLog::SegmentInfo &segment, Throttle &throttle, OnBatch on_batch)
+    {
+        std::ifstream file(segment.path, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open log file: " + segment.path);
+        }
+
+        std::vector<uint8_t> buffer;
+        std::size_t consumed = 0;
+        uint64_t read_to = 0;
+        while (true)
+        {
+            std::size_t needed = kReadChunk;
+            while (buffer.size() - consumed >= record_batch::kLogOverhead)
+            {
+                int32_t batch_len;
+                std::memcpy(&batch_len, buffer.data() + consumed + 8, sizeof(batch_len));
+                std::size_t size = record_batch::kLogOverhead + static_cast<uint32_t>(ntohl(batch_len));
+                if (buffer.size() - consumed < size)
+                {
+                    needed = std::max(needed, size - (buffer.size() - consumed));
+                    break;
+                }
+                on_batch(buffer.data() + consumed, size);
+                consumed += size;
+            }
+            if (read_to >= segment.size)
+            {
+                return;
+            }
+
+            buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(consumed));
+            consumed = 0;
+            std::size_t length = static_cast<std::size_t>(std::min<uint64_t>(needed, segment.size - read_to));
+            std::size_t old_size = buffer.size();
+            buffer.resize(old_size + length);
+            if (!file.read(reinterpret_cast<char *>(buffer.data() + old_size), static_cast<std::streamsize>(length)))
+            {
+                throw std::runtime_error("Failed to read log file: " + segment.path);
+            }
+            read_to += length;
+            throttle.spend(length);
+        }
+    }
+
+    // A segment being rewritten. The file is removed again unless it was renamed into place.
+    class RewrittenSegment
+    {
+    public:
+        explicit RewrittenSegment(std::string path) : path(std::move(path))
+        {
+            fd = ::open(this->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Cannot create " + this->path + ": " + std::strerror(errno));
+            }
+        }
+
+        ~RewrittenSegment()
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+
+        void write(const uint8_t *data, std::size_t size)
+        {
+            std::size_t written = 0;
+            while (written < size)
+            {
+                ssize_t n = ::write(fd, data + written, size - written);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    throw std::runtime_error("Failed to write " + path + ": " + std::strerror(errno));
+                }
+                written += static_cast<std::size_t>(n);
+            }
+        }
+
+        // Makes the file durable before it is renamed over the segment.
+        void commit()
+        {
+            if (::fsync(fd) != 0)
+            {
+                throw std::runtime_error("Failed to sync " + path + ": " + std::strerror(errno));
+            }
+            ::close(fd);
+            fd = -1;
+        }
+
+        const std::string &file() const { return path; }
+
+    private:
+        std::string path;
+        int fd;
+    };
+
+    std::string_view key_of(const record_batch::Record &record)
+    {
+        return std::string_view(reinterpret_cast<const char *>(record.key), record.key_size);
+    }
+
+    // Lets the key map be probed with a view of the record's key, without copying it.
+    struct KeyHash
+    {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view key) const { return std::hash<std::string_view>()(key); }
+    };
+
+    // Keyed by the key bytes themselves: a hash collision must never make a live record look superseded.
+    using LatestOffsets = std::unordered_map<std::string, int64_t, KeyHash, std::equal_to<>>;
+}
+
+LogCompactor::LogCompactor(Options options, std::shared_ptr<IMetadataStore> store, std::shared_ptr<ShardSet> shards)
+    : options(std::move(options)), store(std::move(store)), shards(std::move(shards)) {}
+
+LogCompactor::~LogCompactor()
+{
+    this->worker.request_stop();
+    if (this->worker.joinable())
+    {
+        this->worker.join();
+    }
+}
+
+void LogCompactor::start()
+{
+    if (this->options.topics.empty())
+    {
+        return;
+    }
+    this->worker = std::jthread([this](std::stop_token stop)
+                                { run(stop); });
+}
+
+void LogCompactor::run(std::stop_token stop)
+{
+    while (!stop.stop_requested())
+    {
+        compact_dirty(stop);
+        std::unique_lock lock(this->wait_mutex);
+        this->wake.wait_for(lock, stop, this->options.check_interval, []
+                            { return false; });
+    }
+}
+
+std::size_t LogCompactor::compact_dirty(std::stop_token stop)
+{
+    // Collect the partitions first: the snapshot must not be held while compacting.
+    std::vector<std::pair<PartitionKey, std::string>> partitions;
+    {
+        auto snapshot = this->store->snapshot();
+        for (const auto &name : this->options.topics)
+        {
+            auto id = snapshot->nameToTopicId.find(name);
+            if (id == snapshot->nameToTopicId.end())
+            {
+                continue;
+            }
+            auto pars = snapshot->topicToPars.find(id->second);
+            if (pars == snapshot->topicToPars.end())
+            {
+                continue;
+            }
+            for (const auto &partition : pars->second)
+            {
+                partitions.emplace_back(PartitionKey{id->second, partition.partition_id}, name + "-" + std::to_string(partition.partition_id));
+            }
+        }
+    }
+
+    std::size_t compacted = 0;
+    for (const auto &[key, name] : partitions)
+    {
+        if (stop.stop_requested())
+        {
+            break;
+        }
+        try
+        {
+            compacted += compact_partition(key, name, stop);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Compaction of {} failed: {}", name, e.what());
+        }
+    }
+    return compacted;
+}
+
+bool LogCompactor::compact_partition(const PartitionKey &key, const std::string &name, std::stop_token stop)
+{
+    const auto &[topic_id, partition] = key;
+    auto segments = ShardSet::call_home(this->shards.get(), topic_id, partition, [&]
+                                        { return this->store->closed_segments(topic_id, partition); });
+
+    int64_t &cleaned = this->cleaned_until[key];
+    uint64_t total = 0;
+    uint64_t dirty = 0;
+    for (const auto &segment : segments)
+    {
+        total += segment.size;
+        dirty += segment.base_offset >= cleaned ? segment.size : 0;
+    }
+    if (dirty == 0 || static_cast<double>(dirty) < this->options.min_dirty_ratio * static_cast<double>(total))
+    {
+        return false;
+    }
+
+    Throttle throttle(this->options.io_bytes_per_second, stop);
+    std::vector<uint8_t> storage;
+
+    // Map every key to its latest offset, a whole segment at a time.
+    LatestOffsets latest;
+    std::size_t mapped = 0;
+    while (mapped < segments.size() && (mapped == 0 || latest.size() < this->options.max_map_keys) && !stop.stop_requested())
+    {
+        for_each_batch(segments[mapped], throttle, [&](const uint8_t *batch, std::size_t size)
+                       {
+                           if (record_batch::is_control(batch))
+                           {
+                               return;
+                           }
+                           for (const auto &record : record_batch::read_records(batch, size, storage))
+                           {
+                               if (!record.key)
+                               {
+                                   continue;
+                               }
+                               auto it = latest.find(key_of(record));
+                               if (it != latest.end())
+                               {
+                                   it->second = record.offset;
+                               }
+                               else
+                               {
+                                   latest.emplace(key_of(record), record.offset);
+                               }
+                           } });
+        this->bytes_read += segments[mapped].size;
+        ++mapped;
+    }
+
+    // Rewrite the mapped segments, keeping records without a key, the latest record of
+    // each key, and tombstones younger than the retention.
+    int64_t tombstone_horizon = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() -
+                                this->options.delete_retention.count();
+    uint64_t removed_total = 0;
+    std::size_t rewritten = 0;
+    for (std::size_t i = 0; i < mapped && !stop.stop_requested(); ++i)
+    {
+        const auto &segment = segments[i];
+        RewrittenSegment output(segment.path + ".cleaned");
+        uint64_t removed = 0;
+        uint64_t written = 0;
+        std::vector<record_batch::Record> kept;
+        for_each_batch(segment, throttle, [&](const uint8_t *batch, std::size_t size)
+                       {
+                           auto records = record_batch::is_control(batch) ? std::vector<record_batch::Record>() : record_batch::read_records(batch, size, storage);
+                           kept.clear();
+                           for (const auto &record : records)
+                           {
+                               auto latest_of_key = record.key ? latest.find(key_of(record)) : latest.end();
+                               bool superseded = latest_of_key != latest.end() && latest_of_key->second != record.offset;
+                               bool expired = record.tombstone && record.timestamp < tombstone_horizon;
+                               if (!superseded && !expired)
+                               {
+                                   kept.push_back(record);
+                               }
+                           }
+                           removed += records.size() - kept.size();
+
+                           if (kept.size() == records.size())
+                           {
+                               output.write(batch, size);
+                               written += size;
+                               throttle.spend(size);
+                           }
+                           else if (!kept.empty())
+                           {
+                               auto compacted = record_batch::with_records(batch, kept);
+                               output.write(compacted.data(), compacted.size());
+                               written += compacted.size();
+                               throttle.spend(compacted.size());
+                           } });
+        this->bytes_read += segment.size;
+        this->bytes_written += written;
+        if (removed == 0 || stop.stop_requested())
+        {
+            continue; // The old file stays
+        }
+        output.commit();
+        ShardSet::call_home(this->shards.get(), topic_id, partition, [&]
+                            { this->store->replace_segment(topic_id, partition, segment.base_offset, output.file()); });
+        removed_total += removed;
+        ++rewritten;
+    }
+    if (stop.stop_requested())
+    {
+        return false;
+    }
+
+    cleaned = segments[mapped - 1].next_offset;
+    this->passes++;
+    this->segments_rewritten += rewritten;
+    this->records_removed += removed_total;
+    this->throttled_ms += throttle.waited_ms();
+    LOG_INFO("Compacted {}: {} records removed, {} of {} segments rewritten", name, removed_total, rewritten, mapped);
+    return true;
+}
+
+LogCompactor::Stats LogCompactor::stats() const
+{
+    return Stats{this->passes.load(), this->segments_rewritten.load(), this->bytes_read.load(), this->bytes_written.load(),
+                 this->records_removed.load(), this->throttled_ms.load()};
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "storage/IMetadataStore.hpp"
+#include "core/ShardSet.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Background compaction of keyed topics down to the latest record per key.
+ *
+ * A pass over a partition reads its closed segments, oldest first, into a map of
+ * key → latest offset, then rewrites each of them with only the records the
+ * map points at. Tombstones are dropped once they are older than
+ * `delete_retention`, which gives consumers that long to see the delete. The
+ * active segment is never rewritten and its records are not mapped.
+ *
+ * Closed segments don't change, so they are read and rewritten off the
+ * partition's home shard; only the rename into place runs there, between reads.
+ * Reads and writes share an I/O budget, and the compactor sleeps whenever it is
+ * ahead of it, so a pass over a large log is spread out instead of competing
+ * with fetches for the disk.
+ *
+ * A partition is compacted once what was written since its last pass makes up
+ * `min_dirty_ratio` of its closed segments. That point is only kept in memory,
+ * so the first pass after a restart covers every closed segment again.
+ */
+class LogCompactor
+{
+public:
+    struct Options
+    {
+        std::set<std::string> topics; // Topics with cleanup.policy=compact
+        std::chrono::milliseconds check_interval{15000};
+        double min_dirty_ratio = 0.5;
+        std::chrono::milliseconds delete_retention{std::chrono::hours(24)}; // How long tombstones are kept
+        uint64_t io_bytes_per_second = 32 << 20;                            // Read plus written; 0 for no limit
+        std::size_t max_map_keys = 1 << 22;                                 // Later segments wait for the next pass
+    };
+
+    struct Stats
+    {
+        uint64_t passes; // Partitions compacted
+        uint64_t segments_rewritten;
+        uint64_t bytes_read;
+        uint64_t bytes_written;
+        uint64_t records_removed;
+        uint64_t throttled_ms; // Spent waiting for the I/O budget
+    };
+
+    LogCompactor(Options options, std::shared_ptr<IMetadataStore> store, std::shared_ptr<ShardSet> shards = nullptr);
+    ~LogCompactor();
+
+    LogCompactor(const LogCompactor &) = delete;
+    LogCompactor &operator=(const LogCompactor &) = delete;
+
+    // Starts the background thread, which looks for dirty partitions every `check_interval`.
+    void start();
+
+    // Compacts every partition that is dirty enough on the calling thread, and returns
+    // how many it compacted. Not to be called while the background thread runs.
+    std::size_t compact_dirty(std::stop_token stop = {});
+
+    Stats stats() const;
+
+private:
+    using PartitionKey = std::pair<std::vector<uint8_t>, int32_t>;
+
+    // Compacts one partition if it is dirty enough; returns whether it did.
+    bool compact_partition(const PartitionKey &key, const std::string &name, std::stop_token stop);
+    void run(std::stop_token stop);
+
+    Options options;
+    std::shared_ptr<IMetadataStore> store;
+    std::shared_ptr<ShardSet> shards;
+
+    // First offset each partition's next pass has not seen yet. Compacting thread only.
+    std::map<PartitionKey, int64_t, TopicIdLess> cleaned_until;
+
+    std::atomic<uint64_t> passes{0};
+    std::atomic<uint64_t> segments_rewritten{0};
+    std::atomic<uint64_t> bytes_read{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> records_removed{0};
+    std::atomic<uint64_t> throttled_ms{0};
+
+    std::mutex wait_mutex;
+    std::condition_variable_any wake;
+    std::jthread worker;
+};
@@ -0,0 +1,421 @@
+#include "storage/MetadataCheckpoint.hpp"
+#include "storage/RecordBatch.hpp"
+#include "core/Log.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr char kMagic[8] = {'M', 'K', 'M', 'E', 'T', 'A', '0', '1'};
+    constexpr uint32_t kFormatVersion = 3;
+    constexpr uint32_t kEndianTag = 0x01020304;
+    constexpr const char *kSuffix = ".mkcheckpoint";
+
+    struct FileHeader
+    {
+        char magic[8];
+        uint32_t format_version;
+        uint32_t endian_tag;
+        uint64_t file_size;
+        uint64_t checksum; // FNV-1a over everything after the header
+        uint64_t snapshot_version;
+        int64_t log_segment;
+        int64_t next_offset;
+        uint64_t log_position;
+        uint64_t last_batch_position;
+        uint32_t last_batch_crc;
+        uint32_t topic_count;
+        uint64_t partition_count;
+        uint64_t topics_offset;
+        uint64_t partitions_offset;
+        uint64_t data_offset;
+    };
+
+    // Partitions can be recorded before their TopicRecord is applied, so a topic id
+    // may have partitions but no name yet.
+    constexpr uint32_t kNoName = UINT32_MAX;
+
+    struct TopicEntry
+    {
+        uint8_t id[16];
+        uint64_t name_offset;
+        uint32_t name_len; // kNoName if the topic has no name yet
+        uint32_t partition_count;
+        uint64_t first_partition;
+    };
+
+    struct PartitionEntry
+    {
+        int32_t partition_id;
+        int32_t leader;
+        int32_t leader_epoch;
+        uint32_t replica_count;
+        uint32_t isr_count;
+        uint32_t serialized_len;
+        uint64_t replicas_offset;
+        uint64_t isr_offset;
+        uint64_t serialized_offset;
+    };
+
+    static_assert(sizeof(FileHeader) % 8 == 0 && sizeof(TopicEntry) % 8 == 0 && sizeof(PartitionEntry) % 8 == 0);
+
+    uint64_t fnv1a(const char *data, std::size_t len)
+    {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    std::string checkpoint_name(int64_t next_offset)
+    {
+        std::ostringstream name;
+        name << std::setw(20) << std::setfill('0') << next_offset << kSuffix;
+        return name.str();
+    }
+
+    // Checkpoints in `dir`, newest (highest metadata log offset) first.
+    std::vector<std::filesystem::path> list_checkpoints(const std::string &dir)
+    {
+        std::vector<std::filesystem::path> files;
+        std::error_code ec;
+        for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+        {
+            if (entry.is_regular_file() && entry.path().extension() == kSuffix)
+            {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end(), std::greater<>());
+        return files;
+    }
+
+    // Read-only mapping of a whole file.
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string &path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                throw std::runtime_error("Cannot open checkpoint: " + path);
+            }
+            struct stat st{};
+            if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader)))
+            {
+                ::close(fd);
+                throw std::runtime_error("Checkpoint too small: " + path);
+            }
+            size = static_cast<std::size_t>(st.st_size);
+            void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED)
+            {
+                throw std::runtime_error("Cannot map checkpoint: " + path);
+            }
+            data = static_cast<const char *>(p);
+        }
+
+        ~MappedFile()
+        {
+            munmap(const_cast<char *>(data), size);
+        }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const char *data = nullptr;
+        std::size_t size = 0;
+    };
+
+    class BlobWriter
+    {
+    public:
+        uint64_t append(const void *p, std::size_t len, std::size_t align)
+        {
+            while (blob.size() % align != 0)
+            {
+                blob.push_back(0);
+            }
+            uint64_t offset = blob.size();
+            const char *c = static_cast<const char *>(p);
+            blob.insert(blob.end(), c, c + len);
+            return offset;
+        }
+
+        std::vector<char> blob;
+    };
+}
+
+MetadataCheckpoint::MetadataCheckpoint(std::string dir) : dir(std::move(dir)) {}
+
+void MetadataCheckpoint::write(const MetadataSnapshot &snapshot) const
+{
+    std::vector<TopicEntry> topics;
+    std::vector<PartitionEntry> partitions;
+    BlobWriter data;
+
+    // Every topic id with a name, partitions or both.
+    std::vector<const std::vector<uint8_t> *> ids;
+    for (const auto &[id, name] : snapshot.topicIdToName)
+    {
+        ids.push_back(&id);
+    }
+    for (const auto &[id, pars] : snapshot.topicToPars)
+    {
+        if (!snapshot.topicIdToName.contains(id))
+        {
+            ids.push_back(&id);
+        }
+    }
+
+    topics.reserve(ids.size());
+    for (const auto *id_ptr : ids)
+    {
+        const auto &id = *id_ptr;
+        TopicEntry topic{};
+        std::memcpy(topic.id, id.data(), std::min<std::size_t>(id.size(), sizeof(topic.id)));
+        auto name = snapshot.topicIdToName.find(id);
+        if (name != snapshot.topicIdToName.end())
+        {
+            topic.name_offset = data.append(name->second.data(), name->second.size(), 1);
+            topic.name_len = static_cast<uint32_t>(name->second.size());
+        }
+        else
+        {
+            topic.name_len = kNoName;
+        }
+        topic.first_partition = partitions.size();
+
+        auto pars = snapshot.topicToPars.find(id);
+        if (pars != snapshot.topicToPars.end())
+        {
+            for (const auto &par : pars->second)
+            {
+                PartitionEntry entry{};
+                entry.partition_id = par.partition_id;
+                entry.leader = par.leader;
+                entry.leader_epoch = par.leader_epoch;
+                entry.replica_count = static_cast<uint32_t>(par.replicas.size());
+                entry.isr_count = static_cast<uint32_t>(par.isr.size());
+                entry.serialized_len = static_cast<uint32_t>(par.serialized.size());
+                entry.replicas_offset = data.append(par.replicas.data(), par.replicas.size() * sizeof(int32_t), alignof(int32_t));
+                entry.isr_offset = data.append(par.isr.data(), par.isr.size() * sizeof(int32_t), alignof(int32_t));
+                entry.serialized_offset = data.append(par.serialized.data(), par.serialized.size(), 1);
+                partitions.push_back(entry);
+            }
+            topic.partition_count = static_cast<uint32_t>(pars->second.size());
+        }
+        topics.push_back(topic);
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.format_version = kFormatVersion;
+    header.endian_tag = kEndianTag;
+    header.snapshot_version = snapshot.version;
+    header.log_segment = snapshot.log_segment;
+    header.next_offset = snapshot.next_offset;
+    header.log_position = snapshot.log_position;
+    header.last_batch_position = snapshot.last_batch_position;
+    header.last_batch_crc = snapshot.last_batch_crc;
+    header.topic_count = static_cast<uint32_t>(topics.size());
+    header.partition_count = partitions.size();
+    header.topics_offset = sizeof(FileHeader);
+    header.partitions_offset = header.topics_offset + topics.size() * sizeof(TopicEntry);
+    header.data_offset = header.partitions_offset + partitions.size() * sizeof(PartitionEntry);
+    header.file_size = header.data_offset + data.blob.size();
+
+    std::vector<char> file(header.file_size);
+    std::memcpy(file.data() + header.topics_offset, topics.data(), topics.size() * sizeof(TopicEntry));
+    std::memcpy(file.data() + header.partitions_offset, partitions.data(), partitions.size() * sizeof(PartitionEntry));
+    std::memcpy(file.data() + header.data_offset, data.blob.data(), data.blob.size());
+    header.checksum = fnv1a(file.data() + sizeof(FileHeader), file.size() - sizeof(FileHeader));
+    std::memcpy(file.data(), &header, sizeof(header));
+
+    // Write to a temporary name and rename, so a crash never leaves a torn checkpoint behind.
+    std::filesystem::create_directories(dir);
+    std::filesystem::path final_path = std::filesystem::path(dir) / checkpoint_name(snapshot.next_offset);
+    std::filesystem::path tmp_path = final_path;
+    tmp_path += ".tmp";
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create checkpoint: " + tmp_path.string());
+    }
+    std::size_t written = 0;
+    while (written < file.size())
+    {
+        ssize_t n = ::write(fd, file.data() + written, file.size() - written);
+        if (n <= 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to write checkpoint: " + tmp_path.string());
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    if (fsync(fd) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("Failed to sync checkpoint: " + tmp_path.string());
+    }
+    ::close(fd);
+    std::filesystem::rename(tmp_path, final_path);
+
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    auto existing = list_checkpoints(dir);
+    for (std::size_t i = kRetained; i < existing.size(); ++i)
+    {
+        std::error_code ec;
+        std::filesystem::remove(existing[i], ec);
+    }
+}
+
+std::unique_ptr<MetadataSnapshot> MetadataCheckpoint::load_latest(const SegmentPath &segment_path) const
+{
+    for (const auto &path : list_checkpoints(dir))
+    {
+        try
+        {
+            return load(path.string(), segment_path);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_WARN("Skipping metadata checkpoint {}: {}", path.string(), e.what());
+        }
+    }
+    return nullptr;
+}
+
+std::unique_ptr<MetadataSnapshot> MetadataCheckpoint::load(const std::string &path, const SegmentPath &segment_path) const
+{
+    MappedFile file(path);
+
+    FileHeader header;
+    std::memcpy(&header, file.data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.format_version != kFormatVersion ||
+        header.endian_tag != kEndianTag)
+    {
+        throw std::runtime_error("unrecognized format");
+    }
+    if (header.file_size != file.size ||
+        header.topics_offset + header.topic_count * sizeof(TopicEntry) > file.size ||
+        header.partitions_offset + header.partition_count * sizeof(PartitionEntry) > file.size ||
+        header.data_offset > file.size)
+    {
+        throw std::runtime_error("truncated");
+    }
+    if (fnv1a(file.data + sizeof(FileHeader), file.size - sizeof(FileHeader)) != header.checksum)
+    {
+        throw std::runtime_error("checksum mismatch");
+    }
+
+    // The checkpoint must describe a prefix of the current log: the last batch it
+    // covers has to still be there, end at the recorded position and carry the same CRC.
+    int log_fd = ::open(segment_path(header.log_segment).c_str(), O_RDONLY | O_CLOEXEC);
+    if (log_fd < 0)
+    {
+        throw std::runtime_error("cannot open metadata log segment " + std::to_string(header.log_segment));
+    }
+    char batch_header[record_batch::kAttributesOffset];
+    ssize_t n = pread(log_fd, batch_header, sizeof(batch_header), static_cast<off_t>(header.last_batch_position));
+    ::close(log_fd);
+    if (n != static_cast<ssize_t>(sizeof(batch_header)))
+    {
+        throw std::runtime_error("metadata log is shorter than the checkpoint");
+    }
+    int32_t batch_len;
+    uint32_t batch_crc;
+    std::memcpy(&batch_len, batch_header + 8, sizeof(batch_len));
+    std::memcpy(&batch_crc, batch_header + record_batch::kCrcOffset, sizeof(batch_crc));
+    if (header.last_batch_position + record_batch::kLogOverhead + static_cast<uint32_t>(ntohl(batch_len)) != header.log_position ||
+        ntohl(batch_crc) != header.last_batch_crc)
+    {
+        throw std::runtime_error("metadata log does not match the checkpoint");
+    }
+
+    auto in_data = [&](uint64_t offset, uint64_t len)
+    {
+        if (header.data_offset + offset + len > file.size)
+        {
+            throw std::runtime_error("entry out of bounds");
+        }
+        return file.data + header.data_offset + offset;
+    };
+
+    auto snapshot = std::make_unique<MetadataSnapshot>();
+    snapshot->version = header.snapshot_version;
+    snapshot->log_segment = header.log_segment;
+    snapshot->next_offset = header.next_offset;
+    snapshot->log_position = header.log_position;
+    snapshot->last_batch_position = header.last_batch_position;
+    snapshot->last_batch_crc = header.last_batch_crc;
+
+    const char *partition_table = file.data + header.partitions_offset;
+    for (uint32_t t = 0; t < header.topic_count; ++t)
+    {
+        TopicEntry topic;
+        std::memcpy(&topic, file.data + header.topics_offset + t * sizeof(TopicEntry), sizeof(topic));
+        if (topic.first_partition + topic.partition_count > header.partition_count)
+        {
+            throw std::runtime_error("partition range out of bounds");
+        }
+
+        std::vector<uint8_t> id(topic.id, topic.id + sizeof(topic.id));
+
+        std::vector<PartitionState> pars;
+        pars.reserve(topic.partition_count);
+        for (uint64_t p = topic.first_partition; p < topic.first_partition + topic.partition_count; ++p)
+        {
+            PartitionEntry entry;
+            std::memcpy(&entry, partition_table + p * sizeof(PartitionEntry), sizeof(entry));
+
+            PartitionState par;
+            par.partition_id = entry.partition_id;
+            par.leader = entry.leader;
+            par.leader_epoch = entry.leader_epoch;
+            par.replicas.resize(entry.replica_count);
+            std::memcpy(par.replicas.data(), in_data(entry.replicas_offset, entry.replica_count * sizeof(int32_t)), entry.replica_count * sizeof(int32_t));
+            par.isr.resize(entry.isr_count);
+            std::memcpy(par.isr.data(), in_data(entry.isr_offset, entry.isr_count * sizeof(int32_t)), entry.isr_count * sizeof(int32_t));
+            const char *serialized = in_data(entry.serialized_offset, entry.serialized_len);
+            par.serialized.assign(serialized, serialized + entry.serialized_len);
+            pars.push_back(std::move(par));
+        }
+
+        if (!pars.empty())
+        {
+            snapshot->topicToPars.emplace(id, std::move(pars));
+        }
+        if (topic.name_len == kNoName)
+        {
+            continue;
+        }
+        std::string name(in_data(topic.name_offset, topic.name_len), topic.name_len);
+        snapshot->topicIdToName.emplace(id, name);
+        snapshot->nameToTopicId.emplace(std::move(name), std::move(id));
+    }
+
+    return snapshot;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "storage/MetadataSnapshot.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Reads and writes compact binary checkpoints of a MetadataSnapshot.
+ *
+ * A checkpoint records the derived metadata state together with the metadata log
+ * position it covers, so startup only has to replay the log tail past that point.
+ *
+ * The file is a fixed header followed by fixed-size topic and partition tables and
+ * a data blob, all in host byte order and naturally aligned. Loading maps the file
+ * and walks the tables without any varint or record decoding.
+ */
+class MetadataCheckpoint
+{
+public:
+    // Path of the metadata log segment with a given base offset.
+    using SegmentPath = std::function<std::string(int64_t)>;
+
+    explicit MetadataCheckpoint(std::string dir);
+
+    // Atomically writes a checkpoint for `snapshot` and prunes older ones.
+    void write(const MetadataSnapshot &snapshot) const;
+
+    // Loads the newest checkpoint that is still consistent with the metadata log.
+    // Returns nullptr if there is none.
+    std::unique_ptr<MetadataSnapshot> load_latest(const SegmentPath &segment_path) const;
+
+private:
+    std::unique_ptr<MetadataSnapshot> load(const std::string &path, const SegmentPath &segment_path) const;
+
+    std::string dir;
+    static constexpr std::size_t kRetained = 2;
+};
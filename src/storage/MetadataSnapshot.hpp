@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Orders topic ids, and (topic id, partition) pairs, by their bytes. Maps keyed by a
+// topic id use this rather than std::less, whose std::vector comparison GCC 12 flags
+// with a bogus -Wstringop-overread at -O3.
+struct TopicIdLess
+{
+    static int compare(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+    {
+        std::size_t common = std::min(a.size(), b.size());
+        int order = common == 0 ? 0 : std::memcmp(a.data(), b.data(), common);
+        if (order != 0)
+        {
+            return order;
+        }
+        return a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+    }
+
+    bool operator()(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b) const
+    {
+        return compare(a, b) < 0;
+    }
+
+    bool operator()(const std::pair<std::vector<uint8_t>, int32_t> &a,
+                    const std::pair<std::vector<uint8_t>, int32_t> &b) const
+    {
+        int order = compare(a.first, b.first);
+        return order != 0 ? order < 0 : a.second < b.second;
+    }
+};
+
+// Decoded state of a single partition, as carried by a PartitionRecord.
+struct PartitionState
+{
+    int32_t partition_id = 0;
+    int32_t leader = -1;
+    int32_t leader_epoch = 0;
+    std::vector<int32_t> replicas;
+    std::vector<int32_t> isr;
+
+    // Pre-serialized DescribeTopicPartitions partition entry.
+    std::vector<uint8_t> serialized;
+
+    bool operator==(const PartitionState &) const = default;
+};
+
+// A DescribeTopicPartitions topic entry, encoded once per snapshot. The offsets
+// let a paged response copy out any contiguous range of partitions.
+struct DescribeTopicEntry
+{
+    std::vector<char> bytes;
+    std::size_t partitions_offset = 0;       // Start of the partitions array length
+    std::vector<uint32_t> partition_offsets; // Start of each partition entry, plus one past the last
+    std::vector<int32_t> partition_ids;      // Ascending
+};
+
+/**
+ * @brief An immutable view of the cluster metadata derived from the KRaft log.
+ *
+ * Snapshots are built off to the side by the metadata loader and published as a
+ * whole, so readers never observe a partially applied update.
+ */
+struct MetadataSnapshot
+{
+    uint64_t version = 0; // Bumped on every publish
+
+    // How far into the metadata log this snapshot goes: the segment it stopped in, the
+    // bytes of that segment covered, and one past the last record offset applied.
+    int64_t log_segment = 0;
+    std::size_t log_position = 0;
+    int64_t next_offset = 0;
+
+    // Identifies the last covered batch in log_segment, so a checkpoint can be matched against the log.
+    std::size_t last_batch_position = 0;
+    uint32_t last_batch_crc = 0;
+
+    std::map<std::string, std::vector<uint8_t>> nameToTopicId;
+    std::map<std::vector<uint8_t>, std::string, TopicIdLess> topicIdToName;
+    std::map<std::vector<uint8_t>, std::vector<PartitionState>, TopicIdLess> topicToPars; // Sorted by partition_id
+
+    // Complete DescribeTopicPartitions topic entry for every known topic, encoded once
+    // when the snapshot is built. Shared between snapshots until the topic changes.
+    // Ordered by name, which is also the DescribeTopicPartitions paging order.
+    std::map<std::string, std::shared_ptr<const DescribeTopicEntry>> describeTopicEntries;
+
+    bool operator==(const MetadataSnapshot &other) const
+    {
+        return nameToTopicId == other.nameToTopicId && topicIdToName == other.topicIdToName &&
+               topicToPars == other.topicToPars;
+    }
+};
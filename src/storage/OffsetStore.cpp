@@ -0,0 +1,615 @@
+#include "storage/OffsetStore.hpp"
+#include "storage/RecordBatch.hpp"
+#include "storage/RecordBatchBuilder.hpp"
+#include "core/Log.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    // Versions of the __consumer_offsets key and value this store writes.
+    constexpr int16_t kOffsetCommitKeyVersion = 1;
+    constexpr int16_t kOffsetCommitValueVersion = 3;
+
+    // Records per batch when the log is rewritten.
+    constexpr std::size_t kCompactBatchRecords = 1000;
+
+    int64_t now_ms()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void put_int16(std::vector<uint8_t> &out, int16_t value)
+    {
+        uint16_t be = htons(static_cast<uint16_t>(value));
+        out.resize(out.size() + sizeof(be));
+        std::memcpy(out.data() + out.size() - sizeof(be), &be, sizeof(be));
+    }
+
+    void put_int32(std::vector<uint8_t> &out, int32_t value)
+    {
+        uint32_t be = htonl(static_cast<uint32_t>(value));
+        out.resize(out.size() + sizeof(be));
+        std::memcpy(out.data() + out.size() - sizeof(be), &be, sizeof(be));
+    }
+
+    void put_int64(std::vector<uint8_t> &out, int64_t value)
+    {
+        uint64_t be = htobe64(static_cast<uint64_t>(value));
+        out.resize(out.size() + sizeof(be));
+        std::memcpy(out.data() + out.size() - sizeof(be), &be, sizeof(be));
+    }
+
+    void put_string(std::vector<uint8_t> &out, const std::string &value)
+    {
+        put_int16(out, static_cast<int16_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    std::vector<uint8_t> encode_key(const std::string &group, const OffsetStore::Commit &commit)
+    {
+        std::vector<uint8_t> key;
+        put_int16(key, kOffsetCommitKeyVersion);
+        put_string(key, group);
+        put_string(key, commit.topic);
+        put_int32(key, commit.partition);
+        return key;
+    }
+
+    std::vector<uint8_t> encode_value(const OffsetStore::CommittedOffset &offset)
+    {
+        std::vector<uint8_t> value;
+        put_int16(value, kOffsetCommitValueVersion);
+        put_int64(value, offset.offset);
+        put_int32(value, offset.leader_epoch);
+        put_string(value, offset.metadata);
+        put_int64(value, offset.commit_timestamp);
+        return value;
+    }
+
+    // Bounds-checked reads of the big-endian fields and varints in a record.
+    class FieldReader
+    {
+    public:
+        FieldReader(const uint8_t *data, std::size_t size) : data(data), end(data + size) {}
+
+        int16_t int16() { return static_cast<int16_t>(be16toh(read<uint16_t>())); }
+        int32_t int32() { return static_cast<int32_t>(be32toh(read<uint32_t>())); }
+        int64_t int64() { return static_cast<int64_t>(be64toh(read<uint64_t>())); }
+
+        int64_t varint()
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t byte = read<uint8_t>();
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                {
+                    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+                }
+            }
+            throw std::runtime_error("Malformed varint in offsets log");
+        }
+
+        std::string string()
+        {
+            int16_t size = int16();
+            return std::string(reinterpret_cast<const char *>(take(size < 0 ? 0 : size)), size < 0 ? 0 : size);
+        }
+
+        const uint8_t *take(std::size_t size)
+        {
+            if (static_cast<std::size_t>(end - data) < size)
+            {
+                throw std::runtime_error("Record overruns its batch in offsets log");
+            }
+            const uint8_t *start = data;
+            data += size;
+            return start;
+        }
+
+    private:
+        template <typename T>
+        T read()
+        {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        const uint8_t *data;
+        const uint8_t *end;
+    };
+
+    // Calls `on_record(key, key_size, value, value_size)` for every record of a batch;
+    // a tombstone has a null value.
+    template <typename OnRecord>
+    void for_each_record(const uint8_t *batch, std::size_t size, OnRecord on_record)
+    {
+        int32_t count = FieldReader(batch + record_batch::kHeaderSize - sizeof(int32_t), sizeof(int32_t)).int32();
+        std::vector<uint8_t> decompressed;
+        FieldReader records(batch + record_batch::kHeaderSize, size - record_batch::kHeaderSize);
+        if (record_batch::compression_of(batch) != CompressionType::None)
+        {
+            decompressed = record_batch::decompressed_records(batch, size);
+            records = FieldReader(decompressed.data(), decompressed.size());
+        }
+
+        for (int32_t i = 0; i < count; ++i)
+        {
+            int64_t length = records.varint();
+            FieldReader record(records.take(static_cast<std::size_t>(length)), static_cast<std::size_t>(length));
+            record.take(1); // attributes
+            record.varint(); // timestamp delta
+            record.varint(); // offset delta
+            int64_t key_size = record.varint();
+            const uint8_t *key = key_size > 0 ? record.take(static_cast<std::size_t>(key_size)) : nullptr;
+            int64_t value_size = record.varint();
+            const uint8_t *value = value_size >= 0 ? record.take(static_cast<std::size_t>(value_size)) : nullptr;
+            on_record(key, key_size < 0 ? 0 : static_cast<std::size_t>(key_size), value, value_size < 0 ? 0 : static_cast<std::size_t>(value_size));
+        }
+    }
+
+    void write_all(int fd, const uint8_t *data, std::size_t size, const std::string &path)
+    {
+        std::size_t written = 0;
+        while (written < size)
+        {
+            ssize_t n = ::write(fd, data + written, size - written);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                throw std::runtime_error("Failed to write " + path + ": " + std::strerror(errno));
+            }
+            written += static_cast<std::size_t>(n);
+        }
+    }
+}
+
+OffsetStore::OffsetStore(std::string dir) : OffsetStore(std::move(dir), Options()) {}
+
+OffsetStore::OffsetStore(std::string dir, Options options)
+    : dir(std::move(dir)), options(options)
+{
+    this->log_path = this->dir + "/00000000000000000000.log";
+    std::filesystem::create_directories(this->dir);
+    load();
+
+    this->log_fd = ::open(this->log_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->log_fd < 0)
+    {
+        throw std::runtime_error("Cannot open offsets log: " + this->log_path);
+    }
+    this->compaction_wanted = needs_compaction();
+    this->compactor = std::jthread([this](std::stop_token stop)
+                                   { run_compactor(stop); });
+}
+
+OffsetStore::~OffsetStore()
+{
+    this->compactor.request_stop();
+    if (this->compactor.joinable())
+    {
+        this->compactor.join();
+    }
+    ::close(this->log_fd);
+}
+
+void OffsetStore::load()
+{
+    std::ifstream file(this->log_path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return;
+    }
+    std::vector<uint8_t> log(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(log.data()), static_cast<std::streamsize>(log.size()));
+
+    // A crash can leave a partly written batch at the end; it was never acknowledged.
+    std::size_t valid = record_batch::valid_prefix(log.data(), log.size());
+    if (valid < log.size())
+    {
+        LOG_WARN("Dropping {} bytes of torn or corrupt data at the end of {}", log.size() - valid, this->log_path);
+        std::filesystem::resize_file(this->log_path, valid);
+    }
+
+    std::size_t position = 0;
+    while (position < valid)
+    {
+        record_batch::Header header = record_batch::read_header(log.data() + position);
+        for_each_record(log.data() + position, header.size, [&](const uint8_t *key, std::size_t key_size, const uint8_t *value, std::size_t value_size)
+                        {
+                            FieldReader key_reader(key, key_size);
+                            int16_t key_version = key_size >= sizeof(int16_t) ? key_reader.int16() : -1;
+                            if (key_version != 0 && key_version != kOffsetCommitKeyVersion)
+                            {
+                                return; // Group metadata and other record types
+                            }
+                            std::string group = key_reader.string();
+                            Commit commit;
+                            commit.topic = key_reader.string();
+                            commit.partition = key_reader.int32();
+
+                            if (!value)
+                            {
+                                std::unique_lock lock(this->offsets_mutex);
+                                auto it = this->offsets.find(group);
+                                if (it != this->offsets.end() && it->second.erase(TopicPartition{commit.topic, commit.partition}) > 0)
+                                {
+                                    this->live_offsets.fetch_sub(1, std::memory_order_relaxed);
+                                }
+                                return;
+                            }
+                            FieldReader value_reader(value, value_size);
+                            if (value_reader.int16() != kOffsetCommitValueVersion)
+                            {
+                                return;
+                            }
+                            commit.offset.offset = value_reader.int64();
+                            commit.offset.leader_epoch = value_reader.int32();
+                            commit.offset.metadata = value_reader.string();
+                            commit.offset.commit_timestamp = value_reader.int64();
+                            apply(group, commit); });
+        this->log_records += static_cast<uint64_t>(header.last_offset - header.base_offset + 1);
+        this->next_offset = header.last_offset + 1;
+        position += header.size;
+    }
+    this->log_bytes = valid;
+    LOG_INFO("Loaded {} committed offsets from {}", this->live_offsets.load(), this->log_path);
+}
+
+void OffsetStore::apply(const std::string &group, const Commit &commit)
+{
+    std::unique_lock lock(this->offsets_mutex);
+    auto [it, inserted] = this->offsets[group].insert_or_assign(TopicPartition{commit.topic, commit.partition}, commit.offset);
+    if (inserted)
+    {
+        this->live_offsets.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void OffsetStore::commit(const std::string &group, const std::vector<Commit> &commits)
+{
+    if (commits.empty())
+    {
+        return;
+    }
+
+    int64_t timestamp = now_ms();
+    RecordBatchBuilder batch(0, timestamp);
+    for (const auto &commit : commits)
+    {
+        batch.append(encode_key(group, commit), encode_value(commit.offset), timestamp);
+    }
+
+    std::unique_lock lock(this->write_mutex);
+    if (!this->open_round)
+    {
+        this->open_round = std::make_shared<WriteRound>();
+    }
+    std::shared_ptr<WriteRound> round = this->open_round;
+    round->batches.push_back(batch.build());
+    round->commits.emplace_back(group, commits);
+
+    // The first committer to find no write in progress writes every round queued so far.
+    while (!round->done)
+    {
+        if (this->writing)
+        {
+            this->write_done.wait(lock);
+            continue;
+        }
+        this->writing = true;
+        std::shared_ptr<WriteRound> current = std::move(this->open_round);
+        lock.unlock();
+
+        uint64_t bytes = 0;
+        uint64_t records = 0;
+        try
+        {
+            records = write_round(*current, bytes);
+        }
+        catch (...)
+        {
+            current->error = std::current_exception();
+        }
+
+        lock.lock();
+        this->next_offset += static_cast<int64_t>(records);
+        this->log_bytes += bytes;
+        this->log_records += records;
+        this->commits_total += records;
+        ++this->writes_total;
+        current->done = true;
+        this->writing = false;
+        if (!this->compaction_wanted && needs_compaction())
+        {
+            this->compaction_wanted = true;
+            this->compaction_signal.notify_one();
+        }
+        this->write_done.notify_all();
+    }
+
+    if (round->error)
+    {
+        std::rethrow_exception(round->error);
+    }
+}
+
+uint64_t OffsetStore::write_round(WriteRound &round, uint64_t &bytes)
+{
+    // Batches are built at offset 0; the base offset is outside the CRC, so it is set here.
+    std::vector<uint8_t> data;
+    uint64_t records = 0;
+    for (auto &batch : round.batches)
+    {
+        record_batch::Header header = record_batch::read_header(batch.data());
+        uint64_t base_offset = htobe64(static_cast<uint64_t>(this->next_offset + static_cast<int64_t>(records)));
+        std::memcpy(batch.data(), &base_offset, sizeof(base_offset));
+        records += static_cast<uint64_t>(header.last_offset - header.base_offset + 1);
+        data.insert(data.end(), batch.begin(), batch.end());
+    }
+    append_to_log(data);
+    bytes = data.size();
+
+    for (const auto &[group, commits] : round.commits)
+    {
+        for (const auto &commit : commits)
+        {
+            apply(group, commit);
+        }
+    }
+    return records;
+}
+
+void OffsetStore::append_to_log(const std::vector<uint8_t> &bytes)
+{
+    try
+    {
+        write_all(this->log_fd, bytes.data(), bytes.size(), this->log_path);
+        // Commits are acknowledged once the round returns, so the round must be on disk.
+        if (::fdatasync(this->log_fd) != 0)
+        {
+            throw std::runtime_error("Failed to sync " + this->log_path);
+        }
+    }
+    catch (...)
+    {
+        // Drop a partial write, so later appends follow the last whole batch.
+        if (::ftruncate(this->log_fd, static_cast<off_t>(this->log_bytes)) != 0)
+        {
+            LOG_ERROR("Failed to truncate {} after a failed write", this->log_path);
+        }
+        throw;
+    }
+}
+
+bool OffsetStore::needs_compaction() const
+{
+    if (this->log_bytes < this->options.compact_min_bytes || this->log_records == 0)
+    {
+        return false;
+    }
+    uint64_t live = this->live_offsets.load(std::memory_order_relaxed);
+    double dirty = static_cast<double>(this->log_records - std::min(live, this->log_records)) / static_cast<double>(this->log_records);
+    return dirty >= this->options.compact_dirty_ratio;
+}
+
+std::optional<OffsetStore::CommittedOffset> OffsetStore::fetch(const std::string &group, const std::string &topic, int32_t partition) const
+{
+    std::shared_lock lock(this->offsets_mutex);
+    auto it = this->offsets.find(group);
+    if (it == this->offsets.end())
+    {
+        return std::nullopt;
+    }
+    auto offset = it->second.find(TopicPartition{topic, partition});
+    if (offset == it->second.end())
+    {
+        return std::nullopt;
+    }
+    return offset->second;
+}
+
+std::vector<OffsetStore::Commit> OffsetStore::fetch_all(const std::string &group) const
+{
+    std::vector<Commit> commits;
+    {
+        std::shared_lock lock(this->offsets_mutex);
+        auto it = this->offsets.find(group);
+        if (it == this->offsets.end())
+        {
+            return commits;
+        }
+        commits.reserve(it->second.size());
+        for (const auto &[key, offset] : it->second)
+        {
+            commits.push_back(Commit{key.topic, key.partition, offset});
+        }
+    }
+    std::sort(commits.begin(), commits.end(), [](const Commit &a, const Commit &b)
+              { return a.topic != b.topic ? a.topic < b.topic : a.partition < b.partition; });
+    return commits;
+}
+
+OffsetStore::Stats OffsetStore::stats() const
+{
+    std::lock_guard lock(this->write_mutex);
+    return Stats{this->commits_total, this->writes_total, this->compactions_total, this->log_bytes,
+                 this->live_offsets.load(std::memory_order_relaxed)};
+}
+
+void OffsetStore::acquire_writer(std::unique_lock<std::mutex> &lock)
+{
+    this->write_done.wait(lock, [this]
+                          { return !this->writing; });
+    this->writing = true;
+}
+
+void OffsetStore::release_writer()
+{
+    this->writing = false;
+    this->write_done.notify_all();
+}
+
+void OffsetStore::compact()
+{
+    // The live offsets and the end of the log they were read at. Holding the writer
+    // role means every write up to there has been applied, and none is under way.
+    std::vector<std::pair<std::string, std::vector<Commit>>> live;
+    uint64_t snapshot_bytes = 0;
+    uint64_t snapshot_records = 0;
+    {
+        std::unique_lock lock(this->write_mutex);
+        acquire_writer(lock);
+        snapshot_bytes = this->log_bytes;
+        snapshot_records = this->log_records;
+        {
+            std::shared_lock read(this->offsets_mutex);
+            for (const auto &[group, group_offsets] : this->offsets)
+            {
+                auto &commits = live.emplace_back(group, std::vector<Commit>()).second;
+                for (const auto &[key, offset] : group_offsets)
+                {
+                    commits.push_back(Commit{key.topic, key.partition, offset});
+                }
+            }
+        }
+        release_writer();
+    }
+
+    // Write them to a new log while commits keep appending to the old one.
+    const std::string compacted_path = this->log_path + ".compacting";
+    int fd = ::open(compacted_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot create " + compacted_path);
+    }
+    uint64_t compacted_bytes = 0;
+    uint64_t compacted_records = 0;
+    try
+    {
+        for (const auto &[group, commits] : live)
+        {
+            for (std::size_t begin = 0; begin < commits.size(); begin += kCompactBatchRecords)
+            {
+                std::size_t end = std::min(commits.size(), begin + kCompactBatchRecords);
+                RecordBatchBuilder batch(static_cast<int64_t>(compacted_records), now_ms());
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    batch.append(encode_key(group, commits[i]), encode_value(commits[i].offset), commits[i].offset.commit_timestamp);
+                }
+                auto bytes = batch.build();
+                write_all(fd, bytes.data(), bytes.size(), compacted_path);
+                compacted_bytes += bytes.size();
+                compacted_records += end - begin;
+            }
+        }
+    }
+    catch (...)
+    {
+        ::close(fd);
+        std::filesystem::remove(compacted_path);
+        throw;
+    }
+
+    // Carry over what was appended since the snapshot, then swap the logs.
+    std::unique_lock lock(this->write_mutex);
+    acquire_writer(lock);
+    uint64_t tail_bytes = this->log_bytes - snapshot_bytes;
+    uint64_t tail_records = this->log_records - snapshot_records;
+    lock.unlock();
+    int old_fd = this->log_fd;
+    try
+    {
+        std::vector<uint8_t> tail(tail_bytes);
+        if (::pread(old_fd, tail.data(), tail.size(), static_cast<off_t>(snapshot_bytes)) != static_cast<ssize_t>(tail.size()))
+        {
+            throw std::runtime_error("Failed to read the end of " + this->log_path);
+        }
+        write_all(fd, tail.data(), tail.size(), compacted_path);
+        if (::fsync(fd) != 0)
+        {
+            throw std::runtime_error("Failed to sync " + compacted_path);
+        }
+        ::close(fd);
+        fd = -1;
+        std::filesystem::rename(compacted_path, this->log_path);
+        int new_fd = ::open(this->log_path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+        if (new_fd < 0)
+        {
+            throw std::runtime_error("Cannot reopen offsets log: " + this->log_path);
+        }
+        this->log_fd = new_fd;
+        ::close(old_fd);
+
+        // The rename itself is only durable once the directory is synced.
+        std::filesystem::path dir = std::filesystem::path(this->log_path).parent_path();
+        int dir_fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd < 0 || ::fsync(dir_fd) != 0)
+        {
+            LOG_ERROR("Failed to sync the directory of {}", this->log_path);
+        }
+        if (dir_fd >= 0)
+        {
+            ::close(dir_fd);
+        }
+    }
+    catch (...)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+            std::filesystem::remove(compacted_path);
+        }
+        lock.lock();
+        release_writer();
+        throw;
+    }
+
+    lock.lock();
+    LOG_INFO("Compacted {} from {} to {} bytes", this->log_path, this->log_bytes, compacted_bytes + tail_bytes);
+    this->log_bytes = compacted_bytes + tail_bytes;
+    this->log_records = compacted_records + tail_records;
+    ++this->compactions_total;
+    release_writer();
+}
+
+void OffsetStore::run_compactor(std::stop_token stop)
+{
+    std::unique_lock lock(this->write_mutex);
+    while (true)
+    {
+        this->compaction_signal.wait(lock, stop, [this]
+                                     { return this->compaction_wanted; });
+        if (stop.stop_requested())
+        {
+            return;
+        }
+        lock.unlock();
+        try
+        {
+            compact();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR("Offsets log compaction failed: {}", e.what());
+        }
+        lock.lock();
+        this->compaction_wanted = false;
+    }
+}
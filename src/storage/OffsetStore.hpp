@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Committed consumer group offsets, kept in memory and backed by a compacted log.
+ *
+ * Lookups are served from a hash of group → (topic, partition) → offset and never
+ * touch the disk. Each commit is encoded as one record batch in the layout of
+ * Kafka's __consumer_offsets topic, keyed by (group, topic, partition). Commits
+ * that arrive while a write is in progress are appended together with one write
+ * by whichever committer goes next, and only become visible once written.
+ *
+ * The log holds every commit, so a background thread rewrites it with only the
+ * latest offset per key once it is mostly superseded. Commits go on meanwhile;
+ * whatever they appended to the old log is carried over before the swap.
+ */
+class OffsetStore
+{
+public:
+    struct Options
+    {
+        std::size_t compact_min_bytes = 16 << 20; // Don't rewrite smaller logs
+        double compact_dirty_ratio = 0.5;         // Share of superseded records that triggers a rewrite
+    };
+
+    struct CommittedOffset
+    {
+        int64_t offset = -1;
+        int32_t leader_epoch = -1;
+        std::string metadata;
+        int64_t commit_timestamp = -1;
+    };
+
+    struct Commit
+    {
+        std::string topic;
+        int32_t partition;
+        CommittedOffset offset;
+    };
+
+    struct Stats
+    {
+        uint64_t commits;     // Offsets committed
+        uint64_t writes;      // Log appends, each covering one or more commit calls
+        uint64_t compactions;
+        uint64_t log_bytes;
+        uint64_t live_offsets;
+    };
+
+    // Loads the offsets log in `dir`, creating it if needed.
+    explicit OffsetStore(std::string dir);
+    OffsetStore(std::string dir, Options options);
+    ~OffsetStore();
+
+    OffsetStore(const OffsetStore &) = delete;
+    OffsetStore &operator=(const OffsetStore &) = delete;
+
+    // Appends the commits of one group to the log, then makes them visible.
+    void commit(const std::string &group, const std::vector<Commit> &commits);
+
+    std::optional<CommittedOffset> fetch(const std::string &group, const std::string &topic, int32_t partition) const;
+
+    // Every offset the group has committed, ordered by topic and partition.
+    std::vector<Commit> fetch_all(const std::string &group) const;
+
+    Stats stats() const;
+
+private:
+    struct TopicPartition
+    {
+        std::string topic;
+        int32_t partition;
+
+        bool operator==(const TopicPartition &) const = default;
+    };
+
+    struct TopicPartitionHash
+    {
+        std::size_t operator()(const TopicPartition &key) const
+        {
+            return std::hash<std::string>()(key.topic) * 31 + static_cast<std::size_t>(key.partition);
+        }
+    };
+
+    using GroupOffsets = std::unordered_map<TopicPartition, CommittedOffset, TopicPartitionHash>;
+
+    // The commit calls that go out in one write.
+    struct WriteRound
+    {
+        std::vector<std::vector<uint8_t>> batches;
+        std::vector<std::pair<std::string, std::vector<Commit>>> commits; // Applied once written
+        bool done = false;
+        std::exception_ptr error;
+    };
+
+    void load();
+    void apply(const std::string &group, const Commit &commit);
+    // Appends a round's batches with one write and applies its commits. Returns the records written.
+    uint64_t write_round(WriteRound &round, uint64_t &bytes);
+    void append_to_log(const std::vector<uint8_t> &bytes);
+    bool needs_compaction() const;
+    // Waits until no write is in progress and keeps others out until release_writer.
+    void acquire_writer(std::unique_lock<std::mutex> &lock);
+    void release_writer();
+    void compact();
+    void run_compactor(std::stop_token stop);
+
+    std::string dir;
+    std::string log_path;
+    Options options;
+
+    mutable std::shared_mutex offsets_mutex; // Guards offsets
+    std::unordered_map<std::string, GroupOffsets> offsets;
+    std::atomic<uint64_t> live_offsets{0};
+
+    mutable std::mutex write_mutex; // Guards the fields below
+    std::condition_variable write_done;
+    std::shared_ptr<WriteRound> open_round;
+    bool writing = false; // The log file belongs to the thread that set this
+    int log_fd = -1;
+    int64_t next_offset = 0;
+    uint64_t log_bytes = 0;
+    uint64_t log_records = 0;
+    uint64_t commits_total = 0;
+    uint64_t writes_total = 0;
+    uint64_t compactions_total = 0;
+    bool compaction_wanted = false;
+    std::condition_variable_any compaction_signal;
+
+    std::jthread compactor;
+};
@@ -0,0 +1,636 @@
+#include "storage/PartitionLog.hpp"
+#include "storage/RecordBatch.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <utility>
+#include <arpa/inet.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string segment_name(int64_t base_offset)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020lld.log", static_cast<long long>(base_offset));
+        return name;
+    }
+}
+
+PartitionLog::PartitionLog(std::string dir, const std::array<uint8_t, 16> &topic_id, int32_t partition,
+                           std::shared_ptr<RecordBatchCache> cache, std::shared_ptr<ReadAhead> read_ahead)
+    : dir(std::move(dir)), topic_id(topic_id), partition(partition), cache(std::move(cache)), read_ahead(std::move(read_ahead)) {}
+
+PartitionLog::Records::Records(std::vector<RecordBatchCache::Slice> slices)
+    : parts(std::move(slices))
+{
+    for (const auto &slice : parts)
+    {
+        total += slice.length;
+    }
+}
+
+bool PartitionLog::Records::copy(std::size_t position, void *out, std::size_t length) const
+{
+    if (position + length > total)
+    {
+        return false;
+    }
+    uint8_t *dest = static_cast<uint8_t *>(out);
+    for (const auto &slice : parts)
+    {
+        if (length == 0)
+        {
+            break;
+        }
+        if (position >= slice.length)
+        {
+            position -= slice.length;
+            continue;
+        }
+        std::size_t n = std::min(length, slice.length - position);
+        std::memcpy(dest, slice.data->data() + slice.offset + position, n);
+        dest += n;
+        length -= n;
+        position = 0;
+    }
+    return true;
+}
+
+void PartitionLog::Records::truncate(std::size_t length)
+{
+    if (length >= total)
+    {
+        return;
+    }
+    total = length;
+    std::size_t kept = 0;
+    while (kept < parts.size() && length > 0)
+    {
+        parts[kept].length = std::min(parts[kept].length, length);
+        length -= parts[kept].length;
+        ++kept;
+    }
+    parts.resize(kept);
+}
+
+PartitionLog::SegmentFile::SegmentFile(SegmentFile &&other) noexcept
+    : fd(std::exchange(other.fd, -1)) {}
+
+PartitionLog::SegmentFile &PartitionLog::SegmentFile::operator=(SegmentFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        fd = std::exchange(other.fd, -1);
+    }
+    return *this;
+}
+
+PartitionLog::SegmentFile::~SegmentFile()
+{
+    reset();
+}
+
+int PartitionLog::SegmentFile::get(const std::string &path)
+{
+    if (fd < 0)
+    {
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open log file: " + path);
+        }
+    }
+    return fd;
+}
+
+uint64_t PartitionLog::SegmentFile::size(const std::string &path)
+{
+    struct stat st{};
+    return ::fstat(get(path), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+void PartitionLog::SegmentFile::reset()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+PartitionLog::ReadResult PartitionLog::read(int64_t fetch_offset, int32_t max_bytes)
+{
+    ReadResult result;
+    // Growth of the active segment is seen by the scan below; only new or deleted
+    // segments need the directory listed.
+    if (segments.empty() || fetch_offset >= segments.back().next_offset)
+    {
+        refresh_segments_if_due();
+    }
+    if (segments.empty())
+    {
+        result.error_code = fetch_offset == 0 ? 0 : kOffsetOutOfRange;
+        return result;
+    }
+    scan(segments.back());
+
+    result.log_start_offset = segments.front().base_offset;
+    result.log_end_offset = segments.back().next_offset;
+    if (fetch_offset < result.log_start_offset || fetch_offset > result.log_end_offset)
+    {
+        result.error_code = kOffsetOutOfRange;
+        return result;
+    }
+    if (fetch_offset == result.log_end_offset)
+    {
+        return result;
+    }
+
+    auto it = std::upper_bound(segments.begin(), segments.end(), fetch_offset, [](int64_t offset, const Segment &s)
+                               { return offset < s.base_offset; });
+    --it;
+    scan(*it);
+    // Past the end of this segment's data (e.g. an offset removed by compaction, or a
+    // segment it emptied): start at the next one.
+    while ((fetch_offset >= it->next_offset || it->scanned_end == 0) && std::next(it) != segments.end())
+    {
+        ++it;
+        scan(*it);
+    }
+    Segment &segment = *it;
+
+    BatchHeader header{};
+    uint64_t position = locate(segment, fetch_offset, header);
+    if (position >= segment.scanned_end)
+    {
+        return result;
+    }
+    uint64_t available = segment.scanned_end - position;
+    std::size_t length = std::min<uint64_t>(available, std::max<uint64_t>(header.size, max_bytes > 0 ? max_bytes : 0));
+
+    ReadAhead::Segment current{segment.path, segment.base_offset, segment.scanned_end, std::next(it) == segments.end()};
+    std::optional<ReadAhead::Segment> next;
+    if (std::next(it) != segments.end())
+    {
+        Segment &following = *std::next(it);
+        next = ReadAhead::Segment{following.path, following.base_offset, following.file.size(following.path), std::next(it, 2) == segments.end()};
+    }
+
+    Records data = read_range(segment, current, position, length);
+
+    // Trim to whole batches.
+    std::size_t whole = 0;
+    int32_t batch_len;
+    while (data.copy(whole + 8, &batch_len, sizeof(batch_len)))
+    {
+        std::size_t batch_size = record_batch::kLogOverhead + static_cast<uint32_t>(ntohl(batch_len));
+        if (whole + batch_size > data.size())
+        {
+            break;
+        }
+        whole += batch_size;
+    }
+    data.truncate(whole);
+
+    if (read_ahead)
+    {
+        read_ahead->on_read(topic_id, partition, current, next, position, data.size());
+    }
+
+    result.records = std::move(data);
+    return result;
+}
+
+int64_t PartitionLog::append(const std::vector<uint8_t> &batches)
+{
+    refresh_segments();
+    int64_t end = -1; // Unknown until the first batch when the log is empty
+    if (!segments.empty())
+    {
+        scan(segments.back());
+        end = segments.back().next_offset;
+    }
+
+    if (record_batch::valid_prefix(batches.data(), batches.size()) != batches.size())
+    {
+        throw std::runtime_error("Truncated or corrupt record batch in append to " + dir);
+    }
+
+    // Skip batches the log already holds, then check the rest follow on. A gap is
+    // fine: it is where compaction on the leader removed whole batches.
+    std::size_t begin = 0;
+    std::size_t position = 0;
+    int64_t first_base = -1;
+    while (position < batches.size())
+    {
+        record_batch::Header header = record_batch::read_header(batches.data() + position);
+        if (first_base < 0 && end >= 0 && header.last_offset < end)
+        {
+            position += header.size;
+            begin = position;
+            continue;
+        }
+        if (end >= 0 && header.base_offset < end)
+        {
+            throw std::runtime_error("Batch at offset " + std::to_string(header.base_offset) + " overlaps log end offset " +
+                                     std::to_string(end) + " of " + dir);
+        }
+        if (first_base < 0)
+        {
+            first_base = header.base_offset;
+        }
+        end = header.last_offset + 1;
+        position += header.size;
+    }
+    if (first_base < 0)
+    {
+        return end < 0 ? 0 : end;
+    }
+
+    uint64_t length = position - begin;
+    if (segments.empty() || (segments.back().scanned_end > 0 && segments.back().scanned_end + length > kSegmentBytes))
+    {
+        std::filesystem::create_directories(dir);
+        Segment segment;
+        segment.base_offset = first_base;
+        segment.path = dir + "/" + segment_name(first_base);
+        segment.next_offset = first_base;
+        segments.push_back(std::move(segment));
+    }
+    Segment &active = segments.back();
+
+    int fd = ::open(active.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open log file: " + active.path);
+    }
+    std::size_t written = 0;
+    while (written < length)
+    {
+        ssize_t n = ::write(fd, batches.data() + begin + written, length - written);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to append to log file: " + active.path);
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+
+    scan(active);
+    return active.next_offset;
+}
+
+int64_t PartitionLog::log_end_offset()
+{
+    refresh_segments_if_due();
+    if (segments.empty())
+    {
+        return 0;
+    }
+    scan(segments.back());
+    return segments.back().next_offset;
+}
+
+PartitionLog::OffsetLookup PartitionLog::list_offset(int64_t timestamp)
+{
+    OffsetLookup result;
+    // EARLIEST and LATEST follow segments another writer rolled or deleted.
+    refresh_segments_if_due();
+    if (segments.empty())
+    {
+        if (timestamp == kLatestTimestamp || timestamp == kEarliestTimestamp || timestamp == kEarliestLocalTimestamp)
+        {
+            result.offset = 0;
+        }
+        return result;
+    }
+    scan(segments.back());
+    result.log_end_offset = segments.back().next_offset;
+
+    switch (timestamp)
+    {
+    case kLatestTimestamp:
+        result.offset = result.log_end_offset;
+        return result;
+    case kEarliestTimestamp:
+    case kEarliestLocalTimestamp: // No tiered storage, so all of the log is local
+        result.offset = segments.front().base_offset;
+        return result;
+    case kLatestTieredTimestamp:
+        return result;
+    case kMaxTimestamp:
+        update_max_timestamps();
+        timestamp = max_timestamp_through.back();
+        if (timestamp < 0)
+        {
+            return result;
+        }
+        break;
+    default:
+        if (timestamp < 0)
+        {
+            return result;
+        }
+        update_max_timestamps();
+    }
+
+    // The first segment whose max timestamp reaches `timestamp` holds the first record that does.
+    auto through = std::lower_bound(max_timestamp_through.begin(), max_timestamp_through.end(), timestamp);
+    if (through == max_timestamp_through.end())
+    {
+        return result;
+    }
+    if (auto found = find_timestamp(static_cast<std::size_t>(through - max_timestamp_through.begin()), timestamp))
+    {
+        result.timestamp = found->timestamp;
+        result.offset = found->offset;
+    }
+    return result;
+}
+
+std::optional<record_batch::TimestampOffset> PartitionLog::find_timestamp(std::size_t index, int64_t timestamp)
+{
+    // Every batch up to the last older index entry is older too, and the next entry is at
+    // most an index interval on, so only a few headers are read before the first match.
+    Segment &segment = segments[index];
+    auto older = segment.index->last_before(timestamp);
+    BatchHeader header{};
+    uint64_t position = older ? older->position : 0;
+    ReadAhead::Segment current{segment.path, segment.base_offset, segment.scanned_end, index + 1 == segments.size()};
+
+    int fd = segment.file.get(segment.path);
+    std::optional<record_batch::TimestampOffset> found;
+    while (!found && read_header(fd, position, segment.scanned_end, header))
+    {
+        if (header.max_timestamp >= timestamp)
+        {
+            // The batch may span cache chunks, so it is copied out to be decoded.
+            std::vector<uint8_t> batch(header.size);
+            if (read_range(segment, current, position, header.size).copy(0, batch.data(), batch.size()))
+            {
+                found = record_batch::find_timestamp(batch.data(), batch.size(), timestamp);
+            }
+        }
+        position += header.size;
+    }
+    return found;
+}
+
+std::vector<PartitionLog::SegmentInfo> PartitionLog::closed_segments()
+{
+    refresh_segments();
+    std::vector<SegmentInfo> closed;
+    for (std::size_t i = 0; i + 1 < segments.size(); ++i)
+    {
+        scan(segments[i]);
+        closed.push_back(SegmentInfo{segments[i].base_offset, segments[i].path, segments[i].scanned_end, segments[i].next_offset});
+    }
+    return closed;
+}
+
+void PartitionLog::replace_segment(int64_t base_offset, const std::string &rewritten)
+{
+    refresh_segments();
+    auto it = std::find_if(segments.begin(), segments.end(), [base_offset](const Segment &s)
+                           { return s.base_offset == base_offset; });
+    if (it == segments.end() || std::next(it) == segments.end())
+    {
+        throw std::runtime_error("No closed segment at offset " + std::to_string(base_offset) + " in " + dir);
+    }
+
+    // Everything known about the old file is stale; the scan below rebuilds it. The index is
+    // emptied first, so a crash before the rename only costs a rebuild.
+    if (!it->index)
+    {
+        open_index(*it);
+    }
+    it->index->reset();
+    it->scanned_end = 0;
+    it->next_offset = base_offset;
+    it->last_indexed = 0;
+    it->max_timestamp = -1;
+    max_timestamp_through.clear();
+    if (::rename(rewritten.c_str(), it->path.c_str()) != 0)
+    {
+        throw std::runtime_error("Failed to replace " + it->path + ": " + std::strerror(errno));
+    }
+    it->file.reset();
+    if (cache)
+    {
+        cache->invalidate(topic_id, partition, base_offset);
+    }
+    scan(*it);
+}
+
+void PartitionLog::refresh_segments_if_due()
+{
+    if (listed_at == std::chrono::steady_clock::time_point{} || std::chrono::steady_clock::now() - listed_at >= kRefreshInterval)
+    {
+        refresh_segments();
+    }
+}
+
+void PartitionLog::refresh_segments()
+{
+    listed_at = std::chrono::steady_clock::now();
+    std::error_code ec;
+    std::vector<int64_t> found;
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        const auto &path = entry.path();
+        if (path.extension() != ".log")
+        {
+            continue;
+        }
+        try
+        {
+            found.push_back(std::stoll(path.stem().string()));
+        }
+        catch (const std::exception &)
+        {
+            // Not a segment file
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    // Keep what was already scanned for segments that still exist.
+    std::vector<Segment> refreshed;
+    refreshed.reserve(found.size());
+    bool changed = found.size() != segments.size();
+    for (int64_t base : found)
+    {
+        auto it = std::find_if(segments.begin(), segments.end(), [base](const Segment &s)
+                               { return s.base_offset == base; });
+        if (it != segments.end())
+        {
+            refreshed.push_back(std::move(*it));
+            continue;
+        }
+        changed = true;
+        Segment segment;
+        segment.base_offset = base;
+        segment.path = dir + "/" + segment_name(base);
+        segment.next_offset = base;
+        refreshed.push_back(std::move(segment));
+    }
+    segments = std::move(refreshed);
+    if (changed)
+    {
+        max_timestamp_through.clear();
+    }
+}
+
+void PartitionLog::update_max_timestamps()
+{
+    // Only the segment that was active at the last update, and any after it, can have changed.
+    std::size_t from = max_timestamp_through.empty() ? 0 : max_timestamp_through.size() - 1;
+    max_timestamp_through.resize(segments.size());
+    for (std::size_t i = from; i < segments.size(); ++i)
+    {
+        scan(segments[i]);
+        max_timestamp_through[i] = std::max(i > 0 ? max_timestamp_through[i - 1] : int64_t{-1}, segments[i].max_timestamp);
+    }
+}
+
+void PartitionLog::open_index(Segment &segment)
+{
+    std::string stem = segment.path.substr(0, segment.path.size() - std::strlen(".log"));
+    segment.index = std::make_unique<SegmentIndex>(stem + ".mkindex", segment.base_offset);
+
+    // The index must describe a prefix of the segment: the last batch it covers has to
+    // still be there, end where it recorded, and end at the same offset.
+    SegmentIndex::Coverage coverage = segment.index->coverage();
+    if (coverage.end == 0)
+    {
+        return;
+    }
+    BatchHeader header{};
+    bool matches = read_header(segment.file.get(segment.path), coverage.last_batch_position, segment.file.size(segment.path), header) &&
+                   coverage.last_batch_position + header.size == coverage.end && header.last_offset + 1 == coverage.next_offset;
+    if (!matches)
+    {
+        segment.index->reset();
+        return;
+    }
+
+    segment.scanned_end = coverage.end;
+    segment.next_offset = coverage.next_offset;
+    segment.max_timestamp = coverage.max_timestamp;
+    segment.last_indexed = segment.index->last() ? segment.index->last()->position : 0;
+}
+
+void PartitionLog::scan(Segment &segment)
+{
+    if (!segment.index)
+    {
+        open_index(segment);
+    }
+
+    // One fstat when nothing was appended since the last scan.
+    int fd = segment.file.get(segment.path);
+    uint64_t size = segment.file.size(segment.path);
+    if (segment.scanned_end >= size)
+    {
+        return;
+    }
+
+    BatchHeader header{};
+    uint64_t last_batch_position = 0;
+    bool advanced = false;
+    while (read_header(fd, segment.scanned_end, size, header))
+    {
+        segment.max_timestamp = std::max(segment.max_timestamp, header.max_timestamp);
+        if (segment.index->size() == 0 || segment.scanned_end >= segment.last_indexed + kIndexIntervalBytes)
+        {
+            segment.index->add(SegmentIndex::Entry{header.base_offset, segment.scanned_end, segment.max_timestamp});
+            segment.last_indexed = segment.scanned_end;
+        }
+        last_batch_position = segment.scanned_end;
+        segment.scanned_end += header.size;
+        segment.next_offset = header.last_offset + 1;
+        advanced = true;
+    }
+    if (advanced)
+    {
+        segment.index->cover(SegmentIndex::Coverage{segment.scanned_end, last_batch_position, segment.next_offset, segment.max_timestamp});
+    }
+}
+
+uint64_t PartitionLog::locate(Segment &segment, int64_t offset, BatchHeader &header)
+{
+    auto entry = segment.index ? segment.index->floor(offset) : std::nullopt;
+    uint64_t position = entry ? entry->position : 0;
+
+    int fd = segment.file.get(segment.path);
+    while (position < segment.scanned_end && read_header(fd, position, segment.scanned_end, header) && header.last_offset < offset)
+    {
+        position += header.size;
+    }
+    return position;
+}
+
+bool PartitionLog::read_header(int fd, uint64_t position, uint64_t file_size, BatchHeader &header)
+{
+    uint8_t buf[record_batch::kMaxTimestampOffset + sizeof(int64_t)];
+    if (position + sizeof(buf) > file_size ||
+        ::pread(fd, buf, sizeof(buf), static_cast<off_t>(position)) != static_cast<ssize_t>(sizeof(buf)))
+    {
+        return false;
+    }
+
+    int64_t base_offset;
+    int32_t batch_len;
+    int32_t last_offset_delta;
+    uint64_t max_timestamp;
+    std::memcpy(&base_offset, buf, sizeof(base_offset));
+    std::memcpy(&max_timestamp, buf + record_batch::kMaxTimestampOffset, sizeof(max_timestamp));
+    std::memcpy(&batch_len, buf + 8, sizeof(batch_len));
+    std::memcpy(&last_offset_delta, buf + record_batch::kLastOffsetDeltaOffset, sizeof(last_offset_delta));
+    batch_len = ntohl(batch_len);
+
+    uint64_t size = record_batch::kLogOverhead + static_cast<uint64_t>(batch_len);
+    if (batch_len < 0 || size < record_batch::kHeaderSize || position + size > file_size)
+    {
+        return false; // Truncated, or still being appended
+    }
+
+    header.base_offset = static_cast<int64_t>(be64toh(static_cast<uint64_t>(base_offset)));
+    header.last_offset = header.base_offset + static_cast<int32_t>(ntohl(last_offset_delta));
+    header.size = size;
+    header.max_timestamp = static_cast<int64_t>(be64toh(max_timestamp));
+    return true;
+}
+
+PartitionLog::Records PartitionLog::read_range(Segment &segment, const ReadAhead::Segment &info, uint64_t position, std::size_t length)
+{
+    if (cache)
+    {
+        RecordBatchCache::Key key{};
+        key.topic_id = topic_id;
+        key.partition = partition;
+        key.segment = segment.base_offset;
+        return Records(cache->read(key, segment.path, info.size, position, length, info.active));
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>(length);
+    ssize_t n = ::pread(segment.file.get(segment.path), data->data(), length, static_cast<off_t>(position));
+    if (n < 0)
+    {
+        throw std::runtime_error("Failed to read log file: " + segment.path);
+    }
+    data->resize(static_cast<std::size_t>(n));
+    std::size_t size = data->size();
+    return Records({RecordBatchCache::Slice{std::move(data), 0, size}});
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "storage/ReadAhead.hpp"
+#include "storage/RecordBatch.hpp"
+#include "storage/RecordBatchCache.hpp"
+#include "storage/SegmentIndex.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Read access to the segment files of one partition directory.
+ *
+ * Segments are `<base offset>.log` files. Each segment is scanned once, header by
+ * header, into a sparse index of offsets, file positions and running max timestamps
+ * that is extended as the active segment grows, so a fetch can seek to its offset
+ * without reading record data. The index is memory-mapped and kept across restarts.
+ * A timestamp lookup binary searches the segments by the max timestamp up to each,
+ * then that segment's index, and reads a few headers and one batch.
+ *
+ * Record data is read through the shared RecordBatchCache and handed out as ranges
+ * of its chunks, so a fetch copies it once, into the response. Every read is
+ * reported to ReadAhead so sequential consumers are prefetched for.
+ *
+ * Followers append batches copied from the leader, keeping the leader's offsets.
+ * Appends go to the newest segment, rolling to a new one past kSegmentBytes.
+ * Every older segment is closed: it only changes when the compactor swaps in a
+ * rewritten copy, which drops its indexes and cached data.
+ *
+ * A PartitionLog is not thread-safe: it is owned by the partition's home shard,
+ * or guarded by its owner when sharding is off.
+ */
+class PartitionLog
+{
+public:
+    // Contiguous log bytes held as ranges of shared buffers.
+    class Records
+    {
+    public:
+        Records() = default;
+        explicit Records(std::vector<RecordBatchCache::Slice> slices);
+
+        std::size_t size() const { return total; }
+        bool empty() const { return total == 0; }
+        const std::vector<RecordBatchCache::Slice> &slices() const { return parts; }
+
+        // Copies `length` bytes at `position` into `out`; false if they run past the end.
+        bool copy(std::size_t position, void *out, std::size_t length) const;
+        // Keeps only the first `length` bytes.
+        void truncate(std::size_t length);
+
+    private:
+        std::vector<RecordBatchCache::Slice> parts;
+        std::size_t total = 0;
+    };
+
+    struct ReadResult
+    {
+        int16_t error_code = 0; // OFFSET_OUT_OF_RANGE if the offset is outside the log
+        int64_t log_start_offset = 0;
+        int64_t log_end_offset = 0;
+        Records records; // Whole batches only
+    };
+
+    // ListOffsets special timestamps.
+    static constexpr int64_t kLatestTimestamp = -1;
+    static constexpr int64_t kEarliestTimestamp = -2;
+    static constexpr int64_t kMaxTimestamp = -3;
+    static constexpr int64_t kEarliestLocalTimestamp = -4;
+    static constexpr int64_t kLatestTieredTimestamp = -5;
+
+    struct OffsetLookup
+    {
+        int64_t timestamp = -1;
+        int64_t offset = -1; // -1 when no record matches
+        int64_t log_end_offset = 0;
+    };
+
+    struct SegmentInfo
+    {
+        int64_t base_offset;
+        std::string path;
+        uint64_t size;       // Of the complete batches
+        int64_t next_offset; // One past its last offset
+    };
+
+    PartitionLog(std::string dir, const std::array<uint8_t, 16> &topic_id, int32_t partition,
+                 std::shared_ptr<RecordBatchCache> cache, std::shared_ptr<ReadAhead> read_ahead);
+
+    // Reads the batches starting with the one containing `fetch_offset`, up to
+    // `max_bytes`. The first batch is returned whole even if it is larger.
+    ReadResult read(int64_t fetch_offset, int32_t max_bytes);
+
+    // Appends whole record batches and returns the new log end offset. Batches the
+    // log already holds are skipped; a batch starting past the log end is an error.
+    int64_t append(const std::vector<uint8_t> &batches);
+
+    int64_t log_end_offset();
+
+    // The first offset whose record is at or after `timestamp`, or the offset a special
+    // timestamp names. The log start and end come from the segments already known.
+    OffsetLookup list_offset(int64_t timestamp);
+
+    // The segments before the active one, oldest first. Their files don't change
+    // until replace_segment, so they can be read from any thread.
+    std::vector<SegmentInfo> closed_segments();
+
+    // Atomically renames `rewritten` over the closed segment at `base_offset` and
+    // forgets what was indexed or cached of the old file.
+    void replace_segment(int64_t base_offset, const std::string &rewritten);
+
+private:
+    // A read-only descriptor of a segment file, opened on first use and kept.
+    class SegmentFile
+    {
+    public:
+        SegmentFile() = default;
+        SegmentFile(SegmentFile &&other) noexcept;
+        SegmentFile &operator=(SegmentFile &&other) noexcept;
+        ~SegmentFile();
+
+        int get(const std::string &path);
+        uint64_t size(const std::string &path);
+        void reset();
+
+    private:
+        int fd = -1;
+    };
+
+    struct Segment
+    {
+        int64_t base_offset;
+        std::string path;
+        SegmentFile file;
+        std::unique_ptr<SegmentIndex> index; // One entry per kIndexIntervalBytes of log; opened by scan
+        uint64_t scanned_end = 0;            // End of the last complete batch seen
+        int64_t next_offset;                 // One past the last offset seen
+        uint64_t last_indexed = 0;
+        int64_t max_timestamp = -1; // Of the batches seen
+    };
+
+    // Header fields of the batch at a file position.
+    struct BatchHeader
+    {
+        int64_t base_offset;
+        int64_t last_offset;
+        uint64_t size;
+        int64_t max_timestamp;
+    };
+
+    static constexpr uint64_t kIndexIntervalBytes = 4096;
+    static constexpr uint64_t kSegmentBytes = 1ull << 30;
+    static constexpr int16_t kOffsetOutOfRange = 1;
+    // How late a segment created or deleted by another writer may be noticed by readers.
+    static constexpr std::chrono::milliseconds kRefreshInterval{500};
+
+    void refresh_segments();
+    void refresh_segments_if_due();
+    void open_index(Segment &segment);
+    void scan(Segment &segment);
+    void update_max_timestamps();
+    uint64_t locate(Segment &segment, int64_t offset, BatchHeader &header);
+    std::optional<record_batch::TimestampOffset> find_timestamp(std::size_t segment, int64_t timestamp);
+    static bool read_header(int fd, uint64_t position, uint64_t file_size, BatchHeader &header);
+    Records read_range(Segment &segment, const ReadAhead::Segment &info, uint64_t position, std::size_t length);
+
+    std::string dir;
+    std::array<uint8_t, 16> topic_id;
+    int32_t partition;
+    std::shared_ptr<RecordBatchCache> cache;
+    std::shared_ptr<ReadAhead> read_ahead;
+
+    std::vector<Segment> segments; // Ascending base offset
+    std::chrono::steady_clock::time_point listed_at; // Of the last directory listing
+
+    // The max timestamp of each segment and all before it, so it only increases. Cleared
+    // when the segments change; only the last entry can grow until then.
+    std::vector<int64_t> max_timestamp_through;
+};
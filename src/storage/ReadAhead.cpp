@@ -0,0 +1,182 @@
+#include "storage/ReadAhead.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+ReadAhead::ReadAhead() : ReadAhead(Options{}) {}
+
+ReadAhead::ReadAhead(Options options) : options(options)
+{
+    worker = std::jthread([this](std::stop_token stop)
+                          { worker_loop(stop); });
+}
+
+ReadAhead::~ReadAhead()
+{
+    worker.request_stop();
+    queue_cv.notify_all();
+}
+
+void ReadAhead::on_read(const std::array<uint8_t, 16> &topic_id, int32_t partition, const Segment &segment,
+                        const std::optional<Segment> &next, uint64_t position, std::size_t length)
+{
+    std::vector<Hint> hints;
+    {
+        std::lock_guard<std::mutex> lock(streams_mutex);
+        auto &partition_streams = streams[{topic_id, partition}];
+        ++clock;
+
+        // Find the stream this read continues, either within its segment or into the next one.
+        Stream *stream = nullptr;
+        for (auto &candidate : partition_streams)
+        {
+            bool same_segment = candidate.segment == segment.base_offset &&
+                                position <= candidate.next_position + kSlack &&
+                                position + kSlack >= candidate.next_position;
+            bool next_segment = candidate.next_segment == segment.base_offset && position <= kSlack;
+            if (same_segment || next_segment)
+            {
+                stream = &candidate;
+                break;
+            }
+        }
+
+        if (!stream)
+        {
+            if (partition_streams.size() < kStreamsPerPartition)
+            {
+                partition_streams.emplace_back();
+                stream = &partition_streams.back();
+            }
+            else
+            {
+                stream = &*std::min_element(partition_streams.begin(), partition_streams.end(), [](const Stream &a, const Stream &b)
+                                            { return a.last_used < b.last_used; });
+            }
+            *stream = Stream{
+                .segment = segment.base_offset,
+                .next_segment = std::nullopt,
+                .next_position = position,
+                .prefetched_until = 0,
+                .next_prefetched = 0,
+                .window = options.initial_window,
+                .sequential = 0,
+                .segment_path = segment.path,
+                .segment_active = segment.active,
+                .last_used = 0,
+            };
+        }
+        else
+        {
+            ++stream->sequential;
+            if (stream->segment != segment.base_offset)
+            {
+                // Moved on from an old segment: nothing will read it sequentially again soon.
+                if (!stream->segment_active)
+                {
+                    hints.push_back(Hint{stream->segment_path, 0, 0, true});
+                }
+                stream->segment = segment.base_offset;
+                stream->segment_path = segment.path;
+                stream->segment_active = segment.active;
+                stream->prefetched_until = stream->next_prefetched;
+                stream->next_prefetched = 0;
+            }
+        }
+
+        uint64_t end = position + length;
+        stream->next_position = end;
+        stream->next_segment = next ? std::optional<int64_t>(next->base_offset) : std::nullopt;
+        stream->last_used = clock;
+
+        if (stream->sequential >= options.sequential_reads)
+        {
+            uint64_t target = end + stream->window;
+            uint64_t from = std::max(stream->prefetched_until, end);
+            if (from < std::min(target, segment.size))
+            {
+                hints.push_back(Hint{segment.path, from, std::min(target, segment.size) - from, false});
+            }
+            if (target > segment.size && next)
+            {
+                uint64_t next_target = std::min(target - segment.size, next->size);
+                if (stream->next_prefetched < next_target)
+                {
+                    hints.push_back(Hint{next->path, stream->next_prefetched, next_target - stream->next_prefetched, false});
+                    stream->next_prefetched = next_target;
+                }
+            }
+            stream->prefetched_until = std::max(stream->prefetched_until, std::min(target, segment.size));
+            stream->window = std::min(stream->window * 2, options.max_window);
+        }
+    }
+
+    for (auto &hint : hints)
+    {
+        enqueue(std::move(hint));
+    }
+}
+
+void ReadAhead::enqueue(Hint hint)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (queue.size() >= kMaxPendingHints)
+        {
+            skipped_hints.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        queue.push_back(std::move(hint));
+    }
+    queue_cv.notify_one();
+}
+
+void ReadAhead::worker_loop(std::stop_token stop)
+{
+    while (true)
+    {
+        Hint hint;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (!queue_cv.wait(lock, stop, [this]
+                               { return !queue.empty(); }))
+            {
+                return;
+            }
+            hint = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        int fd = ::open(hint.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            continue; // Deleted or rolled away; hints are best effort
+        }
+
+        if (hint.drop)
+        {
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            dropped_segments.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+#ifdef __linux__
+            // Blocks until the pages are queued for I/O, which is fine on this thread.
+            ::readahead(fd, static_cast<off64_t>(hint.offset), hint.length);
+#else
+            ::posix_fadvise(fd, static_cast<off_t>(hint.offset), static_cast<off_t>(hint.length), POSIX_FADV_WILLNEED);
+#endif
+            prefetched_bytes.fetch_add(hint.length, std::memory_order_relaxed);
+        }
+        ::close(fd);
+    }
+}
+
+ReadAhead::Stats ReadAhead::stats() const
+{
+    return Stats{
+        .prefetched_bytes = prefetched_bytes.load(std::memory_order_relaxed),
+        .dropped_segments = dropped_segments.load(std::memory_order_relaxed),
+        .skipped_hints = skipped_hints.load(std::memory_order_relaxed),
+    };
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Detects sequential partition reads and warms the page cache ahead of them.
+ *
+ * Every partition read is reported after it completes. Reads that continue where an
+ * earlier read of the same partition stopped form a stream; once a stream has been
+ * sequential for a few reads, the range ahead of it is handed to a background
+ * thread that issues readahead hints, with the window doubling up to a limit. When
+ * a stream moves past an old, immutable segment, that segment's pages are dropped
+ * so a catch-up consumer does not push the hot tail out of the page cache.
+ *
+ * A partition tracks a few streams at once, so several consumers at different
+ * positions are each detected independently.
+ */
+class ReadAhead
+{
+public:
+    struct Options
+    {
+        std::size_t initial_window = 256 << 10;
+        std::size_t max_window = 8 << 20;
+        unsigned sequential_reads = 2; // Consecutive reads before prefetching starts
+    };
+
+    // A segment file as seen by the reader.
+    struct Segment
+    {
+        std::string path;
+        int64_t base_offset;
+        uint64_t size;
+        bool active; // The segment still being appended to
+    };
+
+    struct Stats
+    {
+        uint64_t prefetched_bytes;
+        uint64_t dropped_segments;
+        uint64_t skipped_hints; // Hints dropped because the queue was full
+    };
+
+    ReadAhead();
+    explicit ReadAhead(Options options);
+    ~ReadAhead();
+
+    ReadAhead(const ReadAhead &) = delete;
+    ReadAhead &operator=(const ReadAhead &) = delete;
+
+    // Reports a read of [position, position + length) of `segment`. `next` is the
+    // segment that follows it, if any.
+    void on_read(const std::array<uint8_t, 16> &topic_id, int32_t partition, const Segment &segment,
+                 const std::optional<Segment> &next, uint64_t position, std::size_t length);
+
+    Stats stats() const;
+
+private:
+    struct Stream
+    {
+        int64_t segment;
+        std::optional<int64_t> next_segment;
+        uint64_t next_position;    // Where a sequential read would start
+        uint64_t prefetched_until; // End of the range already hinted in `segment`
+        uint64_t next_prefetched;  // Same for the start of `next_segment`
+        std::size_t window;
+        unsigned sequential;
+        std::string segment_path;
+        bool segment_active;
+        uint64_t last_used;
+    };
+
+    struct Hint
+    {
+        std::string path;
+        uint64_t offset;
+        uint64_t length;
+        bool drop; // Drop the range from the page cache instead of loading it
+    };
+
+    using PartitionKey = std::pair<std::array<uint8_t, 16>, int32_t>;
+
+    static constexpr std::size_t kStreamsPerPartition = 4;
+    static constexpr std::size_t kMaxPendingHints = 256;
+    static constexpr uint64_t kSlack = 64 << 10; // Gap still treated as sequential
+
+    void enqueue(Hint hint);
+    void worker_loop(std::stop_token stop);
+
+    Options options;
+
+    std::mutex streams_mutex;
+    std::map<PartitionKey, std::vector<Stream>> streams;
+    uint64_t clock = 0;
+
+    std::mutex queue_mutex;
+    std::condition_variable_any queue_cv;
+    std::deque<Hint> queue;
+
+    std::atomic<uint64_t> prefetched_bytes{0};
+    std::atomic<uint64_t> dropped_segments{0};
+    std::atomic<uint64_t> skipped_hints{0};
+
+    std::jthread worker;
+};
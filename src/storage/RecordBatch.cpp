@@ -0,0 +1,241 @@
+#include "storage/RecordBatch.hpp"
+#include "storage/Crc32c.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <endian.h>
+
+namespace record_batch
+{
+    namespace
+    {
+        constexpr uint8_t kLogAppendTimeFlag = 0x08;
+        constexpr uint8_t kControlFlag = 0x20;
+        constexpr std::size_t kRecordCountOffset = kHeaderSize - sizeof(int32_t);
+
+        // Reads a zig-zag varint, as used inside records; throws past `end`.
+        int64_t read_varint(const uint8_t *&p, const uint8_t *end)
+        {
+            uint64_t value = 0;
+            for (int shift = 0; shift < 64 && p < end; shift += 7)
+            {
+                uint8_t byte = *p++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                {
+                    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+                }
+            }
+            throw std::runtime_error("Malformed varint in record batch");
+        }
+
+        int64_t read_int64(const uint8_t *p)
+        {
+            uint64_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return static_cast<int64_t>(be64toh(value));
+        }
+    }
+
+    uint32_t compute_crc(const uint8_t *batch, std::size_t size)
+    {
+        if (size < kHeaderSize)
+        {
+            return 0;
+        }
+        return crc32c::compute(batch + kAttributesOffset, size - kAttributesOffset);
+    }
+
+    bool crc_matches(const uint8_t *batch, std::size_t size)
+    {
+        if (size < kHeaderSize)
+        {
+            return false;
+        }
+        uint32_t stored;
+        std::memcpy(&stored, batch + kCrcOffset, sizeof(stored));
+        return ntohl(stored) == compute_crc(batch, size);
+    }
+
+    Header read_header(const uint8_t *batch)
+    {
+        uint64_t base_offset;
+        int32_t batch_len;
+        int32_t last_offset_delta;
+        std::memcpy(&base_offset, batch, sizeof(base_offset));
+        std::memcpy(&batch_len, batch + 8, sizeof(batch_len));
+        std::memcpy(&last_offset_delta, batch + kLastOffsetDeltaOffset, sizeof(last_offset_delta));
+
+        Header header;
+        header.base_offset = static_cast<int64_t>(be64toh(base_offset));
+        header.last_offset = header.base_offset + static_cast<int32_t>(ntohl(last_offset_delta));
+        header.size = kLogOverhead + static_cast<uint32_t>(ntohl(batch_len));
+        header.max_timestamp = read_int64(batch + kMaxTimestampOffset);
+        return header;
+    }
+
+    std::size_t valid_prefix(const uint8_t *data, std::size_t size)
+    {
+        std::size_t position = 0;
+        while (position + kLogOverhead <= size)
+        {
+            int32_t batch_len;
+            std::memcpy(&batch_len, data + position + 8, sizeof(batch_len));
+            batch_len = ntohl(batch_len);
+
+            std::size_t batch_size = kLogOverhead + static_cast<std::size_t>(batch_len);
+            if (batch_len < 0 || batch_size < kHeaderSize || position + batch_size > size ||
+                data[position + kMagicOffset] != 2 || !crc_matches(data + position, batch_size))
+            {
+                break;
+            }
+            position += batch_size;
+        }
+        return position;
+    }
+
+    CompressionType compression_of(const uint8_t *batch)
+    {
+        return static_cast<CompressionType>(batch[kAttributesOffset + 1] & 0x07);
+    }
+
+    std::vector<uint8_t> decompressed_records(const uint8_t *batch, std::size_t size)
+    {
+        if (size < kHeaderSize)
+        {
+            throw std::runtime_error("Record batch shorter than its header");
+        }
+        return codec::decompress(compression_of(batch), batch + kHeaderSize, size - kHeaderSize);
+    }
+
+    std::optional<TimestampOffset> find_timestamp(const uint8_t *batch, std::size_t size, int64_t timestamp)
+    {
+        Header header = read_header(batch);
+        if (header.max_timestamp < timestamp)
+        {
+            return std::nullopt;
+        }
+        if (batch[kAttributesOffset + 1] & kLogAppendTimeFlag)
+        {
+            return TimestampOffset{header.max_timestamp, header.base_offset};
+        }
+
+        std::vector<uint8_t> decompressed;
+        const uint8_t *p = batch + kHeaderSize;
+        const uint8_t *end = batch + size;
+        if (compression_of(batch) != CompressionType::None)
+        {
+            decompressed = decompressed_records(batch, size);
+            p = decompressed.data();
+            end = p + decompressed.size();
+        }
+
+        int64_t base_timestamp = read_int64(batch + kBaseTimestampOffset);
+        int32_t count;
+        std::memcpy(&count, batch + kRecordCountOffset, sizeof(count));
+        count = static_cast<int32_t>(ntohl(static_cast<uint32_t>(count)));
+        for (int32_t i = 0; i < count; ++i)
+        {
+            int64_t length = read_varint(p, end);
+            const uint8_t *next = p + length;
+            if (length < 0 || next > end)
+            {
+                throw std::runtime_error("Record overruns its batch");
+            }
+            ++p; // attributes
+            int64_t record_timestamp = base_timestamp + read_varint(p, end);
+            int64_t offset_delta = read_varint(p, end);
+            if (record_timestamp >= timestamp)
+            {
+                return TimestampOffset{record_timestamp, header.base_offset + offset_delta};
+            }
+            p = next;
+        }
+        return std::nullopt;
+    }
+
+    bool is_control(const uint8_t *batch)
+    {
+        return batch[kAttributesOffset + 1] & kControlFlag;
+    }
+
+    std::vector<Record> read_records(const uint8_t *batch, std::size_t size, std::vector<uint8_t> &storage)
+    {
+        Header header = read_header(batch);
+        const uint8_t *p = batch + kHeaderSize;
+        const uint8_t *end = batch + size;
+        if (compression_of(batch) != CompressionType::None)
+        {
+            storage = decompressed_records(batch, size);
+            p = storage.data();
+            end = p + storage.size();
+        }
+
+        bool log_append_time = batch[kAttributesOffset + 1] & kLogAppendTimeFlag;
+        int64_t base_timestamp = read_int64(batch + kBaseTimestampOffset);
+        int32_t count;
+        std::memcpy(&count, batch + kRecordCountOffset, sizeof(count));
+        count = static_cast<int32_t>(ntohl(static_cast<uint32_t>(count)));
+
+        std::vector<Record> records;
+        records.reserve(static_cast<std::size_t>(std::max(count, 0)));
+        for (int32_t i = 0; i < count; ++i)
+        {
+            Record record{};
+            record.data = p;
+            int64_t length = read_varint(p, end);
+            const uint8_t *next = p + length;
+            if (length < 0 || next > end)
+            {
+                throw std::runtime_error("Record overruns its batch");
+            }
+            ++p; // attributes
+            int64_t timestamp_delta = read_varint(p, end);
+            record.timestamp = log_append_time ? header.max_timestamp : base_timestamp + timestamp_delta;
+            record.offset = header.base_offset + read_varint(p, end);
+            int64_t key_size = read_varint(p, end);
+            if (key_size > next - p)
+            {
+                throw std::runtime_error("Record key overruns its record");
+            }
+            if (key_size >= 0)
+            {
+                record.key = p;
+                record.key_size = static_cast<std::size_t>(key_size);
+                p += key_size;
+            }
+            record.tombstone = read_varint(p, end) < 0;
+            record.size = static_cast<std::size_t>(next - record.data);
+            records.push_back(record);
+            p = next;
+        }
+        return records;
+    }
+
+    std::vector<uint8_t> with_records(const uint8_t *batch, const std::vector<Record> &kept)
+    {
+        std::vector<uint8_t> records;
+        for (const auto &record : kept)
+        {
+            records.insert(records.end(), record.data, record.data + record.size);
+        }
+        CompressionType compression = compression_of(batch);
+        if (compression != CompressionType::None)
+        {
+            records = codec::compress(compression, records.data(), records.size());
+        }
+
+        std::vector<uint8_t> out(kHeaderSize + records.size());
+        std::memcpy(out.data(), batch, kHeaderSize);
+        std::copy(records.begin(), records.end(), out.begin() + kHeaderSize);
+        uint32_t batch_len = htonl(static_cast<uint32_t>(out.size() - kLogOverhead));
+        uint32_t count = htonl(static_cast<uint32_t>(kept.size()));
+        std::memcpy(out.data() + 8, &batch_len, sizeof(batch_len));
+        std::memcpy(out.data() + kRecordCountOffset, &count, sizeof(count));
+        uint32_t crc = htonl(compute_crc(out.data(), out.size()));
+        std::memcpy(out.data() + kCrcOffset, &crc, sizeof(crc));
+        return out;
+    }
+
+} // namespace record_batch
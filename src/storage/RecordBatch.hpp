@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "storage/Codec.hpp"
+
+// Layout constants and integrity checks for Kafka v2 (magic 2) record batches.
+namespace record_batch
+{
+    constexpr std::size_t kLogOverhead = 12;       // base_offset + batch_length
+    constexpr std::size_t kMagicOffset = 16;
+    constexpr std::size_t kCrcOffset = 17;
+    constexpr std::size_t kAttributesOffset = 21; // The CRC covers everything from here on
+    constexpr std::size_t kLastOffsetDeltaOffset = 23;
+    constexpr std::size_t kBaseTimestampOffset = 27;
+    constexpr std::size_t kMaxTimestampOffset = 35;
+    constexpr std::size_t kHeaderSize = 61;       // Up to the first record
+
+    struct Header
+    {
+        int64_t base_offset;
+        int64_t last_offset;
+        std::size_t size; // Of the whole batch, including the log overhead
+        int64_t max_timestamp;
+    };
+
+    struct TimestampOffset
+    {
+        int64_t timestamp;
+        int64_t offset;
+    };
+
+    // One record of a batch, pointing into the batch or its decompressed records.
+    struct Record
+    {
+        int64_t offset;
+        int64_t timestamp;
+        const uint8_t *key; // nullptr for a null key
+        std::size_t key_size;
+        bool tombstone;      // Null value
+        const uint8_t *data; // The whole record, from its length prefix on
+        std::size_t size;
+    };
+
+    // Offsets, size and max timestamp of the batch at `batch`, which must hold at least kHeaderSize bytes.
+    Header read_header(const uint8_t *batch);
+
+    // CRC32C of a complete batch (starting at base_offset), as stored in its crc field.
+    uint32_t compute_crc(const uint8_t *batch, std::size_t size);
+
+    bool crc_matches(const uint8_t *batch, std::size_t size);
+
+    // Checks a buffer of consecutive batches, such as a produced record set or a log
+    // segment being recovered. Returns the number of bytes covered by intact batches;
+    // a short return means the batch at that position is truncated or corrupt.
+    std::size_t valid_prefix(const uint8_t *data, std::size_t size);
+
+    CompressionType compression_of(const uint8_t *batch);
+
+    // The records section of a batch, decompressed if the batch is compressed.
+    std::vector<uint8_t> decompressed_records(const uint8_t *batch, std::size_t size);
+
+    // The first record of a complete batch with a timestamp at or after `timestamp`.
+    // Records of a batch with log append time all carry its max timestamp.
+    std::optional<TimestampOffset> find_timestamp(const uint8_t *batch, std::size_t size, int64_t timestamp);
+
+    // Control batches carry transaction markers rather than records.
+    bool is_control(const uint8_t *batch);
+
+    // The records of a complete batch. They point into `storage` if the batch is compressed.
+    std::vector<Record> read_records(const uint8_t *batch, std::size_t size, std::vector<uint8_t> &storage);
+
+    // `batch` with only `kept`, a subset of its records in order. Offsets, timestamps and
+    // producer fields are unchanged, so the batch still spans the same offsets; the
+    // records are compressed again with the batch's codec.
+    std::vector<uint8_t> with_records(const uint8_t *batch, const std::vector<Record> &kept);
+
+} // namespace record_batch
@@ -0,0 +1,137 @@
+#include "storage/RecordBatchBuilder.hpp"
+#include "protocol/Varint.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <arpa/inet.h>
+#include <endian.h>
+
+using kafka::protocol::append_unsigned_varint;
+using kafka::protocol::append_zigzag_varint;
+
+namespace
+{
+    template <typename T>
+    void append_be(std::vector<uint8_t> &out, T val)
+    {
+        uint8_t bytes[sizeof(T)];
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            bytes[i] = static_cast<uint8_t>(static_cast<uint64_t>(val) >> (8 * (sizeof(T) - 1 - i)));
+        }
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void append_int32_array(std::vector<uint8_t> &out, const std::vector<int32_t> &values)
+    {
+        append_unsigned_varint(out, values.size() + 1);
+        for (int32_t v : values)
+        {
+            append_be<int32_t>(out, v);
+        }
+    }
+}
+
+RecordBatchBuilder::RecordBatchBuilder(int64_t base_offset, int64_t base_timestamp, CompressionType compression)
+    : base_offset(base_offset), base_timestamp(base_timestamp), compression(compression), max_timestamp(base_timestamp) {}
+
+void RecordBatchBuilder::append(const std::optional<std::vector<uint8_t>> &key, const std::vector<uint8_t> &value, int64_t timestamp)
+{
+    if (timestamp < 0)
+    {
+        timestamp = base_timestamp;
+    }
+    max_timestamp = std::max(max_timestamp, timestamp);
+
+    std::vector<uint8_t> body;
+    body.push_back(0); // attributes
+    append_zigzag_varint(body, timestamp - base_timestamp);
+    append_zigzag_varint(body, count);
+    if (key)
+    {
+        append_zigzag_varint(body, static_cast<int64_t>(key->size()));
+        body.insert(body.end(), key->begin(), key->end());
+    }
+    else
+    {
+        append_zigzag_varint(body, -1);
+    }
+    append_zigzag_varint(body, static_cast<int64_t>(value.size()));
+    body.insert(body.end(), value.begin(), value.end());
+    append_unsigned_varint(body, 0); // headers
+
+    append_zigzag_varint(records, static_cast<int64_t>(body.size()));
+    records.insert(records.end(), body.begin(), body.end());
+    ++count;
+}
+
+std::vector<uint8_t> RecordBatchBuilder::build() const
+{
+    std::vector<uint8_t> compressed;
+    const std::vector<uint8_t> *payload = &records;
+    if (compression != CompressionType::None)
+    {
+        compressed = codec::compress(compression, records.data(), records.size());
+        payload = &compressed;
+    }
+
+    std::vector<uint8_t> batch;
+    batch.reserve(record_batch::kHeaderSize + payload->size());
+
+    append_be<int64_t>(batch, base_offset);
+    append_be<int32_t>(batch, static_cast<int32_t>(record_batch::kHeaderSize - record_batch::kLogOverhead + payload->size())); // batch_len
+    append_be<int32_t>(batch, 0);                                                                   // partition_leader_epoch
+    batch.push_back(2);                                                                             // magic
+    append_be<uint32_t>(batch, 0);                                                                  // crc
+    append_be<int16_t>(batch, static_cast<int16_t>(compression));                                  // attributes
+    append_be<int32_t>(batch, count > 0 ? count - 1 : 0);                                           // last_offset_delta
+    append_be<int64_t>(batch, base_timestamp);
+    append_be<int64_t>(batch, max_timestamp);
+    append_be<int64_t>(batch, -1); // producer_id
+    append_be<int16_t>(batch, -1); // producer_epoch
+    append_be<int32_t>(batch, -1); // base_sequence
+    append_be<int32_t>(batch, count);
+    batch.insert(batch.end(), payload->begin(), payload->end());
+
+    uint32_t crc = htonl(record_batch::compute_crc(batch.data(), batch.size()));
+    std::memcpy(batch.data() + record_batch::kCrcOffset, &crc, sizeof(crc));
+    return batch;
+}
+
+namespace metadata_records
+{
+    std::vector<uint8_t> topic_record(const std::string &name, const std::vector<uint8_t> &topic_id)
+    {
+        std::vector<uint8_t> value;
+        value.push_back(1); // frame_version
+        value.push_back(2); // type: TopicRecord
+        value.push_back(0); // version
+        append_unsigned_varint(value, name.size() + 1);
+        value.insert(value.end(), name.begin(), name.end());
+        value.insert(value.end(), topic_id.begin(), topic_id.end());
+        append_unsigned_varint(value, 0); // tagged fields
+        return value;
+    }
+
+    std::vector<uint8_t> partition_record(int32_t partition_id, const std::vector<uint8_t> &topic_id,
+                                          const std::vector<int32_t> &replicas, const std::vector<int32_t> &isr,
+                                          int32_t leader, int32_t leader_epoch)
+    {
+        std::vector<uint8_t> value;
+        value.push_back(1); // frame_version
+        value.push_back(3); // type: PartitionRecord
+        value.push_back(1); // version
+        append_be<int32_t>(value, partition_id);
+        value.insert(value.end(), topic_id.begin(), topic_id.end());
+        append_int32_array(value, replicas);
+        append_int32_array(value, isr);
+        append_int32_array(value, {}); // removing_replicas
+        append_int32_array(value, {}); // adding_replicas
+        append_be<int32_t>(value, leader);
+        append_be<int32_t>(value, leader_epoch);
+        append_be<int32_t>(value, 0);     // partition_epoch
+        append_unsigned_varint(value, 1); // directories (empty)
+        append_unsigned_varint(value, 0); // tagged fields
+        return value;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "storage/RecordBatch.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Encodes records into a Kafka v2 (magic 2) record batch.
+ *
+ * Used wherever the broker or its tooling has to produce log data itself rather
+ * than copy batches received from a client. With a codec set, the records section
+ * is compressed as a whole and the codec is recorded in the batch attributes.
+ */
+class RecordBatchBuilder
+{
+public:
+    explicit RecordBatchBuilder(int64_t base_offset, int64_t base_timestamp = 0, CompressionType compression = CompressionType::None);
+
+    void append(const std::optional<std::vector<uint8_t>> &key, const std::vector<uint8_t> &value, int64_t timestamp = -1);
+
+    std::size_t record_count() const { return count; }
+    std::size_t size_estimate() const { return records.size() + record_batch::kHeaderSize; }
+
+    // Returns the complete batch, including the base offset and length prefix and a valid CRC.
+    std::vector<uint8_t> build() const;
+
+private:
+    int64_t base_offset;
+    int64_t base_timestamp;
+    CompressionType compression;
+    int64_t max_timestamp;
+    int32_t count = 0;
+    std::vector<uint8_t> records;
+};
+
+// Encoders for the KRaft metadata records the broker understands.
+namespace metadata_records
+{
+    std::vector<uint8_t> topic_record(const std::string &name, const std::vector<uint8_t> &topic_id);
+
+    std::vector<uint8_t> partition_record(int32_t partition_id, const std::vector<uint8_t> &topic_id,
+                                          const std::vector<int32_t> &replicas, const std::vector<int32_t> &isr,
+                                          int32_t leader, int32_t leader_epoch);
+}
@@ -0,0 +1,270 @@
+#include "storage/RecordBatchCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+    // Share of a shard's capacity given to the probation FIFO, and ghost keys kept per shard.
+    constexpr std::size_t kProbationPercent = 25;
+    constexpr std::size_t kMaxGhosts = 4096;
+}
+
+std::size_t RecordBatchCache::KeyHash::operator()(const Key &key) const
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const void *p, std::size_t len)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(p);
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+    };
+    mix(key.topic_id.data(), key.topic_id.size());
+    mix(&key.partition, sizeof(key.partition));
+    mix(&key.segment, sizeof(key.segment));
+    mix(&key.position, sizeof(key.position));
+    return static_cast<std::size_t>(hash);
+}
+
+RecordBatchCache::RecordBatchCache(std::size_t capacity_bytes)
+    : shard_capacity(std::max<std::size_t>(capacity_bytes / kShards, kChunkSize)) {}
+
+std::vector<RecordBatchCache::Slice> RecordBatchCache::read(const Key &segment, const std::string &path, uint64_t file_size, uint64_t offset, std::size_t length, bool active)
+{
+    std::vector<Slice> out;
+    if (offset >= file_size)
+    {
+        return out;
+    }
+    uint64_t end = length < file_size - offset ? offset + length : file_size;
+
+    for (uint64_t chunk = offset - offset % kChunkSize; chunk < end; chunk += kChunkSize)
+    {
+        Key key = segment;
+        key.position = chunk;
+        Buffer data = get_chunk(key, path, file_size, active && chunk + kChunkSize >= file_size);
+
+        uint64_t from = std::max(offset, chunk) - chunk;
+        uint64_t to = std::min<uint64_t>(end - chunk, data->size());
+        if (from < to)
+        {
+            out.push_back(Slice{std::move(data), from, to - from});
+        }
+    }
+    return out;
+}
+
+RecordBatchCache::Buffer RecordBatchCache::get_chunk(const Key &key, const std::string &path, uint64_t file_size, bool hot)
+{
+    Shard &shard = shards[KeyHash{}(key) % kShards];
+    std::size_t expected_size = std::min<uint64_t>(kChunkSize, file_size - key.position);
+
+    std::promise<Buffer> promise;
+    Buffer cached_tail; // A chunk cached while it was the (short) tail of the file, now grown
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(key);
+        if (it != shard.index.end() && it->second->data->size() < expected_size)
+        {
+            cached_tail = it->second->data;
+        }
+        else if (it != shard.index.end())
+        {
+            auto entry = it->second;
+            if (entry->in_main)
+            {
+                shard.main.splice(shard.main.begin(), shard.main, entry);
+            }
+            else if (hot)
+            {
+                // Sat in probation since before it became the active tail, e.g. loaded by a replay.
+                shard.main.splice(shard.main.begin(), shard.probation, entry);
+                entry->in_main = true;
+                shard.probation_bytes -= entry->data->size();
+                shard.main_bytes += entry->data->size();
+            }
+            // Other probation hits stay put: correlated re-reads don't earn a place in the main LRU.
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return entry->data;
+        }
+
+        auto pending = shard.loading.find(key);
+        if (pending != shard.loading.end())
+        {
+            auto future = pending->second;
+            lock.unlock();
+            coalesced.fetch_add(1, std::memory_order_relaxed);
+            return future.get();
+        }
+
+        shard.loading.emplace(key, promise.get_future().share());
+    }
+
+    misses.fetch_add(1, std::memory_order_relaxed);
+    Buffer data;
+    try
+    {
+        data = load_chunk(path, key.position, file_size, cached_tail);
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.loading.erase(key);
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        insert(shard, key, data, hot);
+        shard.loading.erase(key);
+    }
+    promise.set_value(data);
+    return data;
+}
+
+void RecordBatchCache::insert(Shard &shard, const Key &key, Buffer data, bool hot)
+{
+    bool promote = hot;
+    auto existing = shard.index.find(key);
+    if (existing != shard.index.end())
+    {
+        // Replacing a stale tail chunk keeps its place in the queues.
+        auto entry = existing->second;
+        promote = promote || entry->in_main;
+        (entry->in_main ? shard.main_bytes : shard.probation_bytes) -= entry->data->size();
+        resident_bytes.fetch_sub(entry->data->size(), std::memory_order_relaxed);
+        (entry->in_main ? shard.main : shard.probation).erase(entry);
+        shard.index.erase(existing);
+    }
+
+    auto ghost = shard.ghost_index.find(key);
+    if (ghost != shard.ghost_index.end())
+    {
+        // Read again after leaving probation: this chunk is genuinely hot.
+        promote = true;
+        shard.ghosts.erase(ghost->second);
+        shard.ghost_index.erase(ghost);
+    }
+
+    std::size_t size = data->size();
+    auto &queue = promote ? shard.main : shard.probation;
+    queue.push_front(Entry{key, std::move(data), promote});
+    shard.index[key] = queue.begin();
+    (promote ? shard.main_bytes : shard.probation_bytes) += size;
+    resident_bytes.fetch_add(size, std::memory_order_relaxed);
+
+    evict(shard);
+}
+
+void RecordBatchCache::evict(Shard &shard)
+{
+    std::size_t probation_capacity = shard_capacity * kProbationPercent / 100;
+
+    while (shard.probation_bytes + shard.main_bytes > shard_capacity)
+    {
+        bool from_probation = shard.probation_bytes > probation_capacity || shard.main.empty();
+        auto &queue = from_probation ? shard.probation : shard.main;
+        if (queue.empty())
+        {
+            break;
+        }
+
+        Entry &victim = queue.back();
+        std::size_t size = victim.data->size();
+        (from_probation ? shard.probation_bytes : shard.main_bytes) -= size;
+        resident_bytes.fetch_sub(size, std::memory_order_relaxed);
+        evictions.fetch_add(1, std::memory_order_relaxed);
+
+        if (from_probation)
+        {
+            shard.ghosts.push_front(victim.key);
+            shard.ghost_index[victim.key] = shard.ghosts.begin();
+            if (shard.ghosts.size() > kMaxGhosts)
+            {
+                shard.ghost_index.erase(shard.ghosts.back());
+                shard.ghosts.pop_back();
+            }
+        }
+
+        shard.index.erase(victim.key);
+        queue.pop_back();
+    }
+}
+
+void RecordBatchCache::invalidate(const std::array<uint8_t, 16> &topic_id, int32_t partition, int64_t segment)
+{
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.index.begin(); it != shard.index.end();)
+        {
+            const Key &key = it->first;
+            if (key.topic_id == topic_id && key.partition == partition && key.segment == segment)
+            {
+                auto entry = it->second;
+                (entry->in_main ? shard.main_bytes : shard.probation_bytes) -= entry->data->size();
+                resident_bytes.fetch_sub(entry->data->size(), std::memory_order_relaxed);
+                (entry->in_main ? shard.main : shard.probation).erase(entry);
+                it = shard.index.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+}
+
+RecordBatchCache::Stats RecordBatchCache::stats() const
+{
+    return Stats{
+        .hits = hits.load(std::memory_order_relaxed),
+        .misses = misses.load(std::memory_order_relaxed),
+        .coalesced = coalesced.load(std::memory_order_relaxed),
+        .evictions = evictions.load(std::memory_order_relaxed),
+        .resident_bytes = resident_bytes.load(std::memory_order_relaxed),
+        .capacity_bytes = shard_capacity * kShards,
+    };
+}
+
+RecordBatchCache::Buffer RecordBatchCache::load_chunk(const std::string &path, uint64_t position, uint64_t file_size, const Buffer &cached_tail)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open log file: " + path);
+    }
+
+    auto data = std::make_shared<std::vector<uint8_t>>(std::min<uint64_t>(kChunkSize, file_size - position));
+    std::size_t done = 0;
+    if (cached_tail)
+    {
+        // Appends never rewrite what was already read, so only the bytes past it are read.
+        done = std::min(cached_tail->size(), data->size());
+        std::memcpy(data->data(), cached_tail->data(), done);
+    }
+    while (done < data->size())
+    {
+        ssize_t n = ::pread(fd, data->data() + done, data->size() - done, static_cast<off_t>(position + done));
+        if (n < 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to read log file: " + path);
+        }
+        if (n == 0)
+        {
+            break; // Truncated underneath us
+        }
+        done += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+    data->resize(done);
+    return data;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A broker-wide, memory-bounded cache of segment file ranges.
+ *
+ * Segment files are read in fixed-size, aligned chunks keyed by (topic id,
+ * partition, segment, file position). Every consumer of a chunk shares the same
+ * immutable buffer, and concurrent misses on one chunk are coalesced into a
+ * single disk read.
+ *
+ * Eviction is 2Q: a chunk read once sits in a small FIFO, and only chunks read
+ * again after leaving it (remembered by key in a ghost list) enter the main LRU.
+ * A consumer replaying old data therefore cycles through the FIFO without
+ * flushing the tail chunks that live consumers keep re-reading. The chunk at the
+ * end of a partition's active segment is where every live consumer reads, so it
+ * goes straight to the main LRU instead of waiting to prove itself in the FIFO.
+ */
+class RecordBatchCache
+{
+public:
+    using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // A byte range of a shared buffer; holding it keeps the buffer alive.
+    struct Slice
+    {
+        Buffer data;
+        std::size_t offset;
+        std::size_t length;
+    };
+
+    struct Key
+    {
+        std::array<uint8_t, 16> topic_id;
+        int32_t partition;
+        int64_t segment;  // Base offset of the segment file
+        uint64_t position; // Chunk-aligned file position
+
+        bool operator==(const Key &) const = default;
+    };
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t coalesced; // Misses that waited on another reader's load
+        uint64_t evictions;
+        uint64_t resident_bytes;
+        uint64_t capacity_bytes;
+    };
+
+    static constexpr std::size_t kChunkSize = 1 << 20;
+
+    explicit RecordBatchCache(std::size_t capacity_bytes);
+
+    // Reads [offset, offset + length) of the first `file_size` bytes of a segment file
+    // through the cache, as ranges of the cached chunks rather than a copy. `active`
+    // marks the segment still being appended to.
+    std::vector<Slice> read(const Key &segment, const std::string &path, uint64_t file_size, uint64_t offset, std::size_t length, bool active);
+
+    // Drops every cached chunk of a segment, e.g. after it was rewritten.
+    void invalidate(const std::array<uint8_t, 16> &topic_id, int32_t partition, int64_t segment);
+
+    Stats stats() const;
+
+private:
+    struct KeyHash
+    {
+        std::size_t operator()(const Key &key) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        Buffer data;
+        bool in_main; // In the main LRU rather than the probation FIFO
+    };
+
+    // Each shard is an independent 2Q cache with its own lock.
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> probation; // FIFO, newest at front
+        std::list<Entry> main;      // LRU, most recent at front
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        std::list<Key> ghosts; // Keys recently evicted from probation, newest at front
+        std::unordered_map<Key, std::list<Key>::iterator, KeyHash> ghost_index;
+        std::unordered_map<Key, std::shared_future<Buffer>, KeyHash> loading;
+        std::size_t probation_bytes = 0;
+        std::size_t main_bytes = 0;
+    };
+
+    static constexpr std::size_t kShards = 16;
+
+    // A `hot` chunk is the tail of an active segment and is kept in the main LRU.
+    Buffer get_chunk(const Key &key, const std::string &path, uint64_t file_size, bool hot);
+    void insert(Shard &shard, const Key &key, Buffer data, bool hot);
+    void evict(Shard &shard);
+    // Reads a chunk from disk; a shorter `cached_tail` of it is reused and only extended.
+    static Buffer load_chunk(const std::string &path, uint64_t position, uint64_t file_size, const Buffer &cached_tail);
+
+    std::size_t shard_capacity;
+    std::array<Shard, kShards> shards;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> resident_bytes{0};
+};
@@ -0,0 +1,199 @@
+#include "storage/SegmentIndex.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr char kMagic[8] = {'M', 'K', 'I', 'N', 'D', 'E', 'X', '1'};
+    constexpr uint32_t kFormatVersion = 1;
+    constexpr uint32_t kEndianTag = 0x01020304;
+    constexpr std::size_t kEntrySize = sizeof(SegmentIndex::Entry);
+    constexpr std::size_t kInitialEntries = 1024;
+}
+
+struct SegmentIndex::Header
+{
+    char magic[8];
+    uint32_t format_version;
+    uint32_t endian_tag;
+    int64_t base_offset;
+    uint64_t entries;
+    uint64_t end; // Coverage, as in SegmentIndex::Coverage
+    uint64_t last_batch_position;
+    int64_t next_offset;
+    int64_t max_timestamp;
+};
+
+static_assert(sizeof(SegmentIndex::Entry) == 24);
+
+SegmentIndex::SegmentIndex(std::string path, int64_t base_offset)
+    : path(std::move(path)), base_offset(base_offset)
+{
+    int fd = ::open(this->path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open segment index: " + this->path);
+    }
+    struct stat st{};
+    Header existing{};
+    bool valid = ::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(Header) &&
+                 ::pread(fd, &existing, sizeof(existing), 0) == static_cast<ssize_t>(sizeof(existing));
+    ::close(fd);
+    valid = valid && std::memcmp(existing.magic, kMagic, sizeof(kMagic)) == 0 && existing.format_version == kFormatVersion &&
+            existing.endian_tag == kEndianTag && existing.base_offset == base_offset &&
+            sizeof(Header) + existing.entries * kEntrySize <= static_cast<uint64_t>(st.st_size);
+
+    map_capacity(std::max<std::size_t>(valid ? existing.entries : 0, kInitialEntries));
+    if (!valid)
+    {
+        reset();
+        return;
+    }
+    this->covered = Coverage{existing.end, existing.last_batch_position, existing.next_offset, existing.max_timestamp};
+}
+
+SegmentIndex::~SegmentIndex()
+{
+    std::size_t entries = size();
+    ::munmap(this->map, sizeof(Header) + this->capacity * kEntrySize);
+    // Drop the preallocated tail. Failing to only leaves unused space behind the entries.
+    [[maybe_unused]] int trimmed = ::truncate(this->path.c_str(), static_cast<off_t>(sizeof(Header) + entries * kEntrySize));
+}
+
+void SegmentIndex::reset()
+{
+    Header &h = header();
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.format_version = kFormatVersion;
+    h.endian_tag = kEndianTag;
+    h.base_offset = this->base_offset;
+    h.entries = 0;
+    cover(Coverage{});
+}
+
+void SegmentIndex::add(const Entry &entry)
+{
+    std::size_t entries = size();
+    if (entries == this->capacity)
+    {
+        map_capacity(this->capacity * 2);
+    }
+    std::memcpy(this->map + sizeof(Header) + entries * kEntrySize, &entry, kEntrySize);
+    header().entries = entries + 1;
+}
+
+void SegmentIndex::cover(const Coverage &coverage)
+{
+    this->covered = coverage;
+    Header &h = header();
+    h.end = coverage.end;
+    h.last_batch_position = coverage.last_batch_position;
+    h.next_offset = coverage.next_offset;
+    h.max_timestamp = coverage.max_timestamp;
+}
+
+std::size_t SegmentIndex::size() const
+{
+    return static_cast<std::size_t>(header().entries);
+}
+
+std::optional<SegmentIndex::Entry> SegmentIndex::last() const
+{
+    std::size_t entries = size();
+    if (entries == 0)
+    {
+        return std::nullopt;
+    }
+    return entry(entries - 1);
+}
+
+std::optional<SegmentIndex::Entry> SegmentIndex::floor(int64_t offset) const
+{
+    // Binary search for the first entry past `offset`; the one before it is the answer.
+    std::size_t low = 0;
+    std::size_t high = size();
+    while (low < high)
+    {
+        std::size_t mid = low + (high - low) / 2;
+        if (entry(mid).offset <= offset)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (low == 0)
+    {
+        return std::nullopt;
+    }
+    return entry(low - 1);
+}
+
+std::optional<SegmentIndex::Entry> SegmentIndex::last_before(int64_t timestamp) const
+{
+    // Binary search for the first entry at or after `timestamp`; the one before it is the answer.
+    std::size_t low = 0;
+    std::size_t high = size();
+    while (low < high)
+    {
+        std::size_t mid = low + (high - low) / 2;
+        if (entry(mid).max_timestamp < timestamp)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    if (low == 0)
+    {
+        return std::nullopt;
+    }
+    return entry(low - 1);
+}
+
+SegmentIndex::Entry SegmentIndex::entry(std::size_t index) const
+{
+    Entry entry;
+    std::memcpy(&entry, this->map + sizeof(Header) + index * kEntrySize, kEntrySize);
+    return entry;
+}
+
+SegmentIndex::Header &SegmentIndex::header() const
+{
+    return *reinterpret_cast<Header *>(this->map);
+}
+
+void SegmentIndex::map_capacity(std::size_t capacity)
+{
+    std::size_t bytes = sizeof(Header) + capacity * kEntrySize;
+    int fd = ::open(this->path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(bytes)) != 0)
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+        throw std::runtime_error("Cannot grow segment index: " + this->path);
+    }
+    void *map = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+    {
+        throw std::runtime_error("Cannot map segment index: " + this->path);
+    }
+    if (this->map)
+    {
+        ::munmap(this->map, sizeof(Header) + this->capacity * kEntrySize);
+    }
+    this->map = static_cast<uint8_t *>(map);
+    this->capacity = capacity;
+}
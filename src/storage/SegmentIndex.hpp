@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/**
+ * @brief A segment's sparse offset and time index, in a memory-mapped `<base offset>.mkindex` file.
+ *
+ * Each entry holds a batch's base offset, its file position and the max timestamp of
+ * every batch up to and including it, so both columns only ever increase and either
+ * one can be binary searched. A header records how much of the log the entries cover
+ * and what that part ends with, so a restart picks the index up where it stopped
+ * instead of scanning the segment again.
+ *
+ * The file is this broker's own and sits next to the segment; Kafka's `.index` and
+ * `.timeindex` files are never touched. Entries are in host byte order.
+ */
+class SegmentIndex
+{
+public:
+    struct Entry
+    {
+        int64_t offset;
+        uint64_t position;
+        int64_t max_timestamp; // Of this batch and all before it
+    };
+
+    // What the entries cover: the log up to the end of the last whole batch scanned.
+    struct Coverage
+    {
+        uint64_t end = 0;
+        uint64_t last_batch_position = 0;
+        int64_t next_offset = -1; // -1 when nothing is covered
+        int64_t max_timestamp = -1;
+    };
+
+    // Opens the index, keeping its entries if the file is well formed; the caller checks
+    // the coverage against the log and calls reset() if it no longer matches.
+    SegmentIndex(std::string path, int64_t base_offset);
+    ~SegmentIndex();
+
+    SegmentIndex(const SegmentIndex &) = delete;
+    SegmentIndex &operator=(const SegmentIndex &) = delete;
+
+    // Drops every entry, e.g. when the segment was rewritten.
+    void reset();
+
+    // Adds an entry past the last one.
+    void add(const Entry &entry);
+
+    // Records that the entries now cover the log up to `coverage.end`.
+    void cover(const Coverage &coverage);
+
+    const Coverage &coverage() const { return covered; }
+    std::size_t size() const;
+
+    std::optional<Entry> last() const;
+
+    // The last entry at or before `offset`.
+    std::optional<Entry> floor(int64_t offset) const;
+
+    // The last entry whose max timestamp is older than `timestamp`; every batch up to it is too.
+    std::optional<Entry> last_before(int64_t timestamp) const;
+
+private:
+    struct Header;
+
+    Entry entry(std::size_t index) const;
+    Header &header() const;
+    void map_capacity(std::size_t capacity);
+
+    std::string path;
+    int64_t base_offset;
+    uint8_t *map = nullptr;
+    std::size_t capacity = 0; // In entries
+    Coverage covered;
+};
@@ -0,0 +1,751 @@
+// Drives a broker over many connections and reports throughput and latency.
+//
+// Each worker thread runs an event loop over its share of the connections. In
+// closed-loop mode (rate 0) every connection keeps `depth` requests in flight and
+// sends the next one as soon as a response arrives. In open-loop mode requests are
+// scheduled at `rate` per second across all connections, whether or not the broker
+// keeps up; latency is measured from the scheduled send time, so a stall is charged
+// to every request it delayed rather than hidden by the client waiting on it
+// (coordinated omission).
+//
+// Usage: loadgen [--host=127.0.0.1] [--port=9092] [--connections=16] [--threads=1]
+//                [--depth=1] [--rate=0] [--duration=10] [--warmup=1]
+//                [--mix=api_versions:1,describe:1,fetch:8,produce:0]
+//                [--topic=topic1] [--partitions=1] [--fetch-offset=0]
+//                [--fetch-bytes=1048576] [--produce-bytes=1024]
+//
+// Prints one JSON line per API and one for the whole run.
+
+#include "BenchUtil.hpp"
+#include "core/EventLoop.hpp"
+#include "core/Metrics.hpp"
+#include "protocol/Response.hpp"
+#include "storage/RecordBatchBuilder.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    enum Api : std::size_t
+    {
+        ApiVersions,
+        Describe,
+        Fetch,
+        Produce,
+        kApis,
+    };
+
+    struct ApiSpec
+    {
+        const char *name;
+        int16_t api_key;
+        int16_t api_version;
+    };
+
+    constexpr ApiSpec kApiSpecs[kApis] = {
+        {"api_versions", 18, 4},
+        {"describe", 75, 0},
+        {"fetch", 1, 16},
+        {"produce", 0, 9},
+    };
+
+    struct Options
+    {
+        std::string host = "127.0.0.1";
+        int port = 9092;
+        std::size_t connections = 16;
+        std::size_t threads = 1;
+        std::size_t depth = 1;  // Requests in flight per connection
+        double rate = 0;        // Requests per second across all connections, 0 = closed loop
+        double duration = 10;   // Measured seconds
+        double warmup = 1;      // Seconds run before measuring
+        std::array<unsigned, kApis> mix = {1, 1, 8, 0};
+        std::string topic = "topic1";
+        int32_t partitions = 1;
+        int64_t fetch_offset = 0;
+        int32_t fetch_bytes = 1 << 20;
+        std::size_t produce_bytes = 1024;
+    };
+
+    void parse_mix(const std::string &text, std::array<unsigned, kApis> &mix)
+    {
+        mix.fill(0);
+        std::size_t begin = 0;
+        while (begin < text.size())
+        {
+            std::size_t end = text.find(',', begin);
+            std::string entry = text.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+            begin = end == std::string::npos ? text.size() : end + 1;
+
+            std::size_t colon = entry.find(':');
+            std::string name = entry.substr(0, colon);
+            unsigned weight = colon == std::string::npos ? 1 : static_cast<unsigned>(std::stoul(entry.substr(colon + 1)));
+            auto spec = std::find_if(std::begin(kApiSpecs), std::end(kApiSpecs), [&](const ApiSpec &s)
+                                     { return name == s.name; });
+            if (spec == std::end(kApiSpecs))
+            {
+                throw std::runtime_error("Unknown API in mix: " + name);
+            }
+            mix[spec - std::begin(kApiSpecs)] = weight;
+        }
+    }
+
+    Options parse_options(int argc, char **argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            std::size_t eq = arg.find('=');
+            if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+            {
+                throw std::runtime_error("Expected --name=value, got " + arg);
+            }
+            std::string name = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
+
+            if (name == "host")
+                options.host = value;
+            else if (name == "port")
+                options.port = std::stoi(value);
+            else if (name == "connections")
+                options.connections = std::stoul(value);
+            else if (name == "threads")
+                options.threads = std::stoul(value);
+            else if (name == "depth")
+                options.depth = std::stoul(value);
+            else if (name == "rate")
+                options.rate = std::stod(value);
+            else if (name == "duration")
+                options.duration = std::stod(value);
+            else if (name == "warmup")
+                options.warmup = std::stod(value);
+            else if (name == "mix")
+                parse_mix(value, options.mix);
+            else if (name == "topic")
+                options.topic = value;
+            else if (name == "partitions")
+                options.partitions = std::stoi(value);
+            else if (name == "fetch-offset")
+                options.fetch_offset = std::stoll(value);
+            else if (name == "fetch-bytes")
+                options.fetch_bytes = std::stoi(value);
+            else if (name == "produce-bytes")
+                options.produce_bytes = std::stoul(value);
+            else
+                throw std::runtime_error("Unknown option --" + name);
+        }
+
+        if (options.connections == 0 || options.threads == 0 || options.depth == 0 || options.partitions <= 0)
+        {
+            throw std::runtime_error("connections, threads, depth and partitions must be positive");
+        }
+        if (std::all_of(options.mix.begin(), options.mix.end(), [](unsigned w)
+                        { return w == 0; }))
+        {
+            throw std::runtime_error("The API mix is empty");
+        }
+        options.threads = std::min(options.threads, options.connections);
+        return options;
+    }
+
+    void write_compact_bytes(kafka::protocol::Response &out, const std::vector<uint8_t> &bytes)
+    {
+        out.writeUnsignedVarint(bytes.size() + 1);
+        out.writeBytes(bytes);
+    }
+
+    void write_compact_string(kafka::protocol::Response &out, const std::string &s)
+    {
+        out.writeUnsignedVarint(s.size() + 1);
+        out.writeRawBytes(s.data(), s.size());
+    }
+
+    // Request bodies, built once. Fetch and Produce have one per partition.
+    struct Bodies
+    {
+        std::array<std::vector<std::vector<char>>, kApis> by_partition;
+    };
+
+    Bodies build_bodies(const Options &options, const std::vector<uint8_t> &topic_id)
+    {
+        Bodies bodies;
+
+        kafka::protocol::Response api_versions(0);
+        write_compact_string(api_versions, "mini-kafka-loadgen");
+        write_compact_string(api_versions, "1.0");
+        api_versions.writeInt8(0); // tagged fields
+        bodies.by_partition[ApiVersions].push_back(api_versions.get_data());
+
+        kafka::protocol::Response describe(0);
+        describe.writeUnsignedVarint(2); // topics
+        write_compact_string(describe, options.topic);
+        describe.writeInt8(0);            // topic tagged fields
+        describe.writeInt32(100);         // response_partition_limit
+        describe.writeInt8(static_cast<int8_t>(0xFF)); // cursor (null)
+        describe.writeInt8(0);            // tagged fields
+        bodies.by_partition[Describe].push_back(describe.get_data());
+
+        RecordBatchBuilder batch(0);
+        batch.append(std::nullopt, std::vector<uint8_t>(options.produce_bytes, 'x'));
+        auto records = batch.build();
+
+        for (int32_t partition = 0; partition < options.partitions; ++partition)
+        {
+            kafka::protocol::Response fetch(0);
+            fetch.writeInt32(500);     // max_wait_ms
+            fetch.writeInt32(1);       // min_bytes
+            fetch.writeInt32(options.fetch_bytes);
+            fetch.writeInt8(0);        // isolation_level
+            fetch.writeInt32(0);       // session_id
+            fetch.writeInt32(-1);      // session_epoch
+            fetch.writeUnsignedVarint(2); // topics
+            fetch.writeBytes(topic_id);
+            fetch.writeUnsignedVarint(2); // partitions
+            fetch.writeInt32(partition);
+            fetch.writeInt32(-1);      // current_leader_epoch
+            fetch.writeInt64(options.fetch_offset);
+            fetch.writeInt32(-1);      // last_fetched_epoch
+            fetch.writeInt64(-1);      // log_start_offset
+            fetch.writeInt32(options.fetch_bytes);
+            fetch.writeInt8(0);        // partition tagged fields
+            fetch.writeInt8(0);        // topic tagged fields
+            fetch.writeUnsignedVarint(1); // forgotten_topics_data (empty)
+            write_compact_string(fetch, ""); // rack_id
+            fetch.writeInt8(0);        // tagged fields
+            bodies.by_partition[Fetch].push_back(fetch.get_data());
+
+            kafka::protocol::Response produce(0);
+            produce.writeUnsignedVarint(0); // transactional_id (null)
+            produce.writeInt16(1);          // acks
+            produce.writeInt32(30000);      // timeout_ms
+            produce.writeUnsignedVarint(2); // topic_data
+            write_compact_string(produce, options.topic);
+            produce.writeUnsignedVarint(2); // partition_data
+            produce.writeInt32(partition);
+            write_compact_bytes(produce, records);
+            produce.writeInt8(0); // partition tagged fields
+            produce.writeInt8(0); // topic tagged fields
+            produce.writeInt8(0); // tagged fields
+            bodies.by_partition[Produce].push_back(produce.get_data());
+        }
+        return bodies;
+    }
+
+    // A complete request frame with a v2 header.
+    void append_frame(std::vector<char> &out, Api api, int32_t correlation_id, const std::vector<char> &body)
+    {
+        static const std::string client_id = "loadgen";
+        kafka::protocol::Response frame(0);
+        frame.writeInt32(static_cast<int32_t>(2 + 2 + 4 + 2 + client_id.size() + 1 + body.size()));
+        frame.writeInt16(kApiSpecs[api].api_key);
+        frame.writeInt16(kApiSpecs[api].api_version);
+        frame.writeInt32(correlation_id);
+        frame.writeInt16(static_cast<int16_t>(client_id.size()));
+        frame.writeRawBytes(client_id.data(), client_id.size());
+        frame.writeInt8(0); // header tagged fields
+        frame.writeRawBytes(body.data(), body.size());
+        out.insert(out.end(), frame.get_data().begin(), frame.get_data().end());
+    }
+
+    int connect_to(const Options &options)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to create socket");
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(options.port);
+        if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1)
+        {
+            close(fd);
+            throw std::runtime_error("Invalid host address " + options.host);
+        }
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to connect to " + options.host + ":" + std::to_string(options.port) + ": " + std::strerror(errno));
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        return fd;
+    }
+
+    int32_t read_int32(const char *p)
+    {
+        int32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return static_cast<int32_t>(ntohl(static_cast<uint32_t>(value)));
+    }
+
+    // Looks up the topic ID with one blocking DescribeTopicPartitions request.
+    std::vector<uint8_t> resolve_topic_id(const Options &options, const Bodies &bodies)
+    {
+        int fd = connect_to(options);
+        std::vector<char> request;
+        append_frame(request, Describe, 0, bodies.by_partition[Describe][0]);
+        if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+        {
+            close(fd);
+            throw std::runtime_error("Failed to send DescribeTopicPartitions");
+        }
+
+        std::vector<char> response;
+        char chunk[4096];
+        while (response.size() < 4 || response.size() < 4 + static_cast<std::size_t>(read_int32(response.data())))
+        {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+            {
+                close(fd);
+                throw std::runtime_error("Connection closed while resolving the topic");
+            }
+            response.insert(response.end(), chunk, chunk + n);
+        }
+        close(fd);
+
+        // size, correlation_id, header tagged fields, throttle_time_ms, topics length,
+        // then the first topic: error_code, name, topic_id.
+        std::size_t pos = 4 + 4 + 1 + 4 + 1;
+        if (response.size() < pos + 3)
+        {
+            throw std::runtime_error("Short DescribeTopicPartitions response");
+        }
+        int16_t error = static_cast<int16_t>((static_cast<uint8_t>(response[pos]) << 8) | static_cast<uint8_t>(response[pos + 1]));
+        if (error != 0)
+        {
+            throw std::runtime_error("Topic " + options.topic + " is not known to the broker (error " + std::to_string(error) + ")");
+        }
+        pos += 2;
+        pos += static_cast<uint8_t>(response[pos]); // Compact name: length + 1, then the bytes
+        if (response.size() < pos + 16)
+        {
+            throw std::runtime_error("Short DescribeTopicPartitions response");
+        }
+        return std::vector<uint8_t>(response.begin() + pos, response.begin() + pos + 16);
+    }
+
+    struct ApiStats
+    {
+        metrics::LatencyHistogram corrected; // From the scheduled send time
+        metrics::LatencyHistogram service;   // From the actual send time
+        uint64_t sent = 0;
+        uint64_t completed = 0; // Measured completions only
+    };
+
+    struct Pending
+    {
+        int32_t correlation_id;
+        Api api;
+        Clock::time_point intended;
+        Clock::time_point sent;
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        std::vector<char> in;
+        std::vector<char> out;
+        std::size_t out_offset = 0;
+        bool waiting_for_write = false;
+        std::deque<Pending> in_flight;
+    };
+
+    // Runs a share of the connections on one event loop thread.
+    class Worker
+    {
+    public:
+        Worker(const Options &options, const Bodies &bodies, std::size_t connections, double rate, unsigned seed)
+            : options(options), bodies(bodies), connections(connections), rate(rate), random(seed),
+              pick_api(options.mix.begin(), options.mix.end()) {}
+
+        void run(Clock::time_point start, Clock::time_point measure_from, Clock::time_point end)
+        {
+            this->measure_from = measure_from;
+            this->end = end;
+            this->next_intended = start;
+
+            for (auto &connection : this->connections)
+            {
+                connection.fd = connect_to(this->options);
+                fcntl(connection.fd, F_SETFL, fcntl(connection.fd, F_GETFL) | O_NONBLOCK);
+            }
+
+            this->loop.post([this]
+                            {
+                                for (auto &connection : this->connections)
+                                {
+                                    this->loop.add(connection.fd, EPOLLIN, [this, &connection](uint32_t events)
+                                                   { on_events(connection, events); });
+                                }
+                                tick(); });
+            this->loop.run();
+
+            for (auto &connection : this->connections)
+            {
+                this->incomplete += connection.in_flight.size();
+                close(connection.fd);
+            }
+            this->incomplete += this->backlog.size();
+        }
+
+        std::array<ApiStats, kApis> stats;
+        uint64_t incomplete = 0;
+        uint64_t failed_connections = 0;
+
+    private:
+        // Issues requests whose time has come and re-arms itself every millisecond.
+        void tick()
+        {
+            auto now = Clock::now();
+            if (this->rate > 0)
+            {
+                auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / this->rate));
+                while (this->next_intended <= now && this->next_intended < this->end)
+                {
+                    this->backlog.push_back(this->next_intended);
+                    this->next_intended += interval;
+                }
+            }
+            fill(now);
+
+            if (now >= this->end + kDrainTimeout || (now >= this->end && idle()))
+            {
+                this->loop.stop();
+                return;
+            }
+            this->loop.run_after(std::chrono::milliseconds(1), [this]
+                                 { tick(); });
+        }
+
+        bool idle() const
+        {
+            return this->backlog.empty() && std::all_of(this->connections.begin(), this->connections.end(), [](const Connection &c)
+                                                        { return c.fd == -1 || c.in_flight.empty(); });
+        }
+
+        // Tops every connection up to `depth` requests in flight.
+        void fill(Clock::time_point now)
+        {
+            for (std::size_t i = 0; i < this->connections.size(); ++i)
+            {
+                // Start from a rotating connection so open-loop backlog spreads evenly.
+                Connection &connection = this->connections[(this->next_connection + i) % this->connections.size()];
+                while (connection.fd != -1 && connection.in_flight.size() < this->options.depth)
+                {
+                    Clock::time_point intended;
+                    if (this->rate > 0)
+                    {
+                        if (this->backlog.empty())
+                        {
+                            break;
+                        }
+                        intended = this->backlog.front();
+                        this->backlog.pop_front();
+                    }
+                    else
+                    {
+                        if (now >= this->end)
+                        {
+                            break;
+                        }
+                        intended = now;
+                    }
+                    issue(connection, intended, now);
+                }
+                flush(connection);
+            }
+            this->next_connection = (this->next_connection + 1) % this->connections.size();
+        }
+
+        void issue(Connection &connection, Clock::time_point intended, Clock::time_point now)
+        {
+            Api api = static_cast<Api>(this->pick_api(this->random));
+            const auto &variants = this->bodies.by_partition[api];
+            const auto &body = variants[this->next_partition++ % variants.size()];
+            int32_t correlation_id = this->next_correlation_id++;
+            append_frame(connection.out, api, correlation_id, body);
+            connection.in_flight.push_back(Pending{correlation_id, api, intended, now});
+            ++this->stats[api].sent;
+        }
+
+        void on_events(Connection &connection, uint32_t events)
+        {
+            if (events & (EPOLLERR | EPOLLHUP))
+            {
+                fail(connection);
+                return;
+            }
+            if (events & EPOLLOUT)
+            {
+                flush(connection);
+            }
+            if (events & EPOLLIN)
+            {
+                read_responses(connection);
+            }
+        }
+
+        void read_responses(Connection &connection)
+        {
+            char chunk[64 * 1024];
+            while (connection.fd != -1)
+            {
+                ssize_t n = recv(connection.fd, chunk, sizeof(chunk), 0);
+                if (n > 0)
+                {
+                    connection.in.insert(connection.in.end(), chunk, chunk + n);
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                fail(connection);
+                return;
+            }
+
+            auto now = Clock::now();
+            std::size_t consumed = 0;
+            while (connection.in.size() - consumed >= 8)
+            {
+                int32_t size = read_int32(connection.in.data() + consumed);
+                if (connection.in.size() - consumed - 4 < static_cast<std::size_t>(size))
+                {
+                    break;
+                }
+                int32_t correlation_id = read_int32(connection.in.data() + consumed + 4);
+                consumed += 4 + size;
+
+                if (connection.in_flight.empty() || connection.in_flight.front().correlation_id != correlation_id)
+                {
+                    std::cerr << "Unexpected correlation id " << correlation_id << ", closing connection\n";
+                    fail(connection);
+                    return;
+                }
+                Pending done = connection.in_flight.front();
+                connection.in_flight.pop_front();
+
+                if (done.intended >= this->measure_from)
+                {
+                    auto &api_stats = this->stats[done.api];
+                    ++api_stats.completed;
+                    api_stats.corrected.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - done.intended).count());
+                    api_stats.service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - done.sent).count());
+                }
+            }
+            connection.in.erase(connection.in.begin(), connection.in.begin() + consumed);
+            fill(now);
+        }
+
+        void flush(Connection &connection)
+        {
+            while (connection.fd != -1 && connection.out_offset < connection.out.size())
+            {
+                ssize_t n = send(connection.fd, connection.out.data() + connection.out_offset, connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+                if (n > 0)
+                {
+                    connection.out_offset += n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    set_write_interest(connection, true);
+                    return;
+                }
+                fail(connection);
+                return;
+            }
+            connection.out.clear();
+            connection.out_offset = 0;
+            set_write_interest(connection, false);
+        }
+
+        void set_write_interest(Connection &connection, bool enabled)
+        {
+            if (connection.fd != -1 && enabled != connection.waiting_for_write)
+            {
+                connection.waiting_for_write = enabled;
+                this->loop.modify(connection.fd, EPOLLIN | (enabled ? EPOLLOUT : 0));
+            }
+        }
+
+        void fail(Connection &connection)
+        {
+            if (connection.fd == -1)
+            {
+                return;
+            }
+            this->loop.remove(connection.fd);
+            close(connection.fd);
+            connection.fd = -1;
+            this->incomplete += connection.in_flight.size();
+            connection.in_flight.clear();
+            ++this->failed_connections;
+        }
+
+        static constexpr std::chrono::seconds kDrainTimeout{5};
+
+        const Options &options;
+        const Bodies &bodies;
+        std::vector<Connection> connections;
+        double rate;
+        std::mt19937 random;
+        std::discrete_distribution<std::size_t> pick_api;
+
+        EventLoop loop;
+        Clock::time_point measure_from;
+        Clock::time_point end;
+        Clock::time_point next_intended;
+        std::deque<Clock::time_point> backlog; // Scheduled but not yet sent (open loop)
+        std::size_t next_connection = 0;
+        std::size_t next_partition = 0;
+        int32_t next_correlation_id = 1;
+    };
+
+    double micros(uint64_t ns)
+    {
+        return static_cast<double>(ns) / 1000.0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        options = parse_options(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n"
+                  << "Usage: " << argv[0] << " [--host=] [--port=] [--connections=] [--threads=] [--depth=] [--rate=]"
+                  << " [--duration=] [--warmup=] [--mix=api:weight,...] [--topic=] [--partitions=] [--fetch-offset=]"
+                  << " [--fetch-bytes=] [--produce-bytes=]\n";
+        return 2;
+    }
+
+    try
+    {
+        // The describe body doesn't depend on the topic ID, so build once to resolve it, then again.
+        Bodies bodies = build_bodies(options, std::vector<uint8_t>(16, 0));
+        if (options.mix[Fetch] > 0)
+        {
+            bodies = build_bodies(options, resolve_topic_id(options, bodies));
+        }
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (std::size_t t = 0; t < options.threads; ++t)
+        {
+            std::size_t share = options.connections / options.threads + (t < options.connections % options.threads ? 1 : 0);
+            double rate_share = options.rate * static_cast<double>(share) / static_cast<double>(options.connections);
+            workers.push_back(std::make_unique<Worker>(options, bodies, share, rate_share, static_cast<unsigned>(t + 1)));
+        }
+
+        auto start = Clock::now();
+        auto measure_from = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup));
+        auto end = measure_from + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+        {
+            std::vector<std::jthread> threads;
+            for (auto &worker : workers)
+            {
+                threads.emplace_back([&worker, start, measure_from, end]
+                                     { worker->run(start, measure_from, end); });
+            }
+        }
+
+        metrics::HistogramSummary all;
+        uint64_t completed = 0;
+        uint64_t incomplete = 0;
+        uint64_t failed_connections = 0;
+        for (std::size_t api = 0; api < kApis; ++api)
+        {
+            metrics::HistogramSummary corrected;
+            metrics::HistogramSummary service;
+            uint64_t sent = 0;
+            uint64_t api_completed = 0;
+            for (const auto &worker : workers)
+            {
+                corrected.add(worker->stats[api].corrected);
+                service.add(worker->stats[api].service);
+                all.add(worker->stats[api].corrected);
+                sent += worker->stats[api].sent;
+                api_completed += worker->stats[api].completed;
+            }
+            completed += api_completed;
+            if (sent == 0)
+            {
+                continue;
+            }
+
+            bench::JsonLine("loadgen")
+                .field("api", kApiSpecs[api].name)
+                .field("sent", sent)
+                .field("completed", api_completed)
+                .field("requests_per_s", api_completed / options.duration)
+                .field("p50_us", micros(corrected.quantile(0.5)))
+                .field("p99_us", micros(corrected.quantile(0.99)))
+                .field("p999_us", micros(corrected.quantile(0.999)))
+                .field("max_us", micros(corrected.max_ns))
+                .field("service_p99_us", micros(service.quantile(0.99)));
+        }
+        for (const auto &worker : workers)
+        {
+            incomplete += worker->incomplete;
+            failed_connections += worker->failed_connections;
+        }
+
+        bench::JsonLine("loadgen")
+            .field("api", "all")
+            .field("mode", options.rate > 0 ? "open" : "closed")
+            .field("connections", options.connections)
+            .field("threads", options.threads)
+            .field("depth", options.depth)
+            .field("target_rate", options.rate)
+            .field("seconds", options.duration)
+            .field("completed", completed)
+            .field("requests_per_s", completed / options.duration)
+            .field("p50_us", micros(all.quantile(0.5)))
+            .field("p99_us", micros(all.quantile(0.99)))
+            .field("p999_us", micros(all.quantile(0.999)))
+            .field("max_us", micros(all.max_ns))
+            .field("incomplete", incomplete)
+            .field("failed_connections", failed_connections);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "loadgen: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
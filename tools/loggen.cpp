@@ -0,0 +1,356 @@
+// Writes a synthetic broker log directory: a __cluster_metadata log with a
+// TopicRecord and PartitionRecords for every topic, and optionally segment files
+// full of data records for every partition, in the layout the broker reads from.
+//
+// Usage: loggen [--out=/tmp/kraft-combined-logs] [--topics=100] [--partitions=3]
+//               [--replicas=3] [--brokers=3] [--topic-prefix=topic]
+//               [--topics-per-batch=1] [--metadata-compression=none]
+//               [--records=0] [--batch-records=100] [--record-bytes=100]
+//               [--key-bytes=0] [--segment-bytes=1073741824] [--compression=none]
+//               [--threads=0] [--seed=1] [--force=false]
+//
+// Compression is one of none, gzip, lz4 or zstd. Partition directories are only
+// written when --records is non-zero. --force replaces the directories this run
+// writes; without it, existing ones are an error.
+
+#include "storage/Codec.hpp"
+#include "storage/RecordBatchBuilder.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Options
+    {
+        std::filesystem::path out = "/tmp/kraft-combined-logs";
+        long topics = 100;
+        int32_t partitions = 3;
+        int32_t replicas = 3;
+        int32_t brokers = 3;
+        std::string topic_prefix = "topic";
+        long topics_per_batch = 1; // Topics per metadata batch, as one CreateTopics result each by default
+        CompressionType metadata_compression = CompressionType::None;
+        long records = 0;          // Data records per partition
+        long batch_records = 100;  // Records per data batch
+        std::size_t record_bytes = 100;
+        std::size_t key_bytes = 0;
+        std::size_t segment_bytes = std::size_t(1) << 30;
+        CompressionType compression = CompressionType::None;
+        unsigned threads = 0; // 0 = hardware concurrency
+        uint64_t seed = 1;
+        bool force = false;
+    };
+
+    CompressionType parse_compression(const std::string &value)
+    {
+        for (auto type : {CompressionType::None, CompressionType::Gzip, CompressionType::Lz4, CompressionType::Zstd})
+        {
+            if (value == codec::name(type))
+            {
+                if (!codec::is_supported(type))
+                {
+                    throw std::runtime_error("This build has no " + value + " support");
+                }
+                return type;
+            }
+        }
+        throw std::runtime_error("Unknown compression " + value);
+    }
+
+    Options parse_options(int argc, char **argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            std::size_t eq = arg.find('=');
+            if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+            {
+                throw std::runtime_error("Expected --name=value, got " + arg);
+            }
+            std::string name = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
+
+            if (name == "out")
+                options.out = value;
+            else if (name == "topics")
+                options.topics = std::stol(value);
+            else if (name == "partitions")
+                options.partitions = std::stoi(value);
+            else if (name == "replicas")
+                options.replicas = std::stoi(value);
+            else if (name == "brokers")
+                options.brokers = std::stoi(value);
+            else if (name == "topic-prefix")
+                options.topic_prefix = value;
+            else if (name == "topics-per-batch")
+                options.topics_per_batch = std::stol(value);
+            else if (name == "metadata-compression")
+                options.metadata_compression = parse_compression(value);
+            else if (name == "records")
+                options.records = std::stol(value);
+            else if (name == "batch-records")
+                options.batch_records = std::stol(value);
+            else if (name == "record-bytes")
+                options.record_bytes = std::stoul(value);
+            else if (name == "key-bytes")
+                options.key_bytes = std::stoul(value);
+            else if (name == "segment-bytes")
+                options.segment_bytes = std::stoull(value);
+            else if (name == "compression")
+                options.compression = parse_compression(value);
+            else if (name == "threads")
+                options.threads = static_cast<unsigned>(std::stoul(value));
+            else if (name == "seed")
+                options.seed = std::stoull(value);
+            else if (name == "force")
+                options.force = value == "true" || value == "1";
+            else
+                throw std::runtime_error("Unknown option --" + name);
+        }
+
+        if (options.topics < 0 || options.partitions <= 0 || options.brokers <= 0 || options.replicas <= 0 ||
+            options.topics_per_batch <= 0 || options.records < 0 || options.batch_records <= 0 || options.segment_bytes == 0)
+        {
+            throw std::runtime_error("Counts and sizes must be positive");
+        }
+        if (options.replicas > options.brokers)
+        {
+            throw std::runtime_error("--replicas cannot exceed --brokers");
+        }
+        if (options.threads == 0)
+        {
+            options.threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return options;
+    }
+
+    std::string topic_name(const Options &options, long topic)
+    {
+        return options.topic_prefix + std::to_string(topic);
+    }
+
+    std::string segment_name(int64_t base_offset)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%020lld.log", static_cast<long long>(base_offset));
+        return name;
+    }
+
+    // Random topic IDs derived from the seed, so repeated runs produce identical logs.
+    std::vector<std::vector<uint8_t>> topic_ids(const Options &options)
+    {
+        std::mt19937_64 rng(options.seed);
+        std::vector<std::vector<uint8_t>> ids(static_cast<std::size_t>(options.topics), std::vector<uint8_t>(16));
+        for (auto &id : ids)
+        {
+            for (auto &b : id)
+            {
+                b = static_cast<uint8_t>(rng());
+            }
+            id[0] |= 1; // Never the all-zero ID, which means "no topic"
+        }
+        return ids;
+    }
+
+    void prepare_dir(const Options &options, const std::filesystem::path &dir)
+    {
+        if (std::filesystem::exists(dir))
+        {
+            if (!options.force)
+            {
+                throw std::runtime_error(dir.string() + " already exists; pass --force=true to replace it");
+            }
+            std::filesystem::remove_all(dir);
+        }
+        std::filesystem::create_directories(dir);
+    }
+
+    std::size_t write_metadata(const Options &options, const std::vector<std::vector<uint8_t>> &ids)
+    {
+        auto dir = options.out / "__cluster_metadata-0";
+        prepare_dir(options, dir);
+        std::ofstream out(dir / segment_name(0), std::ios::binary);
+
+        int64_t offset = 0;
+        int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        for (long first = 0; first < options.topics; first += options.topics_per_batch)
+        {
+            RecordBatchBuilder batch(offset, timestamp, options.metadata_compression);
+            for (long t = first; t < std::min(options.topics, first + options.topics_per_batch); ++t)
+            {
+                const auto &id = ids[static_cast<std::size_t>(t)];
+                batch.append(std::nullopt, metadata_records::topic_record(topic_name(options, t), id));
+                for (int32_t p = 0; p < options.partitions; ++p)
+                {
+                    // Spread replicas and leadership round-robin over broker IDs 1..brokers.
+                    std::vector<int32_t> replicas;
+                    for (int32_t r = 0; r < options.replicas; ++r)
+                    {
+                        replicas.push_back(static_cast<int32_t>((t + p + r) % options.brokers) + 1);
+                    }
+                    batch.append(std::nullopt, metadata_records::partition_record(p, id, replicas, replicas, replicas.front(), 0));
+                }
+            }
+            offset += static_cast<int64_t>(batch.record_count());
+            auto bytes = batch.build();
+            out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+        out.flush();
+        if (!out)
+        {
+            throw std::runtime_error("Failed to write the metadata log");
+        }
+        return static_cast<std::size_t>(out.tellp());
+    }
+
+    // Printable, mildly compressible bytes that record values and keys are sliced from.
+    std::vector<uint8_t> value_pool(uint64_t seed)
+    {
+        static const char words[][10] = {"user", "order", "click", "view", "cart", "status", "amount", "ts", "id", "event"};
+        std::mt19937_64 rng(seed);
+        std::vector<uint8_t> pool;
+        pool.reserve(1 << 20);
+        while (pool.size() < (1 << 20))
+        {
+            const char *word = words[rng() % 10];
+            pool.insert(pool.end(), word, word + std::char_traits<char>::length(word));
+            std::string number = std::to_string(rng() % 100000);
+            pool.push_back(':');
+            pool.insert(pool.end(), number.begin(), number.end());
+            pool.push_back(',');
+        }
+        return pool;
+    }
+
+    std::size_t write_partition(const Options &options, long topic, int32_t partition, const std::vector<uint8_t> &pool)
+    {
+        auto dir = options.out / (topic_name(options, topic) + "-" + std::to_string(partition));
+        prepare_dir(options, dir);
+
+        std::mt19937_64 rng(options.seed ^ (static_cast<uint64_t>(topic) << 20) ^ static_cast<uint64_t>(partition));
+        auto slice = [&](std::size_t size)
+        {
+            std::size_t start = rng() % (pool.size() - std::min(size, pool.size() - 1));
+            return std::vector<uint8_t>(pool.begin() + start, pool.begin() + start + std::min(size, pool.size() - start));
+        };
+
+        int64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() -
+                            options.records;
+        std::ofstream out;
+        std::size_t segment_size = 0;
+        std::size_t total = 0;
+        for (int64_t offset = 0; offset < options.records; offset += options.batch_records)
+        {
+            if (!out.is_open() || segment_size >= options.segment_bytes)
+            {
+                out.close();
+                out.open(dir / segment_name(offset), std::ios::binary);
+                segment_size = 0;
+            }
+
+            RecordBatchBuilder batch(offset, timestamp + offset, options.compression);
+            for (int64_t i = offset; i < std::min<int64_t>(options.records, offset + options.batch_records); ++i)
+            {
+                std::optional<std::vector<uint8_t>> key;
+                if (options.key_bytes > 0)
+                {
+                    key = slice(options.key_bytes);
+                }
+                batch.append(key, slice(options.record_bytes), timestamp + i);
+            }
+            auto bytes = batch.build();
+            out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            if (!out)
+            {
+                throw std::runtime_error("Failed to write " + dir.string());
+            }
+            segment_size += bytes.size();
+            total += bytes.size();
+        }
+        return total;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        options = parse_options(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n"
+                  << "Usage: " << argv[0] << " [--out=] [--topics=] [--partitions=] [--replicas=] [--brokers=] [--topic-prefix=]"
+                  << " [--topics-per-batch=] [--metadata-compression=] [--records=] [--batch-records=] [--record-bytes=]"
+                  << " [--key-bytes=] [--segment-bytes=] [--compression=] [--threads=] [--seed=] [--force=]\n";
+        return 2;
+    }
+
+    try
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto ids = topic_ids(options);
+        std::size_t metadata_bytes = write_metadata(options, ids);
+        std::cout << "Wrote " << options.topics << " topics with " << options.partitions << " partitions each ("
+                  << metadata_bytes << " bytes) to " << (options.out / "__cluster_metadata-0").string() << "\n";
+
+        if (options.records > 0)
+        {
+            auto pool = value_pool(options.seed);
+            long total_partitions = options.topics * options.partitions;
+            std::atomic<long> next{0};
+            std::atomic<std::size_t> data_bytes{0};
+            std::exception_ptr failure;
+            std::mutex failure_mutex;
+            {
+                std::vector<std::jthread> workers;
+                for (unsigned t = 0; t < options.threads; ++t)
+                {
+                    workers.emplace_back([&]
+                                         {
+                                             try
+                                             {
+                                                 for (long i = next++; i < total_partitions; i = next++)
+                                                 {
+                                                     data_bytes += write_partition(options, i / options.partitions, static_cast<int32_t>(i % options.partitions), pool);
+                                                 }
+                                             }
+                                             catch (...)
+                                             {
+                                                 std::lock_guard<std::mutex> lock(failure_mutex);
+                                                 failure = std::current_exception();
+                                                 next = total_partitions;
+                                             } });
+                }
+            }
+            if (failure)
+            {
+                std::rethrow_exception(failure);
+            }
+            std::cout << "Wrote " << options.records << " records to each of " << total_partitions << " partitions ("
+                      << data_bytes.load() << " bytes, " << codec::name(options.compression) << ")\n";
+        }
+
+        std::cout << "Done in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s\n";
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "loggen: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
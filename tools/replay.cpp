@@ -0,0 +1,593 @@
+// Replays a request capture recorded by the broker (MINIKAFKA_CAPTURE) against a
+// running broker and reports latency per API.
+//
+// Every captured connection gets its own connection, opened when its first request
+// is due and closed when the capture saw it close. Requests are sent in their
+// captured order on their connection, at their captured time divided by `speed`;
+// latency is measured from that scheduled time, so a slow broker is charged for the
+// requests it delays. With --speed=0 each connection sends its next request as soon
+// as the previous response arrives, and latency is measured from the actual send.
+//
+// With --baseline-port the same traffic is replayed against a second broker (say,
+// the previous build) after the first, and the differences are reported as well.
+//
+// Usage: replay --capture=PATH [--host=127.0.0.1] [--port=9092] [--baseline-port=0]
+//               [--speed=1]
+//
+// Prints one JSON line per API and one for the whole run, per broker, then one
+// "replay_diff" line per API when comparing.
+
+#include "BenchUtil.hpp"
+#include "core/EventLoop.hpp"
+#include "core/Metrics.hpp"
+#include "core/RequestCapture.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::string capture;
+        std::string host = "127.0.0.1";
+        int port = 9092;
+        int baseline_port = 0; // 0 = no comparison
+        double speed = 1;      // 0 = as fast as responses allow
+    };
+
+    Options parse_options(int argc, char **argv)
+    {
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            std::size_t eq = arg.find('=');
+            if (arg.rfind("--", 0) != 0 || eq == std::string::npos)
+            {
+                throw std::runtime_error("Expected --name=value, got " + arg);
+            }
+            std::string name = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
+
+            if (name == "capture")
+                options.capture = value;
+            else if (name == "host")
+                options.host = value;
+            else if (name == "port")
+                options.port = std::stoi(value);
+            else if (name == "baseline-port")
+                options.baseline_port = std::stoi(value);
+            else if (name == "speed")
+                options.speed = std::stod(value);
+            else
+                throw std::runtime_error("Unknown option --" + name);
+        }
+
+        if (options.capture.empty())
+        {
+            throw std::runtime_error("--capture is required");
+        }
+        if (options.speed < 0)
+        {
+            throw std::runtime_error("speed must not be negative");
+        }
+        return options;
+    }
+
+    const char *api_name(int16_t api_key)
+    {
+        switch (api_key)
+        {
+        case 0:
+            return "produce";
+        case 1:
+            return "fetch";
+        case 18:
+            return "api_versions";
+        case 75:
+            return "describe";
+        default:
+            return nullptr;
+        }
+    }
+
+    std::string api_label(int16_t api_key)
+    {
+        const char *name = api_name(api_key);
+        return name ? name : "api_" + std::to_string(api_key);
+    }
+
+    int16_t read_int16(const char *p)
+    {
+        uint16_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return static_cast<int16_t>(ntohs(value));
+    }
+
+    int32_t read_int32(const char *p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return static_cast<int32_t>(ntohl(value));
+    }
+
+    int connect_to(const std::string &host, int port)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to create socket");
+        }
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+        {
+            close(fd);
+            throw std::runtime_error("Invalid host address " + host);
+        }
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to connect to " + host + ":" + std::to_string(port) + ": " + std::strerror(errno));
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+
+    struct ApiStats
+    {
+        metrics::LatencyHistogram corrected; // From the scheduled send time
+        metrics::LatencyHistogram service;   // From the actual send time
+        uint64_t sent = 0;
+        uint64_t completed = 0;
+    };
+
+    struct Results
+    {
+        std::map<int16_t, std::unique_ptr<ApiStats>> by_api;
+        double seconds = 0;
+        std::size_t connections = 0;
+        uint64_t incomplete = 0;
+        uint64_t failed_connections = 0;
+    };
+
+    struct Pending
+    {
+        int32_t correlation_id;
+        int16_t api_key;
+        Clock::time_point intended;
+        Clock::time_point sent;
+    };
+
+    struct Connection
+    {
+        int fd = -1;
+        bool closed = false;      // Closed, by the capture or on an error
+        bool close_due = false;   // The capture closed it; close once responses are in
+        std::deque<std::size_t> due; // Entries whose time has come, not yet sent
+        std::vector<char> in;
+        std::vector<char> out;
+        std::size_t out_offset = 0;
+        bool waiting_for_write = false;
+        std::deque<Pending> in_flight;
+    };
+
+    // Replays the capture against one broker on a single event loop thread.
+    class Replayer
+    {
+    public:
+        Replayer(const Options &options, const std::vector<RequestCapture::Entry> &entries, int port)
+            : options(options), entries(entries), port(port) {}
+
+        Results run()
+        {
+            this->start = Clock::now();
+            this->loop.post([this]
+                            { tick(); });
+            this->loop.run();
+
+            this->results.seconds = std::chrono::duration<double>(Clock::now() - this->start).count();
+            this->results.connections = this->connections.size();
+            for (auto &[id, connection] : this->connections)
+            {
+                this->results.incomplete += connection.in_flight.size() + connection.due.size();
+                if (connection.fd != -1)
+                {
+                    close(connection.fd);
+                }
+            }
+            return std::move(this->results);
+        }
+
+    private:
+        Clock::time_point scheduled(const RequestCapture::Entry &entry) const
+        {
+            if (this->options.speed == 0)
+            {
+                return this->start;
+            }
+            auto offset = std::chrono::duration<double, std::nano>(static_cast<double>(entry.offset_ns) / this->options.speed);
+            return this->start + std::chrono::duration_cast<Clock::duration>(offset);
+        }
+
+        // Releases entries whose time has come and re-arms itself every millisecond.
+        void tick()
+        {
+            auto now = Clock::now();
+            while (this->next_entry < this->entries.size() && scheduled(this->entries[this->next_entry]) <= now)
+            {
+                const auto &entry = this->entries[this->next_entry];
+                Connection &connection = this->connections[entry.connection_id];
+                if (!connection.closed)
+                {
+                    if (entry.closed)
+                    {
+                        connection.close_due = true;
+                    }
+                    else
+                    {
+                        connection.due.push_back(this->next_entry);
+                    }
+                }
+                ++this->next_entry;
+            }
+            for (auto &[id, connection] : this->connections)
+            {
+                advance(connection, now);
+            }
+
+            bool done = this->next_entry == this->entries.size() && idle();
+            if (done || (this->next_entry == this->entries.size() && now >= this->last_progress + kDrainTimeout))
+            {
+                this->loop.stop();
+                return;
+            }
+            this->loop.run_after(std::chrono::milliseconds(1), [this]
+                                 { tick(); });
+        }
+
+        bool idle() const
+        {
+            return std::all_of(this->connections.begin(), this->connections.end(), [](const auto &item)
+                               { return item.second.closed || (item.second.due.empty() && item.second.in_flight.empty()); });
+        }
+
+        // Opens the connection if needed, sends what is due and closes it once it's done.
+        void advance(Connection &connection, Clock::time_point now)
+        {
+            if (connection.closed)
+            {
+                return;
+            }
+            if (connection.fd == -1 && !connection.due.empty())
+            {
+                try
+                {
+                    connection.fd = connect_to(this->options.host, this->port);
+                }
+                catch (const std::exception &e)
+                {
+                    std::cerr << "replay: " << e.what() << "\n";
+                    fail(connection);
+                    return;
+                }
+                this->loop.add(connection.fd, EPOLLIN, [this, &connection](uint32_t events)
+                               { on_events(connection, events); });
+            }
+
+            while (!connection.due.empty() && (this->options.speed > 0 || connection.in_flight.empty()))
+            {
+                const auto &entry = this->entries[connection.due.front()];
+                connection.due.pop_front();
+                if (entry.frame.size() < 8)
+                {
+                    continue; // Too short to hold a request header
+                }
+                int16_t api_key = read_int16(entry.frame.data());
+                int32_t correlation_id = read_int32(entry.frame.data() + 4);
+                Clock::time_point intended = this->options.speed > 0 ? scheduled(entry) : now;
+
+                uint32_t size_be = htonl(static_cast<uint32_t>(entry.frame.size()));
+                const char *size_bytes = reinterpret_cast<const char *>(&size_be);
+                connection.out.insert(connection.out.end(), size_bytes, size_bytes + sizeof(size_be));
+                connection.out.insert(connection.out.end(), entry.frame.begin(), entry.frame.end());
+                connection.in_flight.push_back(Pending{correlation_id, api_key, intended, now});
+                ++stats(api_key).sent;
+            }
+            flush(connection);
+
+            if (connection.close_due && connection.due.empty() && connection.in_flight.empty() && connection.out.empty())
+            {
+                if (connection.fd != -1)
+                {
+                    this->loop.remove(connection.fd);
+                    close(connection.fd);
+                    connection.fd = -1;
+                }
+                connection.closed = true;
+            }
+        }
+
+        ApiStats &stats(int16_t api_key)
+        {
+            auto &slot = this->results.by_api[api_key];
+            if (!slot)
+            {
+                slot = std::make_unique<ApiStats>();
+            }
+            return *slot;
+        }
+
+        void on_events(Connection &connection, uint32_t events)
+        {
+            if (events & (EPOLLERR | EPOLLHUP))
+            {
+                fail(connection);
+                return;
+            }
+            if (events & EPOLLOUT)
+            {
+                flush(connection);
+            }
+            if (events & EPOLLIN)
+            {
+                read_responses(connection);
+            }
+        }
+
+        void read_responses(Connection &connection)
+        {
+            char chunk[64 * 1024];
+            while (connection.fd != -1)
+            {
+                ssize_t n = recv(connection.fd, chunk, sizeof(chunk), 0);
+                if (n > 0)
+                {
+                    connection.in.insert(connection.in.end(), chunk, chunk + n);
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    break;
+                }
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                fail(connection);
+                return;
+            }
+
+            auto now = Clock::now();
+            std::size_t consumed = 0;
+            while (connection.in.size() - consumed >= 8)
+            {
+                int32_t size = read_int32(connection.in.data() + consumed);
+                if (connection.in.size() - consumed - 4 < static_cast<std::size_t>(size))
+                {
+                    break;
+                }
+                int32_t correlation_id = read_int32(connection.in.data() + consumed + 4);
+                consumed += 4 + size;
+
+                if (connection.in_flight.empty() || connection.in_flight.front().correlation_id != correlation_id)
+                {
+                    std::cerr << "Unexpected correlation id " << correlation_id << ", closing connection\n";
+                    fail(connection);
+                    return;
+                }
+                Pending done = connection.in_flight.front();
+                connection.in_flight.pop_front();
+
+                auto &api_stats = stats(done.api_key);
+                ++api_stats.completed;
+                api_stats.corrected.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - done.intended).count());
+                api_stats.service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - done.sent).count());
+                this->last_progress = now;
+            }
+            connection.in.erase(connection.in.begin(), connection.in.begin() + consumed);
+            advance(connection, now);
+        }
+
+        void flush(Connection &connection)
+        {
+            while (connection.fd != -1 && connection.out_offset < connection.out.size())
+            {
+                ssize_t n = send(connection.fd, connection.out.data() + connection.out_offset, connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+                if (n > 0)
+                {
+                    connection.out_offset += n;
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                {
+                    set_write_interest(connection, true);
+                    return;
+                }
+                fail(connection);
+                return;
+            }
+            connection.out.clear();
+            connection.out_offset = 0;
+            set_write_interest(connection, false);
+        }
+
+        void set_write_interest(Connection &connection, bool enabled)
+        {
+            if (connection.fd != -1 && enabled != connection.waiting_for_write)
+            {
+                connection.waiting_for_write = enabled;
+                this->loop.modify(connection.fd, EPOLLIN | (enabled ? EPOLLOUT : 0));
+            }
+        }
+
+        void fail(Connection &connection)
+        {
+            if (connection.closed)
+            {
+                return;
+            }
+            if (connection.fd != -1)
+            {
+                this->loop.remove(connection.fd);
+                close(connection.fd);
+                connection.fd = -1;
+            }
+            connection.closed = true;
+            this->results.incomplete += connection.in_flight.size() + connection.due.size();
+            connection.in_flight.clear();
+            connection.due.clear();
+            ++this->results.failed_connections;
+        }
+
+        static constexpr std::chrono::seconds kDrainTimeout{10}; // Without responses after the last request
+
+        const Options &options;
+        const std::vector<RequestCapture::Entry> &entries;
+        int port;
+
+        EventLoop loop;
+        Clock::time_point start;
+        Clock::time_point last_progress = Clock::now();
+        std::size_t next_entry = 0;
+        std::unordered_map<uint32_t, Connection> connections; // By captured connection id
+        Results results;
+    };
+
+    double micros(uint64_t ns)
+    {
+        return static_cast<double>(ns) / 1000.0;
+    }
+
+    struct Summary
+    {
+        metrics::HistogramSummary corrected;
+        metrics::HistogramSummary service;
+        uint64_t sent = 0;
+        uint64_t completed = 0;
+    };
+
+    // Prints the per-API and overall lines for one broker and returns the per-API summaries.
+    std::map<std::string, Summary> report(const Results &results, const std::string &target, int port)
+    {
+        std::map<std::string, Summary> summaries;
+        Summary &all = summaries["all"];
+        for (const auto &[api_key, stats] : results.by_api)
+        {
+            Summary &summary = summaries[api_label(api_key)];
+            summary.corrected.add(stats->corrected);
+            summary.service.add(stats->service);
+            summary.sent += stats->sent;
+            summary.completed += stats->completed;
+            all.corrected.add(stats->corrected);
+            all.service.add(stats->service);
+            all.sent += stats->sent;
+            all.completed += stats->completed;
+        }
+
+        for (const auto &[api, summary] : summaries)
+        {
+            bench::JsonLine line("replay");
+            line.field("target", target)
+                .field("port", port)
+                .field("api", api)
+                .field("sent", summary.sent)
+                .field("completed", summary.completed)
+                .field("requests_per_s", summary.completed / results.seconds)
+                .field("p50_us", micros(summary.corrected.quantile(0.5)))
+                .field("p99_us", micros(summary.corrected.quantile(0.99)))
+                .field("p999_us", micros(summary.corrected.quantile(0.999)))
+                .field("max_us", micros(summary.corrected.max_ns))
+                .field("service_p99_us", micros(summary.service.quantile(0.99)));
+            if (api == "all")
+            {
+                line.field("seconds", results.seconds)
+                    .field("connections", results.connections)
+                    .field("incomplete", results.incomplete)
+                    .field("failed_connections", results.failed_connections);
+            }
+        }
+        return summaries;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    try
+    {
+        options = parse_options(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n"
+                  << "Usage: " << argv[0] << " --capture=PATH [--host=] [--port=] [--baseline-port=] [--speed=]\n";
+        return 2;
+    }
+
+    try
+    {
+        auto entries = RequestCapture::read(options.capture);
+        if (entries.empty())
+        {
+            throw std::runtime_error(options.capture + " holds no requests");
+        }
+
+        auto candidate = report(Replayer(options, entries, options.port).run(), "candidate", options.port);
+        if (options.baseline_port == 0)
+        {
+            return 0;
+        }
+        auto baseline = report(Replayer(options, entries, options.baseline_port).run(), "baseline", options.baseline_port);
+
+        for (const auto &[api, summary] : candidate)
+        {
+            auto it = baseline.find(api);
+            if (it == baseline.end())
+            {
+                continue;
+            }
+            double p50 = micros(summary.corrected.quantile(0.5));
+            double p99 = micros(summary.corrected.quantile(0.99));
+            double base_p50 = micros(it->second.corrected.quantile(0.5));
+            double base_p99 = micros(it->second.corrected.quantile(0.99));
+            bench::JsonLine("replay_diff")
+                .field("api", api)
+                .field("p50_delta_us", p50 - base_p50)
+                .field("p99_delta_us", p99 - base_p99)
+                .field("p50_ratio", base_p50 > 0 ? p50 / base_p50 : 0.0)
+                .field("p99_ratio", base_p99 > 0 ? p99 / base_p99 : 0.0);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "replay: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}